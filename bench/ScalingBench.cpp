@@ -0,0 +1,94 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include <PcapFileDevice.h>
+#include <EthLayer.h>
+#include <IPv4Layer.h>
+#include <TcpLayer.h>
+
+#include <AsyncLog.h>
+#include <TrafficAnalyzer.h>
+#include <HttpTrafficStats.h>
+
+/**
+ * \brief Записывает синтетический трафик в pcap файл
+ * \param[in] filePath Путь к файлу
+ * \param[in] packetsCount Количество пакетов
+ * \param[in] hostsCount Количество удаленных хостов, пакеты распределяются между ними по кругу
+ */
+static void writeSyntheticCapture(const std::string &filePath, int packetsCount, int hostsCount)
+{
+	pcpp::PcapFileWriterDevice writer(filePath);
+	if (!writer.open())
+	{
+		fprintf(stderr, "cannot open '%s' for writing\n", filePath.c_str());
+		std::remove(filePath.c_str());
+		std::exit(1);
+	}
+
+	for (int i = 0; i < packetsCount; i++)
+	{
+		int host = i % hostsCount;
+		bool isInPacket = (i / hostsCount) % 2 == 0;
+
+		pcpp::IPv4Address remoteIp(htonl(0x0A000000u + static_cast<std::uint32_t>(host)));
+		pcpp::IPv4Address localIp("127.0.0.1");
+
+		pcpp::EthLayer ethLayer(pcpp::MacAddress("00:50:43:11:22:33"), pcpp::MacAddress("aa:bb:cc:dd:ee:ff"));
+		pcpp::IPv4Layer ipLayer(isInPacket ? remoteIp : localIp, isInPacket ? localIp : remoteIp);
+		pcpp::TcpLayer tcpLayer(isInPacket ? 443 : 50000, isInPacket ? 50000 : 443);
+
+		pcpp::Packet packet;
+		packet.addLayer(&ethLayer);
+		packet.addLayer(&ipLayer);
+		packet.addLayer(&tcpLayer);
+		packet.computeCalculateFields();
+
+		writer.writePacket(*packet.getRawPacket());
+	}
+
+	writer.close();
+}
+
+/// Usage: traffic-analyzer-scaling-bench [packetsCount] [hostsCount]
+int main(int argc, char **argv)
+{
+	int packetsCount = argc > 1 ? std::atoi(argv[1]) : 1000000;
+	int hostsCount = argc > 2 ? std::atoi(argv[2]) : 10000;
+	const std::string filePath = (std::filesystem::temp_directory_path() / ("scaling-bench-" + std::to_string(getpid()) + ".pcap")).string();
+
+	AsyncLog::setLevel(boost::log::trivial::warning);
+
+	writeSyntheticCapture(filePath, packetsCount, hostsCount);
+
+	printf("%d packets, %d hosts\n", packetsCount, hostsCount);
+	printf("%8s %14s %14s %10s\n", "workers", "packets/sec", "bytes/sec", "time [s]");
+
+	std::vector<pcpp::GeneralFilter *> portFilterVec;
+	for (std::size_t workersCount : {0, 1, 2, 4, 8})
+	{
+		TrafficAnalyzer analyzer;
+		std::string errorInfo;
+
+		if (!analyzer.initializeFromFileAs<HttpTrafficStats>(filePath, "127.0.0.1", portFilterVec, errorInfo, workersCount))
+		{
+			fprintf(stderr, "%s\n", errorInfo.c_str());
+			std::remove(filePath.c_str());
+			return 1;
+		}
+
+		ReplayReport report = analyzer.replayFile();
+		printf("%8zu %14.0f %14.0f %10.3f\n", workersCount, report.packetsPerSecond(), report.bytesPerSecond(), report.wallTime);
+
+		analyzer.finalize();
+	}
+
+	std::remove(filePath.c_str());
+	return 0;
+}
@@ -0,0 +1,558 @@
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <filesystem>
+
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include <RawPacket.h>
+#include <Packet.h>
+#include <PcapFileDevice.h>
+#include <EthLayer.h>
+#include <IPv4Layer.h>
+#include <TcpLayer.h>
+#include <PayloadLayer.h>
+
+#include <AsyncLog.h>
+#include <TrafficAnalyzer.h>
+#include <HttpTrafficStats.h>
+#include <RawPacketParser.h>
+#include <SnapshotPublisher.h>
+
+/// \brief Состав данных синтетических пакетов
+enum PayloadMix
+{
+	plainMix = 0, ///< Данные без имени хоста
+	httpMix = 1,  ///< HTTP запросы с заголовком Host
+	tlsMix = 2,	  ///< TLS ClientHello с расширением SNI
+	mixedMix = 3  ///< Каждый хост использует один из трех видов данных
+};
+
+static const char *mixNames[] = {"plain", "http", "tls", "mixed"};
+static const std::string localIp = "127.0.0.1";
+static const std::string remoteHostName = "bench.example.com";
+static constexpr std::size_t headersSize = 14 + 20 + 20; ///< Ethernet, IPv4 и TCP заголовки
+static constexpr std::size_t dstIpOffset = 14 + 16;		 ///< Смещение адреса получателя от начала кадра
+
+static void put16(std::string &out, std::size_t value)
+{
+	out.push_back(static_cast<char>((value >> 8) & 0xFF));
+	out.push_back(static_cast<char>(value & 0xFF));
+}
+
+/// \brief Формирует HTTP запрос размером не менее size байт
+static std::string httpRequest(std::size_t size)
+{
+	std::string request = "GET / HTTP/1.1\r\nHost: " + remoteHostName + "\r\n";
+	const std::string padding = "X-Padding: ";
+
+	if (request.size() + padding.size() + 4 < size)
+		request += padding + std::string(size - request.size() - padding.size() - 4, 'x') + "\r\n";
+
+	return request + "\r\n";
+}
+
+/// \brief Формирует TLS запись с ClientHello и SNI размером не менее size байт, дополняя её расширением padding
+static std::string tlsClientHello(std::size_t size)
+{
+	std::string extensions;
+	put16(extensions, 0x0000);
+	put16(extensions, remoteHostName.size() + 5);
+	put16(extensions, remoteHostName.size() + 3);
+	extensions.push_back(0);
+	put16(extensions, remoteHostName.size());
+	extensions += remoteHostName;
+
+	std::string hello = "\x03\x03";
+	hello.append(32, '\x01');
+	hello.push_back(0);
+	put16(hello, 2);
+	hello += "\x13\x01";
+	hello.push_back(1);
+	hello.push_back(0);
+
+	std::size_t used = 5 + 4 + hello.size() + 2 + extensions.size();
+	if (used + 4 <= size)
+	{
+		put16(extensions, 0x0015);
+		put16(extensions, size - used - 4);
+		extensions.append(size - used - 4, '\0');
+	}
+
+	put16(hello, extensions.size());
+	hello += extensions;
+
+	std::string record = "\x16\x03\x01";
+	put16(record, hello.size() + 4);
+	record.push_back(0x01);
+	record.push_back(0);
+	put16(record, hello.size());
+	return record + hello;
+}
+
+/// \brief Собирает Ethernet/IPv4/TCP кадр размером не менее packetSize байт с данными вида kind
+static std::vector<std::uint8_t> makeFrame(PayloadMix kind, std::size_t packetSize)
+{
+	std::size_t payloadSize = packetSize > headersSize ? packetSize - headersSize : 0;
+	std::string payload = kind == httpMix  ? httpRequest(payloadSize)
+						  : kind == tlsMix ? tlsClientHello(payloadSize)
+										   : std::string(payloadSize, 'x');
+
+	pcpp::EthLayer ethLayer(pcpp::MacAddress("00:50:43:11:22:33"), pcpp::MacAddress("aa:bb:cc:dd:ee:ff"));
+	pcpp::IPv4Layer ipLayer(pcpp::IPv4Address(localIp), pcpp::IPv4Address("10.0.0.0"));
+	pcpp::TcpLayer tcpLayer(50000, kind == httpMix ? 80 : kind == tlsMix ? 443 : 5000);
+	pcpp::PayloadLayer payloadLayer(reinterpret_cast<const std::uint8_t *>(payload.data()), payload.size(), false);
+
+	pcpp::Packet packet;
+	packet.addLayer(&ethLayer);
+	packet.addLayer(&ipLayer);
+	packet.addLayer(&tcpLayer);
+	if (!payload.empty())
+		packet.addLayer(&payloadLayer);
+	packet.computeCalculateFields();
+
+	const pcpp::RawPacket *rawPacket = packet.getRawPacket();
+	return std::vector<std::uint8_t>(rawPacket->getRawData(), rawPacket->getRawData() + rawPacket->getRawDataLen());
+}
+
+/**
+ * \brief Поток синтетических исходящих пакетов к hostsCount удаленным хостам (10.0.0.0 и далее)
+ *
+ * Хосты перебираются по кругу, у каждого хоста один TCP поток. Для каждого вида данных хранится
+ * один кадр, в котором перед выдачей заменяются адрес получателя и временная метка,
+ * поэтому поток не занимает памяти сверх самой статистики. Временные метки растут на 1 мкс на пакет
+ */
+class SyntheticTraffic
+{
+private:
+	PayloadMix mix;
+	std::size_t hostsCount;
+	std::size_t nextHost{0};
+	timespec now{1700000000, 0};
+
+	std::vector<std::uint8_t> frames[3];
+	std::unique_ptr<pcpp::RawPacket> rawPackets[3];
+	PacketView views[3];
+
+	PayloadMix kindOf(std::size_t host) const { return mix == mixedMix ? static_cast<PayloadMix>(host % 3) : mix; }
+
+	std::size_t advance()
+	{
+		std::size_t host = nextHost;
+		nextHost = nextHost + 1 == hostsCount ? 0 : nextHost + 1;
+
+		now.tv_nsec += 1000;
+		if (now.tv_nsec >= 1000000000)
+		{
+			now.tv_sec++;
+			now.tv_nsec = 0;
+		}
+
+		return host;
+	}
+
+	static void writeHost(std::uint8_t *data, std::size_t host)
+	{
+		std::uint32_t address = 0x0A000000u + static_cast<std::uint32_t>(host);
+		data[0] = static_cast<std::uint8_t>(address >> 24);
+		data[1] = static_cast<std::uint8_t>(address >> 16);
+		data[2] = static_cast<std::uint8_t>(address >> 8);
+		data[3] = static_cast<std::uint8_t>(address);
+	}
+
+public:
+	SyntheticTraffic(PayloadMix mix, std::size_t hostsCount, std::size_t packetSize)
+		: mix(mix), hostsCount(std::max<std::size_t>(hostsCount, 1))
+	{
+		for (int kind = 0; kind < 3; kind++)
+		{
+			frames[kind] = makeFrame(static_cast<PayloadMix>(kind), packetSize);
+			rawPackets[kind] = std::make_unique<pcpp::RawPacket>(frames[kind].data(), static_cast<int>(frames[kind].size()), now, false);
+			RawPacketParser::parse(*rawPackets[kind], views[kind]);
+		}
+	}
+
+	/// \brief Возвращает разобранный следующий пакет
+	const PacketView &nextView()
+	{
+		std::size_t host = advance();
+		PacketView &view = views[kindOf(host)];
+
+		std::uint8_t address[4];
+		writeHost(address, host);
+		view.dstIp = IpKey::fromIPv4(address);
+		view.timestamp = now;
+		return view;
+	}
+
+	/// \brief Возвращает следующий пакет в том виде, в котором его передает устройство захвата
+	pcpp::RawPacket *nextRawPacket()
+	{
+		std::size_t host = advance();
+		int kind = kindOf(host);
+
+		writeHost(frames[kind].data() + dstIpOffset, host);
+		rawPackets[kind]->setPacketTimeStamp(now);
+		return rawPackets[kind].get();
+	}
+
+	/// \brief Возвращает средний размер пакета в байтах
+	std::size_t averagePacketSize() const
+	{
+		if (mix != mixedMix)
+			return frames[mix].size();
+
+		return (frames[0].size() + frames[1].size() + frames[2].size()) / 3;
+	}
+
+	const pcpp::RawPacket &frameOf(PayloadMix kind) const { return *rawPackets[kind]; }
+};
+
+/// \brief Заполняет статистику одним пакетом каждого хоста
+static void populate(HttpTrafficStats &stats, SyntheticTraffic &traffic, std::size_t hostsCount)
+{
+	for (std::size_t i = 0; i < hostsCount; i++)
+		stats.addPacket(traffic.nextView());
+}
+
+static void setCounters(benchmark::State &state, const SyntheticTraffic &traffic, PayloadMix mix)
+{
+	state.SetItemsProcessed(state.iterations());
+	state.SetBytesProcessed(state.iterations() * traffic.averagePacketSize());
+	state.SetLabel(mixNames[mix]);
+}
+
+/// \brief Стоимость HttpTrafficStats::addPacket для уже известного хоста
+/// Аргументы: количество хостов, размер пакета, вид данных
+static void benchAddPacket(benchmark::State &state)
+{
+	std::size_t hostsCount = state.range(0);
+	PayloadMix mix = static_cast<PayloadMix>(state.range(2));
+
+	SyntheticTraffic traffic(mix, hostsCount, state.range(1));
+	HttpTrafficStats stats(localIp);
+	populate(stats, traffic, hostsCount);
+
+	for (auto _ : state)
+		stats.addPacket(traffic.nextView());
+
+	setCounters(state, traffic, mix);
+}
+
+/**
+ * \brief Стоимость HttpTrafficStats::addPackets в пересчете на пакет, пачки по 64 пакета
+ *
+ * Заголовки пачки копируются из SyntheticTraffic внутри измерения, как их разбирал бы поток захвата
+ * Аргументы: количество хостов, размер пакета, вид данных
+ */
+static void benchAddPackets(benchmark::State &state)
+{
+	constexpr std::size_t batchSize = 64;
+	std::size_t hostsCount = state.range(0);
+	PayloadMix mix = static_cast<PayloadMix>(state.range(2));
+
+	SyntheticTraffic traffic(mix, hostsCount, state.range(1));
+	HttpTrafficStats stats(localIp);
+	populate(stats, traffic, hostsCount);
+
+	std::vector<PacketView> batch(batchSize);
+
+	for (auto _ : state)
+	{
+		for (auto &view : batch)
+			view = traffic.nextView();
+
+		stats.addPackets(batch);
+	}
+
+	setCounters(state, traffic, mix);
+	state.SetItemsProcessed(state.iterations() * batchSize);
+	state.SetBytesProcessed(state.iterations() * batchSize * traffic.averagePacketSize());
+}
+
+/**
+ * \brief Стоимость обработки пакета, полученного от устройства захвата
+ *
+ * Обработчик onPacketArrives закрытый и только передает пакет в processPacket,
+ * поэтому измеряется processPacket: разбор заголовков, статистика, публикация копий и история скорости
+ * Аргументы: количество хостов, размер пакета, вид данных
+ */
+static void benchOnPacketArrives(benchmark::State &state)
+{
+	std::size_t hostsCount = state.range(0);
+	PayloadMix mix = static_cast<PayloadMix>(state.range(2));
+	// Файл нужен только для инициализации анализатора, поэтому создается во временном каталоге
+	const std::string filePath = (std::filesystem::temp_directory_path() / ("stats-bench-" + std::to_string(getpid()) + ".pcap")).string();
+
+	SyntheticTraffic traffic(mix, hostsCount, state.range(1));
+
+	pcpp::PcapFileWriterDevice writer(filePath);
+	if (!writer.open())
+	{
+		std::remove(filePath.c_str());
+		state.SkipWithError("cannot create capture file");
+		return;
+	}
+	writer.writePacket(traffic.frameOf(plainMix));
+	writer.close();
+
+	TrafficAnalyzer analyzer;
+	std::vector<pcpp::GeneralFilter *> portFilterVec;
+	std::string errorInfo;
+
+	bool isInitialized = analyzer.initializeFromFileAs<HttpTrafficStats>(filePath, localIp, portFilterVec, errorInfo);
+	std::remove(filePath.c_str());
+
+	if (!isInitialized)
+	{
+		state.SkipWithError(errorInfo.c_str());
+		return;
+	}
+
+	for (std::size_t i = 0; i < hostsCount; i++)
+		analyzer.processPacket(traffic.nextRawPacket());
+
+	for (auto _ : state)
+		analyzer.processPacket(traffic.nextRawPacket());
+
+	setCounters(state, traffic, mix);
+	analyzer.finalize();
+}
+
+/// \brief Стоимость HttpTrafficStats::toString, items - количество выведенных хостов
+/// Аргументы: количество хостов, вид данных
+static void benchToString(benchmark::State &state)
+{
+	std::size_t hostsCount = state.range(0);
+	PayloadMix mix = static_cast<PayloadMix>(state.range(1));
+
+	SyntheticTraffic traffic(mix, hostsCount, 512);
+	HttpTrafficStats stats(localIp);
+	populate(stats, traffic, hostsCount);
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(stats.toString());
+
+	state.SetItemsProcessed(state.iterations() * hostsCount);
+	state.SetLabel(mixNames[mix]);
+}
+
+/// \brief Стоимость HttpTrafficStats::toJsonString, items - количество выведенных хостов
+/// Аргументы: количество хостов, вид данных
+static void benchToJsonString(benchmark::State &state)
+{
+	std::size_t hostsCount = state.range(0);
+	PayloadMix mix = static_cast<PayloadMix>(state.range(1));
+
+	SyntheticTraffic traffic(mix, hostsCount, 512);
+	HttpTrafficStats stats(localIp);
+	populate(stats, traffic, hostsCount);
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(stats.toJsonString());
+
+	state.SetItemsProcessed(state.iterations() * hostsCount);
+	state.SetLabel(mixNames[mix]);
+}
+
+/**
+ * \brief Стоимость публикации копии статистики (SnapshotPublisher::publish), items - количество хостов
+ *
+ * Публикация копирует статистику в потоке, который обрабатывает пакеты, поэтому время итерации -
+ * это пауза в обработке пакетов раз в период публикации. Между публикациями (вне измерения)
+ * пакеты получает доля changed хостов: переиспользуемая копия обновляется только ими
+ * Аргументы: количество хостов, доля хостов с новыми пакетами (в %)
+ */
+static void benchPublish(benchmark::State &state)
+{
+	std::size_t hostsCount = state.range(0);
+	std::size_t changedCount = hostsCount * state.range(1) / 100;
+
+	SyntheticTraffic traffic(plainMix, hostsCount, 512);
+	HttpTrafficStats stats(localIp);
+	populate(stats, traffic, hostsCount);
+
+	SnapshotPublisher publisher(stats, {std::chrono::hours(1), 0});
+
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		populate(stats, traffic, changedCount);
+		state.ResumeTiming();
+
+		publisher.publish(stats);
+	}
+
+	state.SetItemsProcessed(state.iterations() * hostsCount);
+}
+
+/// \brief Раскладка счетчиков хостов: записи HostInfo или отдельные колонки
+enum HostLayout
+{
+	recordLayout = 0, ///< Одна выровненная запись HostInfo на хост (используется в статистике)
+	columnsLayout = 1 ///< Каждый счетчик в своем массиве, индекс - номер хоста
+};
+
+static const char *layoutNames[] = {"records", "columns"};
+
+/// \brief Счетчики хостов по колонкам, для сравнения с записями HostInfo
+struct HostColumns
+{
+	std::vector<std::uint64_t> inPackets, outPackets, inTraffic, outTraffic, generation;
+
+	explicit HostColumns(std::size_t hostsCount)
+		: inPackets(hostsCount), outPackets(hostsCount), inTraffic(hostsCount), outTraffic(hostsCount),
+		  generation(hostsCount) {}
+
+	/// \brief То же, что HostInfo::addPacket и запись поколения в HttpTrafficStats
+	void addPacket(std::size_t host, std::uint32_t size, bool isInPacket, std::uint64_t currentGeneration)
+	{
+		std::uint64_t inMask = 0 - static_cast<std::uint64_t>(isInPacket);
+
+		inPackets[host] += 1 & inMask;
+		outPackets[host] += 1 & ~inMask;
+		inTraffic[host] += size & inMask;
+		outTraffic[host] += size & ~inMask;
+		generation[host] = currentGeneration;
+	}
+};
+
+/// \brief Псевдослучайные номера хостов пакетов, как при трафике многих хостов вперемешку
+static std::vector<std::uint32_t> randomHosts(std::size_t hostsCount)
+{
+	std::vector<std::uint32_t> hosts(1 << 16);
+	std::uint64_t state = 0x9E3779B97F4A7C15ull;
+	for (auto &host : hosts)
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		host = static_cast<std::uint32_t>(state % hostsCount);
+	}
+
+	return hosts;
+}
+
+/**
+ * \brief Учет пакета в счетчиках хоста при записях HostInfo и при колонках
+ *
+ * Хосты пакетов идут вперемешку, поэтому при большом числе хостов каждая затронутая
+ * кэш-линия - промах: записи затрагивают одну линию, колонки - по линии на счетчик
+ * Аргументы: количество хостов, раскладка
+ */
+static void benchHostUpdate(benchmark::State &state)
+{
+	std::size_t hostsCount = state.range(0);
+	HostLayout layout = static_cast<HostLayout>(state.range(1));
+	std::vector<std::uint32_t> hosts = randomHosts(hostsCount);
+
+	std::vector<HostInfo> records(hostsCount);
+	HostColumns columns(layout == columnsLayout ? hostsCount : 0);
+	std::size_t next = 0;
+
+	for (auto _ : state)
+	{
+		std::uint32_t host = hosts[next++ & (hosts.size() - 1)];
+		bool isInPacket = host & 1;
+
+		if (layout == recordLayout)
+		{
+			records[host].addPacket(512, isInPacket);
+			records[host].generation = 1;
+		}
+		else
+			columns.addPacket(host, 512, isInPacket, 1);
+	}
+
+	benchmark::DoNotOptimize(records.data());
+	benchmark::DoNotOptimize(columns.inTraffic.data());
+	state.SetItemsProcessed(state.iterations());
+	state.SetLabel(layoutNames[layout]);
+}
+
+/**
+ * \brief Проход по счетчикам всех хостов при выводе (сумма трафика), items - количество хостов
+ *
+ * Колонки читают только нужные 16 байт хоста и векторизуются, записи - всю кэш-линию хоста
+ * Аргументы: количество хостов, раскладка
+ */
+static void benchHostScan(benchmark::State &state)
+{
+	std::size_t hostsCount = state.range(0);
+	HostLayout layout = static_cast<HostLayout>(state.range(1));
+
+	std::vector<HostInfo> records(layout == recordLayout ? hostsCount : 0);
+	HostColumns columns(layout == columnsLayout ? hostsCount : 0);
+
+	for (auto _ : state)
+	{
+		std::uint64_t traffic = 0;
+		if (layout == recordLayout)
+			for (const auto &record : records)
+				traffic += record.inTraffic + record.outTraffic;
+		else
+			for (std::size_t i = 0; i < hostsCount; i++)
+				traffic += columns.inTraffic[i] + columns.outTraffic[i];
+
+		benchmark::DoNotOptimize(traffic);
+	}
+
+	state.SetItemsProcessed(state.iterations() * hostsCount);
+	state.SetLabel(layoutNames[layout]);
+}
+
+static const std::vector<std::int64_t> hostsCounts = {10, 1000, 100000, 1000000};
+
+BENCHMARK(benchAddPacket)
+	->ArgNames({"hosts", "size", "mix"})
+	->ArgsProduct({hostsCounts, {64, 1500}, {plainMix, httpMix, tlsMix, mixedMix}});
+
+BENCHMARK(benchAddPackets)
+	->ArgNames({"hosts", "size", "mix"})
+	->ArgsProduct({hostsCounts, {64, 1500}, {plainMix, httpMix, tlsMix, mixedMix}});
+
+BENCHMARK(benchOnPacketArrives)
+	->ArgNames({"hosts", "size", "mix"})
+	->ArgsProduct({hostsCounts, {64, 1500}, {plainMix, httpMix, tlsMix, mixedMix}});
+
+BENCHMARK(benchPublish)
+	->ArgNames({"hosts", "changed"})
+	->ArgsProduct({hostsCounts, {1, 10, 100}})
+	->Unit(benchmark::kMillisecond);
+
+BENCHMARK(benchHostUpdate)
+	->ArgNames({"hosts", "layout"})
+	->ArgsProduct({hostsCounts, {recordLayout, columnsLayout}});
+
+BENCHMARK(benchHostScan)
+	->ArgNames({"hosts", "layout"})
+	->ArgsProduct({hostsCounts, {recordLayout, columnsLayout}});
+
+BENCHMARK(benchToString)
+	->ArgNames({"hosts", "mix"})
+	->ArgsProduct({hostsCounts, {plainMix, mixedMix}})
+	->Unit(benchmark::kMillisecond);
+
+BENCHMARK(benchToJsonString)
+	->ArgNames({"hosts", "mix"})
+	->ArgsProduct({hostsCounts, {plainMix, mixedMix}})
+	->Unit(benchmark::kMillisecond);
+
+int main(int argc, char **argv)
+{
+	// Определение имен хостов пишет в лог на уровне info
+	AsyncLog::setLevel(boost::log::trivial::warning);
+
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv))
+		return 1;
+
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -0,0 +1,193 @@
+#pragma once
+#include <span>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include <PacketView.h>
+#include <FlowTable.h>
+#include <HostNameDetector.h>
+#include <DnsCache.h>
+
+/// \brief Параметры выборочного учета пакетов при перегрузке
+struct SamplingConfig
+{
+	std::uint32_t maxRate{1};						///< Наибольший коэффициент выборки (степень двойки), 1 - пакеты всегда учитываются точно
+	std::chrono::milliseconds checkPeriod{100};		///< Как часто проверяется нагрузка
+	double dropThreshold{0.001};					///< Доля потерянных за проверку пакетов, при которой коэффициент удваивается
+	double queueHighWater{0.5};						///< Заполнение очереди, при котором коэффициент удваивается
+	double queueLowWater{0.1};						///< Заполнение очереди, ниже которого нагрузка считается спадшей
+	std::uint32_t calmChecks{20};					///< Сколько проверок подряд без перегрузки нужно, чтобы уменьшить коэффициент вдвое
+
+	bool isEnabled() const { return maxRate > 1; }
+};
+
+/**
+ * \brief Выборочный учет пакетов по хэшу потока, включаемый при перегрузке
+ *
+ * Писатель статистики периодически передает счетчики принятых и потерянных источником пакетов
+ * и заполнение своей очереди. Пока пакеты теряются или очередь заполнена больше чем наполовину,
+ * коэффициент выборки N удваивается (до maxRate), а после calmChecks спокойных проверок - уменьшается
+ * вдвое, пока учет не станет снова точным.
+ *
+ * При коэффициенте N учитывается каждый поток, у которого младшие log2(N) бит хэша ключа потока равны нулю,
+ * и каждый его пакет получает вес N: пакеты потока всегда либо все учитываются, либо все пропускаются,
+ * а потоки, учитываемые при 2N, учитываются и при N. Пропущенные пакеты, которые могут содержать имя хоста
+ * (HTTP запрос, TLS ClientHello, ответ DNS), передаются статистике с весом 0: они не меняют счетчиков,
+ * но имя хоста определяется по первым пакетам каждого потока.
+ *
+ * Все методы, кроме конструктора, вызываются только писателем статистики
+ */
+class AdaptiveSampler
+{
+private:
+	SamplingConfig config;
+	std::uint32_t rate{1};
+	std::uint32_t calm{0}; ///< Проверок подряд без перегрузки
+	std::uint64_t lastReceived{0};
+	std::uint64_t lastDropped{0};
+	std::uint64_t switches{0};			 ///< Сколько раз менялся коэффициент
+	std::uint64_t skippedPackets{0};	 ///< Пакеты, не учтенные в счетчиках
+	std::uint32_t packetsSinceCheck{0};
+	std::chrono::steady_clock::time_point nextCheck{};
+	std::vector<PacketView> kept; ///< Учитываемые пакеты последней пачки
+
+	static constexpr std::uint32_t packetsPerClockRead = 256; ///< Раз во сколько пакетов читать часы, чтобы проверить срок проверки
+
+public:
+	explicit AdaptiveSampler(const SamplingConfig &config = SamplingConfig()) : config(config) {}
+
+	bool isEnabled() const { return config.isEnabled(); }
+
+	/// \brief Возвращает текущий коэффициент выборки, 1 - пакеты учитываются точно
+	std::uint32_t getRate() const { return rate; }
+
+	std::uint64_t getSwitches() const { return switches; }
+
+	std::uint64_t getSkippedPackets() const { return skippedPackets; }
+
+	/// \brief Отсчитывает packets пакетов и возвращает true, если пора проверить нагрузку
+	bool isCheckDue(std::size_t packets)
+	{
+		packetsSinceCheck += static_cast<std::uint32_t>(packets);
+		if (packetsSinceCheck < packetsPerClockRead)
+			return false;
+
+		packetsSinceCheck = 0;
+		auto now = std::chrono::steady_clock::now();
+		if (now < nextCheck)
+			return false;
+
+		nextCheck = now + config.checkPeriod;
+		return true;
+	}
+
+	/**
+	 * \brief Пересчитывает коэффициент выборки по нагрузке
+	 * \param[in] received Принятые источником пакеты с его запуска, включая потерянные
+	 * \param[in] dropped Потерянные источником пакеты с его запуска
+	 * \param[in] queueFill Доля заполнения очереди писателя от 0 до 1
+	 * \return True - если коэффициент изменился
+	 */
+	bool observe(std::uint64_t received, std::uint64_t dropped, double queueFill)
+	{
+		std::uint64_t receivedDelta = received >= lastReceived ? received - lastReceived : received;
+		std::uint64_t droppedDelta = dropped >= lastDropped ? dropped - lastDropped : dropped;
+		lastReceived = received;
+		lastDropped = dropped;
+
+		bool isOverloaded = (droppedDelta && droppedDelta >= config.dropThreshold * std::max<std::uint64_t>(receivedDelta, 1)) ||
+							queueFill >= config.queueHighWater;
+
+		if (isOverloaded)
+		{
+			calm = 0;
+			if (rate >= config.maxRate)
+				return false;
+
+			rate *= 2;
+			switches++;
+			return true;
+		}
+
+		if (droppedDelta || queueFill > config.queueLowWater || rate == 1)
+		{
+			calm = 0;
+			return false;
+		}
+
+		if (++calm < config.calmChecks)
+			return false;
+
+		calm = 0;
+		rate /= 2;
+		switches++;
+		return true;
+	}
+
+	/**
+	 * \brief Решает, учитывать ли пакет, и задает его вес
+	 * \return False - если пакет не нужно передавать статистике
+	 */
+	bool admit(PacketView &packet)
+	{
+		if (rate == 1)
+			return true;
+
+		bool isFromLow = false;
+		if ((FlowKey::fromPacket(packet, isFromLow).hash() & (rate - 1)) == 0)
+		{
+			packet.weight = rate;
+			return true;
+		}
+
+		skippedPackets++;
+
+		if (HostNameDetector::mayContainHostName(packet) || DnsCache::isResponse(packet))
+		{
+			packet.weight = 0;
+			return true;
+		}
+
+		return false;
+	}
+
+	/**
+	 * \brief Возвращает пакеты пачки, которые нужно передать статистике, с заданными весами
+	 *
+	 * При точном учете возвращает саму пачку, иначе - внутренний буфер, действительный до следующего вызова
+	 */
+	std::span<const PacketView> sample(std::span<const PacketView> packets)
+	{
+		if (rate == 1)
+			return packets;
+
+		kept.clear();
+		for (const auto &packet : packets)
+		{
+			kept.push_back(packet);
+			if (!admit(kept.back()))
+				kept.pop_back();
+		}
+
+		return kept;
+	}
+
+	/**
+	 * \brief Возвращает полуширину 95% доверительного интервала оценки количества пакетов хоста
+	 *
+	 * Оценка по Хорвицу-Томпсону: дисперсия суммы весов равна сумме w * (w - 1) по учтенным пакетам,
+	 * поэтому при весах не больше maxRate она не превышает sampledPackets * maxRate * (maxRate - 1).
+	 * Пакеты здесь считаются независимыми, а выбираются потоки целиком, поэтому для хостов с длинными
+	 * потоками фактическая погрешность больше
+	 * \param[in] sampledPackets Пакеты хоста, учтенные с весом больше 1
+	 * \param[in] maxRate Наибольший коэффициент выборки, с которым они учитывались
+	 */
+	static std::uint64_t packetsErrorBound(std::uint64_t sampledPackets, std::uint32_t maxRate)
+	{
+		double variance = double(sampledPackets) * maxRate * (maxRate > 1 ? maxRate - 1 : 0);
+		return static_cast<std::uint64_t>(std::ceil(1.96 * std::sqrt(variance)));
+	}
+};
@@ -4,6 +4,10 @@
 #include <sstream>
 #include <vector>
 #include <chrono>
+#include <limits>
+#include <cctype>
+#include <algorithm>
+#include <utility>
 
 #include <boost/program_options.hpp>
 #include <boost/log/trivial.hpp>
@@ -16,6 +20,10 @@
 #include <PcapLiveDeviceList.h>
 #include <SystemUtils.h>
 
+#include <AsyncLog.h>
+#include <LocalAddressSet.h>
+#include <HostQuery.h>
+
 namespace app
 {
 	/// \brief Структура, в которой хранятся аргументы запуска программы
@@ -25,12 +33,88 @@ namespace app
 		int updatePeriod{5};					  ///< Временной интервал, с которым будет обновляться консоль
 		int executionTime{60};					  ///< Время которое должна отработать программа
 		std::string interfaceIpAddr{"127.0.0.1"}; ///< Ip адрес интерфейса, для которого будет производиться захват трафика
+		std::string pcapFilePath{};			  ///< Путь к pcap/pcapng файлу, пакеты из которого нужно воспроизвести вместо захвата
+		int workersCount{0};					  ///< Количество потоков-обработчиков пакетов, 0 - обработка в потоке захвата
+		int snapshotPeriod{250};				  ///< Максимальный возраст копии статистики, которую видят читатели (в мс)
+		int snapshotPackets{1000000};			  ///< Через сколько пакетов публиковать копию статистики, 0 - только по времени
+		int topHostsMemory{0};					  ///< Объем памяти статистики наиболее активных хостов (в КиБ), 0 - учитывать все хосты
+		std::string topHostsMetric{"bytes"};	  ///< По какой величине выбирать наиболее активные хосты: bytes или packets
+		int flowCapacity{1 << 20};				  ///< Максимальное количество одновременно отслеживаемых потоков, 0 - не отслеживать потоки
+		int flowTimeout{120};					  ///< Через сколько секунд без пакетов поток считается завершенным
+		int historyResolution{1};				  ///< Длина интервала истории скорости трафика (в сек)
+		int historyRetention{3600};				  ///< Сколько хранится история скорости трафика (в сек), 0 - не хранить
+		int historyHosts{256};					  ///< Для скольких хостов хранится история скорости трафика
+		boost::log::trivial::severity_level logLevel{boost::log::trivial::info}; ///< Минимальный уровень выводимых логов
+		int logSampleEvery{1};					  ///< Какое по счету событие каждого места вызова выводят логи отдельных пакетов
+		std::string captureBackend{"pcap"};		  ///< Способ захвата: pcap (libpcap) или ring (кольца AF_PACKET)
+		int ringBlockSize{1024};				  ///< Размер блока кольца захвата (в КиБ)
+		int ringBlocks{64};						  ///< Количество блоков в каждом кольце захвата
+		int ringThreads{1};						  ///< Количество колец захвата (и их потоков) в группе fanout
+		int ringFanout{0};						  ///< Группа fanout колец захвата, 0 - выбирается автоматически
+		std::vector<std::string> localNetworks{}; ///< Дополнительные локальные сети в нотации CIDR
+		std::string storePath{};				  ///< Файл, в котором статистика хостов сохраняется между запусками, пустой - не сохранять
+		int storeHosts{1 << 18};				  ///< Вместимость нового файла статистики хостов
+		int storeSync{5};						  ///< Как часто файл статистики хостов сбрасывается на диск (в сек), 0 - только при выходе
+		std::vector<std::string> statsConsumers{"hosts"}; ///< Собираемые статистики в порядке вывода: hosts и ports
+		int dnsCacheMemory{0};					  ///< Объем памяти кэша ответов DNS (в КиБ), 0 - не вести кэш
+		std::vector<std::string> interfaceIpAddrs{"127.0.0.1"}; ///< Ip адреса всех захватываемых интерфейсов, первый совпадает с interfaceIpAddr
+		std::vector<int> captureCpus{};			  ///< Ядра, к которым по порядку привязываются потоки захвата, пустой - не привязывать
+		int overloadSampling{0};				  ///< Наибольший коэффициент выборочного учета при перегрузке, 0 - всегда учитывать точно
+		std::string exportPath{};				  ///< Каталог двоичной выгрузки счетчиков хостов за каждый интервал, пустой - не выгружать
+		int exportFileSize{64};					  ///< Размер файла выгрузки, после которого начинается новый файл (в МиБ)
+		int exportFiles{168};					  ///< Сколько последних файлов выгрузки хранится
+		std::string exportCodec{"zeros"};		  ///< Сжатие блоков выгрузки: zeros или none
+		int topRows{0};							  ///< Сколько наиболее активных хостов выводить в консоль, 0 - выводить все хосты
+		std::string sortBy{"bytes"};			  ///< По какой величине упорядочиваются хосты в консоли: bytes, packets, in или out
+		std::string hostFilter{};				  ///< Адрес, сеть или шаблон имени хостов, выводимых в консоль, пустой - все хосты
+		HostQuery screenQuery{};				  ///< Выборка хостов для консоли, собранная из topRows, sortBy и hostFilter
 	};
 
+	/**
+	 * \brief Разбирает длительность вида "90", "90s", "15m", "1h" или "1d"
+	 * \param[out] duration Длительность в секундах
+	 * \return False - если строка не является длительностью
+	 */
+	bool parseDuration(const std::string &text, std::chrono::seconds &duration)
+	{
+		if (text.empty())
+			return false;
+
+		std::size_t digitsEnd = 0;
+		while (digitsEnd < text.size() && std::isdigit(static_cast<unsigned char>(text[digitsEnd])))
+			digitsEnd++;
+
+		if (digitsEnd == 0 || digitsEnd + 1 < text.size() || digitsEnd > 9)
+			return false;
+
+		long long value = std::stoll(text.substr(0, digitsEnd));
+		char unit = digitsEnd < text.size() ? text[digitsEnd] : 's';
+
+		switch (unit)
+		{
+		case 's':
+			break;
+		case 'm':
+			value *= 60;
+			break;
+		case 'h':
+			value *= 3600;
+			break;
+		case 'd':
+			value *= 86400;
+			break;
+		default:
+			return false;
+		}
+
+		duration = std::chrono::seconds(value);
+		return true;
+	}
+
 	void onApplicationInterrupted(void *cookie)
 	{
 		bool *shouldStop = static_cast<bool *>(cookie);
-		BOOST_LOG_TRIVIAL(info) << "onApplicationInterrupted handled";
+		TA_LOG(info) << "onApplicationInterrupted handled";
 		*shouldStop = true;
 	}
 
@@ -86,7 +170,7 @@ namespace app
 		po::variables_map vm;
 		po::options_description description("Allowed Options");
 
-		description.add_options()("help,h", "Produce help message.")("list-interfaces,l", "Print the list of interfaces.")("ip,i", po::value<std::string>()->default_value(interfaceIpAddr), "Use the specified interface.")("exe-time,t", po::value<int>()->default_value(std::numeric_limits<int>::max()), "Program execution time (in sec).")("update-time,u", po::value<int>()->default_value(5), "Terminal update frequency (in sec).");
+		description.add_options()("help,h", "Produce help message.")("list-interfaces,l", "Print the list of interfaces.")("ip,i", po::value<std::vector<std::string>>()->composing()->default_value({interfaceIpAddr}, interfaceIpAddr), "Use the specified interface (may be repeated to capture several interfaces at once).")("exe-time,t", po::value<int>()->default_value(std::numeric_limits<int>::max()), "Program execution time (in sec).")("update-time,u", po::value<int>()->default_value(5), "Terminal update frequency (in sec).")("read-file,r", po::value<std::string>(), "Replay packets from the specified pcap/pcapng file at maximum speed.")("workers,w", po::value<int>()->default_value(0), "Number of packet processing workers (0 - process packets in the capture thread).")("snapshot-period", po::value<int>()->default_value(250), "Maximum age of the statistics snapshot served to readers (in ms).")("snapshot-packets", po::value<int>()->default_value(1000000), "Publish a statistics snapshot every N packets (0 - by time only).")("top-hosts-memory,m", po::value<int>()->default_value(0), "Track only the heaviest hosts in fixed memory of the specified size (in KiB, 0 - track all hosts).")("top-hosts-by", po::value<std::string>()->default_value("bytes"), "Rank the heaviest hosts by 'bytes' or 'packets'.")("flow-capacity", po::value<int>()->default_value(1 << 20), "Maximum number of concurrently tracked TCP/UDP flows (0 - do not track flows).")("flow-timeout", po::value<int>()->default_value(120), "Idle time after which a flow is considered completed (in sec).")("history-resolution", po::value<int>()->default_value(1), "Rate history interval (in sec).")("history-retention", po::value<std::string>()->default_value("1h"), "How long the rate history is kept, e.g. 600s, 30m, 1h (0 - do not keep history).")("history-hosts", po::value<int>()->default_value(256), "Number of hosts with their own rate history (all traffic is always kept).")("log-level", po::value<std::string>()->default_value("info"), "Minimum log level: trace, debug, info, warning, error or fatal.")("log-sample", po::value<int>()->default_value(1), "Log only every N-th per-packet debug event of each call site.")("capture", po::value<std::string>()->default_value("pcap"), "Capture backend: 'pcap' (libpcap) or 'ring' (Linux AF_PACKET TPACKET_V3 memory-mapped ring).")("ring-block-size", po::value<int>()->default_value(1024), "Size of a capture ring block (in KiB, power of two).")("ring-blocks", po::value<int>()->default_value(64), "Number of blocks in each capture ring.")("ring-threads", po::value<int>()->default_value(1), "Number of capture rings in the fanout group, each with its own thread and statistics shard.")("ring-fanout", po::value<int>()->default_value(0), "Fanout group id of the capture rings (0 - chosen automatically for several rings).")("local-net", po::value<std::vector<std::string>>()->composing(), "Additional local network in CIDR notation, e.g. 10.0.0.0/8 or fd00::/8 (may be repeated). Packets to local addresses are incoming.")("store", po::value<std::string>()->default_value(""), "Keep host counters in the specified memory-mapped file so that they survive restarts (with -w, one file per worker with a '.N' suffix).")("store-hosts", po::value<int>()->default_value(1 << 18), "Number of hosts a newly created store file can hold.")("store-sync", po::value<int>()->default_value(5), "How often the store file is flushed to disk (in sec, 0 - only on exit).")("stats", po::value<std::string>()->default_value("hosts"), "Comma separated statistics collected from each packet: 'hosts' and 'ports', e.g. hosts,ports.")("dns-cache-memory", po::value<int>()->default_value(0), "Name hosts from DNS answers seen on port 53, kept in a cache of the specified size (in KiB, 0 - do not sniff DNS).")("capture-cpus", po::value<std::string>()->default_value(""), "Comma separated CPUs the capture threads are pinned to in order, one per interface (or per ring with --capture ring), e.g. 2,10.")("overload-sampling", po::value<int>()->default_value(0), "While packets are dropped or worker queues fill up, count only 1 of N flows scaled by N, doubling N up to the specified power of two (0 - always count exactly).")("export", po::value<std::string>()->default_value(""), "Append per-host counter deltas of every update period to rotating binary files in the specified directory.")("export-file-size", po::value<int>()->default_value(64), "Size of an export file after which a new file is started (in MiB).")("export-files", po::value<int>()->default_value(168), "Number of newest export files kept, older files are removed.")("export-codec", po::value<std::string>()->default_value("zeros"), "Compression of export blocks: 'zeros' (runs of zero bytes) or 'none'.")("top", po::value<int>()->default_value(0), "Print only the N heaviest hosts on every update, redrawing changed rows in place on a terminal (0 - print all hosts).")("sort", po::value<std::string>()->default_value("bytes"), "Order of the printed hosts with --top or --filter: 'bytes', 'packets', 'in' or 'out'.")("filter", po::value<std::string>()->default_value(""), "Print only hosts of the specified address or CIDR network, or with a name or address matching the glob, e.g. 10.0.0.0/8 or *.example.com.");
 
 		po::store(po::parse_command_line(argc, argv, description), vm);
 		po::notify(vm);
@@ -105,14 +189,207 @@ namespace app
 
 		int executionTime = vm["exe-time"].as<int>();
 		int updatePeriod = vm["update-time"].as<int>();
-		interfaceIpAddr = vm["ip"].as<std::string>();
+		std::vector<std::string> interfaceIpAddrs = vm["ip"].as<std::vector<std::string>>();
+		interfaceIpAddr = interfaceIpAddrs.front();
+
+		for (std::size_t i = 0; i < interfaceIpAddrs.size(); i++)
+			if (std::find(interfaceIpAddrs.begin() + i + 1, interfaceIpAddrs.end(), interfaceIpAddrs[i]) != interfaceIpAddrs.end())
+				throw std::runtime_error("interfaceIpAddrs contains '" + interfaceIpAddrs[i] + "' twice.");
+
+		std::string pcapFilePath;
+		if (vm.count("read-file"))
+			pcapFilePath = vm["read-file"].as<std::string>();
 
 		if (executionTime < 0)
 			throw std::runtime_error("executionTime was negative.");
 
+		int workersCount = vm["workers"].as<int>();
+		int snapshotPeriod = vm["snapshot-period"].as<int>();
+		int snapshotPackets = vm["snapshot-packets"].as<int>();
+		int topHostsMemory = vm["top-hosts-memory"].as<int>();
+		std::string topHostsMetric = vm["top-hosts-by"].as<std::string>();
+		int flowCapacity = vm["flow-capacity"].as<int>();
+		int flowTimeout = vm["flow-timeout"].as<int>();
+		int historyResolution = vm["history-resolution"].as<int>();
+		int historyHosts = vm["history-hosts"].as<int>();
+
+		std::chrono::seconds historyRetention;
+		if (!parseDuration(vm["history-retention"].as<std::string>(), historyRetention))
+			throw std::runtime_error("historyRetention was not a duration.");
+
 		if (updatePeriod < 0)
 			throw std::runtime_error("updatePeriod was negative.");
 
-		return {shouldClose, updatePeriod, executionTime, interfaceIpAddr};
+		if (workersCount < 0)
+			throw std::runtime_error("workersCount was negative.");
+
+		if (snapshotPeriod <= 0)
+			throw std::runtime_error("snapshotPeriod was not positive.");
+
+		if (snapshotPackets < 0)
+			throw std::runtime_error("snapshotPackets was negative.");
+
+		if (topHostsMemory < 0)
+			throw std::runtime_error("topHostsMemory was negative.");
+
+		if (topHostsMetric != "bytes" && topHostsMetric != "packets")
+			throw std::runtime_error("topHostsMetric must be 'bytes' or 'packets'.");
+
+		if (flowCapacity < 0)
+			throw std::runtime_error("flowCapacity was negative.");
+
+		if (flowTimeout <= 0)
+			throw std::runtime_error("flowTimeout was not positive.");
+
+		if (historyResolution <= 0)
+			throw std::runtime_error("historyResolution was not positive.");
+
+		if (historyHosts < 0)
+			throw std::runtime_error("historyHosts was negative.");
+
+		if (historyRetention.count() > std::numeric_limits<int>::max())
+			throw std::runtime_error("historyRetention was too long.");
+
+		boost::log::trivial::severity_level logLevel;
+		std::string logLevelName = vm["log-level"].as<std::string>();
+		if (!boost::log::trivial::from_string(logLevelName.c_str(), logLevelName.size(), logLevel))
+			throw std::runtime_error("logLevel must be one of trace, debug, info, warning, error or fatal.");
+
+		int logSampleEvery = vm["log-sample"].as<int>();
+		if (logSampleEvery <= 0)
+			throw std::runtime_error("logSampleEvery was not positive.");
+
+		std::string captureBackend = vm["capture"].as<std::string>();
+		int ringBlockSize = vm["ring-block-size"].as<int>();
+		int ringBlocks = vm["ring-blocks"].as<int>();
+		int ringThreads = vm["ring-threads"].as<int>();
+		int ringFanout = vm["ring-fanout"].as<int>();
+
+		if (captureBackend != "pcap" && captureBackend != "ring")
+			throw std::runtime_error("capture must be 'pcap' or 'ring'.");
+
+		if (ringBlockSize <= 0 || (ringBlockSize & (ringBlockSize - 1)))
+			throw std::runtime_error("ringBlockSize was not a power of two.");
+
+		if (ringBlocks <= 0)
+			throw std::runtime_error("ringBlocks was not positive.");
+
+		if (ringThreads <= 0)
+			throw std::runtime_error("ringThreads was not positive.");
+
+		if (ringFanout < 0 || ringFanout > 0xFFFF)
+			throw std::runtime_error("ringFanout must be in range [0, 65535].");
+
+		std::vector<std::string> localNetworks;
+		if (vm.count("local-net"))
+			localNetworks = vm["local-net"].as<std::vector<std::string>>();
+
+		std::string storePath = vm["store"].as<std::string>();
+		int storeHosts = vm["store-hosts"].as<int>();
+		int storeSync = vm["store-sync"].as<int>();
+
+		if (storeHosts <= 0)
+			throw std::runtime_error("storeHosts was not positive.");
+
+		if (storeSync < 0)
+			throw std::runtime_error("storeSync was negative.");
+
+		if (!storePath.empty() && topHostsMemory > 0)
+			throw std::runtime_error("store cannot be used with topHostsMemory.");
+
+		std::vector<std::string> statsConsumers;
+		std::string statsNames = vm["stats"].as<std::string>();
+		for (std::size_t begin = 0, end = 0; end != std::string::npos; begin = end + 1)
+		{
+			end = statsNames.find(',', begin);
+			std::string consumer = statsNames.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+
+			if (consumer != "hosts" && consumer != "ports")
+				throw std::runtime_error("stats must be a comma separated list of 'hosts' and 'ports'.");
+
+			if (std::find(statsConsumers.begin(), statsConsumers.end(), consumer) != statsConsumers.end())
+				throw std::runtime_error("stats contains '" + consumer + "' twice.");
+
+			statsConsumers.push_back(consumer);
+		}
+
+		if (!storePath.empty() && statsConsumers.front() != "hosts")
+			throw std::runtime_error("store needs 'hosts' to be the first of stats.");
+
+		int dnsCacheMemory = vm["dns-cache-memory"].as<int>();
+		if (dnsCacheMemory < 0)
+			throw std::runtime_error("dnsCacheMemory was negative.");
+
+		if (interfaceIpAddrs.size() > 1)
+		{
+			if (!pcapFilePath.empty())
+				throw std::runtime_error("several interfaces cannot be used with readFile.");
+
+			if (workersCount > 0)
+				throw std::runtime_error("several interfaces cannot be used with workersCount, each interface has its own capture thread.");
+
+			if (captureBackend != "pcap")
+				throw std::runtime_error("several interfaces are captured only by 'pcap'.");
+		}
+
+		std::vector<int> captureCpus;
+		std::string cpuNames = vm["capture-cpus"].as<std::string>();
+		for (std::size_t begin = 0, end = 0; !cpuNames.empty() && end != std::string::npos; begin = end + 1)
+		{
+			end = cpuNames.find(',', begin);
+			std::string cpu = cpuNames.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+
+			if (cpu.empty() || cpu.size() > 4 || !std::all_of(cpu.begin(), cpu.end(), [](unsigned char c)
+															  { return std::isdigit(c); }))
+				throw std::runtime_error("captureCpus must be a comma separated list of CPU numbers.");
+
+			captureCpus.push_back(std::stoi(cpu));
+		}
+
+		std::size_t captureThreads = captureBackend == "ring" ? ringThreads : interfaceIpAddrs.size();
+		if (captureCpus.size() > captureThreads)
+			throw std::runtime_error("captureCpus has more CPUs than capture threads.");
+
+		int overloadSampling = vm["overload-sampling"].as<int>();
+		if (overloadSampling < 0 || overloadSampling == 1 || overloadSampling > 1024 || (overloadSampling & (overloadSampling - 1)))
+			throw std::runtime_error("overloadSampling must be 0 or a power of two in range [2, 1024].");
+		std::string exportPath = vm["export"].as<std::string>();
+		int exportFileSize = vm["export-file-size"].as<int>();
+		int exportFiles = vm["export-files"].as<int>();
+		std::string exportCodec = vm["export-codec"].as<std::string>();
+		if (exportFileSize <= 0)
+			throw std::runtime_error("exportFileSize was not positive.");
+		if (exportFiles <= 0)
+			throw std::runtime_error("exportFiles was not positive.");
+		if (exportCodec != "zeros" && exportCodec != "none")
+			throw std::runtime_error("exportCodec must be 'zeros' or 'none'.");
+		if (!exportPath.empty() && updatePeriod <= 0)
+			throw std::runtime_error("export needs a positive updatePeriod.");
+		int topRows = vm["top"].as<int>();
+		std::string sortBy = vm["sort"].as<std::string>();
+		std::string hostFilter = vm["filter"].as<std::string>();
+		HostQuery hostQuery;
+		std::string hostFilterError;
+		if (topRows < 0)
+			throw std::runtime_error("top was negative.");
+		if (!HostQuery::parseSortKey(sortBy, hostQuery.sortKey))
+			throw std::runtime_error("sort must be 'bytes', 'packets', 'in' or 'out'.");
+		if (!hostQuery.setFilter(hostFilter, hostFilterError))
+			throw std::runtime_error("filter: " + hostFilterError);
+		hostQuery.limit = static_cast<std::size_t>(topRows);
+
+		LocalAddressSet localAddresses;
+		for (const auto &network : localNetworks)
+		{
+			std::string errorInfo;
+			if (!localAddresses.addNetwork(network, errorInfo))
+				throw std::runtime_error("localNetworks: " + errorInfo);
+		}
+
+		return {shouldClose, updatePeriod, executionTime, interfaceIpAddr, pcapFilePath, workersCount, snapshotPeriod, snapshotPackets, topHostsMemory, topHostsMetric, flowCapacity, flowTimeout,
+				historyResolution, static_cast<int>(historyRetention.count()), historyHosts, logLevel, logSampleEvery,
+				captureBackend, ringBlockSize, ringBlocks, ringThreads, ringFanout, localNetworks,
+				storePath, storeHosts, storeSync, statsConsumers, dnsCacheMemory, interfaceIpAddrs, captureCpus, overloadSampling,
+				exportPath, exportFileSize, exportFiles, exportCodec, topRows, sortBy, hostFilter, std::move(hostQuery)};
 	}
 }
@@ -0,0 +1,413 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <tuple>
+#include <string>
+#include <sstream>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <ctime>
+#include <new>
+#include <type_traits>
+#include <algorithm>
+
+#include <boost/log/trivial.hpp>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+
+#include <IpKey.h>
+#include <SpscQueue.h>
+
+/// Минимальный уровень логов, попадающий в сборку (0 - trace, 1 - debug, ... 5 - fatal).
+/// Записи ниже этого уровня удаляются компилятором вместе с вычислением аргументов
+#ifndef TRAFFIC_ANALYZER_LOG_LEVEL
+#define TRAFFIC_ANALYZER_LOG_LEVEL 1
+#endif
+
+#define TA_LOG_IS_ELIDED(level) (::boost::log::trivial::level < TRAFFIC_ANALYZER_LOG_LEVEL)
+
+/// Синхронная запись в лог для редких событий: TA_LOG(info) << "text";
+/// Макрос раскрывается в цикл for без if, поэтому следующий за ним else относится к внешнему if
+#define TA_LOG(level)                                                                            \
+	for (bool taLogIsPending = !TA_LOG_IS_ELIDED(level); taLogIsPending; taLogIsPending = false) \
+	BOOST_LOG_TRIVIAL(level)
+
+/// Асинхронная запись в лог из горячего пути: TA_LOG_ASYNC(warning, "text {} {}", arg1, arg2)
+#define TA_LOG_ASYNC(level, ...)                                            \
+	do                                                                      \
+	{                                                                       \
+		if constexpr (!TA_LOG_IS_ELIDED(level))                             \
+			if (AsyncLog::isEnabled(::boost::log::trivial::level))          \
+				AsyncLog::write(::boost::log::trivial::level, __VA_ARGS__); \
+	} while (0)
+
+/// Асинхронная запись каждого N-го события места вызова, где N задается AsyncLog::setSampleEvery
+#define TA_LOG_SAMPLED(level, ...)                                              \
+	do                                                                          \
+	{                                                                           \
+		if constexpr (!TA_LOG_IS_ELIDED(level))                                 \
+			if (AsyncLog::isEnabled(::boost::log::trivial::level))              \
+			{                                                                   \
+				static thread_local std::uint32_t taLogSampleCounter = 0;       \
+				if (AsyncLog::shouldSample(taLogSampleCounter))                 \
+					AsyncLog::write(::boost::log::trivial::level, __VA_ARGS__); \
+			}                                                                   \
+	} while (0)
+
+/// Асинхронная запись не более perSecond событий места вызова в секунду в каждом потоке
+#define TA_LOG_LIMITED(level, perSecond, ...)                                   \
+	do                                                                          \
+	{                                                                           \
+		if constexpr (!TA_LOG_IS_ELIDED(level))                                 \
+			if (AsyncLog::isEnabled(::boost::log::trivial::level))              \
+			{                                                                   \
+				static thread_local AsyncLog::RateLimit taLogRateLimit;         \
+				if (taLogRateLimit.allow(perSecond))                            \
+					AsyncLog::write(::boost::log::trivial::level, __VA_ARGS__); \
+			}                                                                   \
+	} while (0)
+
+/// \brief Строка фиксированной длины для асинхронной записи, более длинные строки обрезаются
+struct LogString
+{
+	static constexpr std::size_t capacity = 63;
+
+	char text[capacity + 1];
+
+	static LogString from(const std::string &value)
+	{
+		LogString result;
+		std::size_t length = std::min(value.size(), capacity);
+		std::memcpy(result.text, value.data(), length);
+		result.text[length] = '\0';
+		return result;
+	}
+};
+
+/// \brief Запись асинхронного лога: текст, функция форматирования и скопированные аргументы
+struct AsyncLogRecord
+{
+	static constexpr std::size_t argsCapacity = 96;
+
+	boost::log::trivial::severity_level level{boost::log::trivial::info};
+	const char *text{nullptr};											///< Статическая строка, {} заменяются аргументами
+	void (*format)(std::ostream &, const AsyncLogRecord &){nullptr};	///< Форматирует аргументы их настоящего типа
+	alignas(std::max_align_t) unsigned char args[argsCapacity];			///< Кортеж аргументов
+};
+
+/**
+ * \brief Асинхронный лог для горячего пути обработки пакетов
+ *
+ * Поток, пишущий в лог, только копирует аргументы в свое кольцо записей (lock-free, один писатель
+ * и один читатель) и никогда не ждет: при заполненном кольце запись отбрасывается и учитывается.
+ * Форматирование и вывод в синки Boost.Log выполняет фоновый поток, запущенный start().
+ * Пока фоновый поток не запущен, записи форматируются и выводятся синхронно.
+ *
+ * Аргументы должны тривиально копироваться, std::string сохраняется как LogString
+ */
+class AsyncLog
+{
+public:
+	/// \brief Ограничение частоты записей одного места вызова, используется в TA_LOG_LIMITED
+	struct RateLimit
+	{
+		std::int64_t second{-1};
+		std::uint32_t count{0};
+
+		bool allow(std::uint32_t perSecond)
+		{
+			timespec now;
+			clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+
+			if (now.tv_sec != second)
+			{
+				second = now.tv_sec;
+				count = 0;
+			}
+
+			return count++ < perSecond;
+		}
+	};
+
+private:
+	static constexpr std::size_t ringCapacity = 2048;
+	static constexpr std::chrono::milliseconds drainPeriod{20};
+
+	struct ThreadRing
+	{
+		SpscQueue<AsyncLogRecord> records{ringCapacity};
+		std::atomic<std::uint64_t> dropped{0};	 ///< Записи, не поместившиеся в кольцо
+		std::atomic<bool> isDetached{false};	 ///< Поток-писатель завершился
+		std::uint64_t reportedDropped{0};		 ///< Сколько отброшенных записей уже выведено, используется фоновым потоком
+	};
+
+	struct State
+	{
+		std::atomic<int> level{boost::log::trivial::trace};
+		std::atomic<std::uint32_t> sampleEvery{1};
+		std::atomic<bool> isRunning{false};
+
+		std::mutex mutex;
+		std::condition_variable wakeUp;
+		bool isStopRequested{false};
+		std::vector<std::shared_ptr<ThreadRing>> rings;
+		std::thread drainer;
+
+		~State()
+		{
+			if (drainer.joinable())
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					isStopRequested = true;
+				}
+				wakeUp.notify_one();
+				drainer.join();
+			}
+		}
+	};
+
+	/// \brief Отмечает кольцо потока отсоединенным при завершении потока
+	struct ThreadRingOwner
+	{
+		std::shared_ptr<ThreadRing> ring;
+
+		~ThreadRingOwner()
+		{
+			if (ring)
+				ring->isDetached.store(true, std::memory_order_release);
+		}
+	};
+
+	template <class T>
+	struct Stored
+	{
+		using type = T;
+	};
+
+	static State &state()
+	{
+		static State instance;
+		return instance;
+	}
+
+	static ThreadRing &threadRing()
+	{
+		thread_local ThreadRingOwner owner;
+		if (!owner.ring)
+		{
+			owner.ring = std::make_shared<ThreadRing>();
+
+			std::lock_guard<std::mutex> lock(state().mutex);
+			state().rings.push_back(owner.ring);
+		}
+
+		return *owner.ring;
+	}
+
+	static LogString store(const std::string &value) { return LogString::from(value); }
+
+	template <class T>
+	static const T &store(const T &value) { return value; }
+
+	static void writeValue(std::ostream &out, const IpKey &value) { out << value.toString(); }
+	static void writeValue(std::ostream &out, const LogString &value) { out << value.text; }
+
+	template <class T>
+	static void writeValue(std::ostream &out, const T &value) { out << value; }
+
+	/// \brief Выводит текст до очередного {} и значение вместо него
+	template <class T>
+	static void writeNext(std::ostream &out, const char *&text, const T &value)
+	{
+		const char *placeholder = std::strstr(text, "{}");
+		if (!placeholder)
+			return;
+
+		out.write(text, placeholder - text);
+		writeValue(out, value);
+		text = placeholder + 2;
+	}
+
+	template <class... Values>
+	static void formatRecord(std::ostream &out, const AsyncLogRecord &record)
+	{
+		const auto &values = *std::launder(reinterpret_cast<const std::tuple<Values...> *>(record.args));
+		const char *text = record.text;
+
+		std::apply([&out, &text](const Values &...value)
+				   { (writeNext(out, text, value), ...); },
+				   values);
+		out << text;
+	}
+
+	template <class... Args>
+	static void fill(AsyncLogRecord &record, boost::log::trivial::severity_level level, const char *text, const Args &...args)
+	{
+		using Values = std::tuple<typename Stored<Args>::type...>;
+		static_assert(sizeof(Values) <= AsyncLogRecord::argsCapacity, "AsyncLog arguments do not fit into a record");
+		static_assert((std::is_trivially_copyable_v<typename Stored<Args>::type> && ...), "AsyncLog arguments must be trivially copyable");
+
+		record.level = level;
+		record.text = text;
+		record.format = &formatRecord<typename Stored<Args>::type...>;
+		new (record.args) Values(store(args)...);
+	}
+
+	static void emit(boost::log::trivial::severity_level level, const std::string &message)
+	{
+		BOOST_LOG_SEV(::boost::log::trivial::logger::get(), level) << message;
+	}
+
+	/// \brief Выводит все записи кольца, вызывается только фоновым потоком
+	static void drain(ThreadRing &ring, std::ostringstream &out)
+	{
+		while (ring.records.tryPop([&out](const AsyncLogRecord &record)
+								   {
+									   out.str("");
+									   record.format(out, record);
+									   emit(record.level, out.str()); }))
+			;
+
+		std::uint64_t dropped = ring.dropped.load(std::memory_order_relaxed);
+		if (dropped != ring.reportedDropped)
+		{
+			emit(boost::log::trivial::warning, "AsyncLog dropped " + std::to_string(dropped - ring.reportedDropped) + " records, ring was full");
+			ring.reportedDropped = dropped;
+		}
+	}
+
+	static void drainLoop()
+	{
+		State &s = state();
+		std::ostringstream out;
+		std::vector<std::shared_ptr<ThreadRing>> rings;
+
+		for (;;)
+		{
+			bool isStopping;
+			{
+				std::unique_lock<std::mutex> lock(s.mutex);
+				s.wakeUp.wait_for(lock, drainPeriod, [&s]
+								  { return s.isStopRequested; });
+
+				isStopping = s.isStopRequested;
+				rings = s.rings;
+			}
+
+			for (auto &ring : rings)
+				drain(*ring, out);
+
+			{
+				std::lock_guard<std::mutex> lock(s.mutex);
+				std::erase_if(s.rings, [](const std::shared_ptr<ThreadRing> &ring)
+							  { return ring->isDetached.load(std::memory_order_acquire) && !ring->records.size(); });
+			}
+
+			if (isStopping)
+				return;
+		}
+	}
+
+public:
+	AsyncLog() = delete;
+
+	/// \brief Запускает фоновый поток вывода
+	static void start()
+	{
+		State &s = state();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		if (s.drainer.joinable())
+			return;
+
+		s.isStopRequested = false;
+		s.drainer = std::thread(drainLoop);
+		s.isRunning.store(true, std::memory_order_release);
+	}
+
+	/// \brief Выводит накопленные записи и останавливает фоновый поток, дальнейшие записи выводятся синхронно
+	static void stop()
+	{
+		State &s = state();
+		{
+			std::lock_guard<std::mutex> lock(s.mutex);
+			if (!s.drainer.joinable())
+				return;
+
+			s.isRunning.store(false, std::memory_order_release);
+			s.isStopRequested = true;
+		}
+
+		s.wakeUp.notify_one();
+		s.drainer.join();
+	}
+
+	/// \brief Задает минимальный уровень записей, выводимых во время работы, в том числе для синхронных TA_LOG
+	static void setLevel(boost::log::trivial::severity_level level)
+	{
+		state().level.store(level, std::memory_order_relaxed);
+		boost::log::core::get()->set_filter(boost::log::trivial::severity >= level);
+	}
+
+	/// \brief Задает, какое по счету событие выводят TA_LOG_SAMPLED (1 - каждое)
+	static void setSampleEvery(std::uint32_t sampleEvery)
+	{
+		state().sampleEvery.store(std::max<std::uint32_t>(sampleEvery, 1), std::memory_order_relaxed);
+	}
+
+	static bool isEnabled(boost::log::trivial::severity_level level)
+	{
+		return level >= state().level.load(std::memory_order_relaxed);
+	}
+
+	/// \brief Считает событие места вызова и возвращает True для каждого N-го
+	static bool shouldSample(std::uint32_t &counter)
+	{
+		if (++counter < state().sampleEvery.load(std::memory_order_relaxed))
+			return false;
+
+		counter = 0;
+		return true;
+	}
+
+	/// \brief Подставляет аргументы вместо {} в тексте
+	template <class... Args>
+	static std::string format(const char *text, const Args &...args)
+	{
+		AsyncLogRecord record;
+		fill(record, boost::log::trivial::info, text, args...);
+
+		std::ostringstream out;
+		record.format(out, record);
+		return out.str();
+	}
+
+	/// \brief Ставит запись в кольцо потока, а без фонового потока выводит её сразу
+	/// \param[in] text Статическая строка, должна существовать до вывода записи
+	template <class... Args>
+	static void write(boost::log::trivial::severity_level level, const char *text, const Args &...args)
+	{
+		if (!state().isRunning.load(std::memory_order_acquire))
+		{
+			emit(level, format(text, args...));
+			return;
+		}
+
+		ThreadRing &ring = threadRing();
+		if (!ring.records.tryPush([&](AsyncLogRecord &record)
+								  { fill(record, level, text, args...); }))
+			ring.dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+};
+
+template <>
+struct AsyncLog::Stored<std::string>
+{
+	using type = LogString;
+};
@@ -0,0 +1,345 @@
+#pragma once
+#include <atomic>
+#include <array>
+#include <memory>
+#include <span>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+
+#include <RawPacket.h>
+#include <Packet.h>
+
+#include <ITrafficStats.h>
+#include <PacketView.h>
+#include <RawPacketParser.h>
+#include <SpscQueue.h>
+#include <SnapshotPublisher.h>
+#include <RateHistory.h>
+#include <PerfCounters.h>
+#include <AdaptiveSampler.h>
+#include <AsyncLog.h>
+
+/// \brief Копия пакета, переданная из потока захвата в обработчик
+struct QueuedPacket
+{
+	std::vector<std::uint8_t> data; ///< Буфер с байтами пакета, переиспользуется между пакетами
+	int length{0};
+	timespec timestamp{};
+	pcpp::LinkLayerType linkType{pcpp::LINKTYPE_ETHERNET};
+};
+
+/**
+ * \brief Обработчик пакетов, владеющий собственной частью (шардом) статистики
+ *
+ * Поток захвата кладет пакеты в очередь обработчика, а поток обработчика
+ * записывает их в свой шард без каких-либо блокировок. Читатели не обращаются
+ * к шарду напрямую: обработчик периодически публикует его копию через SnapshotPublisher
+ *
+ * При перегрузке (потери пакетов или заполненная очередь) обработчик может перейти
+ * к выборочному учету пакетов (см. AdaptiveSampler)
+ */
+class CaptureWorker
+{
+public:
+	/// \brief Возвращает накопленные с запуска источника счетчики принятых (включая потерянные) и потерянных им пакетов
+	using LoadSource = std::function<void(std::uint64_t &received, std::uint64_t &dropped)>;
+
+private:
+	std::unique_ptr<ITrafficStats> shard; ///< Статистика, принадлежащая потоку обработчика
+	SpscQueue<QueuedPacket> queue;		  ///< Очередь пакетов от потока захвата
+
+	std::thread thread;
+	std::atomic<bool> running{false};  ///< Поток обработчика должен продолжать ожидать новые пакеты
+	std::atomic<bool> active{false};   ///< Поток обработчика запущен и ещё не присоединен
+
+	SnapshotPublisher publisher; ///< Публикует копии шарда для читателей
+	std::unique_ptr<RateHistory> history; ///< История скорости трафика шарда, может отсутствовать
+
+	std::atomic<bool> clearRequested{false};
+	std::atomic<std::uint64_t> droppedPackets{0}; ///< Количество пакетов, не поместившихся в очередь
+
+	AdaptiveSampler sampler; ///< Выборочный учет пакетов при перегрузке
+	LoadSource loadSource;	 ///< Источник счетчиков потерь, без него нагрузка оценивается по очереди
+	std::uint64_t processedPackets{0}; ///< Пакеты, извлеченные из очереди
+
+	static constexpr std::size_t batchSize = 64; ///< Сколько пакетов из очереди обрабатывается за раз
+	std::array<PacketView, batchSize> batch;	 ///< Заголовки пакетов, извлеченных из очереди
+
+	static constexpr std::uint32_t idlePollsBeforeSleep = 64; ///< Сколько раз опросить пустую очередь, прежде чем заснуть
+	static constexpr std::chrono::microseconds idleSleep{100};
+
+	/// \brief Выполняет запрос на очистку шарда, вызывается только потоком обработчика
+	void serveClearRequest()
+	{
+		if (clearRequested.load(std::memory_order_relaxed) && clearRequested.exchange(false, std::memory_order_acquire))
+		{
+			if (history)
+				history->clear();
+
+			shard->clear();
+			publisher.publish(*shard);
+		}
+	}
+
+	/// \brief Пересчитывает коэффициент выборки по нагрузке и отбирает учитываемые пакеты пачки
+	std::span<const PacketView> sample(std::span<const PacketView> views)
+	{
+		if (!sampler.isEnabled())
+			return views;
+
+		if (sampler.isCheckDue(views.size()))
+		{
+			std::uint64_t received = 0, dropped = 0;
+			double queueFill = 0;
+
+			if (loadSource)
+				loadSource(received, dropped);
+			else
+			{
+				dropped = droppedPackets.load(std::memory_order_relaxed);
+				received = processedPackets + dropped;
+				queueFill = double(queue.size()) / queue.capacity();
+			}
+
+			if (sampler.observe(received, dropped, queueFill))
+			{
+				shard->setSamplingRate(sampler.getRate());
+
+				if (sampler.getRate() > 1)
+					TA_LOG_ASYNC(warning, "Overload: worker counts 1 of {} flows", sampler.getRate());
+				else
+					TA_LOG_ASYNC(info, "Load dropped: worker counts all packets again");
+			}
+		}
+
+		return sampler.sample(views);
+	}
+
+	void processViews(std::span<const PacketView> views)
+	{
+		views = sample(views);
+
+		{
+			TA_PERF_SCOPE(stats, views.size());
+			shard->addPackets(views);
+		}
+
+		{
+			TA_PERF_SCOPE(publish, views.size());
+			publisher.onPackets(*shard, views.size());
+		}
+
+		if (history)
+			history->addPackets(views);
+	}
+
+	/// \brief Обрабатывает пачку пакетов из очереди, пакеты освобождаются после обработки
+	/// \return Количество обработанных пакетов
+	std::size_t processQueued()
+	{
+		std::size_t count = queue.readable(batchSize);
+
+		if (count)
+		{
+			TA_PERF_SCOPE(parse, count);
+			for (std::size_t i = 0; i < count; i++)
+			{
+				QueuedPacket &queued = queue.peek(i);
+				RawPacketParser::parse(queued.data.data(), queued.length, queued.linkType, queued.timestamp, batch[i]);
+			}
+		}
+
+		if (count)
+		{
+			processViews(std::span<const PacketView>(batch.data(), count));
+			queue.release(count);
+			processedPackets += count;
+		}
+
+		return count;
+	}
+
+	void run()
+	{
+		TA_PERF_THREAD("worker");
+		std::uint32_t idlePolls = 0;
+
+		while (true)
+		{
+			bool isStopping = !running.load(std::memory_order_acquire);
+
+			serveClearRequest();
+
+			if (processQueued())
+			{
+				idlePolls = 0;
+				continue;
+			}
+
+			if (isStopping)
+				break;
+
+			publisher.onIdle(*shard);
+
+			if (++idlePolls < idlePollsBeforeSleep)
+				std::this_thread::yield();
+			else
+				std::this_thread::sleep_for(idleSleep);
+		}
+
+		publisher.publish(*shard);
+	}
+
+public:
+	/// \param[in] shard Статистика, которую будет заполнять обработчик
+	/// \param[in] policy Правила публикации копий шарда
+	/// \param[in] queueCapacity Вместимость очереди пакетов
+	CaptureWorker(std::unique_ptr<ITrafficStats> shard, const SnapshotPolicy &policy, std::size_t queueCapacity = 65536)
+		: shard(std::move(shard)), queue(queueCapacity), publisher(*this->shard, policy) {}
+
+	~CaptureWorker() { stop(); }
+
+	CaptureWorker(const CaptureWorker &) = delete;
+	CaptureWorker &operator=(const CaptureWorker &) = delete;
+
+	/// \brief Передает обработчику историю скорости трафика, вызывается до start()
+	void attachHistory(std::unique_ptr<RateHistory> rateHistory) { history = std::move(rateHistory); }
+
+	/**
+	 * \brief Включает выборочный учет пакетов при перегрузке, вызывается до start() или beginFeed()
+	 * \param[in] source Счетчики потерь источника пакетов (например, кольца захвата), без него
+	 * нагрузка оценивается по заполнению очереди и отброшенным из неё пакетам
+	 */
+	void setSampling(const SamplingConfig &config, LoadSource source = LoadSource())
+	{
+		sampler = AdaptiveSampler(config);
+		loadSource = std::move(source);
+	}
+
+	/// \brief Загружает шард из файла статистики хостов и публикует его копию, вызывается до start()
+	bool attachStore(std::unique_ptr<HostStore> store, std::string &errorInfo)
+	{
+		if (!shard->attachStore(std::move(store), errorInfo))
+			return false;
+
+		publisher.publish(*shard);
+		return true;
+	}
+
+	/// \brief Закрывает файл статистики хостов шарда, вызывается после stop()
+	void closeStore() { shard->closeStore(); }
+
+	/// \brief Возвращает историю скорости трафика шарда, либо nullptr, может вызываться из любого потока
+	const RateHistory *getHistory() const { return history.get(); }
+
+	/// \brief Запускает поток обработчика
+	void start()
+	{
+		if (running.exchange(true))
+			return;
+
+		active.store(true, std::memory_order_release);
+		thread = std::thread(&CaptureWorker::run, this);
+	}
+
+	/// \brief Обрабатывает оставшиеся в очереди пакеты и останавливает поток обработчика
+	void stop()
+	{
+		running.store(false, std::memory_order_release);
+
+		if (thread.joinable())
+			thread.join();
+
+		active.store(false, std::memory_order_release);
+	}
+
+	bool isRunning() const { return active.load(std::memory_order_acquire); }
+
+	/// \brief Передает шард вызывающему потоку (например, потоку кольца захвата) вместо потока обработчика
+	///
+	/// До endFeed() пакеты передаются через feed() и feedIdle() только этим потоком, а очередь не используется
+	void beginFeed() { active.store(true, std::memory_order_release); }
+
+	/// \brief Записывает пакет в шард без копирования, вызывается только потоком, вызвавшим beginFeed()
+	void feed(const PacketView &view) { feed(std::span<const PacketView>(&view, 1)); }
+
+	/// \brief Записывает пачку пакетов в шард без копирования, вызывается только потоком, вызвавшим beginFeed()
+	void feed(std::span<const PacketView> views)
+	{
+		serveClearRequest();
+		processViews(views);
+	}
+
+	/// \brief Сообщает об отсутствии пакетов, чтобы копия шарда публиковалась и без них
+	void feedIdle()
+	{
+		serveClearRequest();
+		publisher.onIdle(*shard);
+	}
+
+	/// \brief Публикует итоговую копию шарда и возвращает его обработчику
+	void endFeed()
+	{
+		serveClearRequest();
+		publisher.publish(*shard);
+		active.store(false, std::memory_order_release);
+	}
+
+	/**
+	 * \brief Копирует пакет в очередь обработчика, вызывается только потоком захвата
+	 * \param[in] packet Пакет для обработки
+	 * \param[in] waitIfFull Ждать освобождения места в очереди, вместо отбрасывания пакета
+	 * \return False - если пакет был отброшен
+	 */
+	bool enqueue(const pcpp::RawPacket &packet, bool waitIfFull)
+	{
+		auto fill = [&packet](QueuedPacket &queued)
+		{
+			queued.length = packet.getRawDataLen();
+			if (queued.data.size() < static_cast<std::size_t>(queued.length))
+				queued.data.resize(queued.length);
+
+			std::memcpy(queued.data.data(), packet.getRawData(), queued.length);
+			queued.timestamp = packet.getPacketTimeStamp();
+			queued.linkType = packet.getLinkLayerType();
+		};
+
+		while (!queue.tryPush(fill))
+		{
+			if (!waitIfFull)
+			{
+				droppedPackets.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+
+			std::this_thread::yield();
+		}
+
+		return true;
+	}
+
+	/// \brief Возвращает последнюю опубликованную копию шарда, может вызываться из любого потока
+	std::shared_ptr<const ITrafficStats> getSnapshot() { return publisher.get(); }
+
+	/// \brief Очищает шард статистики и историю скорости трафика
+	void clear()
+	{
+		if (isRunning())
+			clearRequested.store(true, std::memory_order_release);
+		else
+		{
+			if (history)
+				history->clear();
+
+			shard->clear();
+			publisher.publish(*shard);
+		}
+	}
+
+	/// \brief Возвращает количество пакетов, не поместившихся в очередь
+	std::uint64_t getDroppedPackets() const { return droppedPackets.load(std::memory_order_relaxed); }
+};
@@ -0,0 +1,130 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+#include <IpKey.h>
+
+/**
+ * \brief Count-Min sketch: приближенные счетчики для произвольного множества хостов в фиксированной памяти
+ *
+ * Таблица из depth строк по width счетчиков, каждый хост увеличивает по одному счетчику в каждой строке.
+ * Оценка никогда не бывает меньше истинного значения, а с вероятностью не менее 1 - e^-depth
+ * превышает его не более чем на e / width * total(), где total() - сумма всех добавленных значений.
+ *
+ * Сводка (summary) хранит только размеры и total() без счетчиков: её оценкой служит total(),
+ * которая тоже никогда не меньше истинного значения
+ */
+class CountMinSketch
+{
+private:
+	std::size_t width;
+	std::size_t depth;
+	std::vector<std::uint64_t> counters; ///< Строки таблицы, расположенные подряд, пусто у сводки
+	std::uint64_t totalValue{0};		 ///< Сумма всех добавленных значений
+
+	/// \brief Возвращает номер счетчика хоста в строке row (двойное хэширование Кирша-Митценмахера)
+	std::size_t cellOf(std::uint64_t hash, std::size_t row) const
+	{
+		std::uint64_t low = hash & 0xFFFFFFFF;
+		std::uint64_t high = (hash >> 32) | 1;
+		return row * width + ((low + row * high) & (width - 1));
+	}
+
+public:
+	/// \param[in] width Количество счетчиков в строке, округляется вверх до степени двойки
+	/// \param[in] depth Количество строк
+	CountMinSketch(std::size_t width, std::size_t depth)
+		: width(1), depth(std::max<std::size_t>(depth, 1))
+	{
+		while (this->width < width)
+			this->width *= 2;
+
+		counters.assign(this->width * this->depth, 0);
+	}
+
+	/// \brief Увеличивает счетчики хоста key на value
+	void add(const IpKey &key, std::uint64_t value)
+	{
+		totalValue += value;
+		if (counters.empty())
+			return;
+
+		std::uint64_t hash = key.hash();
+		for (std::size_t row = 0; row < depth; row++)
+			counters[cellOf(hash, row)] += value;
+	}
+
+	/// \brief Возвращает оценку суммы значений, добавленных для хоста key, сверху
+	std::uint64_t estimate(const IpKey &key) const
+	{
+		if (counters.empty())
+			return totalValue;
+
+		std::uint64_t hash = key.hash();
+		std::uint64_t result = UINT64_MAX;
+
+		for (std::size_t row = 0; row < depth; row++)
+			result = std::min(result, counters[cellOf(hash, row)]);
+
+		return result;
+	}
+
+	/// \brief Возвращает сумму всех добавленных значений
+	std::uint64_t total() const { return totalValue; }
+
+	/// \brief Возвращает границу ошибки оценки e / width * total(), которая соблюдается с вероятностью 1 - e^-depth
+	std::uint64_t errorBound() const
+	{
+		return static_cast<std::uint64_t>(2.718281828459045 * static_cast<double>(totalValue) / width);
+	}
+
+	std::size_t getWidth() const { return width; }
+	std::size_t getDepth() const { return depth; }
+
+	/// \brief Возвращает копию с теми же размерами и суммой, но без счетчиков
+	CountMinSketch summary() const
+	{
+		CountMinSketch result(1, 1);
+		result.width = width;
+		result.depth = depth;
+		result.counters = std::vector<std::uint64_t>();
+		result.totalValue = totalValue;
+		return result;
+	}
+
+	/// \brief Проверяет, хранит ли sketch счетчики (а не только сводку)
+	bool hasCounters() const { return !counters.empty(); }
+
+	/// \brief Возвращает объем памяти, занимаемой счетчиками
+	std::size_t memoryUsage() const { return counters.size() * sizeof(std::uint64_t); }
+
+	/**
+	 * \brief Добавляет счетчики другого sketch с теми же размерами
+	 *
+	 * Если у одного из них только сводка, результат тоже становится сводкой
+	 * \return False - если размеры различаются
+	 */
+	bool merge(const CountMinSketch &other)
+	{
+		if (width != other.width || depth != other.depth)
+			return false;
+
+		if (!other.hasCounters())
+			counters = std::vector<std::uint64_t>();
+
+		for (std::size_t i = 0; i < counters.size(); i++)
+			counters[i] += other.counters[i];
+
+		totalValue += other.totalValue;
+		return true;
+	}
+
+	/// \brief Обнуляет все счетчики
+	void clear()
+	{
+		std::fill(counters.begin(), counters.end(), 0);
+		totalValue = 0;
+	}
+};
@@ -0,0 +1,116 @@
+#pragma once
+#include <string>
+#include <thread>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <AsyncLog.h>
+
+/**
+ * \brief Привязка потоков к ядрам процессора
+ *
+ * Память страницы выделяется ядром ОС на узле NUMA того ядра, которое первым к ней обратилось.
+ * Поэтому поток захвата привязывается к ядру, а его статистика создается потоком, привязанным
+ * к тому же ядру (см. runOn): таблицы статистики оказываются в памяти узла, который их обновляет
+ */
+class CpuAffinity
+{
+public:
+	/// \brief Значение номера ядра, означающее "не привязывать"
+	static constexpr int anyCpu = -1;
+
+	/**
+	 * \brief Привязывает вызывающий поток к ядру cpu
+	 * \param[out] errorInfo В случае ошибки, сюда будет записана причина
+	 */
+	static bool pinCurrentThread(int cpu, std::string &errorInfo)
+	{
+#if defined(__linux__)
+		if (cpu < 0 || cpu >= CPU_SETSIZE)
+		{
+			errorInfo = "CpuAffinity: cpu " + std::to_string(cpu) + " is out of range";
+			return false;
+		}
+
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+
+		int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if (error)
+		{
+			errorInfo = "CpuAffinity: cannot pin thread to cpu " + std::to_string(cpu) + ": " + std::strerror(error);
+			return false;
+		}
+
+		return true;
+#else
+		errorInfo = "CpuAffinity: pinning threads is supported only on Linux";
+		return false;
+#endif
+	}
+
+	/// \brief Возвращает номер узла NUMA ядра cpu, либо -1, если он неизвестен
+	static int numaNodeOf(int cpu)
+	{
+#if defined(__linux__)
+		std::error_code error;
+		std::filesystem::directory_iterator entries("/sys/devices/system/cpu/cpu" + std::to_string(cpu), error);
+		if (error)
+			return -1;
+
+		for (const auto &entry : entries)
+		{
+			std::string name = entry.path().filename().string();
+			if (name.size() > 4 && name.compare(0, 4, "node") == 0 && std::isdigit(static_cast<unsigned char>(name[4])))
+				return std::atoi(name.c_str() + 4);
+		}
+#endif
+		return -1;
+	}
+
+	/**
+	 * \brief Выполняет function в отдельном потоке, привязанном к ядру cpu, и дожидается её завершения
+	 *
+	 * При cpu == anyCpu выполняет function в вызывающем потоке. Если привязать поток не удалось,
+	 * function всё равно выполняется, а причина пишется в лог. Исключение function
+	 * перебрасывается в вызывающем потоке, как если бы она выполнялась в нем
+	 */
+	template <class Function>
+	static void runOn(int cpu, Function &&function)
+	{
+		if (cpu == anyCpu)
+		{
+			function();
+			return;
+		}
+
+		std::exception_ptr error;
+		std::thread thread([cpu, &function, &error]
+						   {
+							   std::string errorInfo;
+							   if (!pinCurrentThread(cpu, errorInfo))
+								   TA_LOG(warning) << errorInfo;
+
+							   try
+							   {
+								   function();
+							   }
+							   catch (...)
+							   {
+								   error = std::current_exception();
+							   } });
+		thread.join();
+
+		if (error)
+			std::rethrow_exception(error);
+	}
+};
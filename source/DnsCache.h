@@ -0,0 +1,400 @@
+#pragma once
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+#include <IpKey.h>
+#include <HostTable.h>
+#include <NameArena.h>
+#include <PacketView.h>
+#include <JsonWriter.h>
+#include <AsyncLog.h>
+
+/// \brief Параметры кэша ответов DNS
+struct DnsCacheConfig
+{
+	std::size_t capacity{0};			 ///< Максимальное количество адресов в кэше, 0 - кэш не ведется
+	std::uint32_t minTtl{60};			 ///< Минимальное время жизни записи (в сек), короткие TTL балансировщиков продлеваются
+	std::uint32_t maxTtl{24 * 60 * 60};	 ///< Максимальное время жизни записи (в сек)
+
+	bool isEnabled() const { return capacity > 0; }
+};
+
+/**
+ * \brief Разбор ответа DNS: имя из вопроса и адреса из записей A и AAAA
+ *
+ * Адреса из ответа на запрос www.example.com получают это имя, даже если ответ
+ * содержит цепочку CNAME: именно его запрашивал клиент
+ */
+class DnsResponseParser
+{
+private:
+	static constexpr std::size_t headerSize = 12;
+	static constexpr std::uint16_t typeA = 1;
+	static constexpr std::uint16_t typeAAAA = 28;
+	static constexpr std::uint16_t classIN = 1;
+	static constexpr int maxPointers = 16; ///< Защита от зацикленных ссылок сжатия имен
+
+	static std::uint16_t read16(const std::uint8_t *data) { return static_cast<std::uint16_t>((data[0] << 8) | data[1]); }
+
+	static std::uint32_t read32(const std::uint8_t *data)
+	{
+		return (std::uint32_t(data[0]) << 24) | (std::uint32_t(data[1]) << 16) | (std::uint32_t(data[2]) << 8) | data[3];
+	}
+
+	/// \brief Пропускает имя в записи, возвращает смещение за ним или 0 при ошибке
+	static std::size_t skipName(const std::uint8_t *data, std::size_t length, std::size_t offset)
+	{
+		while (offset < length)
+		{
+			std::uint8_t label = data[offset];
+			if (label == 0)
+				return offset + 1;
+
+			if ((label & 0xC0) == 0xC0)
+				return offset + 2 <= length ? offset + 2 : 0;
+
+			offset += label + 1;
+		}
+
+		return 0;
+	}
+
+	/// \brief Читает имя, следуя ссылкам сжатия, возвращает смещение за именем в записи или 0 при ошибке
+	static std::size_t readName(const std::uint8_t *data, std::size_t length, std::size_t offset, std::string &name)
+	{
+		std::size_t end = 0;
+		int pointers = 0;
+		name.clear();
+
+		while (offset < length)
+		{
+			std::uint8_t label = data[offset];
+			if (label == 0)
+				return end ? end : offset + 1;
+
+			if ((label & 0xC0) == 0xC0)
+			{
+				if (offset + 2 > length || ++pointers > maxPointers)
+					return 0;
+
+				if (!end)
+					end = offset + 2;
+
+				offset = read16(data + offset) & 0x3FFF;
+				continue;
+			}
+
+			if (offset + 1 + label > length || name.size() + label + 1 > NameArena::maxNameLength)
+				return 0;
+
+			if (!name.empty())
+				name += '.';
+
+			name.append(reinterpret_cast<const char *>(data + offset + 1), label);
+			offset += label + 1;
+		}
+
+		return 0;
+	}
+
+public:
+	/**
+	 * \brief Вызывает onAddress(IpKey, ttl) для каждого адреса в успешном ответе DNS
+	 * \param[out] name Имя из вопроса
+	 * \return False - если данные не являются корректным ответом DNS
+	 */
+	template <class OnAddress>
+	static bool parse(const std::uint8_t *data, std::size_t length, std::string &name, OnAddress &&onAddress)
+	{
+		if (!data || length < headerSize)
+			return false;
+
+		std::uint16_t flags = read16(data + 2);
+		bool isResponse = flags & 0x8000;
+		bool isSuccess = (flags & 0x000F) == 0;
+
+		if (!isResponse || !isSuccess || read16(data + 4) != 1)
+			return false;
+
+		std::size_t answersCount = read16(data + 6);
+		std::size_t offset = readName(data, length, headerSize, name);
+		if (!offset || name.empty() || offset + 4 > length)
+			return false;
+
+		offset += 4;
+
+		for (std::size_t i = 0; i < answersCount; i++)
+		{
+			offset = skipName(data, length, offset);
+			if (!offset || offset + 10 > length)
+				return false;
+
+			std::uint16_t type = read16(data + offset);
+			std::uint16_t recordClass = read16(data + offset + 2);
+			std::uint32_t ttl = read32(data + offset + 4);
+			std::size_t dataLength = read16(data + offset + 8);
+			offset += 10;
+
+			if (offset + dataLength > length)
+				return false;
+
+			if (recordClass == classIN && type == typeA && dataLength == 4)
+				onAddress(IpKey::fromIPv4(data + offset), ttl);
+			else if (recordClass == classIN && type == typeAAAA && dataLength == 16)
+				onAddress(IpKey::fromIPv6(data + offset), ttl);
+
+			offset += dataLength;
+		}
+
+		return true;
+	}
+};
+
+/**
+ * \brief Кэш соответствия IP адресов именам, заполняемый ответами DNS из захваченного трафика
+ *
+ * Кэш никогда не обращается к резолверу: он только запоминает ответы, которые уже прошли через
+ * интерфейс, поэтому на пути захвата нет блокирующих вызовов. Время жизни записи берется из TTL
+ * ответа и отсчитывается по временным меткам всех пакетов, а не только ответов DNS: иначе
+ * без нового трафика DNS записи никогда не истекали бы. Количество записей ограничено вместимостью,
+ * при заполнении запись выбирается алгоритмом CLOCK: истекшие записи и записи без обращений
+ * с прошлого прохода стрелки вытесняются первыми.
+ *
+ * Кэш разделяется писателями статистики: они добавляют записи и ищут имена хостов копий статистики
+ * при публикации (см. Batch). Все операции выполняются под мьютексом: ответы DNS редки по сравнению
+ * с остальными пакетами, а читатели статистики к кэшу не обращаются
+ */
+class DnsCache
+{
+private:
+	/// \brief Запись кэша
+	struct Entry
+	{
+		std::uint32_t nameId{NameArena::noName}; ///< Номер имени в NameArena
+		std::uint32_t expires{0};				 ///< Время истечения записи (в сек по временным меткам пакетов)
+		bool isReferenced{false};				 ///< Было ли обращение к записи с прошлого прохода стрелки
+	};
+
+	DnsCacheConfig config;
+	HostTable<Entry> entries;
+	std::size_t hand{0};	///< Положение стрелки CLOCK
+	std::atomic<std::uint32_t> now{0}; ///< Время самого нового пакета, продвигается без блокировки
+
+	std::uint64_t hits{0};
+	std::uint64_t misses{0};
+	std::uint64_t responses{0};
+	std::uint64_t evictions{0};
+
+	std::string nameBuffer; ///< Переиспользуемый буфер имени из вопроса
+	mutable std::mutex mutex;
+
+	bool isExpired(const Entry &entry) const { return entry.expires < now.load(std::memory_order_relaxed); }
+
+	/// \brief Ищет имя адреса, вызывается под мьютексом
+	std::uint32_t find(const IpKey &address)
+	{
+		Entry *entry = entries.find(address);
+		if (!entry || isExpired(*entry))
+		{
+			misses++;
+			return NameArena::noName;
+		}
+
+		entry->isReferenced = true;
+		hits++;
+		return entry->nameId;
+	}
+
+	/// \brief Выбирает запись для вытеснения, поворачивая стрелку
+	std::size_t selectVictim()
+	{
+		for (;;)
+		{
+			std::size_t index = hand;
+			hand = (hand + 1) % entries.size();
+
+			Entry &entry = entries.valueAt(index);
+			if (!entry.isReferenced || isExpired(entry))
+				return index;
+
+			entry.isReferenced = false;
+		}
+	}
+
+	void insert(const IpKey &address, std::uint32_t nameId, std::uint32_t ttl)
+	{
+		std::uint32_t expires = now.load(std::memory_order_relaxed) + std::clamp(ttl, config.minTtl, config.maxTtl);
+
+		if (Entry *entry = entries.find(address))
+		{
+			entry->nameId = nameId;
+			entry->expires = expires;
+			return;
+		}
+
+		std::size_t index;
+		if (entries.size() < config.capacity)
+			index = entries.findOrInsert(address);
+		else
+		{
+			index = selectVictim();
+			entries.replaceKey(index, address);
+			evictions++;
+		}
+
+		entries.valueAt(index) = {nameId, expires, false};
+	}
+
+public:
+	/// \param[in] config Вместимость и пределы времени жизни записей
+	explicit DnsCache(const DnsCacheConfig &config)
+		: config(config)
+	{
+		this->config.capacity = std::max<std::size_t>(this->config.capacity, 1);
+		entries.reserve(this->config.capacity);
+	}
+
+	/// \brief Объем памяти, занимаемый одной записью кэша (без имен, которые хранятся в NameArena)
+	static constexpr std::size_t entryMemory()
+	{
+		// Запись, ключ и до четырех ячеек индексной части HostTable
+		return sizeof(Entry) + sizeof(IpKey) + 4 * sizeof(std::uint64_t);
+	}
+
+	/// \brief Проверяет, может ли пакет быть ответом DNS
+	static bool isResponse(const PacketView &packet)
+	{
+		return packet.isUdp() && packet.srcPort == 53 && packet.payloadLength > 0;
+	}
+
+	/**
+	 * \brief Продвигает время кэша до временной метки пакета, вызывается писателями для каждого пакета
+	 *
+	 * Время меняется раз в секунду, поэтому обычно это одно чтение без записи в общую память
+	 */
+	void advance(const PacketView &packet)
+	{
+		if (packet.timestamp.tv_sec <= 0)
+			return;
+
+		std::uint32_t seconds = static_cast<std::uint32_t>(packet.timestamp.tv_sec);
+		std::uint32_t current = now.load(std::memory_order_relaxed);
+		// При неудаче current получает время, записанное другим писателем
+		while (seconds > current)
+			if (now.compare_exchange_weak(current, seconds, std::memory_order_relaxed))
+				break;
+	}
+
+	/**
+	 * \brief Запоминает адреса из ответа DNS
+	 * \return False - если пакет не является ответом DNS с адресами
+	 */
+	bool addResponse(const PacketView &packet)
+	{
+		if (!isResponse(packet))
+			return false;
+
+		advance(packet);
+		std::lock_guard<std::mutex> guard(mutex);
+
+		std::uint32_t nameId = NameArena::noName;
+		bool isParsed = DnsResponseParser::parse(packet.payload, packet.payloadLength, nameBuffer, [&](const IpKey &address, std::uint32_t ttl)
+												 {
+													 if (nameId == NameArena::noName)
+														 nameId = NameArena::instance().intern(nameBuffer);
+
+													 if (nameId != NameArena::noName)
+														 insert(address, nameId, ttl); });
+
+		if (!isParsed)
+		{
+			TA_LOG_SAMPLED(debug, "Malformed DNS response from {}", packet.srcIp);
+			return false;
+		}
+
+		responses++;
+		return true;
+	}
+
+	/// \brief Возвращает номер имени адреса в NameArena, либо NameArena::noName, если имени нет или оно истекло
+	std::uint32_t lookup(const IpKey &address)
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		return find(address);
+	}
+
+	/**
+	 * \brief Поиск имен многих адресов, например всех хостов копии статистики
+	 *
+	 * Мьютекс берется один раз на batchSize адресов, а не на каждый адрес, и отпускается между пачками,
+	 * чтобы другие писатели не ждали ответов DNS дольше поиска одной пачки
+	 */
+	class Batch
+	{
+	private:
+		DnsCache &cache;
+		std::unique_lock<std::mutex> guard;
+		std::size_t lookups{0}; ///< Адреса, найденные под текущей блокировкой
+
+		static constexpr std::size_t batchSize = 1024;
+
+	public:
+		explicit Batch(DnsCache &cache) : cache(cache), guard(cache.mutex, std::defer_lock) {}
+
+		/// \brief Аналог DnsCache::lookup
+		std::uint32_t lookup(const IpKey &address)
+		{
+			if (lookups == batchSize)
+			{
+				guard.unlock();
+				lookups = 0;
+			}
+
+			if (!guard.owns_lock())
+				guard.lock();
+
+			lookups++;
+			return cache.find(address);
+		}
+	};
+
+	/// \brief Возвращает количество записей
+	std::size_t size() const
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		return entries.size();
+	}
+
+	std::uint64_t getHits() const
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		return hits;
+	}
+
+	std::uint64_t getMisses() const
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		return misses;
+	}
+
+	/// \brief Дописывает в out счетчики кэша в формате JSON
+	void writeJson(std::string &out) const
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		JsonWriter json(out);
+
+		json.beginObject();
+		json.field("entries", std::uint64_t(entries.size()));
+		json.field("capacity", std::uint64_t(config.capacity));
+		json.field("responses", responses);
+		json.field("hits", hits);
+		json.field("misses", misses);
+		json.field("evictions", evictions);
+		json.endObject();
+		out += '\n';
+	}
+};
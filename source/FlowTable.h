@@ -0,0 +1,402 @@
+#pragma once
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+
+#include <IpKey.h>
+#include <PacketView.h>
+#include <TimingWheel.h>
+
+/**
+ * \brief Ключ потока: транспортный протокол и пары адрес-порт обеих сторон
+ *
+ * Стороны упорядочены, поэтому пакеты обоих направлений имеют одинаковый ключ
+ */
+struct FlowKey
+{
+	IpKey lowIp;			   ///< Адрес меньшей стороны
+	IpKey highIp;			   ///< Адрес большей стороны
+	std::uint16_t lowPort{0};  ///< Порт меньшей стороны
+	std::uint16_t highPort{0}; ///< Порт большей стороны
+	std::uint8_t protocol{0};  ///< Номер транспортного протокола
+
+	/**
+	 * \brief Формирует ключ потока пакета
+	 * \param[out] isFromLow Пакет отправлен меньшей стороной
+	 */
+	static FlowKey fromPacket(const PacketView &packet, bool &isFromLow)
+	{
+		int order = compare(packet.srcIp, packet.dstIp);
+		isFromLow = order < 0 || (order == 0 && packet.srcPort <= packet.dstPort);
+
+		FlowKey key;
+		key.protocol = packet.transportProtocol;
+
+		if (isFromLow)
+		{
+			key.lowIp = packet.srcIp;
+			key.highIp = packet.dstIp;
+			key.lowPort = packet.srcPort;
+			key.highPort = packet.dstPort;
+		}
+		else
+		{
+			key.lowIp = packet.dstIp;
+			key.highIp = packet.srcIp;
+			key.lowPort = packet.dstPort;
+			key.highPort = packet.srcPort;
+		}
+
+		return key;
+	}
+
+	std::uint64_t hash() const
+	{
+		std::uint64_t ports = (std::uint64_t(lowPort) << 24) | (std::uint64_t(highPort) << 8) | protocol;
+		std::uint64_t value = lowIp.hash() * 31 + highIp.hash() + ports * 0x9E3779B97F4A7C15ull;
+
+		value ^= value >> 33;
+		value *= 0xFF51AFD7ED558CCDull;
+		value ^= value >> 33;
+		return value;
+	}
+
+	bool operator==(const FlowKey &other) const
+	{
+		return lowPort == other.lowPort && highPort == other.highPort && protocol == other.protocol &&
+			   lowIp == other.lowIp && highIp == other.highIp;
+	}
+
+private:
+	static int compare(const IpKey &a, const IpKey &b)
+	{
+		if (a.length != b.length)
+			return a.length < b.length ? -1 : 1;
+
+		return std::memcmp(a.bytes.data(), b.bytes.data(), a.length);
+	}
+};
+
+/// \brief Состояние TCP соединения, восстановленное по флагам пакетов
+enum class TcpState : std::uint8_t
+{
+	none,		 ///< Поток не TCP
+	synSent,	 ///< Получен SYN
+	synReceived, ///< Получен SYN+ACK
+	established, ///< Соединение установлено, либо захват начат посреди соединения
+	closing,	 ///< Одна из сторон отправила FIN
+	closed		 ///< Обе стороны отправили FIN, либо получен RST
+};
+
+/// \brief Поток пакетов с одинаковым ключом
+struct Flow
+{
+	FlowKey key;
+	std::uint64_t packets{0};
+	std::uint64_t bytes{0};
+	std::int64_t firstSeen{0}; ///< Время первого пакета (в нс)
+	std::int64_t lastSeen{0};  ///< Время последнего пакета (в нс)
+	std::uint32_t owner{0};	   ///< Номер записи владельца потока (например, хоста в HostTable)
+	TcpState state{TcpState::none};
+	std::uint8_t finFlags{0};	   ///< Стороны, отправившие FIN: 1 - меньшая, 2 - большая
+	bool isInitiatorLow{false};	   ///< Первый пакет потока отправлен меньшей стороной
+};
+
+/// \brief Параметры таблицы потоков
+struct FlowTableConfig
+{
+	std::size_t capacity{1 << 20};			  ///< Максимальное количество одновременно отслеживаемых потоков, 0 - не отслеживать потоки
+	std::chrono::seconds idleTimeout{120};	  ///< Через сколько секунд без пакетов поток считается завершенным
+	std::chrono::seconds closedTimeout{10};	  ///< То же для закрытых TCP соединений
+};
+
+/**
+ * \brief Таблица потоков фиксированной вместимости с вытеснением неактивных потоков
+ *
+ * Потоки хранятся в массиве под постоянными номерами, освобожденные номера переиспользуются
+ * через список свободных. Поиск выполняется по хэш-таблице с открытой адресацией,
+ * а неактивные потоки находит иерархическое колесо таймеров: у каждого потока один таймер,
+ * который при срабатывании переставляется на новый срок, если по потоку шли пакеты.
+ * Поэтому обработка пакета и вытеснение стоят O(1) без периодического просмотра всей таблицы.
+ * Время берется из временных меток пакетов, что одинаково работает при захвате и воспроизведении
+ */
+class FlowTable
+{
+private:
+	/// \brief Ячейка индексной части таблицы
+	struct Slot
+	{
+		std::uint32_t index{0}; ///< Номер потока + 1, ноль означает пустую ячейку
+		std::uint32_t hash{0};	///< Старшие биты хэша ключа
+	};
+
+	static constexpr std::int64_t tickLength = 1000000000; ///< Длина тика колеса таймеров (в нс)
+	static constexpr std::size_t initialCapacity = 1024;
+
+	FlowTableConfig config;
+	std::vector<Flow> flows;			   ///< Потоки по номерам, включая свободные
+	std::vector<std::uint32_t> freeFlows;  ///< Свободные номера потоков
+	std::vector<Slot> slots;			   ///< Индексная часть, размер всегда степень двойки
+	TimingWheel wheel;					   ///< Таймеры неактивности потоков
+	std::size_t activeFlows{0};
+	std::uint64_t droppedFlows{0}; ///< Сколько новых потоков не поместилось в таблицу
+
+	static std::uint32_t tagOf(std::uint64_t hash) { return static_cast<std::uint32_t>(hash >> 32); }
+
+	static std::int64_t toNanoseconds(const timespec &timestamp)
+	{
+		return std::int64_t(timestamp.tv_sec) * 1000000000 + timestamp.tv_nsec;
+	}
+
+	/// \brief Тик, на котором истечет срок неактивности потока
+	std::uint64_t expirationTick(const Flow &flow) const
+	{
+		auto timeout = flow.state == TcpState::closed ? config.closedTimeout : config.idleTimeout;
+		std::int64_t expiresAt = flow.lastSeen + std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+		return expiresAt > 0 ? static_cast<std::uint64_t>(expiresAt / tickLength) : 0;
+	}
+
+	std::size_t probe(const FlowKey &key, std::uint64_t hash) const
+	{
+		std::size_t mask = slots.size() - 1;
+		std::size_t pos = hash & mask;
+		std::uint32_t tag = tagOf(hash);
+
+		while (slots[pos].index)
+		{
+			if (slots[pos].hash == tag && flows[slots[pos].index - 1].key == key)
+				break;
+
+			pos = (pos + 1) & mask;
+		}
+
+		return pos;
+	}
+
+	/// \brief Увеличивает индексную часть вдвое, если она заполнена более чем наполовину
+	void reserveSlot()
+	{
+		if ((activeFlows + 1) * 2 <= slots.size())
+			return;
+
+		std::vector<Slot> newSlots(slots.empty() ? initialCapacity : slots.size() * 2);
+		std::size_t mask = newSlots.size() - 1;
+
+		for (const Slot &slot : slots)
+		{
+			if (!slot.index)
+				continue;
+
+			std::size_t pos = flows[slot.index - 1].key.hash() & mask;
+			while (newSlots[pos].index)
+				pos = (pos + 1) & mask;
+
+			newSlots[pos] = slot;
+		}
+
+		slots.swap(newSlots);
+	}
+
+	/// \brief Освобождает ячейку pos, сдвигая назад ячейки, которые без неё стали бы недостижимы
+	void eraseSlot(std::size_t pos)
+	{
+		std::size_t mask = slots.size() - 1;
+		std::size_t next = pos;
+
+		while (true)
+		{
+			next = (next + 1) & mask;
+			if (!slots[next].index)
+				break;
+
+			std::size_t home = flows[slots[next].index - 1].key.hash() & mask;
+			bool isReachable = pos <= next ? (pos < home && home <= next) : (pos < home || home <= next);
+			if (isReachable)
+				continue;
+
+			slots[pos] = slots[next];
+			pos = next;
+		}
+
+		slots[pos] = Slot();
+	}
+
+	/// \brief Выделяет номер для нового потока, либо возвращает false если таблица заполнена
+	bool allocate(std::uint32_t &id)
+	{
+		if (!freeFlows.empty())
+		{
+			id = freeFlows.back();
+			freeFlows.pop_back();
+			return true;
+		}
+
+		if (flows.size() >= config.capacity)
+			return false;
+
+		id = static_cast<std::uint32_t>(flows.size());
+		flows.emplace_back();
+		wheel.resize(flows.size());
+		return true;
+	}
+
+	static void updateTcpState(Flow &flow, std::uint8_t tcpFlags, bool isFromLow)
+	{
+		constexpr std::uint8_t fin = 0x01, syn = 0x02, rst = 0x04, ack = 0x10;
+
+		if (tcpFlags & rst)
+		{
+			flow.state = TcpState::closed;
+			return;
+		}
+
+		if (tcpFlags & fin)
+		{
+			flow.finFlags |= isFromLow ? 1 : 2;
+			flow.state = flow.finFlags == 3 ? TcpState::closed : TcpState::closing;
+			return;
+		}
+
+		switch (flow.state)
+		{
+		case TcpState::none:
+			flow.state = (tcpFlags & syn) ? ((tcpFlags & ack) ? TcpState::synReceived : TcpState::synSent) : TcpState::established;
+			break;
+		case TcpState::synSent:
+			if ((tcpFlags & (syn | ack)) == (syn | ack))
+				flow.state = TcpState::synReceived;
+			break;
+		case TcpState::synReceived:
+			if ((tcpFlags & (syn | ack)) == ack)
+				flow.state = TcpState::established;
+			break;
+		default:
+			break;
+		}
+	}
+
+public:
+	explicit FlowTable(const FlowTableConfig &config = FlowTableConfig()) : config(config) {}
+
+	/**
+	 * \brief Вытесняет потоки, неактивные к моменту now, и вызывает onExpired(const Flow &) для каждого
+	 *
+	 * Поток, по которому после постановки таймера шли пакеты, получает новый таймер
+	 */
+	template <class OnExpired>
+	void advance(const timespec &now, OnExpired &&onExpired)
+	{
+		std::int64_t nowNs = toNanoseconds(now);
+		std::uint64_t tick = nowNs > 0 ? static_cast<std::uint64_t>(nowNs / tickLength) : 0;
+
+		wheel.advance(tick, [this, &onExpired](std::uint32_t id)
+					  {
+						  Flow &flow = flows[id];
+						  std::uint64_t expiresAt = expirationTick(flow);
+
+						  if (expiresAt > wheel.now())
+						  {
+							  wheel.schedule(id, expiresAt);
+							  return;
+						  }
+
+						  onExpired(static_cast<const Flow &>(flow));
+
+						  eraseSlot(probe(flow.key, flow.key.hash()));
+						  freeFlows.push_back(id);
+						  activeFlows--; });
+	}
+
+	/**
+	 * \brief Учитывает пакет в его потоке, создавая поток при необходимости
+	 * \param[in] owner Номер владельца, который запоминается в новом потоке
+	 * \param[out] isNew Поток создан этим пакетом
+	 * \return Поток пакета, либо nullptr если таблица заполнена
+	 */
+	Flow *update(const PacketView &packet, std::uint32_t owner, bool &isNew)
+	{
+		isNew = false;
+		if (!config.capacity)
+			return nullptr;
+
+		bool isFromLow = false;
+		FlowKey key = FlowKey::fromPacket(packet, isFromLow);
+		std::uint64_t hash = key.hash();
+		std::int64_t timestamp = toNanoseconds(packet.timestamp);
+
+		reserveSlot();
+		std::size_t pos = probe(key, hash);
+
+		if (!slots[pos].index)
+		{
+			std::uint32_t id = 0;
+			if (!allocate(id))
+			{
+				droppedFlows++;
+				return nullptr;
+			}
+
+			Flow &flow = flows[id];
+			flow = Flow();
+			flow.key = key;
+			flow.firstSeen = timestamp;
+			flow.lastSeen = timestamp;
+			flow.owner = owner;
+			flow.isInitiatorLow = isFromLow;
+
+			slots[pos] = {id + 1, tagOf(hash)};
+			activeFlows++;
+			isNew = true;
+
+			wheel.schedule(id, expirationTick(flow));
+		}
+
+		std::uint32_t id = slots[pos].index - 1;
+		Flow &flow = flows[id];
+		flow.packets++;
+		flow.bytes += packet.length;
+		flow.lastSeen = std::max(flow.lastSeen, timestamp);
+
+		if (packet.isTcp() && flow.state != TcpState::closed)
+		{
+			updateTcpState(flow, packet.tcpFlags, isFromLow);
+
+			// Срок закрытого соединения короче, поэтому таймер нужно перенести на более ранний тик
+			if (flow.state == TcpState::closed)
+				wheel.schedule(id, std::min(wheel.deadlineOf(id), expirationTick(flow)));
+		}
+
+		return &flow;
+	}
+
+	/// \brief Возвращает поток с ключом key, либо nullptr
+	const Flow *find(const FlowKey &key) const
+	{
+		if (slots.empty())
+			return nullptr;
+
+		std::size_t pos = probe(key, key.hash());
+		return slots[pos].index ? &flows[slots[pos].index - 1] : nullptr;
+	}
+
+	/// \brief Возвращает количество отслеживаемых потоков
+	std::size_t size() const { return activeFlows; }
+
+	/// \brief Возвращает количество новых потоков, не поместившихся в таблицу
+	std::uint64_t getDroppedFlows() const { return droppedFlows; }
+
+	/// \brief Удаляет все потоки без вызова обработчика вытеснения
+	void clear()
+	{
+		flows.clear();
+		freeFlows.clear();
+		slots.clear();
+		wheel.clear();
+		wheel.resize(0);
+		activeFlows = 0;
+	}
+};
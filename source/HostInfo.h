@@ -1,30 +1,88 @@
 #pragma once
-#include <string>
+#include <string_view>
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
 
-/// \brief Структура, хранящая статистику отдельного хоста
-struct HostInfo
+#include <NameArena.h>
+
+/**
+ * \brief Структура, хранящая статистику отдельного хоста
+ *
+ * Хранит только данные, нужные при учете каждого пакета, и занимает одну кэш-линию: учет пакета
+ * затрагивает одну линию, а редкие данные хоста лежат отдельно (см. HostMeta). Имя хранится
+ * в NameArena, поэтому запись тривиально копируется
+ */
+struct alignas(64) HostInfo
 {
-	unsigned int inPackets{0};	///< Количество входящих пакетов
-	unsigned int outPackets{0}; ///< Количество исходящих пакетов
-	unsigned int inTraffic{0};	///< Входящий трафик
-	unsigned int outTraffic{0}; ///< Исходяший трафик
-	std::string name;			///< Имя хоста
+	std::uint64_t inPackets{0};	 ///< Количество входящих пакетов
+	std::uint64_t outPackets{0}; ///< Количество исходящих пакетов
+	std::uint64_t inTraffic{0};	 ///< Входящий трафик
+	std::uint64_t outTraffic{0}; ///< Исходяший трафик
+	std::uint64_t generation{0}; ///< Поколение статистики, в котором хост изменялся последний раз
+	std::uint32_t nameId{NameArena::noName}; ///< Номер имени хоста в NameArena
+	std::uint32_t activeFlows{0};	 ///< Количество отслеживаемых потоков хоста
+	std::uint32_t completedFlows{0}; ///< Количество завершенных потоков хоста (вытесненных из таблицы потоков)
+	std::uint32_t storeIndex{notStored}; ///< Номер записи хоста в HostStore
+	std::uint8_t nameLookups{0}; ///< Количество полных разборов пакетов, выполненных для поиска имени хоста
+	std::uint32_t sampledPackets{0}; ///< Сколько пакетов хоста учтено выборочно, с весом больше 1
+
+	static constexpr std::uint32_t notStored = UINT32_MAX; ///< Хост не сохраняется в файл
+
+	bool hasName() const { return nameId != NameArena::noName; }
+
+	/// \brief Возвращает имя хоста, пустое если имя не определено
+	std::string_view getName() const { return NameArena::instance().view(nameId); }
 
 	/**
+	 * \brief Учитывает пакет без ветвления: направление пакетов в трафике плохо предсказывается
 	 * \param[in] size Размер пакета
 	 * \param[in] isInPacket Является ли пакет входящим
+	 * \param[in] weight Сколько пакетов представляет пакет при выборочном учете
 	 */
-	void addPacket(int size, bool isInPacket)
+	void addPacket(std::uint32_t size, bool isInPacket, std::uint32_t weight = 1)
+	{
+		std::uint64_t inMask = 0 - static_cast<std::uint64_t>(isInPacket);
+		std::uint64_t bytes = std::uint64_t(size) * weight;
+
+		inPackets += weight & inMask;
+		outPackets += weight & ~inMask;
+		inTraffic += bytes & inMask;
+		outTraffic += bytes & ~inMask;
+		sampledPackets += weight > 1;
+	}
+
+	/// \brief Добавляет к статистике хоста данные other
+	void merge(const HostInfo &other)
+	{
+		inPackets += other.inPackets;
+		outPackets += other.outPackets;
+		inTraffic += other.inTraffic;
+		outTraffic += other.outTraffic;
+
+		activeFlows += other.activeFlows;
+		completedFlows += other.completedFlows;
+		sampledPackets += other.sampledPackets;
+
+		if (!hasName())
+			nameId = other.nameId;
+
+		generation = std::max(generation, other.generation);
+	}
+};
+
+static_assert(std::is_trivially_copyable_v<HostInfo>, "HostInfo is copied into snapshots and merged shards as a plain record");
+static_assert(sizeof(HostInfo) == 64, "HostInfo must fit exactly one cache line");
+
+/// \brief Редко используемые данные хоста, хранятся отдельно от счетчиков HostInfo
+struct HostMeta
+{
+	std::int64_t firstSeen{0}; ///< Время первого пакета хоста (в сек по временной метке пакета)
+
+	/// \brief Добавляет данные другого экземпляра того же хоста
+	void merge(const HostMeta &other)
 	{
-		if (isInPacket)
-		{
-			inPackets++;
-			inTraffic += size;
-		}
-		else
-		{
-			outPackets++;
-			outTraffic += size;
-		}
+		if (!firstSeen || (other.firstSeen && other.firstSeen < firstSeen))
+			firstSeen = other.firstSeen;
 	}
-};
\ No newline at end of file
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <cstring>
+
+#include <RawPacket.h>
+#include <Packet.h>
+#include <HttpLayer.h>
+#include <SSLLayer.h>
+
+#include <HostInfo.h>
+#include <NameArena.h>
+#include <PacketView.h>
+#include <PerfCounters.h>
+#include <AsyncLog.h>
+
+/**
+ * \brief Определение имени хоста по HTTP заголовку Host или TLS расширению SNI
+ *
+ * Полный разбор пакета через pcpp::Packet выполняется, только если хост ещё не имеет имени,
+ * а данные пакета похожи на HTTP запрос или TLS ClientHello
+ */
+class HostNameDetector
+{
+public:
+	static constexpr std::uint8_t maxNameLookups = 16; ///< Сколько раз разбирать пакеты безымянного хоста в поисках имени
+
+	/// \brief Проверяет, похожи ли данные TCP пакета на HTTP запрос или TLS ClientHello
+	static bool mayContainHostName(const PacketView &packet)
+	{
+		if (!packet.isTcp() || packet.payloadLength < 6)
+			return false;
+
+		const std::uint8_t *payload = packet.payload;
+
+		// TLS handshake record, содержащий ClientHello
+		if (payload[0] == 0x16 && payload[1] == 0x03 && payload[5] == 0x01)
+			return true;
+
+		static const char *httpMethods[] = {"GET ", "POST", "PUT ", "HEAD", "DELE", "OPTI", "PATC", "CONN", "TRAC"};
+		for (const char *method : httpMethods)
+			if (std::memcmp(payload, method, 4) == 0)
+				return true;
+
+		return false;
+	}
+
+	/// \brief Ищет имя хоста в HTTP заголовке Host или в TLS расширении SNI, найденное имя добавляется в NameArena
+	static void detectHostName(const pcpp::Packet &packet, HostInfo &hostInfo)
+	{
+		if (auto *httpRequestLayer = packet.getLayerOfType<pcpp::HttpRequestLayer>())
+		{
+			if (auto *hostField = httpRequestLayer->getFieldByName(PCPP_HTTP_HOST_FIELD))
+			{
+				std::string name = hostField->getFieldValue();
+				hostInfo.nameId = NameArena::instance().intern(name);
+				TA_LOG_ASYNC(info, "HTTP host name detected: {}", name);
+			}
+		}
+		else if (auto *sslHadshakeLayer = packet.getLayerOfType<pcpp::SSLHandshakeLayer>())
+		{
+			if (auto *clientHelloMessage = sslHadshakeLayer->getHandshakeMessageOfType<pcpp::SSLClientHelloMessage>())
+			{
+				if (auto *sniExt = clientHelloMessage->getExtensionOfType<pcpp::SSLServerNameIndicationExtension>())
+				{
+					std::string name = sniExt->getHostName();
+					hostInfo.nameId = NameArena::instance().intern(name);
+					TA_LOG_ASYNC(info, "HTTPS host name detected: {}", name);
+				}
+			}
+		}
+	}
+
+	/// \brief Определяет имя безымянного хоста по пакету, если пакет может его содержать
+	static void update(const PacketView &packet, HostInfo &hostInfo)
+	{
+		if (hostInfo.hasName() || hostInfo.nameLookups >= maxNameLookups || !mayContainHostName(packet))
+			return;
+
+		hostInfo.nameLookups++;
+		TA_PERF_SCOPE(names);
+
+		if (packet.parsedPacket)
+			detectHostName(*packet.parsedPacket, hostInfo);
+		else
+		{
+			pcpp::RawPacket rawPacket(packet.data, packet.length, packet.timestamp, false, packet.linkType);
+			detectHostName(pcpp::Packet(&rawPacket), hostInfo);
+		}
+	}
+};
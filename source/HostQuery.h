@@ -0,0 +1,291 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <sstream>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <string_view>
+
+#include <fnmatch.h>
+
+#include <IpKey.h>
+#include <HostInfo.h>
+#include <NameArena.h>
+#include <JsonWriter.h>
+#include <LocalAddressSet.h>
+#include <ITrafficStats.h>
+
+/// \brief Параметры выборки наиболее активных хостов из статистики
+struct HostQuery
+{
+	/// \brief Величина, по убыванию которой упорядочиваются хосты
+	enum class SortKey
+	{
+		bytes,	 ///< Весь трафик
+		packets, ///< Все пакеты
+		in,		 ///< Входящий трафик
+		out,	 ///< Исходящий трафик
+	};
+
+	SortKey sortKey{SortKey::bytes};
+	std::size_t limit{0};			 ///< Сколько хостов вернуть, 0 - все подходящие
+	std::uint64_t sinceGeneration{0}; ///< Возвращать только хосты, изменённые после этого поколения, 0 - все
+	std::string filter;				 ///< Фильтр в исходном виде, пустой - все хосты
+
+	LocalAddressSet networks; ///< Сети фильтра, если фильтр задан адресом или сетью
+	std::string namePattern;  ///< Шаблон имени фильтра (как в shell: *, ?, [...]), если фильтр задан шаблоном
+
+	/// \brief Разбирает имя величины: bytes, packets, in или out
+	/// \return False - если имя неизвестно
+	static bool parseSortKey(std::string_view name, SortKey &key)
+	{
+		static constexpr std::pair<std::string_view, SortKey> names[] = {
+			{"bytes", SortKey::bytes}, {"packets", SortKey::packets}, {"in", SortKey::in}, {"out", SortKey::out}};
+
+		for (const auto &[keyName, value] : names)
+			if (keyName == name)
+			{
+				key = value;
+				return true;
+			}
+
+		return false;
+	}
+
+	static std::string_view sortKeyName(SortKey key)
+	{
+		static constexpr std::string_view names[] = {"bytes", "packets", "in", "out"};
+		return names[static_cast<int>(key)];
+	}
+
+	/**
+	 * \brief Задает фильтр: адрес или сеть в нотации CIDR, либо шаблон имени хоста
+	 *
+	 * Шаблону соответствуют хосты, у которых имя или строковый адрес подходят под шаблон,
+	 * так что "*.example.com" отбирает хосты по имени, а "10.1.*" - по адресу
+	 * \param[out] errorInfo В случае ошибки, сюда будет записана причина
+	 */
+	bool setFilter(const std::string &value, std::string &errorInfo)
+	{
+		filter = value;
+		networks = LocalAddressSet();
+		namePattern.clear();
+
+		if (value.empty())
+			return true;
+
+		if (!IpKey::fromString(value.substr(0, value.find('/'))).empty())
+		{
+			if (networks.addNetwork(value, errorInfo))
+				return true;
+
+			errorInfo = "HostQuery: wrong filter '" + value + "': " + errorInfo;
+			return false;
+		}
+
+		if (value.find('/') != std::string::npos)
+		{
+			errorInfo = "HostQuery: filter '" + value + "' is neither a network nor a host name pattern";
+			return false;
+		}
+
+		namePattern = value;
+		return true;
+	}
+
+	/// \brief Проверяет, подходит ли хост под фильтр
+	bool matches(const IpKey &host, std::string_view name) const
+	{
+		if (!networks.empty())
+			return networks.contains(host);
+
+		if (namePattern.empty())
+			return true;
+
+		if (!name.empty() && fnmatch(namePattern.c_str(), std::string(name).c_str(), 0) == 0)
+			return true;
+
+		char ipBuffer[IpKey::maxStringLength];
+		host.format(ipBuffer);
+		return fnmatch(namePattern.c_str(), ipBuffer, 0) == 0;
+	}
+};
+
+/**
+ * \brief Результат выборки HostQuery: подходящие хосты копии статистики по убыванию выбранной величины
+ *
+ * Хосты собираются одним обходом копии. При ограничении limit набранные строки время от времени
+ * урезаются до limit лучших через nth_element, поэтому память растет с limit, а не с числом хостов,
+ * а полностью упорядочиваются только возвращаемые строки (partial_sort)
+ */
+class HostQueryResult : private IHostVisitor
+{
+public:
+	/// \brief Хост в результате выборки
+	struct Row
+	{
+		IpKey host;
+		std::uint32_t nameId{NameArena::noName};
+		std::uint32_t activeFlows{0};
+		std::uint32_t completedFlows{0};
+		std::uint64_t inPackets{0};
+		std::uint64_t outPackets{0};
+		std::uint64_t inTraffic{0};
+		std::uint64_t outTraffic{0};
+	};
+
+private:
+	const HostQuery *query{nullptr};
+	std::vector<Row> rows;
+	std::size_t matched{0};
+	std::uint64_t generation{0};
+
+	std::uint64_t valueOf(const Row &row) const
+	{
+		switch (query->sortKey)
+		{
+		case HostQuery::SortKey::packets:
+			return row.inPackets + row.outPackets;
+		case HostQuery::SortKey::in:
+			return row.inTraffic;
+		case HostQuery::SortKey::out:
+			return row.outTraffic;
+		default:
+			return row.inTraffic + row.outTraffic;
+		}
+	}
+
+	/// \brief Порядок строк: по убыванию величины, при равенстве - по адресу, чтобы строки не менялись местами между выборками
+	bool isBefore(const Row &left, const Row &right) const
+	{
+		std::uint64_t leftValue = valueOf(left), rightValue = valueOf(right);
+		if (leftValue != rightValue)
+			return leftValue > rightValue;
+
+		if (left.host.length != right.host.length)
+			return left.host.length < right.host.length;
+
+		return std::memcmp(left.host.bytes.data(), right.host.bytes.data(), left.host.length) < 0;
+	}
+
+	/// \brief Оставляет limit лучших строк
+	void truncate()
+	{
+		std::nth_element(rows.begin(), rows.begin() + query->limit, rows.end(), [this](const Row &left, const Row &right)
+						 { return isBefore(left, right); });
+		rows.resize(query->limit);
+	}
+
+	void onHost(const IpKey &host, const HostInfo &hostInfo, std::uint32_t nameId) override
+	{
+		if (query->sinceGeneration && hostInfo.generation <= query->sinceGeneration)
+			return;
+
+		if (!query->matches(host, NameArena::instance().view(nameId)))
+			return;
+
+		matched++;
+		rows.push_back({host, nameId, hostInfo.activeFlows, hostInfo.completedFlows,
+						hostInfo.inPackets, hostInfo.outPackets, hostInfo.inTraffic, hostInfo.outTraffic});
+
+		if (query->limit && rows.size() >= query->limit * 2)
+			truncate();
+	}
+
+public:
+	/// \brief Выполняет выборку по копии статистики snapshot, предыдущий результат заменяется
+	void run(const ITrafficStats &snapshot, const HostQuery &hostQuery)
+	{
+		query = &hostQuery;
+		rows.clear();
+		matched = 0;
+		generation = snapshot.getGeneration();
+
+		snapshot.visitHosts(*this);
+
+		if (query->limit && rows.size() > query->limit)
+			truncate();
+
+		std::sort(rows.begin(), rows.end(), [this](const Row &left, const Row &right)
+				  { return isBefore(left, right); });
+	}
+
+	/// \brief Возвращает выбранные хосты по порядку
+	const std::vector<Row> &getRows() const { return rows; }
+
+	/// \brief Возвращает количество хостов, подошедших под фильтр, включая не вошедшие в limit
+	std::size_t getMatched() const { return matched; }
+
+	/**
+	 * \brief Дописывает результат в формате JSON в конец буфера out
+	 *
+	 * Документ имеет вид {"generation":N,"sort":"bytes","matched":M,"hosts":[...]}, хосты выводятся
+	 * с теми же полями счетчиков, что и в ITrafficStats::writeJson
+	 */
+	void writeJson(std::string &out) const
+	{
+		char ipBuffer[IpKey::maxStringLength];
+		JsonWriter json(out);
+
+		json.beginObject();
+		json.field("generation", generation);
+		json.field("sort", HostQuery::sortKeyName(query ? query->sortKey : HostQuery::SortKey::bytes));
+		json.field("matched", std::uint64_t(matched));
+		json.key("hosts").beginArray();
+
+		for (const auto &row : rows)
+		{
+			json.beginObject();
+			json.field("ip", std::string_view(ipBuffer, row.host.format(ipBuffer)));
+			json.field("name", NameArena::instance().view(row.nameId));
+
+			json.key("packets").beginObject();
+			json.field("in", row.inPackets);
+			json.field("out", row.outPackets);
+			json.field("total", row.outPackets + row.inPackets);
+			json.endObject();
+
+			json.key("traffic").beginObject();
+			json.field("in", row.inTraffic);
+			json.field("out", row.outTraffic);
+			json.field("total", row.outTraffic + row.inTraffic);
+			json.endObject();
+
+			json.key("flows").beginObject();
+			json.field("active", row.activeFlows);
+			json.field("completed", row.completedFlows);
+			json.endObject();
+
+			json.endObject();
+		}
+
+		json.endArray();
+		json.endObject();
+		out += '\n';
+	}
+
+	/// \brief Возвращает выбранные хосты строками в формате ITrafficStats::toString, с заголовком
+	std::string toString() const
+	{
+		std::stringstream ss;
+		ss << "Top " << rows.size() << " of " << matched << " hosts by " << HostQuery::sortKeyName(query ? query->sortKey : HostQuery::SortKey::bytes);
+		if (query && !query->filter.empty())
+			ss << " matching '" << query->filter << "'";
+		ss << std::endl;
+
+		for (const auto &row : rows)
+		{
+			ss << std::left << std::setw(37) << (row.nameId != NameArena::noName ? std::string(NameArena::instance().view(row.nameId)) : row.host.toString()) << " "
+			   << std::right << std::setw(6) << (row.inPackets + row.outPackets) << " packets (OUT "
+			   << std::left << std::setw(6) << row.outPackets << " | "
+			   << std::right << std::setw(6) << row.inPackets << " IN) traffic: "
+			   << std::right << std::setw(8) << (row.inTraffic + row.outTraffic) << " [bytes] (OUT "
+			   << std::left << std::setw(8) << row.outTraffic << " | "
+			   << std::right << std::setw(6) << row.inTraffic << " IN)" << std::endl;
+		}
+
+		return ss.str();
+	}
+};
@@ -0,0 +1,348 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <condition_variable>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <IpKey.h>
+#include <AsyncLog.h>
+
+/// \brief Параметры файла с сохраняемой статистикой хостов
+struct HostStoreConfig
+{
+	std::string path;						 ///< Путь к файлу, пустой - статистика не сохраняется
+	std::size_t capacity{1 << 18};			 ///< Количество хостов в новом файле, у существующего файла сохраняется его вместимость
+	std::chrono::seconds syncPeriod{5};		 ///< Как часто изменения сбрасываются на диск, 0 - только при закрытии
+
+	bool isEnabled() const { return !path.empty(); }
+};
+
+/// \brief Запись хоста в файле, имеет фиксированный формат и занимает две кэш-линии
+struct StoredHost
+{
+	std::uint8_t address[16];	 ///< Байты адреса в сетевом порядке
+	std::uint8_t addressLength;	 ///< 4 для IPv4, 16 для IPv6
+	std::uint8_t nameLength;	 ///< Длина имени хоста в name
+	std::uint8_t reserved[6];
+	std::uint64_t inPackets;
+	std::uint64_t outPackets;
+	std::uint64_t inTraffic;
+	std::uint64_t outTraffic;
+	std::uint64_t completedFlows;
+	char name[64]; ///< Имя хоста, более длинные имена обрезаются
+
+	static constexpr std::size_t maxNameLength = sizeof(name);
+
+	IpKey key() const
+	{
+		return addressLength == 4 ? IpKey::fromIPv4(address) : IpKey::fromIPv6(address);
+	}
+
+	/// \brief Учитывает пакет без ветвления, как HostInfo::addPacket
+	void addPacket(std::uint32_t size, bool isInPacket, std::uint32_t weight = 1)
+	{
+		std::uint64_t inMask = 0 - static_cast<std::uint64_t>(isInPacket);
+		std::uint64_t bytes = std::uint64_t(size) * weight;
+
+		inPackets += weight & inMask;
+		outPackets += weight & ~inMask;
+		inTraffic += bytes & inMask;
+		outTraffic += bytes & ~inMask;
+	}
+
+	void setName(std::string_view value)
+	{
+		nameLength = static_cast<std::uint8_t>(std::min(value.size(), maxNameLength));
+		std::memcpy(name, value.data(), nameLength);
+	}
+};
+
+static_assert(sizeof(StoredHost) == 128, "StoredHost layout is a part of the file format");
+
+/**
+ * \brief Таблица хостов в отображенном в память файле, переживающая перезапуск программы
+ *
+ * Файл состоит из заголовка, индексной части хэш-таблицы с открытой адресацией и массива
+ * записей StoredHost. Индексная часть хранится в файле, поэтому при открытии ничего не
+ * перестраивается: проверяются только заголовок и размер файла. Отображение разделяемое,
+ * так что записанное остается в страничном кэше и при аварийном завершении процесса,
+ * а на диск страницы сбрасывает фоновый поток вызовом msync, а не поток захвата.
+ *
+ * Записи добавляет и изменяет один поток (писатель статистики)
+ */
+class HostStore
+{
+private:
+	/// \brief Заголовок файла
+	struct Header
+	{
+		char magic[8];				///< "TAHOSTS\0"
+		std::uint32_t version;
+		std::uint32_t recordSize;	///< sizeof(StoredHost)
+		std::uint64_t capacity;		///< Количество записей
+		std::uint64_t slotsCount;	///< Размер индексной части, степень двойки
+		std::uint64_t count;		///< Количество занятых записей
+	};
+
+	static constexpr char magic[8] = {'T', 'A', 'H', 'O', 'S', 'T', 'S', '\0'};
+	static constexpr std::uint32_t version = 1;
+	static constexpr std::size_t headerSize = 4096; ///< Заголовок занимает страницу, чтобы индекс и записи были выровнены
+
+	int fd{-1};
+	std::uint8_t *mapping{nullptr};
+	std::size_t mappingSize{0};
+
+	Header *header{nullptr};
+	std::uint32_t *slots{nullptr}; ///< Номер записи + 1, ноль означает пустую ячейку
+	StoredHost *records{nullptr};
+
+	std::thread flusher;
+	std::mutex flusherMutex;
+	std::condition_variable flusherWakeup;
+	bool isStopping{false};
+
+	static std::size_t fileSize(std::uint64_t capacity, std::uint64_t slotsCount)
+	{
+		return headerSize + slotsCount * sizeof(std::uint32_t) + capacity * sizeof(StoredHost);
+	}
+
+	static std::uint64_t slotsFor(std::uint64_t capacity)
+	{
+		std::uint64_t result = 64;
+		while (result < capacity * 2)
+			result *= 2;
+
+		return result;
+	}
+
+	bool fail(const std::string &reason, const std::string &path, std::string &errorInfo)
+	{
+		errorInfo = "HostStore: " + reason + " '" + path + "'";
+		close();
+		return false;
+	}
+
+	bool map(std::size_t size)
+	{
+		void *address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (address == MAP_FAILED)
+			return false;
+
+		mapping = static_cast<std::uint8_t *>(address);
+		mappingSize = size;
+		header = reinterpret_cast<Header *>(mapping);
+		slots = reinterpret_cast<std::uint32_t *>(mapping + headerSize);
+		records = reinterpret_cast<StoredHost *>(mapping + headerSize + header->slotsCount * sizeof(std::uint32_t));
+		return true;
+	}
+
+	/// \brief Проверяет заголовок существующего файла
+	bool isValid(const Header &fileHeader, std::size_t size) const
+	{
+		return std::memcmp(fileHeader.magic, magic, sizeof(magic)) == 0 &&
+			   fileHeader.version == version &&
+			   fileHeader.recordSize == sizeof(StoredHost) &&
+			   fileHeader.capacity > 0 &&
+			   fileHeader.slotsCount >= fileHeader.capacity * 2 &&
+			   (fileHeader.slotsCount & (fileHeader.slotsCount - 1)) == 0 &&
+			   fileHeader.count <= fileHeader.capacity &&
+			   size == fileSize(fileHeader.capacity, fileHeader.slotsCount);
+	}
+
+	/// \brief Проверяет, что индекс отображенного файла ссылается только на занятые записи
+	bool isIndexValid() const
+	{
+		for (std::uint64_t pos = 0; pos < header->slotsCount; pos++)
+			if (slots[pos] > header->count)
+				return false;
+
+		return true;
+	}
+
+	void runFlusher(std::chrono::seconds period)
+	{
+		std::unique_lock<std::mutex> lock(flusherMutex);
+
+		while (!flusherWakeup.wait_for(lock, period, [this]
+									   { return isStopping; }))
+			flush();
+	}
+
+public:
+	static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+	HostStore() = default;
+	~HostStore() { close(); }
+
+	HostStore(const HostStore &) = delete;
+	HostStore &operator=(const HostStore &) = delete;
+
+	/**
+	 * \brief Открывает файл, либо создает его, если файла нет
+	 *
+	 * Файл с чужим или поврежденным заголовком либо индексом не изменяется, а открытие завершается ошибкой
+	 * \param[out] errorInfo В случае ошибки, сюда будет записана причина
+	 * \return True - если файл открыт
+	 */
+	bool open(const HostStoreConfig &config, std::string &errorInfo)
+	{
+		close();
+
+		fd = ::open(config.path.c_str(), O_RDWR | O_CREAT, 0644);
+		if (fd < 0)
+			return fail("cannot open file", config.path, errorInfo);
+
+		struct stat fileStat;
+		if (fstat(fd, &fileStat) != 0)
+			return fail("cannot stat file", config.path, errorInfo);
+
+		if (fileStat.st_size == 0)
+		{
+			std::uint64_t capacity = std::max<std::size_t>(config.capacity, 1);
+			std::uint64_t slotsCount = slotsFor(capacity);
+
+			// Новый файл заполнен нулями, поэтому индексная часть и записи уже пустые
+			if (ftruncate(fd, fileSize(capacity, slotsCount)) != 0)
+				return fail("cannot allocate file", config.path, errorInfo);
+
+			Header fileHeader{};
+			std::memcpy(fileHeader.magic, magic, sizeof(magic));
+			fileHeader.version = version;
+			fileHeader.recordSize = sizeof(StoredHost);
+			fileHeader.capacity = capacity;
+			fileHeader.slotsCount = slotsCount;
+
+			if (pwrite(fd, &fileHeader, sizeof(fileHeader), 0) != static_cast<ssize_t>(sizeof(fileHeader)))
+				return fail("cannot write header of file", config.path, errorInfo);
+
+			fileStat.st_size = static_cast<off_t>(fileSize(capacity, slotsCount));
+		}
+		else
+		{
+			Header fileHeader{};
+			if (pread(fd, &fileHeader, sizeof(fileHeader), 0) != static_cast<ssize_t>(sizeof(fileHeader)) ||
+				!isValid(fileHeader, static_cast<std::size_t>(fileStat.st_size)))
+				return fail("wrong format of file", config.path, errorInfo);
+		}
+
+		if (!map(static_cast<std::size_t>(fileStat.st_size)))
+			return fail("cannot map file", config.path, errorInfo);
+
+		if (!isIndexValid())
+			return fail("damaged index of file", config.path, errorInfo);
+
+		if (config.syncPeriod.count() > 0)
+		{
+			isStopping = false;
+			flusher = std::thread(&HostStore::runFlusher, this, config.syncPeriod);
+		}
+
+		TA_LOG(info) << "HostStore opened '" << config.path << "': " << header->count << " of " << header->capacity << " hosts";
+		return true;
+	}
+
+	/// \brief Сбрасывает изменения на диск и закрывает файл
+	void close()
+	{
+		if (flusher.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> guard(flusherMutex);
+				isStopping = true;
+			}
+
+			flusherWakeup.notify_all();
+			flusher.join();
+		}
+
+		if (mapping)
+		{
+			flush();
+			munmap(mapping, mappingSize);
+		}
+
+		if (fd >= 0)
+			::close(fd);
+
+		fd = -1;
+		mapping = nullptr;
+		mappingSize = 0;
+		header = nullptr;
+		slots = nullptr;
+		records = nullptr;
+	}
+
+	bool isOpened() const { return mapping != nullptr; }
+
+	/// \brief Синхронно сбрасывает изменения на диск, может вызываться из любого потока
+	void flush()
+	{
+		if (mapping)
+			msync(mapping, mappingSize, MS_SYNC);
+	}
+
+	/**
+	 * \brief Возвращает номер записи хоста key, добавляя её при отсутствии
+	 * \return Номер записи, либо npos, если файл заполнен
+	 */
+	std::size_t findOrInsert(const IpKey &key)
+	{
+		std::uint64_t mask = header->slotsCount - 1;
+		std::uint64_t pos = key.hash() & mask;
+
+		while (slots[pos])
+		{
+			std::uint32_t index = slots[pos] - 1;
+			if (records[index].addressLength == key.length && std::memcmp(records[index].address, key.bytes.data(), key.length) == 0)
+				return index;
+
+			pos = (pos + 1) & mask;
+		}
+
+		if (header->count >= header->capacity)
+			return npos;
+
+		std::size_t index = header->count;
+		StoredHost &record = records[index];
+		std::memset(&record, 0, sizeof(record));
+		std::memcpy(record.address, key.bytes.data(), key.length);
+		record.addressLength = key.length;
+
+		// Ячейка публикуется после записи, чтобы при аварийном завершении не указывать на пустую запись
+		header->count = index + 1;
+		slots[pos] = static_cast<std::uint32_t>(index + 1);
+		return index;
+	}
+
+	StoredHost &at(std::size_t index) { return records[index]; }
+
+	const StoredHost &at(std::size_t index) const { return records[index]; }
+
+	/// \brief Возвращает количество записей
+	std::size_t size() const { return header ? header->count : 0; }
+
+	/// \brief Возвращает вместимость файла
+	std::size_t capacity() const { return header ? header->capacity : 0; }
+
+	/// \brief Удаляет все записи
+	void clear()
+	{
+		if (!mapping)
+			return;
+
+		std::memset(slots, 0, header->slotsCount * sizeof(std::uint32_t));
+		header->count = 0;
+	}
+};
@@ -0,0 +1,229 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include <IpKey.h>
+
+/**
+ * \brief Хэш-таблица с открытой адресацией, где ключ - бинарный IP адрес хоста
+ *
+ * Записи хранятся плотно в порядке добавления, а индексная часть таблицы содержит
+ * только номер записи и хэш ключа, поэтому поиск с линейным пробированием
+ * обходит небольшой непрерывный массив и сравнивает ключи только при совпадении хэшей.
+ * Номер записи не меняется до вызова clear(), ключ записи можно заменить через replaceKey()
+ * \tparam Value Тип значения, хранимого для каждого хоста
+ */
+template <class Value>
+class HostTable
+{
+private:
+	/// \brief Ячейка индексной части таблицы
+	struct Slot
+	{
+		std::uint32_t index{0}; ///< Номер записи + 1, ноль означает пустую ячейку
+		std::uint32_t hash{0};	///< Старшие биты хэша ключа
+	};
+
+	static constexpr std::size_t initialCapacity = 64;
+
+	std::vector<Slot> slots;   ///< Индексная часть, размер всегда степень двойки
+	std::vector<IpKey> keys;   ///< Ключи записей в порядке добавления
+	std::vector<Value> values; ///< Значения записей в порядке добавления
+
+	static std::uint32_t tagOf(std::uint64_t hash) { return static_cast<std::uint32_t>(hash >> 32); }
+
+	/// \brief Перестраивает индексную часть с размером newSize
+	void rehash(std::size_t newSize)
+	{
+		std::vector<Slot> newSlots(newSize);
+		std::size_t mask = newSlots.size() - 1;
+
+		for (std::size_t i = 0; i < keys.size(); i++)
+		{
+			std::uint64_t hash = keys[i].hash();
+			std::size_t pos = hash & mask;
+
+			while (newSlots[pos].index)
+				pos = (pos + 1) & mask;
+
+			newSlots[pos] = {static_cast<std::uint32_t>(i + 1), tagOf(hash)};
+		}
+
+		slots.swap(newSlots);
+	}
+
+	/// \brief Увеличивает индексную часть вдвое, если она заполнена более чем наполовину
+	void reserveSlot()
+	{
+		if ((keys.size() + 1) * 2 <= slots.size())
+			return;
+
+		rehash(slots.empty() ? initialCapacity : slots.size() * 2);
+	}
+
+	/// \brief Освобождает ячейку pos, сдвигая назад ячейки, которые без неё стали бы недостижимы
+	void eraseSlot(std::size_t pos)
+	{
+		std::size_t mask = slots.size() - 1;
+		std::size_t next = pos;
+
+		while (true)
+		{
+			next = (next + 1) & mask;
+			if (!slots[next].index)
+				break;
+
+			// Ячейку next можно перенести в pos, только если её исходная позиция не лежит в (pos, next]
+			std::size_t home = keys[slots[next].index - 1].hash() & mask;
+			bool isReachable = pos <= next ? (pos < home && home <= next) : (pos < home || home <= next);
+			if (isReachable)
+				continue;
+
+			slots[pos] = slots[next];
+			pos = next;
+		}
+
+		slots[pos] = Slot();
+	}
+
+	/// \brief Ищет ячейку с ключом key, либо первую пустую ячейку на пути пробирования
+	std::size_t probe(const IpKey &key, std::uint64_t hash) const
+	{
+		std::size_t mask = slots.size() - 1;
+		std::size_t pos = hash & mask;
+		std::uint32_t tag = tagOf(hash);
+
+		while (slots[pos].index)
+		{
+			if (slots[pos].hash == tag && keys[slots[pos].index - 1] == key)
+				break;
+
+			pos = (pos + 1) & mask;
+		}
+
+		return pos;
+	}
+
+public:
+	static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+	/// \brief Заранее выделяет память под count записей, чтобы таблица не перестраивалась при добавлении
+	void reserve(std::size_t count)
+	{
+		keys.reserve(count);
+		values.reserve(count);
+
+		std::size_t newSize = initialCapacity;
+		while (newSize < count * 2)
+			newSize *= 2;
+
+		if (newSize > slots.size())
+			rehash(newSize);
+	}
+
+	/// \brief Возвращает номер записи с ключом key, добавляя её при отсутствии
+	std::size_t findOrInsert(const IpKey &key)
+	{
+		reserveSlot();
+
+		std::uint64_t hash = key.hash();
+		std::size_t pos = probe(key, hash);
+
+		if (!slots[pos].index)
+		{
+			keys.push_back(key);
+			values.emplace_back();
+			slots[pos] = {static_cast<std::uint32_t>(keys.size()), tagOf(hash)};
+		}
+
+		return slots[pos].index - 1;
+	}
+
+	/// \brief Подгружает в кэш ячейку индексной части, с которой начнется поиск ключа с хэшем hash
+	void prefetchSlot(std::uint64_t hash) const
+	{
+		if (!slots.empty())
+			__builtin_prefetch(&slots[hash & (slots.size() - 1)]);
+	}
+
+	/**
+	 * \brief Подгружает в кэш ключ и значение записи из первой ячейки пробирования хэша hash
+	 *
+	 * Читает ячейку, поэтому вызывается через несколько пакетов после prefetchSlot того же хэша
+	 */
+	void prefetchEntry(std::uint64_t hash) const
+	{
+		if (slots.empty())
+			return;
+
+		std::uint32_t index = slots[hash & (slots.size() - 1)].index;
+		if (index)
+		{
+			__builtin_prefetch(&keys[index - 1]);
+			__builtin_prefetch(&values[index - 1], 1);
+		}
+	}
+
+	/// \brief Возвращает значение для ключа key, добавляя его при отсутствии
+	Value &operator[](const IpKey &key) { return values[findOrInsert(key)]; }
+
+	/// \brief Возвращает номер записи с ключом key, либо npos
+	std::size_t indexOf(const IpKey &key) const
+	{
+		if (slots.empty())
+			return npos;
+
+		std::size_t pos = probe(key, key.hash());
+		return slots[pos].index ? slots[pos].index - 1 : npos;
+	}
+
+	/// \brief Возвращает указатель на значение для ключа key, либо nullptr
+	Value *find(const IpKey &key)
+	{
+		std::size_t index = indexOf(key);
+		return index == npos ? nullptr : &values[index];
+	}
+
+	/// \brief Константная версия find
+	const Value *find(const IpKey &key) const
+	{
+		return const_cast<HostTable *>(this)->find(key);
+	}
+
+	/**
+	 * \brief Заменяет ключ записи с номером index на key, сохраняя номер и значение записи
+	 *
+	 * Ключ key не должен присутствовать в таблице
+	 */
+	void replaceKey(std::size_t index, const IpKey &key)
+	{
+		eraseSlot(probe(keys[index], keys[index].hash()));
+		keys[index] = key;
+
+		std::uint64_t hash = key.hash();
+		slots[probe(key, hash)] = {static_cast<std::uint32_t>(index + 1), tagOf(hash)};
+	}
+
+	/// \brief Возвращает ключ записи с номером index
+	const IpKey &keyAt(std::size_t index) const { return keys[index]; }
+
+	/// \brief Возвращает значение записи с номером index
+	Value &valueAt(std::size_t index) { return values[index]; }
+
+	/// \brief Константная версия valueAt
+	const Value &valueAt(std::size_t index) const { return values[index]; }
+
+	/// \brief Возвращает количество записей
+	std::size_t size() const { return keys.size(); }
+
+	bool empty() const { return keys.empty(); }
+
+	/// \brief Удаляет все записи
+	void clear()
+	{
+		slots.clear();
+		keys.clear();
+		values.clear();
+	}
+};
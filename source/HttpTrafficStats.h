@@ -2,36 +2,256 @@
 #include <iomanip>
 #include <sstream>
 #include <string>
-#include <map>
-
-#include <boost/log/trivial.hpp>
-#include <nlohmann/json.hpp>
+#include <memory>
+#include <vector>
+#include <ranges>
 
 #include <PacketUtils.h>
-#include <HttpLayer.h>
-#include <SSLLayer.h>
 #include <IPv4Layer.h>
 
 #include <ITrafficStats.h>
 #include <HostInfo.h>
+#include <HostTable.h>
+#include <HostNameDetector.h>
+#include <FlowTable.h>
+#include <AdaptiveSampler.h>
+#include <IpKey.h>
+#include <JsonWriter.h>
+#include <AsyncLog.h>
 
 /// \brief Класс, определяющий формат вывода статистики и обработку пакетов HTTP трафика
 class HttpTrafficStats : public ITrafficStats
 {
 private:
-	std::map<std::string, HostInfo> stat; ///< Словарь, где ключ это IP адрес хоста, значение объект HostInfo
+	HostTable<HostInfo> stat; ///< Таблица, где ключ это бинарный IP адрес хоста, значение объект HostInfo
+	std::vector<HostMeta> meta; ///< Редко используемые данные хостов, номер совпадает с номером записи в stat
+
+	/// \brief Потоки хостов, nullptr если потоки не отслеживаются
+	///
+	/// Копии статистики, публикуемые для читателей, потоки не отслеживают и не копируют
+	std::unique_ptr<FlowTable> flows;
+
+	/// \brief Файл, в котором сохраняются счетчики хостов, nullptr если статистика не сохраняется
+	///
+	/// Как и потоки, не копируется в публикуемые копии статистики. Пакеты учитываются только в записях
+	/// HostInfo, а записи файла получают счетчики изменённых хостов при смене поколения (syncStore)
+	std::unique_ptr<HostStore> store;
+
+	/// \brief Журналы изменённых хостов, по которым updateCopy обновляет старые копии статистики
+	///
+	/// Номер хоста попадает в журнал поколения при первом изменении хоста в этом поколении.
+	/// Копии статистики журналы не ведут
+	std::vector<std::uint32_t> changed;			///< Хосты, изменённые в текущем поколении
+	std::vector<std::uint32_t> previousChanged; ///< Хосты, изменённые в предыдущем поколении
+	std::uint64_t previousGeneration{0};		///< Поколение журнала previousChanged
+	std::uint64_t previousBase{0};				///< Поколение, предшествовавшее previousGeneration
+	bool isChangedComplete{false};				///< В changed попали все изменения текущего поколения
+	bool isPreviousComplete{false};				///< В previousChanged попали все изменения предыдущего поколения
+
+	/// \brief Помечает хост изменённым в текущем поколении
+	void markChanged(std::size_t index, HostInfo &hostInfo)
+	{
+		if (hostInfo.generation == generation)
+			return;
+
+		hostInfo.generation = generation;
+		changed.push_back(static_cast<std::uint32_t>(index));
+	}
+
+	/// \brief Копирует в target записи хостов с номерами hosts
+	void copyHosts(HttpTrafficStats &target, const std::vector<std::uint32_t> &hosts) const
+	{
+		for (std::uint32_t index : hosts)
+		{
+			target.stat.valueAt(index) = stat.valueAt(index);
+			target.meta[index] = meta[index];
+		}
+	}
+
+	/// \brief Возвращает номер записи хоста, добавляя запись и её HostMeta при отсутствии
+	std::size_t findOrInsertHost(const IpKey &host, std::int64_t firstSeen)
+	{
+		std::size_t index = stat.findOrInsert(host);
+		if (index == meta.size())
+			meta.push_back({firstSeen});
+
+		return index;
+	}
+
+	/// \brief Учитывает завершенный поток в статистике его хоста
+	void rollUpFlow(const Flow &flow)
+	{
+		auto &hostInfo = stat.valueAt(flow.owner);
+		hostInfo.activeFlows--;
+		hostInfo.completedFlows++;
+		markChanged(flow.owner, hostInfo);
+	}
+
+	/// \brief Выдает новому хосту запись в файле статистики
+	void assignStoreIndex(const IpKey &host, HostInfo &hostInfo)
+	{
+		std::size_t index = store->findOrInsert(host);
+		if (index == HostStore::npos)
+		{
+			TA_LOG_LIMITED(warning, 1, "Host store is full, {} is not stored", host);
+			return;
+		}
+
+		hostInfo.storeIndex = static_cast<std::uint32_t>(index);
+	}
+
+	/// \brief Записывает счетчики хоста в его запись в файле
+	void updateStored(const HostInfo &hostInfo)
+	{
+		StoredHost &stored = store->at(hostInfo.storeIndex);
+		stored.inPackets = hostInfo.inPackets;
+		stored.outPackets = hostInfo.outPackets;
+		stored.inTraffic = hostInfo.inTraffic;
+		stored.outTraffic = hostInfo.outTraffic;
+		stored.completedFlows = hostInfo.completedFlows;
+
+		if (!stored.nameLength && hostInfo.hasName())
+			stored.setName(hostInfo.getName());
+	}
+
+	/**
+	 * \brief Переносит в файл хосты, изменённые в текущем поколении
+	 *
+	 * Если журнал поколения неполон (после загрузки файла или очистки), переносятся все хосты
+	 */
+	void syncStore()
+	{
+		if (!store)
+			return;
+
+		if (!isChangedComplete)
+		{
+			for (std::size_t i = 0; i < stat.size(); i++)
+				if (stat.valueAt(i).storeIndex != HostInfo::notStored)
+					updateStored(stat.valueAt(i));
+
+			return;
+		}
+
+		for (std::uint32_t index : changed)
+			if (stat.valueAt(index).storeIndex != HostInfo::notStored)
+				updateStored(stat.valueAt(index));
+	}
+
+	/// \brief Дописывает погрешность выборочной оценки счетчиков хоста (95% доверительный интервал)
+	///
+	/// Погрешность трафика оценивается пропорционально погрешности количества пакетов
+	void writeEstimate(JsonWriter &json, const HostInfo &hostInfo) const
+	{
+		std::uint64_t packets = hostInfo.inPackets + hostInfo.outPackets;
+		std::uint64_t packetsError = AdaptiveSampler::packetsErrorBound(hostInfo.sampledPackets, maxSamplingRate);
+		double relativeError = packets ? double(packetsError) / packets : 0;
+
+		json.key("estimate").beginObject();
+		json.field("sampledPackets", std::uint64_t(hostInfo.sampledPackets));
+		json.field("packetsError", packetsError);
+		json.field("trafficError", static_cast<std::uint64_t>(relativeError * (hostInfo.inTraffic + hostInfo.outTraffic)));
+		json.endObject();
+	}
+
+	static constexpr std::size_t prefetchDistance = 8; ///< За сколько пакетов пачки подгружается ячейка таблицы хостов
+
+	/// \brief Записывает пакет в статистику, общая часть addPacket и addPackets
+	void record(const PacketView &packet)
+	{
+		if (packet.srcIp.empty())
+		{
+			TA_LOG_LIMITED(warning, 1, "IPLayer was nullptr");
+			return;
+		}
+
+		TA_LOG_SAMPLED(debug, "Captured packet { srcIP: {} dstIP: {} size: {} }", packet.srcIp, packet.dstIp, packet.length);
+
+		if (dnsCache)
+		{
+			if (DnsCache::isResponse(packet))
+				dnsCache->addResponse(packet);
+			else
+				dnsCache->advance(packet);
+		}
+
+		bool isInPacket = false;
+		const IpKey &host = localAddresses->remoteHostOf(packet, isInPacket);
+
+		// Пакет с нулевым весом передан только для поиска имени уже учтенного хоста:
+		// хост без учтенных пакетов не создается, а потоки пакета не учитываются
+		if (!packet.weight)
+		{
+			std::size_t index = stat.indexOf(host);
+			if (index == HostTable<HostInfo>::npos || stat.valueAt(index).hasName())
+				return;
+
+			HostNameDetector::update(packet, stat.valueAt(index));
+			markChanged(index, stat.valueAt(index));
+			return;
+		}
+
+		std::size_t hostsCount = stat.size();
+		std::size_t hostIndex = findOrInsertHost(host, packet.timestamp.tv_sec);
+
+		if (store && stat.size() != hostsCount)
+			assignStoreIndex(host, stat.valueAt(hostIndex));
+
+		if (flows)
+		{
+			flows->advance(packet.timestamp, [this](const Flow &flow)
+						   { rollUpFlow(flow); });
+
+			bool isNewFlow = false;
+			if (!flows->update(packet, static_cast<std::uint32_t>(hostIndex), isNewFlow))
+			{
+				std::uint64_t dropped = flows->getDroppedFlows();
+				if ((dropped & (dropped - 1)) == 0)
+					TA_LOG_ASYNC(warning, "Flow table is full, {} flows were not tracked", dropped);
+			}
+			else if (isNewFlow)
+				stat.valueAt(hostIndex).activeFlows++;
+		}
+
+		auto &hostInfo = stat.valueAt(hostIndex);
+		hostInfo.addPacket(packet.length, isInPacket, packet.weight);
+		markChanged(hostIndex, hostInfo);
+
+		HostNameDetector::update(packet, hostInfo);
+	}
 
 public:
-	HttpTrafficStats(const std::string &interfaceIpAddr) : ITrafficStats(interfaceIpAddr) {}
+	/// \param[in] interfaceIpAddr IP-адрес интерфейса, относительно которого определяется направление пакетов
+	/// \param[in] flowConfig Параметры таблицы потоков, при нулевой вместимости потоки не отслеживаются
+	HttpTrafficStats(const std::string &interfaceIpAddr, const FlowTableConfig &flowConfig = FlowTableConfig())
+		: ITrafficStats(interfaceIpAddr)
+	{
+		if (flowConfig.capacity)
+			flows = std::make_unique<FlowTable>(flowConfig);
+	}
+
+	/// \brief Копирует статистику хостов без таблицы потоков
+	HttpTrafficStats(const HttpTrafficStats &other)
+		: ITrafficStats(other),
+		  stat(other.stat),
+		  meta(other.meta) {}
+
+	/// \brief Перемещает статистику вместе с таблицей потоков и файлом статистики
+	HttpTrafficStats(HttpTrafficStats &&other) = default;
+
+	std::string_view name() const override { return "hosts"; }
 
 	/// \brief Возвращает статистику об обработанных пакетах в виде строки
-	std::string toString() override
+	std::string toString() const override
 	{
 		std::stringstream ss;
 
-		for (const auto &[ip, hostInfo] : stat)
+		for (std::size_t i = 0; i < stat.size(); i++)
 		{
-			ss << std::left << std::setw(37) << (hostInfo.name.empty() ? ip.c_str() : hostInfo.name.c_str()) << " "
+			const auto &hostInfo = stat.valueAt(i);
+			std::uint32_t nameId = hostInfo.nameId;
+
+			ss << std::left << std::setw(37) << (nameId != NameArena::noName ? std::string(NameArena::instance().view(nameId)) : stat.keyAt(i).toString()) << " "
 			   << std::right << std::setw(6) << (hostInfo.inPackets + hostInfo.outPackets) << " packets (OUT "
 			   << std::left << std::setw(6) << hostInfo.outPackets << " | "
 			   << std::right << std::setw(6) << hostInfo.inPackets << " IN) traffic: "
@@ -43,90 +263,262 @@ public:
 		return ss.str();
 	}
 
-	/// \brief Возвращает статистику об обработанных пакетах в формате JSON
-	std::string toJsonString() override
+	/**
+	 * \brief Дописывает статистику в формате JSON в конец буфера out
+	 *
+	 * Документ имеет вид {"generation":N,"hosts":[...]}, где generation - поколение,
+	 * которое клиент передает в sinceGeneration следующего запроса, чтобы получить только изменения.
+	 * Если пакеты учитывались выборочно, в документе есть поле sampling с текущим и наибольшим
+	 * коэффициентами, а у хостов с оцененными счетчиками - поле estimate с погрешностью оценки
+	 */
+	void writeJson(std::string &out, std::uint64_t sinceGeneration) const override
 	{
-		nlohmann::json jsonStat = nlohmann::json::object();
-		jsonStat["hosts"] = nlohmann::json::array();
+		JsonWriter json(out);
+		char ipBuffer[IpKey::maxStringLength];
+
+		json.beginObject();
+		json.field("generation", generation);
+
+		if (maxSamplingRate > 1)
+		{
+			json.key("sampling").beginObject();
+			json.field("rate", std::uint64_t(samplingRate));
+			json.field("maxRate", std::uint64_t(maxSamplingRate));
+			json.endObject();
+		}
+
+		json.key("hosts").beginArray();
 
-		for (const auto &[ip, hostInfo] : stat)
+		for (std::size_t i = 0; i < stat.size(); i++)
 		{
-			nlohmann::json hostJson;
-			hostJson["ip"] = ip;
-			hostJson["name"] = hostInfo.name;
+			const auto &hostInfo = stat.valueAt(i);
+			if (sinceGeneration && hostInfo.generation <= sinceGeneration)
+				continue;
+
+			json.beginObject();
+			json.field("ip", std::string_view(ipBuffer, stat.keyAt(i).format(ipBuffer)));
+			json.field("name", NameArena::instance().view(hostInfo.nameId));
+			json.field("firstSeen", std::uint64_t(meta[i].firstSeen));
+
+			json.key("packets").beginObject();
+			json.field("in", hostInfo.inPackets);
+			json.field("out", hostInfo.outPackets);
+			json.field("total", hostInfo.outPackets + hostInfo.inPackets);
+			json.endObject();
 
-			hostJson["traffic"]["in"] = hostInfo.inTraffic;
-			hostJson["traffic"]["out"] = hostInfo.outTraffic;
-			hostJson["traffic"]["total"] = hostInfo.outTraffic + hostInfo.inTraffic;
+			json.key("traffic").beginObject();
+			json.field("in", hostInfo.inTraffic);
+			json.field("out", hostInfo.outTraffic);
+			json.field("total", hostInfo.outTraffic + hostInfo.inTraffic);
+			json.endObject();
 
-			hostJson["packets"]["in"] = hostInfo.inPackets;
-			hostJson["packets"]["out"] = hostInfo.outPackets;
-			hostJson["packets"]["total"] = hostInfo.outPackets + hostInfo.inPackets;
+			json.key("flows").beginObject();
+			json.field("active", hostInfo.activeFlows);
+			json.field("completed", hostInfo.completedFlows);
+			json.endObject();
 
-			jsonStat["hosts"].push_back(hostJson);
+			if (hostInfo.sampledPackets)
+				writeEstimate(json, hostInfo);
+
+			json.endObject();
 		}
 
-		std::stringstream ss;
-		ss << jsonStat << std::endl;
+		json.endArray();
+		json.endObject();
+		out += '\n';
+	}
 
-		return ss.str();
+	using ITrafficStats::addPacket;
+
+	/// @brief Метод обрабатывающий пакет по его заголовкам
+	/// \param[in] packet Заголовки пакета, прочитанные RawPacketParser
+	///
+	/// Полный разбор пакета выполняется, только если хост ещё не имеет имени,
+	/// а данные пакета похожи на HTTP запрос или TLS ClientHello
+	void addPacket(const PacketView &packet) override { record(packet); }
+
+	/**
+	 * \brief Обрабатывает пачку пакетов
+	 *
+	 * Пока обрабатывается пакет i, для пакета i + prefetchDistance подгружается ячейка таблицы хостов,
+	 * а для пакета i + prefetchDistance / 2 - запись хоста, на которую эта ячейка указывает,
+	 * так что промахи кэша разных пакетов перекрываются
+	 */
+	void addPackets(std::span<const PacketView> packets) override
+	{
+		std::size_t count = packets.size();
+		bool isInPacket = false;
+
+		for (std::size_t i = 0; i < count; i++)
+		{
+			if (i + prefetchDistance < count)
+				stat.prefetchSlot(localAddresses->remoteHostOf(packets[i + prefetchDistance], isInPacket).hash());
+
+			if (i + prefetchDistance / 2 < count)
+				stat.prefetchEntry(localAddresses->remoteHostOf(packets[i + prefetchDistance / 2], isInPacket).hash());
+
+			record(packets[i]);
+		}
 	}
 
-	/// @brief Метод обрабатывающий пакет
-	/// \param[in] packet Пакет, из который нужно
-	void addPacket(const pcpp::Packet &packet) override
+	/// \brief Очищает статистику
+	void clear() override
 	{
-		auto *ipLayer = packet.getLayerOfType<pcpp::IPLayer>();
-		if (!ipLayer)
+		stat.clear();
+		meta.clear();
+		isChangedComplete = false;
+		isPreviousComplete = false;
+
+		if (flows)
+			flows->clear();
+
+		if (store)
+			store->clear();
+	}
+
+	/**
+	 * \brief Загружает статистику хостов из файла и далее сохраняет в него изменения
+	 *
+	 * Записи файла уже лежат в памяти, поэтому загрузка - это один проход по массиву записей.
+	 * Изменения попадают в файл при каждой публикации копии статистики и при закрытии файла
+	 */
+	bool attachStore(std::unique_ptr<HostStore> hostStore, std::string &) override
+	{
+		stat.reserve(stat.size() + hostStore->size());
+		meta.reserve(stat.size() + hostStore->size());
+
+		for (std::size_t i = 0; i < hostStore->size(); i++)
 		{
-			BOOST_LOG_TRIVIAL(warning) << "IPLayer was nullptr";
-			return;
+			const StoredHost &stored = hostStore->at(i);
+			auto &hostInfo = stat.valueAt(findOrInsertHost(stored.key(), 0));
+
+			hostInfo.inPackets += stored.inPackets;
+			hostInfo.outPackets += stored.outPackets;
+			hostInfo.inTraffic += stored.inTraffic;
+			hostInfo.outTraffic += stored.outTraffic;
+			hostInfo.completedFlows += static_cast<std::uint32_t>(stored.completedFlows);
+
+			if (!hostInfo.hasName())
+				hostInfo.nameId = NameArena::instance().intern(std::string_view(stored.name, stored.nameLength));
+
+			hostInfo.storeIndex = static_cast<std::uint32_t>(i);
+			hostInfo.generation = generation;
 		}
 
-		auto srcIp = ipLayer->getSrcIPAddress().toString();
-		auto dstIp = ipLayer->getDstIPAddress().toString();
-		int size = packet.getRawPacket()->getRawDataLen();
+		TA_LOG(info) << "HttpTrafficStats loaded " << hostStore->size() << " hosts from the host store";
 
-		int srcPort, dstPort;
-		std::string transportProtoName;
+		isChangedComplete = false;
 
-		BOOST_LOG_TRIVIAL(debug) << "Captured packet {"
-								 << " srcIP: " << std::left << std::setw(15) << srcIp
-								 << " dstIP: " << std::left << std::setw(15) << dstIp
-								 << " size: " << std::left << std::setw(9) << size << " }";
+		store = std::move(hostStore);
+		return true;
+	}
 
-		bool isInPacket = dstIp == interfaceIpAddr;
-		auto &hostInfo = isInPacket ? stat[srcIp] : stat[dstIp];
+	/// \brief Сбрасывает на диск и закрывает файл статистики
+	void closeStore() override
+	{
+		syncStore();
+		store.reset();
 
-		hostInfo.addPacket(size, isInPacket);
+		for (std::size_t i = 0; i < stat.size(); i++)
+			stat.valueAt(i).storeIndex = HostInfo::notStored;
+	}
 
-		if (hostInfo.name.empty())
+	/// \brief Возвращает таблицу потоков, либо nullptr если потоки не отслеживаются
+	const FlowTable *getFlows() const { return flows.get(); }
+
+	/// \brief Добавляет хосты в группировку по именам
+	void collectNames(NameTotals &totals) const override
+	{
+		for (std::size_t i = 0; i < stat.size(); i++)
+			totals.add(stat.valueAt(i), stat.valueAt(i).nameId);
+	}
+
+	void visitHosts(IHostVisitor &visitor) const override
+	{
+		for (std::size_t i = 0; i < stat.size(); i++)
+			visitor.onHost(stat.keyAt(i), stat.valueAt(i), stat.valueAt(i).nameId);
+	}
+
+	/// \brief Возвращает независимую копию статистики с именами хостов из кэша DNS
+	std::unique_ptr<ITrafficStats> clone() const override
+	{
+		auto copy = std::make_unique<HttpTrafficStats>(*this);
+		copy->resolveNames(copy->stat, std::views::iota(std::size_t(0), copy->stat.size()));
+		return copy;
+	}
+
+	/// \brief Начинает новое поколение, журнал текущего поколения становится журналом предыдущего
+	void setGeneration(std::uint64_t value) override
+	{
+		syncStore();
+
+		previousBase = previousGeneration;
+		previousGeneration = generation;
+		previousChanged.swap(changed);
+		changed.clear();
+		isPreviousComplete = isChangedComplete;
+		isChangedComplete = true;
+
+		generation = value;
+	}
+
+	/**
+	 * \brief Переносит в копию добавленные хосты и хосты из журналов изменений
+	 *
+	 * Записи хостов копии и статистики имеют одинаковые номера: хосты не удаляются и добавляются
+	 * в копию в том же порядке. Копия предыдущей публикации получает изменения текущего поколения,
+	 * а копия позапрошлой - ещё и предыдущего
+	 */
+	bool updateCopy(ITrafficStats &copy) const override
+	{
+		auto *target = dynamic_cast<HttpTrafficStats *>(&copy);
+		if (!target || target->stat.size() > stat.size() || !isChangedComplete)
+			return false;
+
+		bool isPreviousNeeded = target->generation != previousGeneration;
+		if (isPreviousNeeded && (target->generation != previousBase || !isPreviousComplete))
+			return false;
+
+		std::size_t copiedCount = target->stat.size();
+		for (std::size_t i = copiedCount; i < stat.size(); i++)
 		{
-			if (auto *httpRequestLayer = packet.getLayerOfType<pcpp::HttpRequestLayer>())
-			{
-				if (auto *hostField = httpRequestLayer->getFieldByName(PCPP_HTTP_HOST_FIELD))
-				{
-					hostInfo.name = hostField->getFieldValue();
-					BOOST_LOG_TRIVIAL(info) << "HTTP host name detected: " << hostInfo.name;
-				}
-			}
-			else if (auto *sslHadshakeLayer = packet.getLayerOfType<pcpp::SSLHandshakeLayer>())
-			{
-				if (auto *clientHelloMessage = sslHadshakeLayer->getHandshakeMessageOfType<pcpp::SSLClientHelloMessage>())
-				{
-					if (auto *sniExt = clientHelloMessage->getExtensionOfType<pcpp::SSLServerNameIndicationExtension>())
-					{
-						hostInfo.name = sniExt->getHostName();
-						BOOST_LOG_TRIVIAL(info) << "HTTPS host name detected: " << hostInfo.name;
-					}
-				}
-			}
+			target->stat.valueAt(target->stat.findOrInsert(stat.keyAt(i))) = stat.valueAt(i);
+			target->meta.push_back(meta[i]);
 		}
+
+		if (isPreviousNeeded)
+			copyHosts(*target, previousChanged);
+
+		copyHosts(*target, changed);
+
+		static_cast<ITrafficStats &>(*target) = *this;
+
+		target->resolveNames(target->stat, std::views::iota(copiedCount, stat.size()));
+		if (isPreviousNeeded)
+			target->resolveNames(target->stat, previousChanged);
+
+		target->resolveNames(target->stat, changed);
+		return true;
 	}
 
-	/// \brief Очищает статистику
-	void clear() override
+	/// \brief Добавляет к статистике данные другого объекта HttpTrafficStats
+	void merge(const ITrafficStats &other) override
 	{
-		stat.clear();
+		auto *otherStats = dynamic_cast<const HttpTrafficStats *>(&other);
+		if (!otherStats)
+		{
+			TA_LOG(warning) << "HttpTrafficStats merge failed, other stats have different type";
+			return;
+		}
+
+		mergeSampling(other);
+		isChangedComplete = false;
+
+		for (std::size_t i = 0; i < otherStats->stat.size(); i++)
+		{
+			std::size_t index = findOrInsertHost(otherStats->stat.keyAt(i), otherStats->meta[i].firstSeen);
+			stat.valueAt(index).merge(otherStats->stat.valueAt(i));
+			meta[index].merge(otherStats->meta[i]);
+		}
 	}
 };
@@ -1,8 +1,30 @@
 #pragma once
 #include <string>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <cstdint>
+#include <algorithm>
 
 #include <Packet.h>
 
+#include <PacketView.h>
+#include <LocalAddressSet.h>
+#include <HostStore.h>
+#include <NameTotals.h>
+#include <DnsCache.h>
+#include <RawPacketParser.h>
+
+/// \brief Получатель хостов статистики при обходе ITrafficStats::visitHosts
+class IHostVisitor
+{
+public:
+	virtual ~IHostVisitor() {}
+
+	/// \param[in] nameId Номер имени хоста в NameArena, в копиях статистики - с учетом кэша DNS
+	virtual void onHost(const IpKey &host, const HostInfo &hostInfo, std::uint32_t nameId) = 0;
+};
+
 /** \brief Интерфейс, определяющий методы обработки полученных пакетов и вывода статистики
  *  Обязывает наследников переопределить абстактные методы
  **/
@@ -11,20 +33,173 @@ class ITrafficStats
 protected:
 	std::string interfaceIpAddr; ///< IP-адрес интерфейса, для которого собирается статистика
 
+	/// \brief Локальные адреса, относительно которых определяется направление пакетов
+	///
+	/// По умолчанию содержит только interfaceIpAddr, копии статистики разделяют одно множество
+	std::shared_ptr<const LocalAddressSet> localAddresses;
+
+	/// \brief Кэш ответов DNS, nullptr если кэш не ведется
+	///
+	/// Писатель статистики заполняет кэш ответами DNS и берет из него имена безымянных хостов
+	/// копий статистики, которые публикует (resolveNames). Все копии разделяют один кэш
+	std::shared_ptr<DnsCache> dnsCache;
+
+	/**
+	 * \brief Подставляет хостам hosts таблицы table копии статистики имена из кэша DNS
+	 *
+	 * Вызывается писателем при создании или обновлении копии, поэтому читатели при выводе статистики
+	 * к кэшу не обращаются. Имя из кэша остается в копии до следующего изменения хоста.
+	 * Хосты с именем, определенным по HTTP или TLS, не изменяются
+	 */
+	template <class Table, class Hosts>
+	void resolveNames(Table &table, Hosts &&hosts) const
+	{
+		if (!dnsCache)
+			return;
+
+		DnsCache::Batch batch(*dnsCache);
+		for (std::size_t index : hosts)
+		{
+			HostInfo &hostInfo = table.valueAt(index);
+			if (!hostInfo.hasName())
+				hostInfo.nameId = batch.lookup(table.keyAt(index));
+		}
+	}
+
+	/**
+	 * \brief Текущее поколение статистики
+	 *
+	 * Записи, изменённые после публикации копии статистики, помечаются поколением,
+	 * большим чем у этой копии. Это позволяет отдавать клиенту только изменения
+	 */
+	std::uint64_t generation{0};
+
+	std::uint32_t samplingRate{1};	  ///< Коэффициент выборочного учета последующих пакетов, 1 - пакеты учитываются точно
+	std::uint32_t maxSamplingRate{1}; ///< Наибольший коэффициент выборочного учета с создания статистики
+
+	/// \brief Объединяет коэффициенты выборочного учета с другой статистикой, вызывается из merge наследников
+	void mergeSampling(const ITrafficStats &other)
+	{
+		samplingRate = std::max(samplingRate, other.samplingRate);
+		maxSamplingRate = std::max(maxSamplingRate, other.maxSamplingRate);
+	}
+
 public:
-	ITrafficStats(const std::string &interfaceIpAddr) : interfaceIpAddr(interfaceIpAddr) {}
+	ITrafficStats(const std::string &interfaceIpAddr)
+		: interfaceIpAddr(interfaceIpAddr),
+		  localAddresses(LocalAddressSet::ofAddress(interfaceIpAddr)) {}
 
 	virtual ~ITrafficStats() {}
 
 	/// \brief Возвращает статистику об обработанных пакетах в виде строки
-	virtual std::string toString() = 0;
+	virtual std::string toString() const = 0;
 
 	/// \brief Возвращает статистику об обработанных пакетах в формате JSON
-	virtual std::string toJsonString() = 0;
+	virtual std::string toJsonString() const
+	{
+		std::string out;
+		writeJson(out, 0);
+		return out;
+	}
+
+	/**
+	 * \brief Дописывает статистику в формате JSON в конец буфера out
+	 * \param[out] out Буфер, может переиспользоваться между вызовами
+	 * \param[in] sinceGeneration Выводить только записи, изменённые после этого поколения, 0 - выводить все
+	 */
+	virtual void writeJson(std::string &out, std::uint64_t sinceGeneration) const = 0;
+
+	/// \brief Задает локальные адреса (все адреса интерфейса и дополнительные сети), вызывается до обработки пакетов
+	virtual void setLocalAddresses(std::shared_ptr<const LocalAddressSet> addresses) { localAddresses = std::move(addresses); }
+
+	/// \brief Задает кэш ответов DNS, вызывается до обработки пакетов
+	virtual void setDnsCache(std::shared_ptr<DnsCache> cache) { dnsCache = std::move(cache); }
 
-	/// \brief Обрабатывает полученный пакет, записывает данные о нём в статистку
-	virtual void addPacket(const pcpp::Packet &packet) = 0;
+	/// \brief Возвращает текущее поколение статистики
+	std::uint64_t getGeneration() const { return generation; }
+
+	/// \brief Задает поколение, которым будут помечаться последующие изменения
+	virtual void setGeneration(std::uint64_t value) { generation = value; }
+
+	/// \brief Задает коэффициент, с которым выборочно учитываются последующие пакеты (см. AdaptiveSampler)
+	virtual void setSamplingRate(std::uint32_t rate)
+	{
+		samplingRate = rate;
+		maxSamplingRate = std::max(maxSamplingRate, rate);
+	}
+
+	/// \brief Возвращает текущий коэффициент выборочного учета, 1 - пакеты учитываются точно
+	std::uint32_t getSamplingRate() const { return samplingRate; }
+
+	/// \brief Возвращает наибольший коэффициент выборочного учета с создания статистики
+	std::uint32_t getMaxSamplingRate() const { return maxSamplingRate; }
+
+	/// \brief Возвращает короткое имя вида статистики, под которым она выводится в составе конвейера
+	virtual std::string_view name() const = 0;
+
+	/// \brief Обрабатывает пакет по заголовкам, прочитанным RawPacketParser, записывает данные о нём в статистку
+	virtual void addPacket(const PacketView &packet) = 0;
+
+	/**
+	 * \brief Обрабатывает пачку пакетов, записывает данные о них в статистку
+	 *
+	 * Наследники переопределяют метод, чтобы обойтись одним виртуальным вызовом на пачку
+	 * и заранее подгружать в кэш записи хостов следующих пакетов
+	 */
+	virtual void addPackets(std::span<const PacketView> packets)
+	{
+		for (const auto &packet : packets)
+			addPacket(packet);
+	}
+
+	/// \brief Обрабатывает уже разобранный пакет, записывает данные о нём в статистку
+	virtual void addPacket(const pcpp::Packet &packet)
+	{
+		PacketView view;
+		RawPacketParser::parse(*packet.getRawPacket(), view);
+		view.parsedPacket = &packet;
+		addPacket(view);
+	}
 
 	/// \brief Очищает собранную статистку
 	virtual void clear() = 0;
+
+	/**
+	 * \brief Загружает статистику хостов из открытого файла и далее сохраняет в него все изменения
+	 *
+	 * Вызывается до обработки пакетов. Очистка статистики очищает и файл
+	 * \param[out] errorInfo В случае ошибки, сюда будет записана причина
+	 * \return False - если тип статистики не поддерживает сохранение
+	 */
+	virtual bool attachStore(std::unique_ptr<HostStore>, std::string &errorInfo)
+	{
+		errorInfo = "ITrafficStats: this statistics type cannot be stored in a file";
+		return false;
+	}
+
+	/// \brief Сбрасывает на диск и закрывает файл статистики, сохраненная статистика не изменяется
+	virtual void closeStore() {}
+
+	/// \brief Добавляет хосты статистики в группировку по именам, статистика без хостов ничего не добавляет
+	virtual void collectNames(NameTotals &) const {}
+
+	/// \brief Передает visitor каждый хост статистики, статистика без хостов ничего не передает
+	virtual void visitHosts(IHostVisitor &) const {}
+
+	/// \brief Возвращает независимую копию собранной статистики
+	virtual std::unique_ptr<ITrafficStats> clone() const = 0;
+
+	/**
+	 * \brief Переносит в старую копию статистики изменения, сделанные после неё
+	 *
+	 * Копия должна быть получена clone() (или обновлена updateCopy) одной из двух последних публикаций,
+	 * то есть перед одним из двух последних вызовов setGeneration. Время обновления пропорционально
+	 * числу изменившихся записей, а не всех записей статистики.
+	 * При неудаче копия может остаться частично обновленной и должна быть заменена новой clone()
+	 * \return False - если тип статистики не ведет журнал изменений, копия старше или статистика очищалась
+	 */
+	virtual bool updateCopy(ITrafficStats &) const { return false; }
+
+	/// \brief Добавляет к статистике данные другого объекта того же типа
+	virtual void merge(const ITrafficStats &other) = 0;
 };
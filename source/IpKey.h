@@ -0,0 +1,113 @@
+#pragma once
+#include <array>
+#include <string>
+#include <cstdint>
+#include <cstring>
+
+#include <arpa/inet.h>
+
+#include <IpAddress.h>
+
+/**
+ * \brief IP адрес в бинарном виде, используемый как ключ в таблицах статистики
+ *
+ * Хранит 4 или 16 байт адреса без выделения памяти в куче.
+ * Строковое представление формируется только по запросу
+ */
+struct IpKey
+{
+	std::array<std::uint8_t, 16> bytes{}; ///< Байты адреса в сетевом порядке, неиспользуемые байты равны нулю
+	std::uint8_t length{0};				  ///< Длина адреса: 4 для IPv4, 16 для IPv6, 0 для пустого ключа
+
+	/// \brief Создает ключ из 4 байт IPv4 адреса
+	static IpKey fromIPv4(const std::uint8_t *data)
+	{
+		IpKey key;
+		std::memcpy(key.bytes.data(), data, 4);
+		key.length = 4;
+		return key;
+	}
+
+	/// \brief Создает ключ из 16 байт IPv6 адреса
+	static IpKey fromIPv6(const std::uint8_t *data)
+	{
+		IpKey key;
+		std::memcpy(key.bytes.data(), data, 16);
+		key.length = 16;
+		return key;
+	}
+
+	/// \brief Создает ключ из адреса PcapPlusPlus
+	static IpKey fromIPAddress(const pcpp::IPAddress &address)
+	{
+		return address.isIPv4() ? fromIPv4(address.getIPv4().toBytes()) : fromIPv6(address.getIPv6().toBytes());
+	}
+
+	/// \brief Создает ключ из строкового представления адреса
+	/// \return Пустой ключ, если строка не является IPv4 или IPv6 адресом
+	static IpKey fromString(const std::string &address)
+	{
+		IpKey key;
+		if (inet_pton(AF_INET, address.c_str(), key.bytes.data()) == 1)
+			key.length = 4;
+		else if (inet_pton(AF_INET6, address.c_str(), key.bytes.data()) == 1)
+			key.length = 16;
+		else
+			key.bytes.fill(0);
+
+		return key;
+	}
+
+	bool isIPv4() const { return length == 4; }
+	bool isIPv6() const { return length == 16; }
+	bool empty() const { return length == 0; }
+
+	/// \brief Максимальная длина строкового представления адреса вместе с завершающим нулем
+	static constexpr std::size_t maxStringLength = INET6_ADDRSTRLEN;
+
+	/**
+	 * \brief Записывает строковое представление адреса в буфер без выделения памяти
+	 * \param[out] buffer Буфер размером не менее maxStringLength
+	 * \return Длина записанной строки
+	 */
+	std::size_t format(char *buffer) const
+	{
+		buffer[0] = '\0';
+
+		if (isIPv4())
+			inet_ntop(AF_INET, bytes.data(), buffer, maxStringLength);
+		else if (isIPv6())
+			inet_ntop(AF_INET6, bytes.data(), buffer, maxStringLength);
+
+		return std::strlen(buffer);
+	}
+
+	/// \brief Возвращает строковое представление адреса
+	std::string toString() const
+	{
+		char buffer[maxStringLength];
+		return std::string(buffer, format(buffer));
+	}
+
+	/// \brief Возвращает хэш адреса
+	std::uint64_t hash() const
+	{
+		std::uint64_t high, low;
+		std::memcpy(&high, bytes.data(), 8);
+		std::memcpy(&low, bytes.data() + 8, 8);
+
+		std::uint64_t h = high ^ (low * 0x9E3779B97F4A7C15ull) ^ length;
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDull;
+		h ^= h >> 33;
+		h *= 0xC4CEB9FE1A85EC53ull;
+		return h ^ (h >> 33);
+	}
+
+	bool operator==(const IpKey &other) const
+	{
+		return length == other.length && bytes == other.bytes;
+	}
+
+	bool operator!=(const IpKey &other) const { return !(*this == other); }
+};
@@ -0,0 +1,178 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <charconv>
+
+/**
+ * \brief Потоковый сериализатор JSON, пишущий напрямую в строковый буфер
+ *
+ * Не строит промежуточного дерева документа и не выделяет память на каждый элемент:
+ * буфер может переиспользоваться между вызовами, сохраняя выделенную ёмкость.
+ * Корректность вложенности элементов остается на совести вызывающего.
+ * Строки берутся из захваченных пакетов, поэтому некорректные байты UTF-8 заменяются на U+FFFD
+ */
+class JsonWriter
+{
+private:
+	std::string &out;
+	bool needComma{false}; ///< Перед следующим элементом текущего уровня нужна запятая
+
+	void separate()
+	{
+		if (needComma)
+			out += ',';
+
+		needComma = true;
+	}
+
+	/// \brief Возвращает длину корректной последовательности UTF-8 из 2-4 байт в начале value, либо 0
+	static std::size_t sequenceLength(std::string_view value)
+	{
+		auto byte = [&value](std::size_t i)
+		{ return i < value.size() ? static_cast<unsigned char>(value[i]) : 0; };
+
+		unsigned char lead = byte(0);
+		std::size_t length = lead >= 0xC2 && lead <= 0xDF ? 2 : lead >= 0xE0 && lead <= 0xEF ? 3 : lead >= 0xF0 && lead <= 0xF4 ? 4 : 0;
+
+		// Второй байт ограничен, чтобы исключить избыточные формы, суррогаты и значения больше U+10FFFF
+		unsigned char low = lead == 0xE0 ? 0xA0 : lead == 0xF0 ? 0x90 : 0x80;
+		unsigned char high = lead == 0xED ? 0x9F : lead == 0xF4 ? 0x8F : 0xBF;
+		if (!length || byte(1) < low || byte(1) > high)
+			return 0;
+
+		for (std::size_t i = 2; i < length; i++)
+			if ((byte(i) & 0xC0) != 0x80)
+				return 0;
+
+		return length;
+	}
+
+	void writeString(std::string_view value)
+	{
+		static const char hexDigits[] = "0123456789abcdef";
+
+		out += '"';
+		for (std::size_t i = 0; i < value.size(); i++)
+		{
+			char c = value[i];
+			if (static_cast<unsigned char>(c) >= 0x80)
+			{
+				std::size_t length = sequenceLength(value.substr(i));
+				if (length)
+				{
+					out.append(value.data() + i, length);
+					i += length - 1;
+				}
+				else
+					out += "\xEF\xBF\xBD";
+
+				continue;
+			}
+
+			switch (c)
+			{
+			case '"':
+				out += "\\\"";
+				break;
+			case '\\':
+				out += "\\\\";
+				break;
+			case '\n':
+				out += "\\n";
+				break;
+			case '\r':
+				out += "\\r";
+				break;
+			case '\t':
+				out += "\\t";
+				break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20)
+				{
+					out += "\\u00";
+					out += hexDigits[(c >> 4) & 0x0F];
+					out += hexDigits[c & 0x0F];
+				}
+				else
+					out += c;
+			}
+		}
+		out += '"';
+	}
+
+public:
+	/// \param[in] out Буфер, в конец которого будет записан документ
+	explicit JsonWriter(std::string &out) : out(out) {}
+
+	JsonWriter &beginObject()
+	{
+		separate();
+		out += '{';
+		needComma = false;
+		return *this;
+	}
+
+	JsonWriter &endObject()
+	{
+		out += '}';
+		needComma = true;
+		return *this;
+	}
+
+	JsonWriter &beginArray()
+	{
+		separate();
+		out += '[';
+		needComma = false;
+		return *this;
+	}
+
+	JsonWriter &endArray()
+	{
+		out += ']';
+		needComma = true;
+		return *this;
+	}
+
+	/// \brief Записывает ключ элемента объекта, за ним должно следовать значение
+	JsonWriter &key(std::string_view name)
+	{
+		separate();
+		writeString(name);
+		out += ':';
+		needComma = false;
+		return *this;
+	}
+
+	JsonWriter &value(std::string_view value)
+	{
+		separate();
+		writeString(value);
+		return *this;
+	}
+
+	JsonWriter &value(std::uint64_t value)
+	{
+		separate();
+
+		char buffer[20];
+		auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+		out.append(buffer, result.ptr);
+		return *this;
+	}
+
+	/// \brief Отмечает, что значение после key() уже дописано в буфер напрямую, например вложенным документом
+	JsonWriter &valueWritten()
+	{
+		needComma = true;
+		return *this;
+	}
+
+	/// \brief Записывает пару "ключ: значение"
+	template <class T>
+	JsonWriter &field(std::string_view name, const T &fieldValue)
+	{
+		return key(name).value(fieldValue);
+	}
+};
@@ -0,0 +1,277 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#include <ifaddrs.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <IpKey.h>
+#include <PacketView.h>
+
+/**
+ * \brief Множество локальных адресов и сетей, относительно которых определяется направление пакетов
+ *
+ * Сети IPv4 и IPv6 хранятся в двух отсортированных массивах непересекающихся диапазонов
+ * [first, last], поэтому проверка адреса - это двоичный поиск по нескольким числам без выделения памяти.
+ * Множество заполняется при инициализации и после этого не изменяется, поэтому
+ * одно множество разделяется всеми копиями статистики без синхронизации
+ */
+class LocalAddressSet
+{
+private:
+	/// \brief IPv6 адрес в виде 128-битного беззнакового числа
+	struct Address128
+	{
+		std::uint64_t high{0};
+		std::uint64_t low{0};
+
+		auto operator<=>(const Address128 &) const = default;
+	};
+
+	template <class Address>
+	struct Range
+	{
+		Address first;
+		Address last;
+	};
+
+	std::vector<Range<std::uint32_t>> ranges4;
+	std::vector<Range<Address128>> ranges6;
+
+	static std::uint64_t read64(const std::uint8_t *data)
+	{
+		std::uint64_t value = 0;
+		for (int i = 0; i < 8; i++)
+			value = (value << 8) | data[i];
+
+		return value;
+	}
+
+	static std::uint32_t toAddress4(const IpKey &key)
+	{
+		return (std::uint32_t(key.bytes[0]) << 24) | (std::uint32_t(key.bytes[1]) << 16) | (std::uint32_t(key.bytes[2]) << 8) | key.bytes[3];
+	}
+
+	static Address128 toAddress6(const IpKey &key)
+	{
+		return {read64(key.bytes.data()), read64(key.bytes.data() + 8)};
+	}
+
+	/// \brief Сортирует диапазоны и объединяет пересекающиеся и смежные
+	template <class Address>
+	static void normalize(std::vector<Range<Address>> &ranges, Address maxAddress)
+	{
+		std::sort(ranges.begin(), ranges.end(), [](const auto &a, const auto &b)
+				  { return a.first < b.first; });
+
+		std::size_t kept = 0;
+		for (std::size_t i = 0; i < ranges.size(); i++)
+		{
+			if (kept && (ranges[kept - 1].last == maxAddress || next(ranges[kept - 1].last) >= ranges[i].first))
+			{
+				ranges[kept - 1].last = std::max(ranges[kept - 1].last, ranges[i].last);
+				continue;
+			}
+
+			ranges[kept++] = ranges[i];
+		}
+
+		ranges.resize(kept);
+	}
+
+	static std::uint32_t next(std::uint32_t address) { return address + 1; }
+
+	static Address128 next(Address128 address)
+	{
+		return address.low == UINT64_MAX ? Address128{address.high + 1, 0} : Address128{address.high, address.low + 1};
+	}
+
+	template <class Address>
+	static bool find(const std::vector<Range<Address>> &ranges, const Address &address)
+	{
+		auto it = std::upper_bound(ranges.begin(), ranges.end(), address, [](const Address &value, const auto &range)
+								   { return value < range.first; });
+
+		return it != ranges.begin() && address <= std::prev(it)->last;
+	}
+
+public:
+	/// \brief Создает множество из одного адреса, например адреса интерфейса
+	static std::shared_ptr<LocalAddressSet> ofAddress(const std::string &address)
+	{
+		auto addresses = std::make_shared<LocalAddressSet>();
+		addresses->addNetwork(IpKey::fromString(address), 128);
+		return addresses;
+	}
+
+	/**
+	 * \brief Добавляет сеть с адресом network и длиной префикса prefixLength
+	 *
+	 * Длина префикса больше длины адреса означает один адрес, пустой адрес игнорируется
+	 */
+	void addNetwork(const IpKey &network, unsigned int prefixLength)
+	{
+		if (network.isIPv4())
+		{
+			std::uint32_t hostMask = prefixLength >= 32 ? 0 : UINT32_MAX >> prefixLength;
+			std::uint32_t first = toAddress4(network) & ~hostMask;
+			ranges4.push_back({first, first | hostMask});
+			normalize(ranges4, UINT32_MAX);
+		}
+		else if (network.isIPv6())
+		{
+			Address128 hostMask;
+			if (prefixLength < 64)
+				hostMask = {UINT64_MAX >> prefixLength, UINT64_MAX};
+			else if (prefixLength < 128)
+				hostMask = {0, UINT64_MAX >> (prefixLength - 64)};
+
+			Address128 address = toAddress6(network);
+			Address128 first{address.high & ~hostMask.high, address.low & ~hostMask.low};
+			ranges6.push_back({first, {first.high | hostMask.high, first.low | hostMask.low}});
+			normalize(ranges6, Address128{UINT64_MAX, UINT64_MAX});
+		}
+	}
+
+	/**
+	 * \brief Добавляет сеть в нотации CIDR, например "10.0.0.0/8" или "fd00::/8", либо отдельный адрес
+	 * \param[out] errorInfo В случае ошибки, сюда будет записана причина
+	 * \return False - если строка не является адресом или сетью
+	 */
+	bool addNetwork(const std::string &cidr, std::string &errorInfo)
+	{
+		std::size_t slash = cidr.find('/');
+		IpKey network = IpKey::fromString(cidr.substr(0, slash));
+
+		if (network.empty())
+		{
+			errorInfo = "LocalAddressSet: '" + cidr + "' is not an IPv4 or IPv6 network";
+			return false;
+		}
+
+		unsigned int prefixLength = network.length * 8;
+		if (slash != std::string::npos)
+		{
+			const char *text = cidr.c_str() + slash + 1;
+			char *end = nullptr;
+			unsigned long value = std::strtoul(text, &end, 10);
+
+			if (end == text || *end != '\0' || value > prefixLength)
+			{
+				errorInfo = "LocalAddressSet: wrong prefix length in '" + cidr + "'";
+				return false;
+			}
+
+			prefixLength = static_cast<unsigned int>(value);
+		}
+
+		addNetwork(network, prefixLength);
+		return true;
+	}
+
+	/**
+	 * \brief Добавляет все IPv4 и IPv6 адреса интерфейса, включая дополнительные
+	 * \param[out] errorInfo В случае ошибки, сюда будет записана причина
+	 * \return False - если список адресов интерфейсов недоступен
+	 */
+	bool addInterfaceAddresses(const std::string &interfaceName, std::string &errorInfo)
+	{
+		ifaddrs *interfaces = nullptr;
+		if (getifaddrs(&interfaces) != 0)
+		{
+			errorInfo = "LocalAddressSet: cannot list addresses of interface '" + interfaceName + "'";
+			return false;
+		}
+
+		for (ifaddrs *entry = interfaces; entry; entry = entry->ifa_next)
+		{
+			if (!entry->ifa_addr || interfaceName != entry->ifa_name)
+				continue;
+
+			if (entry->ifa_addr->sa_family == AF_INET)
+				addNetwork(IpKey::fromIPv4(reinterpret_cast<const std::uint8_t *>(&reinterpret_cast<const sockaddr_in *>(entry->ifa_addr)->sin_addr)), 32);
+			else if (entry->ifa_addr->sa_family == AF_INET6)
+				addNetwork(IpKey::fromIPv6(reinterpret_cast<const std::uint8_t *>(&reinterpret_cast<const sockaddr_in6 *>(entry->ifa_addr)->sin6_addr)), 128);
+		}
+
+		freeifaddrs(interfaces);
+		return true;
+	}
+
+	/// \brief Проверяет, принадлежит ли адрес одной из локальных сетей
+	bool contains(const IpKey &address) const
+	{
+		if (address.isIPv4())
+			return find(ranges4, toAddress4(address));
+
+		if (address.isIPv6())
+			return find(ranges6, toAddress6(address));
+
+		return false;
+	}
+
+	/**
+	 * \brief Определяет направление пакета и удаленный хост одной проверкой адреса получателя
+	 * \param[out] isInPacket Адресован ли пакет локальному адресу
+	 * \return Адрес отправителя для входящего пакета, иначе адрес получателя
+	 */
+	const IpKey &remoteHostOf(const PacketView &packet, bool &isInPacket) const
+	{
+		isInPacket = contains(packet.dstIp);
+		return isInPacket ? packet.srcIp : packet.dstIp;
+	}
+
+	/// \brief Возвращает количество непересекающихся диапазонов адресов
+	std::size_t size() const { return ranges4.size() + ranges6.size(); }
+
+	bool empty() const { return ranges4.empty() && ranges6.empty(); }
+
+	/// \brief Возвращает диапазоны адресов через запятую, для вывода в лог
+	std::string toString() const
+	{
+		std::string out;
+		auto append = [&out](const IpKey &first, const IpKey &last)
+		{
+			if (!out.empty())
+				out += ", ";
+
+			out += first.toString();
+			if (first != last)
+				out += " - " + last.toString();
+		};
+
+		for (const auto &range : ranges4)
+		{
+			std::uint8_t first[4], last[4];
+			for (int i = 0; i < 4; i++)
+			{
+				first[i] = static_cast<std::uint8_t>(range.first >> (24 - 8 * i));
+				last[i] = static_cast<std::uint8_t>(range.last >> (24 - 8 * i));
+			}
+
+			append(IpKey::fromIPv4(first), IpKey::fromIPv4(last));
+		}
+
+		for (const auto &range : ranges6)
+		{
+			std::uint8_t first[16], last[16];
+			for (int i = 0; i < 8; i++)
+			{
+				first[i] = static_cast<std::uint8_t>(range.first.high >> (56 - 8 * i));
+				first[8 + i] = static_cast<std::uint8_t>(range.first.low >> (56 - 8 * i));
+				last[i] = static_cast<std::uint8_t>(range.last.high >> (56 - 8 * i));
+				last[8 + i] = static_cast<std::uint8_t>(range.last.low >> (56 - 8 * i));
+			}
+
+			append(IpKey::fromIPv6(first), IpKey::fromIPv6(last));
+		}
+
+		return out;
+	}
+};
@@ -0,0 +1,278 @@
+#pragma once
+#include <mutex>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <charconv>
+
+#include <ITrafficStats.h>
+#include <HostTable.h>
+#include <NameArena.h>
+#include <IpKey.h>
+
+/// \brief Показатели работы самого анализатора, которые выводятся вместе со счетчиками хостов
+struct AnalyzerHealth
+{
+	std::uint64_t queueDrops{0};  ///< Пакеты, отброшенные из-за переполнения очередей обработчиков
+	bool hasRings{false};		  ///< Пакеты захватываются через кольца AF_PACKET
+	std::uint64_t ringPackets{0}; ///< Принятые кольцами пакеты, включая отброшенные
+	std::uint64_t ringDrops{0};	  ///< Пакеты, отброшенные ядром из-за заполненного кольца
+	bool hasPcap{false};			  ///< Пакеты захватываются через libpcap с живого интерфейса
+	std::uint64_t pcapPackets{0};	  ///< Принятые libpcap пакеты
+	std::uint64_t pcapDrops{0};		  ///< Пакеты, отброшенные libpcap из-за заполненного буфера
+	std::uint64_t interfaceDrops{0};  ///< Пакеты, отброшенные интерфейсом или его драйвером
+	bool hasDnsCache{false};	  ///< Ведется кэш ответов DNS
+	std::uint64_t dnsEntries{0};  ///< Количество записей кэша DNS
+	std::uint64_t dnsHits{0};	  ///< Найденные в кэше DNS имена
+	std::uint64_t dnsMisses{0};	  ///< Промахи кэша DNS
+	std::uint64_t names{0};		  ///< Количество имен в NameArena
+	std::uint64_t samplingRate{1}; ///< Коэффициент выборочного учета пакетов, 1 - пакеты учитываются точно
+};
+
+/**
+ * \brief Вывод статистики в текстовом формате Prometheus с кэшем строк каждого хоста
+ *
+ * Строки серий хоста формируются один раз и хранятся до тех пор, пока хост не изменится:
+ * при запросе хост переформировывается, только если поколение его записи или номер его имени
+ * отличаются от запомненных. Остальные хосты копируются в ответ готовыми строками,
+ * поэтому запрос к статистике из десятков тысяч неизменившихся хостов сводится к копированию памяти.
+ * Если с прошлого запроса не опубликована новая копия статистики, обход хостов пропускается целиком.
+ *
+ * Хосты, которых нет в очередной копии статистики (например, после очистки), удаляются из кэша.
+ * Запросы синхронизируются собственным мьютексом и не блокируют ни поток захвата, ни других читателей статистики
+ */
+class MetricsExposition
+{
+private:
+	/// \brief Готовые строки серий одного хоста
+	struct Series
+	{
+		std::string bytes;			 ///< Строки traffic_analyzer_host_bytes_total
+		std::string packets;		 ///< Строки traffic_analyzer_host_packets_total
+		std::uint64_t generation{0}; ///< Поколение записи хоста, по которому сформированы строки
+		std::uint32_t nameId{NameArena::noName};
+		std::uint64_t seen{0}; ///< Номер последнего запроса, в копии статистики которого был хост
+	};
+
+	/// \brief Обход хостов копии статистики с переформированием изменившихся
+	class Renderer : public IHostVisitor
+	{
+	private:
+		MetricsExposition &exposition;
+
+	public:
+		explicit Renderer(MetricsExposition &exposition) : exposition(exposition) {}
+
+		void onHost(const IpKey &host, const HostInfo &hostInfo, std::uint32_t nameId) override
+		{
+			std::size_t index = exposition.series.findOrInsert(host);
+			Series &entry = exposition.series.valueAt(index);
+			entry.seen = exposition.scrapes;
+
+			// Поколение 0 у статистики, которая не публиковалась, по нему изменения не отследить
+			bool isChanged = entry.bytes.empty() || !hostInfo.generation || hostInfo.generation != entry.generation;
+			if (!isChanged && nameId == entry.nameId)
+				return;
+
+			exposition.render(host, hostInfo, nameId, entry);
+			exposition.renderedHosts++;
+		}
+	};
+
+	HostTable<Series> series;
+	/// Копия статистики, по которой сформирован hostsBuffer. Удерживается, пока не придет другая копия:
+	/// SnapshotPublisher повторно использует отпущенные копии, и по weak_ptr обновленную копию не отличить от прошлой
+	std::shared_ptr<const ITrafficStats> renderedSnapshot;
+	std::string hostsBuffer; ///< Собранные серии всех хостов
+	std::uint64_t scrapes{0};
+	std::uint64_t renderedHosts{0}; ///< Хосты, переформированные при последнем обходе
+	std::uint64_t snapshotGeneration{0};
+	mutable std::mutex mutex;
+
+	static void appendNumber(std::string &out, std::uint64_t value)
+	{
+		char buffer[24];
+		auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+		out.append(buffer, result.ptr);
+	}
+
+	/// \brief Дописывает значение метки, экранируя символы по правилам текстового формата
+	static void appendLabelValue(std::string &out, std::string_view value)
+	{
+		for (char c : value)
+		{
+			switch (c)
+			{
+			case '\\':
+				out += "\\\\";
+				break;
+			case '"':
+				out += "\\\"";
+				break;
+			case '\n':
+				out += "\\n";
+				break;
+			default:
+				out += c;
+			}
+		}
+	}
+
+	static void appendSample(std::string &out, std::string_view metric, std::string_view labels, std::string_view direction, std::uint64_t value)
+	{
+		out += metric;
+		out += labels;
+		out += ",direction=\"";
+		out += direction;
+		out += "\"} ";
+		appendNumber(out, value);
+		out += '\n';
+	}
+
+	static void appendFamily(std::string &out, std::string_view metric, std::string_view type, std::string_view help)
+	{
+		out += "# HELP ";
+		out += metric;
+		out += ' ';
+		out += help;
+		out += "\n# TYPE ";
+		out += metric;
+		out += ' ';
+		out += type;
+		out += '\n';
+	}
+
+	static void appendMetric(std::string &out, std::string_view metric, std::string_view type, std::string_view help, std::uint64_t value)
+	{
+		appendFamily(out, metric, type, help);
+		out += metric;
+		out += ' ';
+		appendNumber(out, value);
+		out += '\n';
+	}
+
+	void render(const IpKey &host, const HostInfo &hostInfo, std::uint32_t nameId, Series &entry)
+	{
+		char ipBuffer[IpKey::maxStringLength];
+		std::string labels = "{host=\"";
+		labels.append(ipBuffer, host.format(ipBuffer));
+		labels += "\",name=\"";
+		appendLabelValue(labels, NameArena::instance().view(nameId));
+		labels += '"';
+
+		entry.bytes.clear();
+		appendSample(entry.bytes, "traffic_analyzer_host_bytes_total", labels, "in", hostInfo.inTraffic);
+		appendSample(entry.bytes, "traffic_analyzer_host_bytes_total", labels, "out", hostInfo.outTraffic);
+
+		entry.packets.clear();
+		appendSample(entry.packets, "traffic_analyzer_host_packets_total", labels, "in", hostInfo.inPackets);
+		appendSample(entry.packets, "traffic_analyzer_host_packets_total", labels, "out", hostInfo.outPackets);
+
+		entry.generation = hostInfo.generation;
+		entry.nameId = nameId;
+	}
+
+	/// \brief Удаляет из кэша хосты, которых не было в последней копии статистики
+	void dropUnseen()
+	{
+		std::size_t seenCount = 0;
+		for (std::size_t i = 0; i < series.size(); i++)
+			seenCount += series.valueAt(i).seen == scrapes;
+
+		if (seenCount == series.size())
+			return;
+
+		HostTable<Series> kept;
+		kept.reserve(seenCount);
+
+		for (std::size_t i = 0; i < series.size(); i++)
+			if (series.valueAt(i).seen == scrapes)
+				kept[series.keyAt(i)] = std::move(series.valueAt(i));
+
+		series = std::move(kept);
+	}
+
+	void assembleHosts()
+	{
+		hostsBuffer.clear();
+
+		appendFamily(hostsBuffer, "traffic_analyzer_host_bytes_total", "counter", "Traffic of the host in bytes by direction relative to the local addresses");
+		for (std::size_t i = 0; i < series.size(); i++)
+			hostsBuffer += series.valueAt(i).bytes;
+
+		appendFamily(hostsBuffer, "traffic_analyzer_host_packets_total", "counter", "Packets of the host by direction relative to the local addresses");
+		for (std::size_t i = 0; i < series.size(); i++)
+			hostsBuffer += series.valueAt(i).packets;
+	}
+
+public:
+	/**
+	 * \brief Дописывает в out серии хостов копии статистики snapshot и показатели работы анализатора
+	 * \param[in] snapshot Опубликованная копия статистики, сравнивается с прошлой по указателю
+	 */
+	void write(const std::shared_ptr<const ITrafficStats> &snapshot, const AnalyzerHealth &health, std::string &out)
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+
+		if (renderedSnapshot != snapshot)
+		{
+			scrapes++;
+			renderedHosts = 0;
+
+			Renderer renderer(*this);
+			snapshot->visitHosts(renderer);
+
+			dropUnseen();
+			assembleHosts();
+
+			renderedSnapshot = snapshot;
+			snapshotGeneration = snapshot->getGeneration();
+		}
+
+		out += hostsBuffer;
+
+		appendMetric(out, "traffic_analyzer_hosts", "gauge", "Hosts in the published statistics", series.size());
+		appendMetric(out, "traffic_analyzer_snapshot_generation", "gauge", "Generation of the published statistics", snapshotGeneration);
+		appendMetric(out, "traffic_analyzer_metrics_rendered_hosts", "gauge", "Hosts whose series were re-rendered for the latest statistics", renderedHosts);
+		appendMetric(out, "traffic_analyzer_queue_dropped_packets_total", "counter", "Packets dropped by full worker queues", health.queueDrops);
+
+		if (health.hasRings)
+		{
+			appendMetric(out, "traffic_analyzer_ring_packets_total", "counter", "Packets received by the capture rings, including dropped", health.ringPackets);
+			appendMetric(out, "traffic_analyzer_ring_dropped_packets_total", "counter", "Packets dropped by the kernel because of a full capture ring", health.ringDrops);
+		}
+
+		if (health.hasPcap)
+		{
+			appendMetric(out, "traffic_analyzer_pcap_packets_total", "counter", "Packets received by libpcap", health.pcapPackets);
+			appendMetric(out, "traffic_analyzer_pcap_dropped_packets_total", "counter", "Packets dropped by libpcap because of a full buffer", health.pcapDrops);
+			appendMetric(out, "traffic_analyzer_interface_dropped_packets_total", "counter", "Packets dropped by the network interface or its driver", health.interfaceDrops);
+		}
+
+		if (health.hasDnsCache)
+		{
+			appendMetric(out, "traffic_analyzer_dns_cache_entries", "gauge", "Addresses in the DNS answer cache", health.dnsEntries);
+			appendMetric(out, "traffic_analyzer_dns_cache_hits_total", "counter", "Host names found in the DNS answer cache", health.dnsHits);
+			appendMetric(out, "traffic_analyzer_dns_cache_misses_total", "counter", "Host names not found in the DNS answer cache", health.dnsMisses);
+		}
+
+		appendMetric(out, "traffic_analyzer_names", "gauge", "Distinct host names interned since start", health.names);
+		appendMetric(out, "traffic_analyzer_sampling_rate", "gauge", "Only 1 of N flows is counted and scaled by N because of overload (1 - exact counting)", health.samplingRate);
+	}
+
+	/// \brief Возвращает количество хостов, переформированных при последнем обходе копии статистики
+	std::uint64_t getRenderedHosts() const
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		return renderedHosts;
+	}
+
+	/// \brief Возвращает количество хостов в кэше
+	std::size_t size() const
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		return series.size();
+	}
+};
@@ -0,0 +1,142 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+#include <AsyncLog.h>
+
+/**
+ * \brief Пул имен хостов: каждое имя хранится один раз и обозначается 32-битным номером
+ *
+ * Имена дописываются в блоки фиксированного размера, которые не перемещаются и не освобождаются,
+ * поэтому полученный по номеру string_view действителен до конца работы программы.
+ * Добавление имени защищено мьютексом (имя добавляется не чаще одного раза на хост),
+ * а чтение по номеру не блокируется: номер попадает к читателю вместе с копией статистики,
+ * опубликованной после записи имени.
+ *
+ * Пул один на процесс, чтобы номера совпадали во всех шардах и копиях статистики
+ */
+class NameArena
+{
+public:
+	static constexpr std::uint32_t noName = 0; ///< Номер отсутствующего имени
+
+	static constexpr std::size_t blockSize = 64 * 1024;		///< Размер блока с символами имен
+	static constexpr std::size_t maxBlocks = 1024;			///< Предел памяти под символы: 64 МиБ
+	static constexpr std::size_t namesPerBlock = 4096;		///< Количество имен в блоке индекса номеров
+	static constexpr std::size_t maxNameBlocks = 1024;		///< Предел количества имен: 4 Мi
+	static constexpr std::size_t maxNameLength = 255;		///< Длина имени по RFC 1035, более длинные имена обрезаются
+
+private:
+	std::array<std::unique_ptr<char[]>, maxBlocks> blocks;
+	std::array<std::unique_ptr<std::string_view[]>, maxNameBlocks> names; ///< Имя по номеру, номер 0 не используется
+
+	std::size_t blocksCount{0};
+	std::size_t blockUsed{blockSize}; ///< Занято в последнем блоке, новый пул сразу заводит первый блок
+	std::atomic<std::uint32_t> namesCount{1};
+
+	std::unordered_map<std::string_view, std::uint32_t> index; ///< Номер по имени, ключи указывают в блоки
+	mutable std::mutex mutex;
+
+	/// \brief Копирует имя в последний блок, при необходимости заводит новый
+	const char *append(std::string_view name)
+	{
+		if (blockUsed + name.size() > blockSize)
+		{
+			if (blocksCount == maxBlocks)
+				return nullptr;
+
+			blocks[blocksCount++] = std::make_unique<char[]>(blockSize);
+			blockUsed = 0;
+		}
+
+		char *place = blocks[blocksCount - 1].get() + blockUsed;
+		std::memcpy(place, name.data(), name.size());
+		blockUsed += name.size();
+		return place;
+	}
+
+public:
+	NameArena() = default;
+
+	NameArena(const NameArena &) = delete;
+	NameArena &operator=(const NameArena &) = delete;
+
+	/// \brief Возвращает пул имен процесса
+	static NameArena &instance()
+	{
+		static NameArena arena;
+		return arena;
+	}
+
+	/**
+	 * \brief Возвращает номер имени, добавляя имя при отсутствии
+	 * \return Номер имени, noName для пустого имени или если пул заполнен
+	 */
+	std::uint32_t intern(std::string_view name)
+	{
+		if (name.empty())
+			return noName;
+
+		name = name.substr(0, maxNameLength);
+
+		std::lock_guard<std::mutex> guard(mutex);
+
+		auto it = index.find(name);
+		if (it != index.end())
+			return it->second;
+
+		std::uint32_t id = namesCount.load(std::memory_order_relaxed);
+		const char *text = id < namesPerBlock * maxNameBlocks ? append(name) : nullptr;
+		if (!text)
+		{
+			TA_LOG_LIMITED(warning, 1, "Name arena is full, host names are not stored");
+			return noName;
+		}
+
+		auto &nameBlock = names[id / namesPerBlock];
+		if (!nameBlock)
+			nameBlock = std::make_unique<std::string_view[]>(namesPerBlock);
+
+		std::string_view stored(text, name.size());
+		nameBlock[id % namesPerBlock] = stored;
+		index.emplace(stored, id);
+
+		namesCount.store(id + 1, std::memory_order_release);
+		return id;
+	}
+
+	/// \brief Возвращает имя по номеру, пустое для noName
+	std::string_view view(std::uint32_t id) const
+	{
+		if (id == noName)
+			return {};
+
+		return names[id / namesPerBlock][id % namesPerBlock];
+	}
+
+	/// \brief Возвращает номер имени, либо noName, если такого имени нет
+	std::uint32_t find(std::string_view name) const
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+
+		auto it = index.find(name.substr(0, maxNameLength));
+		return it == index.end() ? noName : it->second;
+	}
+
+	/// \brief Возвращает количество различных имен
+	std::size_t size() const { return namesCount.load(std::memory_order_acquire) - 1; }
+
+	/// \brief Возвращает объем памяти, занятой блоками символов
+	std::size_t memoryUsage() const
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		return blocksCount * blockSize;
+	}
+};
@@ -0,0 +1,123 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+
+#include <HostInfo.h>
+#include <NameArena.h>
+#include <JsonWriter.h>
+
+/**
+ * \brief Суммарная статистика хостов, сгруппированная по имени
+ *
+ * Хосты одного имени (например, адреса CDN) складываются в одну запись.
+ * Группировка идет по номеру имени в NameArena, без сравнения строк
+ */
+class NameTotals
+{
+private:
+	struct Totals
+	{
+		std::uint64_t hosts{0};
+		std::uint64_t inPackets{0};
+		std::uint64_t outPackets{0};
+		std::uint64_t inTraffic{0};
+		std::uint64_t outTraffic{0};
+		std::uint64_t activeFlows{0};
+		std::uint64_t completedFlows{0};
+	};
+
+	std::unordered_map<std::uint32_t, Totals> totals;
+	std::uint64_t unnamedHosts{0};
+
+public:
+	/// \brief Добавляет хост к записи его имени, безымянные хосты только подсчитываются
+	void add(const HostInfo &hostInfo) { add(hostInfo, hostInfo.nameId); }
+
+	/// \brief Добавляет хост к записи имени nameId, например имени из кэша DNS
+	void add(const HostInfo &hostInfo, std::uint32_t nameId)
+	{
+		if (nameId == NameArena::noName)
+		{
+			unnamedHosts++;
+			return;
+		}
+
+		Totals &entry = totals[nameId];
+		entry.hosts++;
+		entry.inPackets += hostInfo.inPackets;
+		entry.outPackets += hostInfo.outPackets;
+		entry.inTraffic += hostInfo.inTraffic;
+		entry.outTraffic += hostInfo.outTraffic;
+		entry.activeFlows += hostInfo.activeFlows;
+		entry.completedFlows += hostInfo.completedFlows;
+	}
+
+	/// \brief Возвращает количество различных имен
+	std::size_t size() const { return totals.size(); }
+
+	/// \brief Возвращает количество хостов без имени
+	std::uint64_t getUnnamedHosts() const { return unnamedHosts; }
+
+	/**
+	 * \brief Дописывает статистику имен в формате JSON в конец буфера out
+	 *
+	 * Документ имеет вид {"generation":N,"unnamedHosts":M,"names":[...]},
+	 * имена упорядочены по убыванию суммарного трафика
+	 */
+	void writeJson(std::string &out, std::uint64_t generation) const
+	{
+		std::vector<const std::pair<const std::uint32_t, Totals> *> order;
+		order.reserve(totals.size());
+		for (const auto &entry : totals)
+			order.push_back(&entry);
+
+		std::sort(order.begin(), order.end(), [](const auto *a, const auto *b)
+				  {
+					  std::uint64_t aTraffic = a->second.inTraffic + a->second.outTraffic;
+					  std::uint64_t bTraffic = b->second.inTraffic + b->second.outTraffic;
+					  return aTraffic != bTraffic ? aTraffic > bTraffic : a->first < b->first; });
+
+		const NameArena &arena = NameArena::instance();
+		JsonWriter json(out);
+
+		json.beginObject();
+		json.field("generation", generation);
+		json.field("unnamedHosts", unnamedHosts);
+		json.key("names").beginArray();
+
+		for (const auto *entry : order)
+		{
+			const Totals &total = entry->second;
+
+			json.beginObject();
+			json.field("name", arena.view(entry->first));
+			json.field("hosts", total.hosts);
+
+			json.key("packets").beginObject();
+			json.field("in", total.inPackets);
+			json.field("out", total.outPackets);
+			json.field("total", total.inPackets + total.outPackets);
+			json.endObject();
+
+			json.key("traffic").beginObject();
+			json.field("in", total.inTraffic);
+			json.field("out", total.outTraffic);
+			json.field("total", total.inTraffic + total.outTraffic);
+			json.endObject();
+
+			json.key("flows").beginObject();
+			json.field("active", total.activeFlows);
+			json.field("completed", total.completedFlows);
+			json.endObject();
+
+			json.endObject();
+		}
+
+		json.endArray();
+		json.endObject();
+		out += '\n';
+	}
+};
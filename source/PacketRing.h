@@ -0,0 +1,396 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+
+#include <RawPacket.h>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+#include <pcap/pcap.h>
+#endif
+
+/// \brief Параметры кольца AF_PACKET
+struct PacketRingConfig
+{
+	std::size_t blockSize{1 << 20};				///< Размер блока (в байтах), степень двойки, кратная размеру страницы
+	std::size_t blocksCount{64};				///< Количество блоков в кольце
+	std::size_t frameSize{2048};				///< Размер кадра для расчета tp_frame_nr, в TPACKET_V3 кадры переменной длины
+	std::uint32_t blockTimeoutMs{10};			///< Через сколько мс ядро отдает неполный блок
+	std::uint16_t fanoutGroup{0};				///< Группа fanout, 0 - без группы, если кольцо одно
+	std::size_t ringsCount{0};					///< Количество колец (и потоков захвата) в группе fanout, 0 - не использовать кольца
+
+	bool isEnabled() const { return ringsCount > 0; }
+};
+
+/// \brief Счетчики ядра для кольца, накопленные с момента открытия
+struct PacketRingStats
+{
+	std::uint64_t packets{0};		///< Принятые сокетом пакеты, включая отброшенные
+	std::uint64_t drops{0};			///< Пакеты, отброшенные ядром из-за заполненного кольца
+	std::uint64_t queueFreezes{0};	///< Сколько раз кольцо было заполнено целиком
+
+	void merge(const PacketRingStats &other)
+	{
+		packets += other.packets;
+		drops += other.drops;
+		queueFreezes += other.queueFreezes;
+	}
+};
+
+/// \brief Кадр в блоке кольца, данные действительны до возврата блока ядру
+struct PacketRingFrame
+{
+	const std::uint8_t *data{nullptr};
+	std::uint32_t length{0};	 ///< Захваченная длина
+	std::uint32_t wireLength{0}; ///< Длина пакета в сети
+	timespec timestamp{};
+};
+
+/**
+ * \brief Захват пакетов через кольцо AF_PACKET TPACKET_V3, отображенное в память процесса
+ *
+ * Ядро заполняет блоки кадрами и передает их процессу целиком. Кадры обрабатываются прямо
+ * в блоке, без копирования, после чего блок возвращается ядру. Несколько колец одного интерфейса
+ * объединяются в группу fanout: ядро распределяет пакеты между ними по паре IP адресов,
+ * так что пакеты одного хоста в обоих направлениях попадают в одно кольцо.
+ *
+ * Методы poll, collectStats и close вызываются одним потоком (потоком кольца), getStats - любым:
+ * счетчики ядра читает из сокета только поток кольца, а getStats возвращает накопленные им значения
+ */
+class PacketRing
+{
+private:
+	int socketFd{-1};
+	std::uint8_t *ring{nullptr};
+	std::size_t ringSize{0};
+	std::size_t blockSize{0};
+	std::size_t blocksCount{0};
+	std::size_t currentBlock{0};
+	std::size_t blocksSinceStats{0}; ///< Сколько блоков обработано с последнего чтения счетчиков ядра
+	bool isLoopback{false};
+	pcpp::LinkLayerType linkType{pcpp::LINKTYPE_ETHERNET};
+
+	std::atomic<std::uint64_t> packets{0};
+	std::atomic<std::uint64_t> drops{0};
+	std::atomic<std::uint64_t> queueFreezes{0};
+
+	static constexpr std::size_t statsPeriodBlocks = 16; ///< Через сколько блоков под нагрузкой читаются счетчики ядра
+
+#if defined(__linux__)
+	bool fail(const std::string &what, std::string &errorInfo)
+	{
+		errorInfo = "PacketRing: " + what + ": " + std::strerror(errno);
+		close();
+		return false;
+	}
+
+	/// \brief Программа fanout: XOR последних 4 байт адресов отправителя и получателя (IPv4 или IPv6),
+	/// ядро берет остаток от деления на количество сокетов группы
+	static std::vector<sock_filter> addressPairProgram()
+	{
+		return {
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 5),
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 14 + 12),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 14 + 16),
+			BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IPV6, 0, 5),
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 14 + 8 + 12),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 14 + 24 + 12),
+			BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+			BPF_STMT(BPF_RET | BPF_K, 0),
+		};
+	}
+
+	/// \brief Компилирует фильтр в формате pcap и устанавливает его на сокет
+	bool attachFilter(const std::string &filterText, std::string &errorInfo)
+	{
+		pcap_t *dead = pcap_open_dead(linkType == pcpp::LINKTYPE_ETHERNET ? DLT_EN10MB : DLT_RAW, 65535);
+		if (!dead)
+		{
+			errorInfo = "PacketRing: cannot create pcap handle to compile filter";
+			return false;
+		}
+
+		bpf_program program;
+		if (pcap_compile(dead, &program, filterText.c_str(), 1, PCAP_NETMASK_UNKNOWN) != 0)
+		{
+			errorInfo = "PacketRing: cannot compile filter '" + filterText + "': " + pcap_geterr(dead);
+			pcap_close(dead);
+			return false;
+		}
+
+		sock_fprog code{static_cast<unsigned short>(program.bf_len), reinterpret_cast<sock_filter *>(program.bf_insns)};
+		int result = setsockopt(socketFd, SOL_SOCKET, SO_ATTACH_FILTER, &code, sizeof(code));
+
+		pcap_freecode(&program);
+		pcap_close(dead);
+
+		if (result != 0)
+		{
+			errorInfo = std::string("PacketRing: cannot attach filter: ") + std::strerror(errno);
+			return false;
+		}
+
+		return true;
+	}
+#endif
+
+public:
+	PacketRing() = default;
+	~PacketRing() { close(); }
+
+	PacketRing(const PacketRing &) = delete;
+	PacketRing &operator=(const PacketRing &) = delete;
+
+	/**
+	 * \brief Создает кольцо на интерфейсе и начинает прием пакетов
+	 * \param[in] interfaceName Имя интерфейса, например "lo" или "eth0"
+	 * \param[in] config Размеры кольца и группа fanout
+	 * \param[in] filterText Фильтр в формате pcap, пустая строка - без фильтра
+	 * \param[out] errorInfo В случае ошибки сюда будет записана причина
+	 * \return False - если кольцо создать не удалось
+	 */
+	bool open(const std::string &interfaceName, const PacketRingConfig &config, const std::string &filterText, std::string &errorInfo)
+	{
+#if defined(__linux__)
+		close();
+
+		long pageSize = sysconf(_SC_PAGESIZE);
+		if (config.blockSize == 0 || (config.blockSize & (config.blockSize - 1)) || config.blockSize % pageSize ||
+			config.frameSize < TPACKET3_HDRLEN || config.frameSize % TPACKET_ALIGNMENT || config.blockSize % config.frameSize || config.blocksCount == 0)
+		{
+			errorInfo = "PacketRing: block size must be a power of two and a multiple of the page size and of the frame size";
+			return false;
+		}
+
+		int interfaceIndex = static_cast<int>(if_nametoindex(interfaceName.c_str()));
+		if (!interfaceIndex)
+		{
+			errorInfo = "PacketRing: cannot find interface '" + interfaceName + "'";
+			return false;
+		}
+
+		// Протокол 0: сокет не принимает пакеты, пока не будет привязан к интерфейсу
+		socketFd = socket(AF_PACKET, SOCK_RAW, 0);
+		if (socketFd < 0)
+			return fail("cannot create AF_PACKET socket", errorInfo);
+
+		ifreq request{};
+		std::strncpy(request.ifr_name, interfaceName.c_str(), IFNAMSIZ - 1);
+		if (ioctl(socketFd, SIOCGIFHWADDR, &request) != 0)
+			return fail("cannot get interface type", errorInfo);
+
+		isLoopback = request.ifr_hwaddr.sa_family == ARPHRD_LOOPBACK;
+		linkType = request.ifr_hwaddr.sa_family == ARPHRD_ETHER || isLoopback ? pcpp::LINKTYPE_ETHERNET : pcpp::LINKTYPE_RAW;
+
+		int version = TPACKET_V3;
+		if (setsockopt(socketFd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0)
+			return fail("TPACKET_V3 is not supported", errorInfo);
+
+		if (!filterText.empty() && !attachFilter(filterText, errorInfo))
+		{
+			close();
+			return false;
+		}
+
+		tpacket_req3 ringRequest{};
+		ringRequest.tp_block_size = static_cast<unsigned int>(config.blockSize);
+		ringRequest.tp_block_nr = static_cast<unsigned int>(config.blocksCount);
+		ringRequest.tp_frame_size = static_cast<unsigned int>(config.frameSize);
+		ringRequest.tp_frame_nr = static_cast<unsigned int>(config.blockSize / config.frameSize * config.blocksCount);
+		ringRequest.tp_retire_blk_tov = config.blockTimeoutMs;
+		if (setsockopt(socketFd, SOL_PACKET, PACKET_RX_RING, &ringRequest, sizeof(ringRequest)) != 0)
+			return fail("cannot create ring", errorInfo);
+
+		blockSize = config.blockSize;
+		blocksCount = config.blocksCount;
+		ringSize = blockSize * blocksCount;
+
+		void *mapped = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED | MAP_POPULATE, socketFd, 0);
+		if (mapped == MAP_FAILED)
+			mapped = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, socketFd, 0);
+		if (mapped == MAP_FAILED)
+			return fail("cannot map ring", errorInfo);
+
+		ring = static_cast<std::uint8_t *>(mapped);
+		currentBlock = 0;
+
+		sockaddr_ll address{};
+		address.sll_family = AF_PACKET;
+		address.sll_protocol = htons(ETH_P_ALL);
+		address.sll_ifindex = interfaceIndex;
+		if (bind(socketFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+			return fail("cannot bind to interface '" + interfaceName + "'", errorInfo);
+
+		if (config.fanoutGroup)
+		{
+			bool isByAddressPair = linkType == pcpp::LINKTYPE_ETHERNET;
+			int fanout = config.fanoutGroup | ((isByAddressPair ? PACKET_FANOUT_CBPF : PACKET_FANOUT_HASH) << 16);
+			if (setsockopt(socketFd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) != 0)
+				return fail("cannot join fanout group " + std::to_string(config.fanoutGroup), errorInfo);
+
+			if (isByAddressPair)
+			{
+				std::vector<sock_filter> program = addressPairProgram();
+				sock_fprog code{static_cast<unsigned short>(program.size()), program.data()};
+				if (setsockopt(socketFd, SOL_PACKET, PACKET_FANOUT_DATA, &code, sizeof(code)) != 0)
+					return fail("cannot set fanout program", errorInfo);
+			}
+		}
+
+		return true;
+#else
+		errorInfo = "PacketRing: AF_PACKET capture is supported only on Linux";
+		return false;
+#endif
+	}
+
+	bool isOpened() const { return ring != nullptr; }
+
+	/// \brief Канальный уровень кадров кольца
+	pcpp::LinkLayerType getLinkType() const { return linkType; }
+
+	/**
+	 * \brief Обрабатывает кадры очередного заполненного блока и возвращает блок ядру
+	 *
+	 * Если заполненного блока нет, ожидает его не дольше timeoutMs
+	 * \param[in] onFrame Вызывается для каждого кадра блока с const PacketRingFrame &
+	 * \return Количество обработанных кадров
+	 */
+	template <class OnFrame>
+	std::size_t poll(int timeoutMs, OnFrame &&onFrame)
+	{
+		return poll(timeoutMs, onFrame, [] {});
+	}
+
+	/**
+	 * \brief Аналог poll, дополнительно вызывающий onBlockEnd() после всех кадров блока
+	 *
+	 * Кадры блока остаются действительными до возврата из onBlockEnd, поэтому
+	 * onFrame может только собрать их, а onBlockEnd - обработать собранное пачкой
+	 */
+	template <class OnFrame, class OnBlockEnd>
+	std::size_t poll(int timeoutMs, OnFrame &&onFrame, OnBlockEnd &&onBlockEnd)
+	{
+#if defined(__linux__)
+		if (!ring)
+			return 0;
+
+		auto *block = reinterpret_cast<tpacket_block_desc *>(ring + currentBlock * blockSize);
+		if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+		{
+			pollfd descriptor{socketFd, POLLIN | POLLERR, 0};
+			::poll(&descriptor, 1, timeoutMs);
+			collectStats();
+			return 0;
+		}
+
+		std::uint32_t framesCount = block->hdr.bh1.num_pkts;
+		std::size_t processed = 0;
+		auto *header = reinterpret_cast<tpacket3_hdr *>(reinterpret_cast<std::uint8_t *>(block) + block->hdr.bh1.offset_to_first_pkt);
+
+		for (std::uint32_t i = 0; i < framesCount; i++)
+		{
+			// На loopback исходящий пакет виден дважды: при отправке и при приеме
+			auto *linkAddress = reinterpret_cast<const sockaddr_ll *>(reinterpret_cast<std::uint8_t *>(header) + TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+			if (!(isLoopback && linkAddress->sll_pkttype == PACKET_OUTGOING))
+			{
+				PacketRingFrame frame;
+				frame.data = reinterpret_cast<std::uint8_t *>(header) + header->tp_mac;
+				frame.length = header->tp_snaplen;
+				frame.wireLength = header->tp_len;
+				frame.timestamp.tv_sec = header->tp_sec;
+				frame.timestamp.tv_nsec = header->tp_nsec;
+
+				onFrame(static_cast<const PacketRingFrame &>(frame));
+				processed++;
+			}
+
+			header = reinterpret_cast<tpacket3_hdr *>(reinterpret_cast<std::uint8_t *>(header) + header->tp_next_offset);
+		}
+
+		onBlockEnd();
+
+		__atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+		currentBlock = currentBlock + 1 == blocksCount ? 0 : currentBlock + 1;
+
+		if (++blocksSinceStats == statsPeriodBlocks)
+			collectStats();
+
+		return processed;
+#else
+		return 0;
+#endif
+	}
+
+	/**
+	 * \brief Добавляет к накопленным счетчикам счетчики ядра, вызывается только потоком кольца
+	 *
+	 * poll вызывает его сам, когда ждет пакеты и через каждые statsPeriodBlocks блоков, а close - перед закрытием сокета
+	 */
+	void collectStats()
+	{
+		blocksSinceStats = 0;
+
+#if defined(__linux__)
+		tpacket_stats_v3 kernelStats{};
+		socklen_t length = sizeof(kernelStats);
+
+		// Ядро обнуляет счетчики при каждом чтении, поэтому они накапливаются здесь
+		if (socketFd >= 0 && getsockopt(socketFd, SOL_PACKET, PACKET_STATISTICS, &kernelStats, &length) == 0)
+		{
+			packets.fetch_add(kernelStats.tp_packets, std::memory_order_relaxed);
+			drops.fetch_add(kernelStats.tp_drops, std::memory_order_relaxed);
+			queueFreezes.fetch_add(kernelStats.tp_freeze_q_cnt, std::memory_order_relaxed);
+		}
+#endif
+	}
+
+	/// \brief Возвращает счетчики ядра, накопленные с открытия кольца, может вызываться из любого потока
+	PacketRingStats getStats() const
+	{
+		PacketRingStats stats;
+		stats.packets = packets.load(std::memory_order_relaxed);
+		stats.drops = drops.load(std::memory_order_relaxed);
+		stats.queueFreezes = queueFreezes.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	/// \brief Освобождает кольцо и закрывает сокет, сохранив последние счетчики ядра
+	void close()
+	{
+		collectStats();
+
+#if defined(__linux__)
+		if (ring)
+			munmap(ring, ringSize);
+
+		if (socketFd >= 0)
+			::close(socketFd);
+#endif
+
+		ring = nullptr;
+		socketFd = -1;
+	}
+};
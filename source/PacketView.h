@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <ctime>
+
+#include <RawPacket.h>
+#include <Packet.h>
+
+#include <IpKey.h>
+
+/**
+ * \brief Поля пакета, прочитанные напрямую из его заголовков
+ *
+ * Не владеет байтами пакета: указатели действительны, пока жив исходный буфер.
+ * Полный разбор пакета через pcpp::Packet выполняется только по необходимости
+ */
+struct PacketView
+{
+	IpKey srcIp;						 ///< Адрес отправителя
+	IpKey dstIp;						 ///< Адрес получателя
+	std::uint32_t length{0};			 ///< Размер пакета целиком
+	std::uint8_t transportProtocol{0};	 ///< Номер транспортного протокола (6 - TCP, 17 - UDP), 0 если неизвестен
+	std::uint8_t tcpFlags{0};			 ///< Флаги TCP заголовка
+	std::uint16_t srcPort{0};			 ///< Порт отправителя
+	std::uint16_t dstPort{0};			 ///< Порт получателя
+	const std::uint8_t *payload{nullptr}; ///< Начало данных транспортного уровня
+	std::uint32_t payloadLength{0};		 ///< Размер данных транспортного уровня
+
+	const std::uint8_t *data{nullptr};					///< Байты пакета целиком
+	timespec timestamp{};								///< Время захвата пакета
+	pcpp::LinkLayerType linkType{pcpp::LINKTYPE_ETHERNET}; ///< Тип канального уровня
+	const pcpp::Packet *parsedPacket{nullptr};			///< Уже разобранный пакет, если он есть у вызывающего
+
+	/// \brief Сколько пакетов представляет пакет при выборочном учете (см. AdaptiveSampler)
+	///
+	/// 1 - пакет учитывается точно, 0 - пакет передан только для поиска имени хоста и не меняет счетчиков
+	std::uint32_t weight{1};
+
+	static constexpr std::uint8_t tcpProtocol = 6;
+	static constexpr std::uint8_t udpProtocol = 17;
+
+	bool isTcp() const { return transportProtocol == tcpProtocol; }
+	bool isUdp() const { return transportProtocol == udpProtocol; }
+};
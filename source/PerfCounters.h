@@ -0,0 +1,381 @@
+#pragma once
+#include <atomic>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <JsonWriter.h>
+
+/// Сборка с гистограммами задержек этапов обработки пакетов (1 - включены, 0 - макросы TA_PERF_* удаляются компилятором)
+#ifndef TRAFFIC_ANALYZER_PERF
+#define TRAFFIC_ANALYZER_PERF 0
+#endif
+
+/// \brief Этапы обработки пакета, задержка каждого учитывается отдельной гистограммой
+enum class PerfStage : std::uint8_t
+{
+	dispatch, ///< Копирование пакета в очередь обработчика, включая ожидание места
+	parse,	  ///< Разбор заголовков RawPacketParser
+	stats,	  ///< Запись пачки пакетов в статистику (обновление таблиц хостов, потоков и портов)
+	names,	  ///< Полный разбор пакета для поиска имени хоста
+	publish,  ///< Проверка и публикация копии статистики
+	count
+};
+
+/// \brief Возвращает имя этапа для вывода
+inline std::string_view perfStageName(PerfStage stage)
+{
+	static constexpr std::string_view names[] = {"dispatch", "parse", "stats", "names", "publish"};
+	return names[static_cast<std::size_t>(stage)];
+}
+
+/**
+ * \brief Часы на счетчике тактов процессора
+ *
+ * Чтение счетчика (rdtsc) стоит десятки тактов против сотни у steady_clock, поэтому время
+ * этапов измеряется в тактах, а в наносекунды переводится только при выводе.
+ * На других архитектурах используется steady_clock, и такт равен наносекунде
+ */
+class TscClock
+{
+public:
+	static std::uint64_t now()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+	}
+
+	/// \brief Возвращает количество тактов в наносекунде, при первом вызове замеряет его за 20 мс
+	static double ticksPerNs()
+	{
+		static const double value = []
+		{
+#if defined(__x86_64__) || defined(__i386__)
+			auto startTime = std::chrono::steady_clock::now();
+			std::uint64_t startTicks = now();
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+			std::uint64_t ticks = now() - startTicks;
+			auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+			return ns > 0 && ticks > 0 ? double(ticks) / double(ns) : 1.0;
+#else
+			return 1.0;
+#endif
+		}();
+
+		return value;
+	}
+
+	/// \brief Переводит такты в наносекунды
+	static std::uint64_t toNs(std::uint64_t ticks) { return static_cast<std::uint64_t>(ticks / ticksPerNs()); }
+};
+
+/**
+ * \brief Гистограмма задержек с логарифмически-линейными корзинами, как в HdrHistogram
+ *
+ * Каждый диапазон [2^k, 2^(k+1)) делится на subBuckets равных корзин, так что относительная
+ * погрешность значения не превышает 1 / subBuckets при фиксированных 4 КиБ на гистограмму.
+ * В гистограмму пишет только один поток, поэтому счетчики увеличиваются обычной записью без
+ * атомарных read-modify-write, а читатели в любой момент видят согласованные по отдельности значения
+ */
+class LatencyHistogram
+{
+public:
+	static constexpr unsigned subBucketBits = 3;
+	static constexpr std::uint64_t subBuckets = 1 << subBucketBits;
+	static constexpr std::size_t bucketsCount = (64 - subBucketBits + 1) * subBuckets;
+
+private:
+	std::array<std::atomic<std::uint64_t>, bucketsCount> buckets{};
+	std::atomic<std::uint64_t> calls{0};	  ///< Количество измерений
+	std::atomic<std::uint64_t> items{0};	  ///< Количество пакетов во всех измерениях
+	std::atomic<std::uint64_t> totalTicks{0}; ///< Суммарная задержка
+	std::atomic<std::uint64_t> maxTicks{0};
+
+	/// \brief Увеличивает счетчик единственного писателя
+	static void bump(std::atomic<std::uint64_t> &counter, std::uint64_t delta)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+	}
+
+public:
+	/// \brief Возвращает номер корзины значения
+	static std::size_t bucketOf(std::uint64_t value)
+	{
+		if (value < 2 * subBuckets)
+			return static_cast<std::size_t>(value);
+
+		unsigned shift = static_cast<unsigned>(std::bit_width(value)) - subBucketBits - 1;
+		return static_cast<std::size_t>(shift * subBuckets + (value >> shift));
+	}
+
+	/// \brief Возвращает наибольшее значение, попадающее в корзину
+	static std::uint64_t upperBoundOf(std::size_t bucket)
+	{
+		if (bucket < 2 * subBuckets)
+			return bucket;
+
+		unsigned shift = static_cast<unsigned>(bucket / subBuckets) - 1;
+		std::uint64_t mantissa = bucket % subBuckets + subBuckets;
+		return ((mantissa + 1) << shift) - 1;
+	}
+
+	/// \brief Учитывает измерение, вызывается только потоком-владельцем
+	/// \param[in] count Количество пакетов, обработанных за измерение
+	void record(std::uint64_t ticks, std::uint64_t count = 1)
+	{
+		bump(buckets[bucketOf(ticks)], 1);
+		bump(calls, 1);
+		bump(items, count);
+		bump(totalTicks, ticks);
+
+		if (ticks > maxTicks.load(std::memory_order_relaxed))
+			maxTicks.store(ticks, std::memory_order_relaxed);
+	}
+
+	std::uint64_t getCalls() const { return calls.load(std::memory_order_relaxed); }
+	std::uint64_t getItems() const { return items.load(std::memory_order_relaxed); }
+	std::uint64_t getTotalTicks() const { return totalTicks.load(std::memory_order_relaxed); }
+	std::uint64_t getMaxTicks() const { return maxTicks.load(std::memory_order_relaxed); }
+
+	/**
+	 * \brief Возвращает значение, не меньше которого quantile измерений
+	 * \param[in] quantile Доля измерений от 0 до 1
+	 * \return Верхняя граница корзины, но не больше наибольшего измерения
+	 */
+	std::uint64_t valueAt(double quantile) const
+	{
+		std::uint64_t total = 0;
+		for (const auto &bucket : buckets)
+			total += bucket.load(std::memory_order_relaxed);
+
+		if (!total)
+			return 0;
+
+		std::uint64_t target = std::max<std::uint64_t>(static_cast<std::uint64_t>(quantile * total + 0.5), 1);
+		std::uint64_t seen = 0;
+
+		for (std::size_t i = 0; i < bucketsCount; i++)
+		{
+			seen += buckets[i].load(std::memory_order_relaxed);
+			if (seen >= target)
+				return std::min(upperBoundOf(i), getMaxTicks());
+		}
+
+		return getMaxTicks();
+	}
+};
+
+/// \brief Гистограммы этапов одного потока
+struct PerfThread
+{
+	std::string name; ///< Роль потока (capture, worker, ring, replay), меняется под мьютексом PerfRegistry
+	std::array<LatencyHistogram, static_cast<std::size_t>(PerfStage::count)> stages;
+	std::uint32_t sampleCounter{0}; ///< Счетчик выборки для поштучно измеряемых этапов
+
+	LatencyHistogram &at(PerfStage stage) { return stages[static_cast<std::size_t>(stage)]; }
+	const LatencyHistogram &at(PerfStage stage) const { return stages[static_cast<std::size_t>(stage)]; }
+};
+
+/**
+ * \brief Реестр гистограмм всех потоков, которые обрабатывают пакеты
+ *
+ * Поток получает свою запись при первом измерении и пишет в неё без синхронизации.
+ * Записи не удаляются, поэтому после завершения потоков их данные остаются доступны итоговому выводу.
+ * Реестр один на процесс (см. instance()): запись потока запоминается в thread_local переменной
+ */
+class PerfRegistry
+{
+private:
+	std::vector<std::unique_ptr<PerfThread>> threads;
+	mutable std::mutex mutex;
+
+	PerfRegistry() = default;
+
+public:
+	/// \brief Поштучно измеряемые этапы (разбор, очередь) замеряются у каждого sampleEvery-го пакета
+	static constexpr std::uint32_t sampleEvery = 16;
+
+	static PerfRegistry &instance()
+	{
+		static PerfRegistry registry;
+		return registry;
+	}
+
+	/// \brief Возвращает запись вызывающего потока, регистрируя её при первом вызове
+	PerfThread &local()
+	{
+		thread_local PerfThread *thread = nullptr;
+		if (!thread)
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			threads.push_back(std::make_unique<PerfThread>());
+			threads.back()->name = "thread " + std::to_string(threads.size());
+			thread = threads.back().get();
+		}
+
+		return *thread;
+	}
+
+	/// \brief Задает роль вызывающего потока для вывода
+	void nameThread(std::string_view name)
+	{
+		PerfThread &thread = local();
+		std::lock_guard<std::mutex> guard(mutex);
+		thread.name = name;
+	}
+
+	/// \brief Проверяет, нужно ли замерять очередной пакет вызывающего потока
+	static bool shouldSample(PerfThread &thread)
+	{
+		if (++thread.sampleCounter < sampleEvery)
+			return false;
+
+		thread.sampleCounter = 0;
+		return true;
+	}
+
+	/**
+	 * \brief Дописывает гистограммы потоков в формате JSON: массив {"thread","stages":[...]}
+	 *
+	 * Для каждого этапа выводятся количество измерений и пакетов, средняя задержка на пакет,
+	 * перцентили и максимум задержки измерения (в нс)
+	 */
+	void writeJson(JsonWriter &json) const
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+
+		json.beginArray();
+		for (const auto &thread : threads)
+		{
+			json.beginObject();
+			json.field("thread", std::string_view(thread->name));
+			json.key("stages").beginArray();
+
+			for (std::size_t i = 0; i < thread->stages.size(); i++)
+			{
+				const LatencyHistogram &histogram = thread->stages[i];
+				if (!histogram.getCalls())
+					continue;
+
+				json.beginObject();
+				json.field("stage", perfStageName(static_cast<PerfStage>(i)));
+				json.field("calls", histogram.getCalls());
+				json.field("packets", histogram.getItems());
+				json.field("meanPerPacketNs", TscClock::toNs(histogram.getTotalTicks() / std::max<std::uint64_t>(histogram.getItems(), 1)));
+				json.field("p50Ns", TscClock::toNs(histogram.valueAt(0.5)));
+				json.field("p99Ns", TscClock::toNs(histogram.valueAt(0.99)));
+				json.field("p999Ns", TscClock::toNs(histogram.valueAt(0.999)));
+				json.field("maxNs", TscClock::toNs(histogram.getMaxTicks()));
+				json.endObject();
+			}
+
+			json.endArray();
+			json.endObject();
+		}
+		json.endArray();
+	}
+
+	/// \brief Возвращает таблицу задержек этапов всех потоков для вывода в терминал
+	std::string toString() const
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+
+		std::string out;
+		char line[256];
+		std::snprintf(line, sizeof(line), "%-12s %-9s %12s %14s %10s %10s %10s %10s %12s\n",
+					  "thread", "stage", "calls", "packets", "mean/pkt", "p50", "p99", "p99.9", "max [ns]");
+		out += line;
+
+		for (const auto &thread : threads)
+			for (std::size_t i = 0; i < thread->stages.size(); i++)
+			{
+				const LatencyHistogram &histogram = thread->stages[i];
+				if (!histogram.getCalls())
+					continue;
+
+				std::snprintf(line, sizeof(line), "%-12s %-9s %12llu %14llu %10llu %10llu %10llu %10llu %12llu\n",
+							  thread->name.c_str(), std::string(perfStageName(static_cast<PerfStage>(i))).c_str(),
+							  static_cast<unsigned long long>(histogram.getCalls()),
+							  static_cast<unsigned long long>(histogram.getItems()),
+							  static_cast<unsigned long long>(TscClock::toNs(histogram.getTotalTicks() / std::max<std::uint64_t>(histogram.getItems(), 1))),
+							  static_cast<unsigned long long>(TscClock::toNs(histogram.valueAt(0.5))),
+							  static_cast<unsigned long long>(TscClock::toNs(histogram.valueAt(0.99))),
+							  static_cast<unsigned long long>(TscClock::toNs(histogram.valueAt(0.999))),
+							  static_cast<unsigned long long>(TscClock::toNs(histogram.getMaxTicks())));
+				out += line;
+			}
+
+		return out;
+	}
+};
+
+/// \brief Замеряет время жизни объекта и учитывает его в гистограмме этапа вызывающего потока
+class PerfScope
+{
+private:
+	LatencyHistogram *histogram;
+	std::uint64_t items;
+	std::uint64_t start{0};
+
+public:
+	/// \param[in] items Количество пакетов, обрабатываемых за измерение
+	/// \param[in] isSampled Замерять только каждое PerfRegistry::sampleEvery-е измерение
+	PerfScope(PerfStage stage, std::uint64_t items = 1, bool isSampled = false)
+		: histogram(nullptr), items(items)
+	{
+		PerfThread &thread = PerfRegistry::instance().local();
+		if (isSampled && !PerfRegistry::shouldSample(thread))
+			return;
+
+		histogram = &thread.at(stage);
+		start = TscClock::now();
+	}
+
+	~PerfScope()
+	{
+		if (histogram)
+			histogram->record(TscClock::now() - start, items);
+	}
+
+	PerfScope(const PerfScope &) = delete;
+	PerfScope &operator=(const PerfScope &) = delete;
+};
+
+#define TA_PERF_CONCAT_IMPL(a, b) a##b
+#define TA_PERF_CONCAT(a, b) TA_PERF_CONCAT_IMPL(a, b)
+
+#if TRAFFIC_ANALYZER_PERF
+/// Замеряет задержку до конца блока: TA_PERF_SCOPE(stats, views.size());
+#define TA_PERF_SCOPE(stage, ...) PerfScope TA_PERF_CONCAT(taPerfScope, __LINE__)(PerfStage::stage __VA_OPT__(, ) __VA_ARGS__)
+/// Замеряет задержку до конца блока у каждого PerfRegistry::sampleEvery-го вызова в потоке
+#define TA_PERF_SAMPLED_SCOPE(stage) PerfScope TA_PERF_CONCAT(taPerfScope, __LINE__)(PerfStage::stage, 1, true)
+/// Задает роль вызывающего потока в выводе гистограмм, в каждом потоке выполняется один раз
+#define TA_PERF_THREAD(name)                                                                    \
+	do                                                                                          \
+	{                                                                                           \
+		static thread_local bool taPerfNamed = (PerfRegistry::instance().nameThread(name), true); \
+		(void)taPerfNamed;                                                                      \
+	} while (0)
+#else
+#define TA_PERF_SCOPE(stage, ...) ((void)0)
+#define TA_PERF_SAMPLED_SCOPE(stage) ((void)0)
+#define TA_PERF_THREAD(name) ((void)0)
+#endif
@@ -0,0 +1,225 @@
+#pragma once
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include <ITrafficStats.h>
+#include <JsonWriter.h>
+#include <AsyncLog.h>
+
+/// \brief Статистика трафика одного порта
+struct PortInfo
+{
+	std::uint64_t inPackets{0};
+	std::uint64_t outPackets{0};
+	std::uint64_t inTraffic{0};
+	std::uint64_t outTraffic{0};
+	std::uint64_t generation{0}; ///< Поколение статистики, в котором порт изменялся последний раз
+
+	void merge(const PortInfo &other)
+	{
+		inPackets += other.inPackets;
+		outPackets += other.outPackets;
+		inTraffic += other.inTraffic;
+		outTraffic += other.outTraffic;
+		generation = std::max(generation, other.generation);
+	}
+};
+
+/**
+ * \brief Статистика трафика по портам сервисов TCP и UDP
+ *
+ * Портом сервиса считается меньший из портов пакета: у клиента обычно динамический порт из верхнего диапазона.
+ * Номер записи порта хранится в плоском массиве на все 2 * 65536 портов,
+ * а сами записи лежат плотно в порядке появления портов
+ */
+class PortTrafficStats : public ITrafficStats
+{
+private:
+	static constexpr std::size_t portsCount = 65536;
+	static constexpr std::uint32_t noEntry = UINT32_MAX;
+
+	std::vector<std::uint32_t> entryOf;	  ///< Номер записи для TCP (первая половина) и UDP (вторая) портов
+	std::vector<std::uint32_t> slotOf;	  ///< Номер ячейки entryOf каждой записи
+	std::vector<PortInfo> entries;		  ///< Записи портов в порядке появления
+
+	static const char *protocolName(std::uint32_t slot) { return slot < portsCount ? "tcp" : "udp"; }
+
+	/// \brief Записывает пакет в статистику, общая часть addPacket и addPackets
+	void record(const PacketView &packet)
+	{
+		// Пакеты с нулевым весом переданы только для поиска имени хоста
+		if ((!packet.isTcp() && !packet.isUdp()) || !packet.weight)
+			return;
+
+		std::uint32_t slot = std::min(packet.srcPort, packet.dstPort) + (packet.isUdp() ? portsCount : 0);
+		std::uint32_t index = entryOf[slot];
+
+		if (index == noEntry)
+		{
+			index = static_cast<std::uint32_t>(entries.size());
+			entryOf[slot] = index;
+			slotOf.push_back(slot);
+			entries.emplace_back();
+		}
+
+		bool isInPacket = localAddresses->contains(packet.dstIp);
+		std::uint64_t inMask = 0 - static_cast<std::uint64_t>(isInPacket);
+		std::uint64_t bytes = std::uint64_t(packet.length) * packet.weight;
+
+		PortInfo &port = entries[index];
+		port.inPackets += packet.weight & inMask;
+		port.outPackets += packet.weight & ~inMask;
+		port.inTraffic += bytes & inMask;
+		port.outTraffic += bytes & ~inMask;
+		port.generation = generation;
+	}
+
+public:
+	/// \param[in] interfaceIpAddr IP-адрес интерфейса, относительно которого определяется направление пакетов
+	PortTrafficStats(const std::string &interfaceIpAddr)
+		: ITrafficStats(interfaceIpAddr), entryOf(2 * portsCount, noEntry) {}
+
+	std::string_view name() const override { return "ports"; }
+
+	/// \brief Возвращает статистику об обработанных пакетах в виде строки
+	std::string toString() const override
+	{
+		std::stringstream ss;
+
+		for (std::size_t i = 0; i < entries.size(); i++)
+		{
+			const auto &port = entries[i];
+
+			ss << std::left << std::setw(37) << (std::string(protocolName(slotOf[i])) + "/" + std::to_string(slotOf[i] % portsCount)) << " "
+			   << std::right << std::setw(6) << (port.inPackets + port.outPackets) << " packets (OUT "
+			   << std::left << std::setw(6) << port.outPackets << " | "
+			   << std::right << std::setw(6) << port.inPackets << " IN) traffic: "
+			   << std::right << std::setw(8) << (port.inTraffic + port.outTraffic) << " [bytes] (OUT "
+			   << std::left << std::setw(8) << port.outTraffic << " | "
+			   << std::right << std::setw(6) << port.inTraffic << " IN)" << std::endl;
+		}
+
+		return ss.str();
+	}
+
+	/// \brief Дописывает статистику в формате JSON в конец буфера out
+	///
+	/// Документ имеет вид {"generation":N,"ports":[{"protocol":"tcp","port":443,...}]}
+	void writeJson(std::string &out, std::uint64_t sinceGeneration) const override
+	{
+		JsonWriter json(out);
+
+		json.beginObject();
+		json.field("generation", generation);
+		json.key("ports").beginArray();
+
+		for (std::size_t i = 0; i < entries.size(); i++)
+		{
+			const auto &port = entries[i];
+			if (sinceGeneration && port.generation <= sinceGeneration)
+				continue;
+
+			json.beginObject();
+			json.field("protocol", protocolName(slotOf[i]));
+			json.field("port", std::uint64_t(slotOf[i] % portsCount));
+
+			json.key("packets").beginObject();
+			json.field("in", port.inPackets);
+			json.field("out", port.outPackets);
+			json.field("total", port.inPackets + port.outPackets);
+			json.endObject();
+
+			json.key("traffic").beginObject();
+			json.field("in", port.inTraffic);
+			json.field("out", port.outTraffic);
+			json.field("total", port.inTraffic + port.outTraffic);
+			json.endObject();
+
+			json.endObject();
+		}
+
+		json.endArray();
+		json.endObject();
+		out += '\n';
+	}
+
+	using ITrafficStats::addPacket;
+
+	/// \brief Учитывает пакет в статистике порта сервиса, пакеты без TCP или UDP заголовка пропускаются
+	void addPacket(const PacketView &packet) override { record(packet); }
+
+	void addPackets(std::span<const PacketView> packets) override
+	{
+		for (const auto &packet : packets)
+			record(packet);
+	}
+
+	/// \brief Очищает статистику
+	void clear() override
+	{
+		for (std::uint32_t slot : slotOf)
+			entryOf[slot] = noEntry;
+
+		slotOf.clear();
+		entries.clear();
+	}
+
+	/// \brief Возвращает независимую копию статистики
+	std::unique_ptr<ITrafficStats> clone() const override
+	{
+		return std::make_unique<PortTrafficStats>(*this);
+	}
+
+	/// \brief Копирует статистику в старую копию целиком: записей не больше 2 * 65536, и память копии переиспользуется
+	bool updateCopy(ITrafficStats &copy) const override
+	{
+		auto *target = dynamic_cast<PortTrafficStats *>(&copy);
+		if (!target)
+			return false;
+
+		*target = *this;
+		return true;
+	}
+
+	/// \brief Добавляет к статистике данные другого объекта PortTrafficStats
+	void merge(const ITrafficStats &other) override
+	{
+		auto *otherStats = dynamic_cast<const PortTrafficStats *>(&other);
+		if (!otherStats)
+		{
+			TA_LOG(warning) << "PortTrafficStats merge failed, other stats have different type";
+			return;
+		}
+
+		mergeSampling(other);
+
+		for (std::size_t i = 0; i < otherStats->entries.size(); i++)
+		{
+			std::uint32_t slot = otherStats->slotOf[i];
+			if (entryOf[slot] == noEntry)
+			{
+				entryOf[slot] = static_cast<std::uint32_t>(entries.size());
+				slotOf.push_back(slot);
+				entries.emplace_back();
+			}
+
+			entries[entryOf[slot]].merge(otherStats->entries[i]);
+		}
+	}
+
+	/// \brief Возвращает статистику порта, либо nullptr
+	/// \param[in] isUdp Порт UDP, иначе TCP
+	const PortInfo *findPort(std::uint16_t port, bool isUdp) const
+	{
+		std::uint32_t index = entryOf[port + (isUdp ? portsCount : 0)];
+		return index == noEntry ? nullptr : &entries[index];
+	}
+
+	/// \brief Возвращает количество портов в статистике
+	std::size_t size() const { return entries.size(); }
+};
@@ -0,0 +1,413 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+#include <IpKey.h>
+#include <HostTable.h>
+#include <PacketView.h>
+#include <LocalAddressSet.h>
+
+/// \brief Параметры истории скорости трафика
+struct RateHistoryConfig
+{
+	std::chrono::seconds resolution{1};	   ///< Длина интервала
+	std::chrono::seconds retention{3600};  ///< Сколько времени хранится история, 0 - не хранить историю
+	std::size_t hostsCapacity{256};		   ///< Для скольких хостов хранится история, помимо всего трафика
+};
+
+/// \brief Сумма значений за окно из нескольких интервалов
+struct RateSummary
+{
+	std::uint64_t bytes{0};
+	std::uint64_t packets{0};
+	std::uint64_t peakBytes{0};	  ///< Наибольшее количество байт за один интервал
+	std::uint64_t peakPackets{0}; ///< Наибольшее количество пакетов за один интервал
+
+	/// \brief Добавляет значения интервалов, пики определяются по каждому интервалу
+	void addIntervals(std::span<const std::uint64_t> intervalBytes, std::span<const std::uint64_t> intervalPackets)
+	{
+		for (std::size_t i = 0; i < intervalBytes.size(); i++)
+		{
+			bytes += intervalBytes[i];
+			packets += intervalPackets[i];
+			peakBytes = std::max(peakBytes, intervalBytes[i]);
+			peakPackets = std::max(peakPackets, intervalPackets[i]);
+		}
+	}
+};
+
+/**
+ * \brief История количества байт и пакетов каждого хоста по интервалам фиксированной длины
+ *
+ * Для каждого хоста и для всего трафика хранится кольцевой буфер из retention / resolution интервалов.
+ * Счетчики 64-битные (за длинный интервал канал 10 Гбит/с передает больше 4 ГиБ) и лежат построчно
+ * в двух непрерывных массивах, выделенных при создании, поэтому переход к новому интервалу -
+ * это один проход по строкам с обнулением ячейки, без выделения памяти.
+ * Интервалы отсчитываются по временным меткам пакетов.
+ *
+ * Пишет в историю один поток (поток захвата или обработчик), а читатели обращаются к счетчикам
+ * без блокировок, счетчики атомарные. Строка хоста, по которому не было трафика за всю глубину истории,
+ * выдается новому хосту, а очистка освобождает все строки. Хост строки меняется под мьютексом,
+ * который писатель берет только при выдаче строки, поэтому читатель проверяет, что за время чтения
+ * счетчиков строка осталась за тем же хостом (см. Row). Хосты, которым не хватило свободной строки,
+ * учитываются только в общем трафике
+ */
+class RateHistory
+{
+private:
+	using Counter = std::atomic<std::uint64_t>;
+
+	RateHistoryConfig config;
+	std::shared_ptr<const LocalAddressSet> localAddresses; ///< Адреса, относительно которых определяется удаленный хост
+	std::size_t slotsCount;		   ///< Количество интервалов в кольцевом буфере
+	std::int64_t resolutionSeconds; ///< Длина интервала (в сек)
+
+	std::unique_ptr<Counter[]> bytes;	///< Строка на каждый хост (нулевая - весь трафик) по slotsCount счетчиков
+	std::unique_ptr<Counter[]> packets; ///< Аналогично bytes
+
+	std::vector<IpKey> hosts;				///< Хост каждой выданной строки, начиная с первой, защищен hostsMutex
+	std::atomic<std::size_t> hostsCount{0}; ///< Количество выданных строк хостов, изменяется под hostsMutex
+	mutable std::mutex hostsMutex;			///< Защищает хосты строк, писатель берет его только при выдаче строки
+
+	HostTable<std::uint32_t> rowOf;		  ///< Номер строки хоста, запись с номером i - строка i + 1, используется только писателем
+	std::vector<std::uint64_t> lastTicks; ///< Интервал последнего пакета каждой строки, используется только писателем
+	std::vector<std::uint32_t> idleRows;  ///< Строки без трафика за всю глубину истории, используется только писателем
+
+	std::uint64_t currentTick{0};				///< Интервал последнего пакета, используется только писателем
+	bool isStarted{false};						///< Писатель получил хотя бы один пакет
+	std::atomic<std::uint64_t> publishedTick{0}; ///< Опубликованное значение currentTick + 1, 0 - пакетов ещё не было
+
+	static void increment(Counter &counter, std::uint64_t value)
+	{
+		// Писатель единственный, поэтому read-modify-write не требуется
+		counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+
+	/// \brief Обнуляет интервалы, пропущенные до нового тика
+	void rollOver(std::uint64_t tick)
+	{
+		std::size_t rows = hostsCount.load(std::memory_order_relaxed) + 1;
+		std::uint64_t first = isStarted ? std::max(currentTick + 1, tick - std::min<std::uint64_t>(tick, slotsCount - 1)) : tick;
+
+		for (std::uint64_t t = first; t <= tick; t++)
+		{
+			std::size_t slot = t % slotsCount;
+			for (std::size_t row = 0; row < rows; row++)
+			{
+				bytes[row * slotsCount + slot].store(0, std::memory_order_relaxed);
+				packets[row * slotsCount + slot].store(0, std::memory_order_relaxed);
+			}
+		}
+
+		currentTick = tick;
+		isStarted = true;
+		publishedTick.store(tick + 1, std::memory_order_release);
+
+		// Строки ищутся, только когда свободных уже нет: проход по строкам здесь и так выполняется
+		if (rows - 1 >= config.hostsCapacity)
+		{
+			idleRows.clear();
+			for (std::size_t row = rows - 1; row > 0; row--)
+				if (isIdle(row))
+					idleRows.push_back(static_cast<std::uint32_t>(row));
+		}
+	}
+
+	/// \brief Проверяет, что все интервалы строки уже обнулены после последнего пакета её хоста
+	bool isIdle(std::size_t row) const { return lastTicks[row - 1] + slotsCount <= currentTick; }
+
+	/// \brief Назначает строке row хост host, вызывается только писателем
+	void assignRow(std::size_t row, const IpKey &host)
+	{
+		std::lock_guard<std::mutex> guard(hostsMutex);
+		hosts[row - 1] = host;
+		if (row > hostsCount.load(std::memory_order_relaxed))
+			hostsCount.store(row, std::memory_order_relaxed);
+	}
+
+	/// \brief Возвращает строку хоста, выдавая ему свободную или простаивающую строку, либо 0
+	std::size_t rowFor(const IpKey &host)
+	{
+		std::size_t index = rowOf.indexOf(host);
+		if (index != HostTable<std::uint32_t>::npos)
+			return rowOf.valueAt(index);
+
+		std::size_t count = hostsCount.load(std::memory_order_relaxed);
+		if (count < config.hostsCapacity)
+		{
+			assignRow(count + 1, host);
+			rowOf[host] = static_cast<std::uint32_t>(count + 1);
+			return count + 1;
+		}
+
+		// Хост строки мог вернуться после того, как её отметили простаивающей
+		while (!idleRows.empty())
+		{
+			std::size_t row = idleRows.back();
+			idleRows.pop_back();
+
+			if (isIdle(row))
+			{
+				assignRow(row, host);
+				rowOf.replaceKey(row - 1, host);
+				return row;
+			}
+		}
+
+		return 0;
+	}
+
+	/// \brief Вызывает visit(номер от конца окна, байты, пакеты) для каждого хранимого интервала из count, заканчивающихся endTick
+	template <class Visitor>
+	void forEachInterval(std::size_t row, std::uint64_t endTick, std::size_t count, Visitor &&visit) const
+	{
+		std::uint64_t published = publishedTick.load(std::memory_order_acquire);
+		if (!published)
+			return;
+
+		std::uint64_t latest = published - 1;
+
+		for (std::size_t i = 0; i < count && i <= endTick; i++)
+		{
+			std::uint64_t tick = endTick - i;
+			if (tick > latest || latest - tick >= slotsCount)
+				continue;
+
+			std::size_t cell = row * slotsCount + tick % slotsCount;
+			visit(i, bytes[cell].load(std::memory_order_relaxed), packets[cell].load(std::memory_order_relaxed));
+		}
+	}
+
+	void sumRow(std::size_t row, std::uint64_t endTick, std::size_t count, RateSummary &summary) const
+	{
+		forEachInterval(row, endTick, count, [&summary](std::size_t, std::uint64_t intervalBytes, std::uint64_t intervalPackets)
+						{
+							summary.bytes += intervalBytes;
+							summary.packets += intervalPackets;
+							summary.peakBytes = std::max(summary.peakBytes, intervalBytes);
+							summary.peakPackets = std::max(summary.peakPackets, intervalPackets); });
+	}
+
+	void collectRow(std::size_t row, std::uint64_t endTick, std::size_t count, std::uint64_t *bytesOut, std::uint64_t *packetsOut) const
+	{
+		forEachInterval(row, endTick, count, [&](std::size_t i, std::uint64_t intervalBytes, std::uint64_t intervalPackets)
+						{
+							bytesOut[count - 1 - i] += intervalBytes;
+							packetsOut[count - 1 - i] += intervalPackets; });
+	}
+
+	/// \brief Проверяет, что строка с номером index выдана хосту host
+	bool isRowOf(std::size_t index, const IpKey &host) const
+	{
+		std::lock_guard<std::mutex> guard(hostsMutex);
+		return index < hostsCount.load(std::memory_order_relaxed) && hosts[index] == host;
+	}
+
+public:
+	/// \param[in] config Длина интервала, глубина истории и количество хостов
+	/// \param[in] interfaceIpAddr IP-адрес интерфейса, относительно которого определяется удаленный хост
+	RateHistory(const RateHistoryConfig &config, const std::string &interfaceIpAddr)
+		: RateHistory(config, LocalAddressSet::ofAddress(interfaceIpAddr)) {}
+
+	/// \param[in] config Длина интервала, глубина истории и количество хостов
+	/// \param[in] localAddresses Локальные адреса, относительно которых определяется удаленный хост
+	RateHistory(const RateHistoryConfig &config, std::shared_ptr<const LocalAddressSet> localAddresses)
+		: config(config),
+		  localAddresses(std::move(localAddresses)),
+		  resolutionSeconds(std::max<std::int64_t>(config.resolution.count(), 1))
+	{
+		slotsCount = std::max<std::size_t>(config.retention.count() / resolutionSeconds, 2);
+
+		std::size_t cells = (config.hostsCapacity + 1) * slotsCount;
+		bytes.reset(new Counter[cells]());
+		packets.reset(new Counter[cells]());
+
+		hosts.resize(config.hostsCapacity);
+		lastTicks.resize(config.hostsCapacity);
+		idleRows.reserve(config.hostsCapacity);
+		rowOf.reserve(config.hostsCapacity);
+	}
+
+	RateHistory(const RateHistory &) = delete;
+	RateHistory &operator=(const RateHistory &) = delete;
+
+	/// \brief Учитывает пакет в интервале его временной метки, вызывается только писателем
+	void addPacket(const PacketView &packet)
+	{
+		if (packet.srcIp.empty() || !packet.weight)
+			return;
+
+		std::uint64_t tick = packet.timestamp.tv_sec > 0 ? packet.timestamp.tv_sec / resolutionSeconds : 0;
+		if (!isStarted || tick > currentTick)
+			rollOver(tick);
+
+		// Пакеты с опоздавшей временной меткой учитываются в текущем интервале
+		std::size_t slot = currentTick % slotsCount;
+		bool isInPacket = false;
+		const IpKey &host = localAddresses->remoteHostOf(packet, isInPacket);
+		std::size_t row = rowFor(host);
+
+		// При выборочном учете пакет представляет weight пакетов
+		std::uint64_t packetBytes = std::uint64_t(packet.length) * packet.weight;
+
+		increment(bytes[slot], packetBytes);
+		increment(packets[slot], packet.weight);
+
+		if (row)
+		{
+			increment(bytes[row * slotsCount + slot], packetBytes);
+			increment(packets[row * slotsCount + slot], packet.weight);
+			lastTicks[row - 1] = currentTick;
+		}
+	}
+
+	/// \brief Учитывает пачку пакетов, вызывается только писателем
+	void addPackets(std::span<const PacketView> packets)
+	{
+		for (const auto &packet : packets)
+			addPacket(packet);
+	}
+
+	/**
+	 * \brief Обнуляет все счетчики и освобождает строки хостов
+	 *
+	 * Вызывается только писателем: increment не атомарен относительно других записей,
+	 * поэтому очистку из другого потока писатель мог бы частично перезаписать
+	 */
+	void clear()
+	{
+		std::size_t cells = (config.hostsCapacity + 1) * slotsCount;
+		for (std::size_t i = 0; i < cells; i++)
+		{
+			bytes[i].store(0, std::memory_order_relaxed);
+			packets[i].store(0, std::memory_order_relaxed);
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(hostsMutex);
+			hostsCount.store(0, std::memory_order_relaxed);
+		}
+
+		rowOf.clear();
+		idleRows.clear();
+	}
+
+	/// \brief Проверяет, был ли учтен хотя бы один пакет
+	bool hasPackets() const { return publishedTick.load(std::memory_order_acquire) != 0; }
+
+	/// \brief Возвращает номер интервала последнего пакета (время от начала эпохи, деленное на длину интервала)
+	std::uint64_t getLatestTick() const
+	{
+		std::uint64_t published = publishedTick.load(std::memory_order_acquire);
+		return published ? published - 1 : 0;
+	}
+
+	/// \brief Возвращает длину интервала (в сек)
+	std::int64_t getResolution() const { return resolutionSeconds; }
+
+	/// \brief Возвращает количество интервалов в истории
+	std::size_t getSlotsCount() const { return slotsCount; }
+
+	static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+	/// \brief Строка истории: номер строки хоста в истории (npos - весь трафик) и хост, которому она была выдана
+	struct Row
+	{
+		const RateHistory *history{nullptr};
+		std::size_t index{npos};
+		IpKey host;
+	};
+
+	/// \brief Возвращает количество хостов, для которых хранится история
+	std::size_t getHostsCount() const
+	{
+		std::lock_guard<std::mutex> guard(hostsMutex);
+		return hostsCount.load(std::memory_order_relaxed);
+	}
+
+	/// \brief Возвращает строки всех хостов, для которых хранится история
+	std::vector<Row> getHostRows() const
+	{
+		std::lock_guard<std::mutex> guard(hostsMutex);
+
+		std::vector<Row> rows(hostsCount.load(std::memory_order_relaxed));
+		for (std::size_t i = 0; i < rows.size(); i++)
+			rows[i] = {this, i, hosts[i]};
+
+		return rows;
+	}
+
+	/// \brief Возвращает строку хоста host, либо строку с номером npos, если для хоста нет истории
+	Row findHost(const IpKey &host) const
+	{
+		std::lock_guard<std::mutex> guard(hostsMutex);
+
+		std::size_t count = hostsCount.load(std::memory_order_relaxed);
+		for (std::size_t i = 0; i < count; i++)
+			if (hosts[i] == host)
+				return {this, i, host};
+
+		return {this, npos, host};
+	}
+
+	/// \brief Возвращает строку всего трафика
+	Row totalRow() const { return {this, npos, IpKey()}; }
+
+	/// \brief Добавляет к summary весь трафик за count интервалов, заканчивающихся интервалом endTick
+	void sumTotal(std::uint64_t endTick, std::size_t count, RateSummary &summary) const
+	{
+		sumRow(0, endTick, count, summary);
+	}
+
+	/**
+	 * \brief Добавляет к массивам значения строки row за каждый из count интервалов, заканчивающихся интервалом endTick
+	 *
+	 * Значения записываются от старого интервала к новому, для интервалов вне истории ничего не добавляется
+	 * \return False - если строку хоста за время чтения выдали другому хосту, тогда массивы не изменяются
+	 */
+	bool collect(const Row &row, std::uint64_t endTick, std::size_t count, std::uint64_t *bytesOut, std::uint64_t *packetsOut) const
+	{
+		if (row.index == npos)
+		{
+			collectRow(0, endTick, count, bytesOut, packetsOut);
+			return true;
+		}
+
+		std::vector<std::uint64_t> rowBytes(count, 0), rowPackets(count, 0);
+		collectRow(row.index + 1, endTick, count, rowBytes.data(), rowPackets.data());
+
+		if (!isRowOf(row.index, row.host))
+			return false;
+
+		for (std::size_t i = 0; i < count; i++)
+		{
+			bytesOut[i] += rowBytes[i];
+			packetsOut[i] += rowPackets[i];
+		}
+
+		return true;
+	}
+
+	/**
+	 * \brief Добавляет к summary трафик строк нескольких историй за count интервалов, заканчивающихся интервалом endTick
+	 *
+	 * Пакеты одного хоста могут попасть в истории разных писателей, поэтому строки сначала
+	 * суммируются по каждому интервалу, и только потом определяются пики
+	 */
+	static void sumRows(std::span<const Row> rows, std::uint64_t endTick, std::size_t count, RateSummary &summary)
+	{
+		std::vector<std::uint64_t> intervalBytes(count, 0), intervalPackets(count, 0);
+		for (const auto &row : rows)
+			row.history->collect(row, endTick, count, intervalBytes.data(), intervalPackets.data());
+
+		summary.addIntervals(intervalBytes, intervalPackets);
+	}
+};
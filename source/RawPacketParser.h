@@ -0,0 +1,246 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+#include <RawPacket.h>
+
+#include <IpKey.h>
+#include <PacketView.h>
+
+/**
+ * \brief Разбор заголовков пакета напрямую из байт RawPacket, без построения pcpp::Packet
+ *
+ * Поддерживаются Ethernet (в том числе с VLAN тегами), Linux SLL/SLL2, loopback и "сырой" IP
+ */
+class RawPacketParser
+{
+public:
+	/// \brief Положение сетевого уровня внутри пакета
+	struct NetworkLayer
+	{
+		std::size_t offset{0}; ///< Смещение IP заголовка от начала пакета
+		int version{0};		   ///< Версия IP: 4, 6, либо 0 если пакет не IP
+	};
+
+	/// \brief Ищет IP заголовок в пакете с канальным уровнем linkType
+	static NetworkLayer locateNetworkLayer(const std::uint8_t *data, std::size_t length, pcpp::LinkLayerType linkType)
+	{
+		std::size_t offset = 0;
+		std::uint16_t etherType = 0;
+
+		switch (linkType)
+		{
+		case pcpp::LINKTYPE_ETHERNET:
+			offset = 14;
+			if (length < offset)
+				return {};
+
+			etherType = read16(data + 12);
+			while ((etherType == 0x8100 || etherType == 0x88A8) && length >= offset + 4)
+			{
+				etherType = read16(data + offset + 2);
+				offset += 4;
+			}
+			return fromEtherType(etherType, offset, length);
+
+		case pcpp::LINKTYPE_LINUX_SLL:
+			return length < 16 ? NetworkLayer{} : fromEtherType(read16(data + 14), 16, length);
+
+		case pcpp::LINKTYPE_LINUX_SLL2:
+			return length < 20 ? NetworkLayer{} : fromEtherType(read16(data), 20, length);
+
+		case pcpp::LINKTYPE_NULL:
+		case pcpp::LINKTYPE_LOOP:
+			return fromVersionNibble(data, 4, length);
+
+		case pcpp::LINKTYPE_RAW:
+		case pcpp::LINKTYPE_DLT_RAW1:
+		case pcpp::LINKTYPE_DLT_RAW2:
+		case pcpp::LINKTYPE_IPV4:
+		case pcpp::LINKTYPE_IPV6:
+			return fromVersionNibble(data, 0, length);
+
+		default:
+			return {};
+		}
+	}
+
+	/**
+	 * \brief Извлекает адреса отправителя и получателя
+	 * \return False - если пакет не содержит IP заголовка
+	 */
+	static bool extractAddresses(const pcpp::RawPacket &packet, IpKey &srcIp, IpKey &dstIp)
+	{
+		const std::uint8_t *data = packet.getRawData();
+		NetworkLayer layer = locateNetworkLayer(data, packet.getRawDataLen(), packet.getLinkLayerType());
+
+		if (layer.version == 4)
+		{
+			srcIp = IpKey::fromIPv4(data + layer.offset + 12);
+			dstIp = IpKey::fromIPv4(data + layer.offset + 16);
+			return true;
+		}
+
+		if (layer.version == 6)
+		{
+			srcIp = IpKey::fromIPv6(data + layer.offset + 8);
+			dstIp = IpKey::fromIPv6(data + layer.offset + 24);
+			return true;
+		}
+
+		return false;
+	}
+
+	/**
+	 * \brief Читает адреса, порты и границы данных транспортного уровня из заголовков пакета
+	 *
+	 * Размер пакета, временная метка и ссылка на байты заполняются всегда,
+	 * даже если пакет не содержит IP заголовка
+	 * \return False - если пакет не содержит IP заголовка
+	 */
+	static bool parse(const std::uint8_t *data, std::size_t length, pcpp::LinkLayerType linkType, timespec timestamp, PacketView &view)
+	{
+		view = PacketView();
+		view.data = data;
+		view.length = static_cast<std::uint32_t>(length);
+		view.timestamp = timestamp;
+		view.linkType = linkType;
+
+		NetworkLayer layer = locateNetworkLayer(data, length, linkType);
+		const std::uint8_t *ip = data + layer.offset;
+		std::size_t transportOffset = 0;
+		std::size_t networkEnd = length;
+
+		if (layer.version == 4)
+		{
+			view.srcIp = IpKey::fromIPv4(ip + 12);
+			view.dstIp = IpKey::fromIPv4(ip + 16);
+
+			std::size_t headerLength = (ip[0] & 0x0F) * 4;
+			std::size_t totalLength = read16(ip + 2);
+			bool isFragment = (read16(ip + 6) & 0x1FFF) != 0;
+
+			if (headerLength < 20 || isFragment)
+				return true;
+
+			networkEnd = std::min(length, layer.offset + std::max(totalLength, headerLength));
+			view.transportProtocol = ip[9];
+			transportOffset = layer.offset + headerLength;
+		}
+		else if (layer.version == 6)
+		{
+			view.srcIp = IpKey::fromIPv6(ip + 8);
+			view.dstIp = IpKey::fromIPv6(ip + 24);
+
+			networkEnd = std::min(length, layer.offset + 40 + read16(ip + 4));
+			std::uint8_t nextHeader = ip[6];
+			transportOffset = layer.offset + 40;
+
+			while (isIPv6ExtensionHeader(nextHeader))
+			{
+				if (nextHeader == 44 || transportOffset + 8 > networkEnd)
+					return true;
+
+				// Длина AH задается в 4-байтовых словах без учета первых двух, остальных - в 8-байтовых без первого
+				std::size_t headerLength = nextHeader == 51 ? (data[transportOffset + 1] + 2) * 4 : (data[transportOffset + 1] + 1) * 8;
+				nextHeader = data[transportOffset];
+				transportOffset += headerLength;
+			}
+
+			view.transportProtocol = nextHeader;
+		}
+		else
+			return false;
+
+		if (view.isTcp() && transportOffset + 20 <= networkEnd)
+		{
+			const std::uint8_t *tcp = data + transportOffset;
+			std::size_t headerLength = (tcp[12] >> 4) * 4;
+
+			view.srcPort = read16(tcp);
+			view.dstPort = read16(tcp + 2);
+			view.tcpFlags = tcp[13];
+
+			if (headerLength >= 20)
+				setPayload(view, transportOffset + headerLength, networkEnd);
+		}
+		else if (view.isUdp() && transportOffset + 8 <= networkEnd)
+		{
+			const std::uint8_t *udp = data + transportOffset;
+
+			view.srcPort = read16(udp);
+			view.dstPort = read16(udp + 2);
+			setPayload(view, transportOffset + 8, networkEnd);
+		}
+
+		return true;
+	}
+
+	/// \brief Перегрузка parse для RawPacket
+	static bool parse(const pcpp::RawPacket &packet, PacketView &view)
+	{
+		return parse(packet.getRawData(), packet.getRawDataLen(), packet.getLinkLayerType(), packet.getPacketTimeStamp(), view);
+	}
+
+	/**
+	 * \brief Возвращает симметричный хэш пары адресов пакета
+	 *
+	 * Пакеты обоих направлений между двумя хостами получают одинаковый хэш.
+	 * Для пакетов без IP заголовка возвращается 0
+	 */
+	static std::uint64_t flowHash(const pcpp::RawPacket &packet)
+	{
+		IpKey srcIp, dstIp;
+		if (!extractAddresses(packet, srcIp, dstIp))
+			return 0;
+
+		return srcIp.hash() + dstIp.hash();
+	}
+
+private:
+	static std::uint16_t read16(const std::uint8_t *data)
+	{
+		return static_cast<std::uint16_t>((data[0] << 8) | data[1]);
+	}
+
+	static bool isIPv6ExtensionHeader(std::uint8_t nextHeader)
+	{
+		return nextHeader == 0 || nextHeader == 43 || nextHeader == 44 || nextHeader == 51 || nextHeader == 60;
+	}
+
+	static void setPayload(PacketView &view, std::size_t offset, std::size_t end)
+	{
+		if (offset >= end)
+			return;
+
+		view.payload = view.data + offset;
+		view.payloadLength = static_cast<std::uint32_t>(end - offset);
+	}
+
+	static NetworkLayer fromEtherType(std::uint16_t etherType, std::size_t offset, std::size_t length)
+	{
+		if (etherType == 0x0800 && length >= offset + 20)
+			return {offset, 4};
+
+		if (etherType == 0x86DD && length >= offset + 40)
+			return {offset, 6};
+
+		return {};
+	}
+
+	static NetworkLayer fromVersionNibble(const std::uint8_t *data, std::size_t offset, std::size_t length)
+	{
+		if (length < offset + 20)
+			return {};
+
+		int version = data[offset] >> 4;
+		if (version == 4)
+			return {offset, 4};
+
+		if (version == 6 && length >= offset + 40)
+			return {offset, 6};
+
+		return {};
+	}
+};
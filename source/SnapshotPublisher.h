@@ -0,0 +1,212 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+#include <ITrafficStats.h>
+
+/// \brief Правила публикации копий статистики
+struct SnapshotPolicy
+{
+	std::chrono::milliseconds period{250}; ///< Максимальный возраст опубликованной копии
+	std::uint64_t packets{1000000};		   ///< Через сколько пакетов публиковать копию, независимо от времени
+};
+
+/**
+ * \brief Публикует неизменяемые копии статистики для читателей (по принципу RCU)
+ *
+ * Писатель (поток захвата или обработчик) изменяет статистику без блокировок
+ * и периодически публикует её копию заменой указателя. Читатели получают
+ * последнюю опубликованную копию и формируют ответ из неё, не обращаясь к писателю.
+ * Старая копия освобождается, когда её перестает использовать последний читатель.
+ * Замена и чтение указателя защищены отдельным мьютексом, который удерживается
+ * только на время копирования shared_ptr, поэтому сериализация ответа читателем
+ * никогда не задерживает писателя
+ *
+ * После публикации живой статистике назначается новое поколение из общего счетчика,
+ * поэтому все последующие изменения помечаются поколением больше, чем у опубликованной копии
+ */
+class SnapshotPublisher
+{
+private:
+	std::shared_ptr<ITrafficStats> snapshot;	   ///< Последняя опубликованная копия, читатели получают её только для чтения
+	std::shared_ptr<ITrafficStats> spare;		   ///< Предпоследняя опубликованная копия, используется только писателем
+	mutable std::mutex snapshotMutex;			   ///< Защищает только замену и копирование указателя snapshot
+	std::atomic<std::int64_t> publishedAt{0};	   ///< Время публикации последней копии (в нс)
+	std::atomic<bool> publishRequested{false};	   ///< Читатель получил устаревшую копию
+
+	std::int64_t period;
+	std::uint64_t packetsThreshold;
+	std::uint64_t pendingPackets{0}; ///< Количество пакетов, не попавших в опубликованную копию, используется только писателем
+
+	static constexpr std::uint64_t clockCheckMask = 63; ///< Время проверяется раз в 64 пакета
+
+	static inline std::atomic<std::uint64_t> generationClock{0}; ///< Общий для всех писателей счетчик поколений статистики
+
+	static std::int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	bool isExpired() const
+	{
+		return now() - publishedAt.load(std::memory_order_relaxed) >= period;
+	}
+
+public:
+	/// \param[in] initial Статистика, копия которой будет опубликована сразу
+	/// \param[in] policy Правила публикации
+	SnapshotPublisher(ITrafficStats &initial, const SnapshotPolicy &policy)
+		: period(std::chrono::duration_cast<std::chrono::nanoseconds>(policy.period).count()),
+		  packetsThreshold(policy.packets ? policy.packets : UINT64_MAX)
+	{
+		publish(initial);
+	}
+
+	SnapshotPublisher(const SnapshotPublisher &) = delete;
+	SnapshotPublisher &operator=(const SnapshotPublisher &) = delete;
+
+	/// \brief Учитывает обработанный пакет и при необходимости публикует копию, вызывается только писателем
+	void onPacket(ITrafficStats &stats) { onPackets(stats, 1); }
+
+	/// \brief Учитывает пачку из count обработанных пакетов, вызывается только писателем
+	///
+	/// Время проверяется, если пачка пересекла границу очередных 64 пакетов
+	void onPackets(ITrafficStats &stats, std::uint64_t count)
+	{
+		std::uint64_t previous = pendingPackets;
+		pendingPackets += count;
+
+		if (pendingPackets >= packetsThreshold ||
+			publishRequested.load(std::memory_order_relaxed) ||
+			((previous | clockCheckMask) < pendingPackets && isExpired()))
+			publish(stats);
+	}
+
+	/// \brief Публикует копию, если есть неопубликованные пакеты и копия устарела, вызывается только писателем
+	void onIdle(ITrafficStats &stats)
+	{
+		if (pendingPackets && (publishRequested.load(std::memory_order_relaxed) || isExpired()))
+			publish(stats);
+	}
+
+	/**
+	 * \brief Публикует копию статистики немедленно, вызывается только писателем
+	 *
+	 * Если предпоследнюю копию больше не держит ни один читатель, в неё переносятся только изменения
+	 * двух последних поколений (ITrafficStats::updateCopy), и она публикуется вместо новой копии.
+	 * Так пауза писателя пропорциональна числу изменившихся хостов, а не всех хостов.
+	 * Иначе (или если статистика не умеет обновлять копии) статистика копируется целиком
+	 */
+	void publish(ITrafficStats &stats)
+	{
+		std::shared_ptr<ITrafficStats> published;
+
+		if (spare && spare.use_count() == 1)
+		{
+			// Последний читатель отпустил копию до того, как писатель начнет её изменять
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (stats.updateCopy(*spare))
+				published = std::move(spare);
+		}
+
+		if (!published)
+			published = stats.clone();
+
+		stats.setGeneration(generationClock.fetch_add(1, std::memory_order_relaxed) + 1);
+
+		{
+			std::lock_guard<std::mutex> guard(snapshotMutex);
+			snapshot.swap(published);
+		}
+
+		spare = std::move(published);
+
+		publishedAt.store(now(), std::memory_order_relaxed);
+		publishRequested.store(false, std::memory_order_relaxed);
+		pendingPackets = 0;
+	}
+
+	/**
+	 * \brief Возвращает последнюю опубликованную копию, может вызываться из любого потока
+	 *
+	 * Если копия старше периода публикации, писатель опубликует новую при обработке следующего пакета,
+	 * либо при простое (onIdle)
+	 */
+	std::shared_ptr<const ITrafficStats> get()
+	{
+		if (isExpired())
+			publishRequested.store(true, std::memory_order_relaxed);
+
+		std::lock_guard<std::mutex> guard(snapshotMutex);
+		return snapshot;
+	}
+};
+
+
+/**
+ * \brief Поток, который периодически дает писателю опубликовать копию без поступления пакетов
+ *
+ * Поток libpcap вызывает писателя только при поступлении пакета, поэтому без трафика писатель
+ * не проверяет возраст копии и читатели получали бы устаревшую копию сколь угодно долго.
+ * Таймер раз в период вызывает tick, в котором писатель публикует копию через onIdle.
+ * Вызов tick сериализуется с обработкой пакетов самим писателем: например, tick пытается
+ * без ожидания захватить мьютекс, который поток захвата удерживает на время обработки пакета
+ */
+class IdlePublishTimer
+{
+private:
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	bool running{false}; ///< Защищен mutex
+
+public:
+	IdlePublishTimer() = default;
+	~IdlePublishTimer() { stop(); }
+
+	IdlePublishTimer(const IdlePublishTimer &) = delete;
+	IdlePublishTimer &operator=(const IdlePublishTimer &) = delete;
+
+	/// \brief Запускает поток, вызывающий tick раз в period (но не чаще раза в миллисекунду)
+	void start(std::chrono::milliseconds period, std::function<void()> tick)
+	{
+		stop();
+
+		running = true;
+		period = std::max(period, std::chrono::milliseconds(1));
+
+		thread = std::thread(
+			[this, period, tick = std::move(tick)]
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				while (!wakeup.wait_for(lock, period, [this]
+										{ return !running; }))
+				{
+					lock.unlock();
+					tick();
+					lock.lock();
+				}
+			});
+	}
+
+	/// \brief Останавливает поток, после возврата tick больше не вызывается
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			running = false;
+		}
+
+		wakeup.notify_all();
+
+		if (thread.joinable())
+			thread.join();
+	}
+};
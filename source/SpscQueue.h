@@ -0,0 +1,104 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+/**
+ * \brief Ограниченная lock-free очередь с одним писателем и одним читателем
+ *
+ * Элементы создаются один раз при создании очереди и переиспользуются,
+ * запись и чтение выполняются "на месте" через переданные функторы
+ * \tparam T Тип элемента очереди
+ */
+template <class T>
+class SpscQueue
+{
+private:
+	static constexpr std::size_t cacheLineSize = 64;
+
+	std::vector<T> slots;
+	std::size_t mask;
+
+	alignas(cacheLineSize) std::atomic<std::size_t> head{0}; ///< Позиция следующего элемента для чтения
+	alignas(cacheLineSize) std::atomic<std::size_t> tail{0}; ///< Позиция следующего элемента для записи
+
+	static std::size_t roundUpToPowerOfTwo(std::size_t value)
+	{
+		std::size_t result = 1;
+		while (result < value)
+			result <<= 1;
+
+		return result;
+	}
+
+public:
+	/// \param[in] capacity Минимальная вместимость очереди, округляется вверх до степени двойки
+	explicit SpscQueue(std::size_t capacity)
+		: slots(roundUpToPowerOfTwo(capacity)), mask(slots.size() - 1) {}
+
+	SpscQueue(const SpscQueue &) = delete;
+	SpscQueue &operator=(const SpscQueue &) = delete;
+
+	/**
+	 * \brief Записывает элемент в очередь, вызывается только писателем
+	 * \param[in] fill Функтор, заполняющий свободный элемент очереди
+	 * \return False - если очередь заполнена
+	 */
+	template <class F>
+	bool tryPush(F &&fill)
+	{
+		std::size_t currentTail = tail.load(std::memory_order_relaxed);
+		if (currentTail - head.load(std::memory_order_acquire) == slots.size())
+			return false;
+
+		fill(slots[currentTail & mask]);
+		tail.store(currentTail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * \brief Извлекает элемент из очереди, вызывается только читателем
+	 * \param[in] consume Функтор, обрабатывающий элемент очереди
+	 * \return False - если очередь пуста
+	 */
+	template <class F>
+	bool tryPop(F &&consume)
+	{
+		std::size_t currentHead = head.load(std::memory_order_relaxed);
+		if (currentHead == tail.load(std::memory_order_acquire))
+			return false;
+
+		consume(slots[currentHead & mask]);
+		head.store(currentHead + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * \brief Возвращает количество элементов, доступных читателю, но не больше maxCount, вызывается только читателем
+	 *
+	 * Элементы читаются через peek() и остаются в очереди до вызова release(),
+	 * что позволяет обработать их пачкой и освободить одной записью позиции
+	 */
+	std::size_t readable(std::size_t maxCount) const
+	{
+		std::size_t available = tail.load(std::memory_order_acquire) - head.load(std::memory_order_relaxed);
+		return available < maxCount ? available : maxCount;
+	}
+
+	/// \brief Возвращает i-й из доступных читателю элементов
+	T &peek(std::size_t i) { return slots[(head.load(std::memory_order_relaxed) + i) & mask]; }
+
+	/// \brief Освобождает count первых элементов, прочитанных через peek()
+	void release(std::size_t count)
+	{
+		head.store(head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+	}
+
+	/// \brief Возвращает приблизительное количество элементов в очереди
+	std::size_t size() const
+	{
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+
+	std::size_t capacity() const { return slots.size(); }
+};
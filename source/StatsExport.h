@@ -0,0 +1,1012 @@
+#pragma once
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <filesystem>
+#include <string_view>
+#include <system_error>
+#include <condition_variable>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <IpKey.h>
+#include <HostInfo.h>
+#include <HostTable.h>
+#include <NameArena.h>
+#include <AsyncLog.h>
+#include <ITrafficStats.h>
+
+/// \brief Способ сжатия блоков файла выгрузки
+enum class StatsExportCodec : std::uint8_t
+{
+	none = 0,	  ///< Блок пишется как есть
+	zeroRuns = 1, ///< Байты записей группируются по смещению в записи, затем сжимаются серии нулевых байтов
+};
+
+/// \brief Параметры выгрузки статистики хостов в двоичные файлы
+struct StatsExportConfig
+{
+	std::string directory;						 ///< Каталог файлов, пустой - статистика не выгружается
+	std::chrono::milliseconds period{5000};		 ///< Интервал, изменения счетчиков за который записываются вместе
+	std::uint64_t maxFileSize{64ull << 20};		 ///< Размер файла, после которого блоки пишутся в новый файл
+	std::size_t maxFiles{168};					 ///< Сколько последних файлов хранится, более старые удаляются
+	StatsExportCodec codec{StatsExportCodec::zeroRuns};
+	std::size_t blockSize{1 << 20};				 ///< Размер несжатого блока записей, при котором блок пишется на диск
+	std::chrono::seconds flushPeriod{60};		 ///< Блок пишется на диск не позже, чем через это время после начала
+
+	bool isEnabled() const { return !directory.empty(); }
+};
+
+/**
+ * \brief Формат файлов выгрузки статистики хостов
+ *
+ * Каталог выгрузки содержит файлы stats-<время создания в мс>.bin, которые только дописываются.
+ * Файл начинается с заголовка FileHeader, за ним идут блоки: заголовок BlockHeader и записи блока,
+ * сжатые кодеком блока. Все записи имеют размер recordSize, вид записи задается её первым байтом.
+ * Интервал - это запись IntervalRecord, за которой идут записи хостов, изменившихся за интервал:
+ * счетчики HostRecord содержат прирост с прошлого интервала. Имя хоста (NameRecord) пишется
+ * в каждом блоке перед первой записью хоста, поэтому каждый блок читается независимо.
+ *
+ * Рядом с файлом лежит индекс stats-<время>.idx: для каждого блока время первого и последнего
+ * интервала и смещение блока в файле. Индекс нужен только для поиска первого блока по времени,
+ * после него блоки читаются по заголовкам, так что отставший от файла индекс не мешает чтению
+ */
+struct StatsExportFormat
+{
+	static constexpr std::uint32_t version = 1;
+	static constexpr std::size_t recordSize = 64;
+	static constexpr char fileMagic[8] = {'T', 'A', 'E', 'X', 'P', 'R', 'T', '\0'};
+	static constexpr char indexMagic[8] = {'T', 'A', 'E', 'X', 'I', 'D', 'X', '\0'};
+	static constexpr std::uint32_t blockMagic = 0x4B4C4254; ///< "TBLK"
+
+	/// \brief Вид записи, её первый байт
+	enum Kind : std::uint8_t
+	{
+		interval = 1,
+		host = 2,
+		name = 3,
+	};
+
+	/// \brief Начало интервала, время - в мс с начала эпохи Unix
+	struct IntervalRecord
+	{
+		std::uint8_t kind;
+		std::uint8_t reserved[3];
+		std::uint32_t hostsCount; ///< Количество записей хостов интервала
+		std::int64_t time;		  ///< Конец интервала
+		std::int64_t duration;	  ///< Длина интервала
+		std::uint64_t hostsTotal; ///< Количество хостов в статистике, включая не изменившиеся
+		std::uint8_t padding[32];
+	};
+
+	/// \brief Прирост счетчиков хоста за интервал
+	struct HostRecord
+	{
+		std::uint8_t kind;
+		std::uint8_t addressLength; ///< 4 для IPv4, 16 для IPv6
+		std::uint8_t reserved[2];
+		std::uint32_t completedFlows;
+		std::uint8_t address[16]; ///< Байты адреса в сетевом порядке
+		std::uint64_t inPackets;
+		std::uint64_t outPackets;
+		std::uint64_t inTraffic;
+		std::uint64_t outTraffic;
+		std::uint32_t activeFlows; ///< Значение на конец интервала, а не прирост
+		std::uint32_t sampledPackets;
+	};
+
+	/// \brief Часть имени хоста, длинные имена занимают несколько записей подряд
+	struct NameRecord
+	{
+		std::uint8_t kind;
+		std::uint8_t addressLength;
+		std::uint8_t offset; ///< Смещение части в имени
+		std::uint8_t length; ///< Длина части
+		std::uint8_t address[16];
+		char name[44];
+	};
+
+	struct FileHeader
+	{
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t recordSize;
+		std::int64_t createdTime; ///< Время создания файла в мс
+		std::int64_t period;	  ///< Длина интервала в мс
+	};
+
+	struct BlockHeader
+	{
+		std::uint32_t magic;
+		std::uint8_t codec; ///< StatsExportCodec
+		std::uint8_t reserved[3];
+		std::uint32_t rawSize;	  ///< Размер записей блока до сжатия
+		std::uint32_t storedSize; ///< Размер записей блока в файле
+		std::uint32_t recordsCount;
+		std::uint32_t checksum; ///< FNV-1a записанных байтов блока
+		std::int64_t firstTime; ///< Время первого интервала блока
+		std::int64_t lastTime;	///< Время последнего интервала блока
+	};
+
+	struct IndexHeader
+	{
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t entrySize;
+	};
+
+	struct IndexEntry
+	{
+		std::int64_t firstTime;
+		std::int64_t lastTime;
+		std::uint64_t offset; ///< Смещение заголовка блока в файле
+	};
+
+	static constexpr std::size_t maxNameLength = 255;
+
+	static std::uint32_t checksum(const std::uint8_t *data, std::size_t size)
+	{
+		std::uint32_t hash = 2166136261u;
+		for (std::size_t i = 0; i < size; i++)
+			hash = (hash ^ data[i]) * 16777619u;
+
+		return hash;
+	}
+
+	/// \brief Возвращает имя файла данных, созданного в момент createdTime (в мс)
+	static std::string dataFileName(std::int64_t createdTime)
+	{
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "stats-%014lld.bin", static_cast<long long>(createdTime));
+		return buffer;
+	}
+
+	/// \brief Возвращает путь индекса файла данных dataPath
+	static std::string indexPathOf(const std::string &dataPath)
+	{
+		return dataPath.substr(0, dataPath.size() - 4) + ".idx";
+	}
+
+	/// \brief Возвращает пути файлов данных каталога directory в порядке создания
+	static std::vector<std::string> listDataFiles(const std::string &directory)
+	{
+		std::vector<std::string> files;
+		std::error_code error;
+
+		for (const auto &entry : std::filesystem::directory_iterator(directory, error))
+		{
+			// Время создания в имени разбирается при чтении, поэтому чужие файлы с похожим именем пропускаются
+			std::string fileName = entry.path().filename().string();
+			if (fileName.size() == dataFileName(0).size() && fileName.compare(0, 6, "stats-") == 0 &&
+				fileName.compare(fileName.size() - 4, 4, ".bin") == 0 &&
+				std::all_of(fileName.begin() + 6, fileName.end() - 4, [](unsigned char c)
+							{ return std::isdigit(c) != 0; }))
+				files.push_back(entry.path().string());
+		}
+
+		std::sort(files.begin(), files.end());
+		return files;
+	}
+
+	/**
+	 * \brief Сжимает записи: байты с одним смещением во всех записях идут подряд, после чего
+	 * старшие байты счетчиков и неиспользуемые поля образуют длинные серии нулей
+	 *
+	 * Управляющий байт c < 0x80 означает c + 1 байт как есть, 0x80 <= c < 0xFF - c - 0x7F нулевых байтов,
+	 * 0xFF - количество нулевых байтов в следующих 4 байтах
+	 */
+	static void encodeZeroRuns(const std::uint8_t *records, std::size_t size, std::vector<std::uint8_t> &shuffled, std::vector<std::uint8_t> &out)
+	{
+		std::size_t count = size / recordSize;
+		shuffled.resize(size);
+		for (std::size_t record = 0; record < count; record++)
+			for (std::size_t offset = 0; offset < recordSize; offset++)
+				shuffled[offset * count + record] = records[record * recordSize + offset];
+
+		const std::uint8_t *data = shuffled.data();
+		out.clear();
+
+		for (std::size_t i = 0; i < size;)
+		{
+			std::size_t zeros = 0;
+			while (i + zeros < size && data[i + zeros] == 0)
+				zeros++;
+
+			if (zeros >= 2 || (zeros == 1 && i + 1 == size))
+			{
+				if (zeros < 0x80)
+					out.push_back(static_cast<std::uint8_t>(0x7F + zeros));
+				else
+				{
+					std::uint32_t length = static_cast<std::uint32_t>(zeros);
+					out.push_back(0xFF);
+					out.insert(out.end(), reinterpret_cast<const std::uint8_t *>(&length), reinterpret_cast<const std::uint8_t *>(&length) + sizeof(length));
+				}
+
+				i += zeros;
+				continue;
+			}
+
+			std::size_t end = i;
+			while (end < size && end - i < 0x80 && !(data[end] == 0 && end + 1 < size && data[end + 1] == 0))
+				end++;
+
+			out.push_back(static_cast<std::uint8_t>(end - i - 1));
+			out.insert(out.end(), data + i, data + end);
+			i = end;
+		}
+	}
+
+	/// \brief Восстанавливает rawSize байтов записей, сжатых encodeZeroRuns
+	/// \return False - если данные повреждены
+	static bool decodeZeroRuns(const std::uint8_t *data, std::size_t size, std::size_t rawSize, std::vector<std::uint8_t> &shuffled, std::vector<std::uint8_t> &records)
+	{
+		if (rawSize % recordSize)
+			return false;
+
+		shuffled.assign(rawSize, 0);
+		std::size_t written = 0;
+
+		for (std::size_t i = 0; i < size;)
+		{
+			std::uint8_t control = data[i++];
+			std::size_t length;
+
+			if (control < 0x80)
+			{
+				length = std::size_t(control) + 1;
+				if (i + length > size || written + length > rawSize)
+					return false;
+
+				std::memcpy(shuffled.data() + written, data + i, length);
+				i += length;
+			}
+			else if (control < 0xFF)
+				length = control - 0x7F;
+			else
+			{
+				std::uint32_t zeros;
+				if (i + sizeof(zeros) > size)
+					return false;
+
+				std::memcpy(&zeros, data + i, sizeof(zeros));
+				i += sizeof(zeros);
+				length = zeros;
+			}
+
+			if (written + length > rawSize)
+				return false;
+
+			written += length;
+		}
+
+		if (written != rawSize)
+			return false;
+
+		std::size_t count = rawSize / recordSize;
+		records.resize(rawSize);
+		for (std::size_t record = 0; record < count; record++)
+			for (std::size_t offset = 0; offset < recordSize; offset++)
+				records[record * recordSize + offset] = shuffled[offset * count + record];
+
+		return true;
+	}
+};
+
+static_assert(sizeof(StatsExportFormat::IntervalRecord) == StatsExportFormat::recordSize, "IntervalRecord layout is a part of the file format");
+static_assert(sizeof(StatsExportFormat::HostRecord) == StatsExportFormat::recordSize, "HostRecord layout is a part of the file format");
+static_assert(sizeof(StatsExportFormat::NameRecord) == StatsExportFormat::recordSize, "NameRecord layout is a part of the file format");
+static_assert(sizeof(StatsExportFormat::FileHeader) == 32, "FileHeader layout is a part of the file format");
+static_assert(sizeof(StatsExportFormat::BlockHeader) == 40, "BlockHeader layout is a part of the file format");
+static_assert(sizeof(StatsExportFormat::IndexEntry) == 24, "IndexEntry layout is a part of the file format");
+
+/**
+ * \brief Периодически выгружает счетчики хостов в файлы формата StatsExportFormat
+ *
+ * Работает в собственном потоке: раз в период берет хосты последней опубликованной копии статистики
+ * через source, записывает прирост счетчиков изменившихся хостов в блок в памяти и пишет блок
+ * на диск одним вызовом write, когда он наберет blockSize байтов или пролежит flushPeriod.
+ * Поток захвата в выгрузке не участвует
+ */
+class StatsExporter : private IHostVisitor
+{
+public:
+	/// \brief Передает visitor хосты текущей статистики, вызывается потоком выгрузки
+	using HostsSource = std::function<void(IHostVisitor &visitor)>;
+
+private:
+	using Format = StatsExportFormat;
+
+	/// \brief Счетчики хоста на конец прошлого интервала
+	struct Counters
+	{
+		std::uint64_t inPackets{0};
+		std::uint64_t outPackets{0};
+		std::uint64_t inTraffic{0};
+		std::uint64_t outTraffic{0};
+		std::uint32_t activeFlows{0};
+		std::uint32_t completedFlows{0};
+		std::uint32_t sampledPackets{0};
+	};
+
+	StatsExportConfig config;
+	HostsSource source;
+
+	std::thread writer;
+	std::mutex writerMutex;
+	std::condition_variable writerWakeup;
+	bool isStopping{false};
+
+	HostTable<Counters> previous; ///< Счетчики хостов на конец прошлого интервала
+	HostTable<Counters> current;  ///< Счетчики хостов текущего интервала
+	HostTable<std::uint32_t> blockNames; ///< Номера имен хостов, уже записанные в текущий блок
+	bool isPriming{false};		  ///< Текущий обход только запоминает счетчики, ничего не записывая
+
+	std::vector<std::uint8_t> block; ///< Несжатые записи текущего блока
+	std::vector<std::uint8_t> shuffled;
+	std::vector<std::uint8_t> encoded;
+	std::vector<std::uint8_t> output; ///< Заголовок и записи блока, которые пишутся одним вызовом
+	std::int64_t blockFirstTime{0};
+	std::int64_t blockLastTime{0};
+	std::chrono::steady_clock::time_point blockStarted{};
+
+	int fd{-1};
+	int indexFd{-1};
+	std::string filePath;
+	std::uint64_t fileSize{0};
+
+	std::chrono::steady_clock::time_point intervalStarted{};
+	std::size_t intervalOffset{0}; ///< Смещение записи текущего интервала в блоке
+
+	std::uint64_t intervals{0};
+	std::uint64_t writtenBytes{0};
+	std::uint64_t filesCount{0};
+	std::uint64_t failedBlocks{0};
+
+	static std::int64_t nowMs()
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+
+	static void copyAddress(const IpKey &host, std::uint8_t *address, std::uint8_t &addressLength)
+	{
+		std::memcpy(address, host.bytes.data(), 16);
+		addressLength = host.length;
+	}
+
+	template <class Record>
+	Record &appendRecord()
+	{
+		block.resize(block.size() + Format::recordSize);
+		Record *record = reinterpret_cast<Record *>(block.data() + block.size() - Format::recordSize);
+		std::memset(record, 0, Format::recordSize);
+		return *record;
+	}
+
+	static std::uint64_t delta(std::uint64_t value, std::uint64_t previousValue)
+	{
+		// Уменьшившийся счетчик означает очистку статистики, прирост считается с нуля
+		return value >= previousValue ? value - previousValue : value;
+	}
+
+	void onHost(const IpKey &host, const HostInfo &hostInfo, std::uint32_t nameId) override
+	{
+		Counters &counters = current[host];
+		counters = {hostInfo.inPackets, hostInfo.outPackets, hostInfo.inTraffic, hostInfo.outTraffic,
+					hostInfo.activeFlows, hostInfo.completedFlows, hostInfo.sampledPackets};
+
+		if (isPriming)
+			return;
+
+		static const Counters none;
+		const Counters *last = previous.find(host);
+		if (!last)
+			last = &none;
+
+		Format::HostRecord record{};
+		record.kind = Format::host;
+		copyAddress(host, record.address, record.addressLength);
+		record.inPackets = delta(counters.inPackets, last->inPackets);
+		record.outPackets = delta(counters.outPackets, last->outPackets);
+		record.inTraffic = delta(counters.inTraffic, last->inTraffic);
+		record.outTraffic = delta(counters.outTraffic, last->outTraffic);
+		record.completedFlows = static_cast<std::uint32_t>(delta(counters.completedFlows, last->completedFlows));
+		record.sampledPackets = static_cast<std::uint32_t>(delta(counters.sampledPackets, last->sampledPackets));
+		record.activeFlows = counters.activeFlows;
+
+		if (!record.inPackets && !record.outPackets && !record.completedFlows && counters.activeFlows == last->activeFlows)
+			return;
+
+		if (nameId != NameArena::noName)
+		{
+			std::uint32_t &writtenName = blockNames[host];
+			if (writtenName != nameId + 1)
+			{
+				writtenName = nameId + 1;
+				appendName(host, NameArena::instance().view(nameId));
+			}
+		}
+
+		appendRecord<Format::HostRecord>() = record;
+		reinterpret_cast<Format::IntervalRecord *>(block.data() + intervalOffset)->hostsCount++;
+	}
+
+	void appendName(const IpKey &host, std::string_view name)
+	{
+		name = name.substr(0, Format::maxNameLength);
+		std::size_t offset = 0;
+
+		do
+		{
+			auto &record = appendRecord<Format::NameRecord>();
+			record.kind = Format::name;
+			copyAddress(host, record.address, record.addressLength);
+			record.offset = static_cast<std::uint8_t>(offset);
+			record.length = static_cast<std::uint8_t>(std::min(name.size() - offset, sizeof(record.name)));
+			std::memcpy(record.name, name.data() + offset, record.length);
+			offset += record.length;
+		} while (offset < name.size());
+	}
+
+	/// \brief Записывает интервал, закончившийся сейчас
+	void recordInterval()
+	{
+		auto now = std::chrono::steady_clock::now();
+		std::int64_t time = nowMs();
+
+		if (block.empty())
+		{
+			blockFirstTime = time;
+			blockStarted = now;
+		}
+
+		intervalOffset = block.size();
+		auto &interval = appendRecord<Format::IntervalRecord>();
+		interval.kind = Format::interval;
+		interval.time = time;
+		interval.duration = std::chrono::duration_cast<std::chrono::milliseconds>(now - intervalStarted).count();
+		intervalStarted = now;
+		blockLastTime = time;
+
+		current.clear();
+		current.reserve(previous.size());
+		source(*this);
+
+		reinterpret_cast<Format::IntervalRecord *>(block.data() + intervalOffset)->hostsTotal = current.size();
+		std::swap(previous, current);
+		intervals++;
+
+		if (block.size() >= config.blockSize || now - blockStarted >= config.flushPeriod)
+			writeBlock();
+	}
+
+	/// \brief Удаляет самые старые файлы сверх maxFiles
+	void removeOldFiles()
+	{
+		std::vector<std::string> files = Format::listDataFiles(config.directory);
+
+		for (std::size_t i = 0; i + config.maxFiles < files.size(); i++)
+		{
+			std::error_code error;
+			std::filesystem::remove(files[i], error);
+			std::filesystem::remove(Format::indexPathOf(files[i]), error);
+			TA_LOG(info) << "StatsExporter removed '" << files[i] << "'";
+		}
+	}
+
+	void closeFile()
+	{
+		if (fd >= 0)
+			::close(fd);
+
+		if (indexFd >= 0)
+			::close(indexFd);
+
+		fd = -1;
+		indexFd = -1;
+		fileSize = 0;
+	}
+
+	static bool writeAll(int file, const void *data, std::size_t size)
+	{
+		const auto *bytes = static_cast<const std::uint8_t *>(data);
+
+		while (size)
+		{
+			ssize_t written = ::write(file, bytes, size);
+			if (written < 0 && errno == EINTR)
+				continue;
+
+			if (written <= 0)
+				return false;
+
+			bytes += written;
+			size -= static_cast<std::size_t>(written);
+		}
+
+		return true;
+	}
+
+	/// \brief Начинает новый файл данных и его индекс
+	bool openNextFile()
+	{
+		closeFile();
+
+		// Время создания входит в имя файла, поэтому при совпадении имен оно сдвигается на миллисекунду
+		std::int64_t createdTime = nowMs();
+		for (int attempt = 0; attempt < 16; attempt++, createdTime++)
+		{
+			filePath = (std::filesystem::path(config.directory) / Format::dataFileName(createdTime)).string();
+			fd = ::open(filePath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND, 0644);
+			if (fd >= 0 || errno != EEXIST)
+				break;
+		}
+
+		if (fd < 0)
+		{
+			TA_LOG(error) << "StatsExporter cannot create file '" << filePath << "': " << std::strerror(errno);
+			return false;
+		}
+
+		Format::FileHeader header{};
+		std::memcpy(header.magic, Format::fileMagic, sizeof(header.magic));
+		header.version = Format::version;
+		header.recordSize = Format::recordSize;
+		header.createdTime = createdTime;
+		header.period = config.period.count();
+
+		Format::IndexHeader indexHeader{};
+		std::memcpy(indexHeader.magic, Format::indexMagic, sizeof(indexHeader.magic));
+		indexHeader.version = Format::version;
+		indexHeader.entrySize = sizeof(Format::IndexEntry);
+
+		std::string indexPath = Format::indexPathOf(filePath);
+		indexFd = ::open(indexPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+
+		if (!writeAll(fd, &header, sizeof(header)) || indexFd < 0 || !writeAll(indexFd, &indexHeader, sizeof(indexHeader)))
+		{
+			TA_LOG(error) << "StatsExporter cannot write headers of '" << filePath << "': " << std::strerror(errno);
+			closeFile();
+			return false;
+		}
+
+		fileSize = sizeof(header);
+		filesCount++;
+		TA_LOG(info) << "StatsExporter started file '" << filePath << "'";
+
+		removeOldFiles();
+		return true;
+	}
+
+	/// \brief Сжимает текущий блок и дописывает его в файл одним вызовом write
+	void writeBlock()
+	{
+		if (block.empty())
+			return;
+
+		Format::BlockHeader header{};
+		header.magic = Format::blockMagic;
+		header.codec = static_cast<std::uint8_t>(StatsExportCodec::none);
+		header.rawSize = static_cast<std::uint32_t>(block.size());
+		header.recordsCount = static_cast<std::uint32_t>(block.size() / Format::recordSize);
+		header.firstTime = blockFirstTime;
+		header.lastTime = blockLastTime;
+
+		const std::vector<std::uint8_t> *payload = &block;
+		if (config.codec == StatsExportCodec::zeroRuns)
+		{
+			Format::encodeZeroRuns(block.data(), block.size(), shuffled, encoded);
+			if (encoded.size() < block.size())
+			{
+				header.codec = static_cast<std::uint8_t>(StatsExportCodec::zeroRuns);
+				payload = &encoded;
+			}
+		}
+
+		header.storedSize = static_cast<std::uint32_t>(payload->size());
+		header.checksum = Format::checksum(payload->data(), payload->size());
+
+		output.resize(sizeof(header) + payload->size());
+		std::memcpy(output.data(), &header, sizeof(header));
+		std::memcpy(output.data() + sizeof(header), payload->data(), payload->size());
+
+		block.clear();
+		blockNames.clear();
+
+		if ((fd < 0 || (fileSize > sizeof(Format::FileHeader) && fileSize + output.size() > config.maxFileSize)) && !openNextFile())
+		{
+			failedBlocks++;
+			return;
+		}
+
+		Format::IndexEntry entry{header.firstTime, header.lastTime, fileSize};
+
+		if (!writeAll(fd, output.data(), output.size()))
+		{
+			TA_LOG(error) << "StatsExporter cannot write to '" << filePath << "': " << std::strerror(errno);
+			failedBlocks++;
+
+			// Файл мог остаться с частью блока, следующие блоки пишутся в новый файл
+			closeFile();
+			return;
+		}
+
+		fileSize += output.size();
+		writtenBytes += output.size();
+
+		if (!writeAll(indexFd, &entry, sizeof(entry)))
+			TA_LOG(warning) << "StatsExporter cannot write index of '" << filePath << "': " << std::strerror(errno);
+	}
+
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(writerMutex);
+
+		while (!writerWakeup.wait_for(lock, config.period, [this]
+									  { return isStopping; }))
+			recordInterval();
+	}
+
+public:
+	StatsExporter() = default;
+	~StatsExporter() { stop(); }
+
+	StatsExporter(const StatsExporter &) = delete;
+	StatsExporter &operator=(const StatsExporter &) = delete;
+
+	/**
+	 * \brief Создает каталог выгрузки и запускает поток выгрузки
+	 *
+	 * Текущие счетчики хостов запоминаются как начальные, так что первый интервал содержит только
+	 * прирост после запуска
+	 * \param[in] source Источник хостов, вызывается потоком выгрузки до вызова stop
+	 * \param[out] errorInfo В случае ошибки, сюда будет записана причина
+	 */
+	bool start(const StatsExportConfig &exportConfig, HostsSource hostsSource, std::string &errorInfo)
+	{
+		stop();
+
+		if (exportConfig.period.count() <= 0 || !exportConfig.maxFiles || !exportConfig.maxFileSize)
+		{
+			errorInfo = "StatsExporter: period, maxFiles and maxFileSize must be positive";
+			return false;
+		}
+
+		std::error_code error;
+		std::filesystem::create_directories(exportConfig.directory, error);
+		if (error || ::access(exportConfig.directory.c_str(), W_OK) != 0)
+		{
+			errorInfo = "StatsExporter: cannot write to directory '" + exportConfig.directory + "'";
+			return false;
+		}
+
+		config = exportConfig;
+		source = std::move(hostsSource);
+		intervals = writtenBytes = filesCount = failedBlocks = 0;
+		block.reserve(config.blockSize + Format::recordSize * 8);
+
+		isPriming = true;
+		current.clear();
+		source(*this);
+		std::swap(previous, current);
+		isPriming = false;
+
+		intervalStarted = std::chrono::steady_clock::now();
+		isStopping = false;
+		writer = std::thread(&StatsExporter::run, this);
+
+		TA_LOG(info) << "StatsExporter writes to '" << config.directory << "' every " << config.period.count() << " ms";
+		return true;
+	}
+
+	/// \brief Записывает последний интервал, дописывает блок на диск и останавливает поток выгрузки
+	void stop()
+	{
+		if (!writer.joinable())
+			return;
+
+		{
+			std::lock_guard<std::mutex> guard(writerMutex);
+			isStopping = true;
+		}
+
+		writerWakeup.notify_all();
+		writer.join();
+
+		recordInterval();
+		writeBlock();
+		closeFile();
+
+		TA_LOG(info) << "StatsExporter wrote " << intervals << " intervals, " << writtenBytes << " bytes in "
+					 << filesCount << " files, failed blocks: " << failedBlocks;
+	}
+
+	bool isRunning() const { return writer.joinable(); }
+
+	/// \brief Возвращает количество байтов, записанных в файлы, читается после stop
+	std::uint64_t getWrittenBytes() const { return writtenBytes; }
+
+	/// \brief Возвращает количество записанных интервалов, читается после stop
+	std::uint64_t getIntervals() const { return intervals; }
+};
+
+/// \brief Хост интервала, прочитанный из файла выгрузки
+struct ExportedHost
+{
+	IpKey host;
+	std::string name;
+	std::uint64_t inPackets{0};
+	std::uint64_t outPackets{0};
+	std::uint64_t inTraffic{0};
+	std::uint64_t outTraffic{0};
+	std::uint32_t activeFlows{0};
+	std::uint32_t completedFlows{0};
+	std::uint32_t sampledPackets{0};
+};
+
+/// \brief Интервал, прочитанный из файла выгрузки
+struct ExportedInterval
+{
+	std::int64_t time{0};	  ///< Конец интервала в мс с начала эпохи Unix
+	std::int64_t duration{0}; ///< Длина интервала в мс
+	std::uint64_t hostsTotal{0};
+	std::vector<ExportedHost> hosts; ///< Хосты, изменившиеся за интервал, с приростом счетчиков
+};
+
+/// \brief Читает интервалы из каталога выгрузки StatsExporter
+class StatsExportReader
+{
+public:
+	using IntervalHandler = std::function<void(const ExportedInterval &interval)>;
+
+private:
+	using Format = StatsExportFormat;
+
+	std::vector<std::uint8_t> stored;
+	std::vector<std::uint8_t> shuffled;
+	std::vector<std::uint8_t> records;
+	HostTable<std::string> names; ///< Имена хостов текущего блока
+	ExportedInterval interval;
+
+	static IpKey keyOf(const std::uint8_t *address, std::uint8_t addressLength)
+	{
+		return addressLength == 4 ? IpKey::fromIPv4(address) : IpKey::fromIPv6(address);
+	}
+
+	static bool readAt(int fd, void *data, std::size_t size, std::uint64_t offset)
+	{
+		return pread(fd, data, size, static_cast<off_t>(offset)) == static_cast<ssize_t>(size);
+	}
+
+	/// \brief Возвращает смещение первого блока, который может содержать интервалы не раньше from
+	static std::uint64_t firstBlockOffset(const std::string &dataPath, std::uint64_t dataSize, std::int64_t from)
+	{
+		std::uint64_t offset = sizeof(Format::FileHeader);
+
+		int fd = ::open(Format::indexPathOf(dataPath).c_str(), O_RDONLY);
+		if (fd < 0)
+			return offset;
+
+		Format::IndexHeader header{};
+		struct stat indexStat;
+		if (readAt(fd, &header, sizeof(header), 0) && fstat(fd, &indexStat) == 0 &&
+			std::memcmp(header.magic, Format::indexMagic, sizeof(header.magic)) == 0 &&
+			header.version == Format::version && header.entrySize == sizeof(Format::IndexEntry))
+		{
+			std::size_t count = (static_cast<std::uint64_t>(indexStat.st_size) - sizeof(header)) / sizeof(Format::IndexEntry);
+			std::vector<Format::IndexEntry> entries(count);
+
+			if (readAt(fd, entries.data(), count * sizeof(Format::IndexEntry), sizeof(header)))
+			{
+				auto it = std::partition_point(entries.begin(), entries.end(), [from](const Format::IndexEntry &entry)
+											   { return entry.lastTime < from; });
+
+				// Блоки после последней записи индекса читаются по заголовкам
+				if (it == entries.end() && !entries.empty())
+					offset = entries.back().offset;
+				else if (it != entries.end())
+					offset = it->offset;
+
+				if (offset < sizeof(Format::FileHeader) || offset >= dataSize)
+					offset = sizeof(Format::FileHeader);
+			}
+		}
+
+		::close(fd);
+		return offset;
+	}
+
+	void emit(std::int64_t from, std::int64_t to, const IntervalHandler &handler)
+	{
+		if (interval.time && interval.time >= from && interval.time <= to)
+			handler(interval);
+
+		interval = ExportedInterval();
+	}
+
+	/// \brief Разбирает записи блока, возвращает false при повреждении
+	bool readRecords(std::size_t count, std::int64_t from, std::int64_t to, const IntervalHandler &handler)
+	{
+		names.clear();
+
+		for (std::size_t i = 0; i < count; i++)
+		{
+			const std::uint8_t *data = records.data() + i * Format::recordSize;
+
+			switch (data[0])
+			{
+			case Format::interval:
+			{
+				emit(from, to, handler);
+
+				Format::IntervalRecord record;
+				std::memcpy(&record, data, sizeof(record));
+				interval.time = record.time;
+				interval.duration = record.duration;
+				interval.hostsTotal = record.hostsTotal;
+				interval.hosts.reserve(record.hostsCount);
+				break;
+			}
+			case Format::name:
+			{
+				Format::NameRecord record;
+				std::memcpy(&record, data, sizeof(record));
+
+				std::string &name = names[keyOf(record.address, record.addressLength)];
+				if (record.offset == 0)
+					name.clear();
+
+				name.append(record.name, std::min<std::size_t>(record.length, sizeof(record.name)));
+				break;
+			}
+			case Format::host:
+			{
+				Format::HostRecord record;
+				std::memcpy(&record, data, sizeof(record));
+
+				ExportedHost host;
+				host.host = keyOf(record.address, record.addressLength);
+				if (const std::string *name = names.find(host.host))
+					host.name = *name;
+
+				host.inPackets = record.inPackets;
+				host.outPackets = record.outPackets;
+				host.inTraffic = record.inTraffic;
+				host.outTraffic = record.outTraffic;
+				host.activeFlows = record.activeFlows;
+				host.completedFlows = record.completedFlows;
+				host.sampledPackets = record.sampledPackets;
+				interval.hosts.push_back(std::move(host));
+				break;
+			}
+			default:
+				return false;
+			}
+		}
+
+		emit(from, to, handler);
+		return true;
+	}
+
+public:
+	/**
+	 * \brief Читает один файл данных, вызывая handler для каждого интервала, закончившегося в [from, to]
+	 *
+	 * Поврежденный или недописанный блок завершает чтение файла: все блоки до него уже прочитаны
+	 * \param[out] errorInfo В случае ошибки, сюда будет записана причина
+	 * \return False - если файл не удалось открыть или он имеет чужой формат
+	 */
+	bool readFile(const std::string &path, std::int64_t from, std::int64_t to, const IntervalHandler &handler, std::string &errorInfo)
+	{
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			errorInfo = "StatsExportReader: cannot open file '" + path + "'";
+			return false;
+		}
+
+		Format::FileHeader header{};
+		struct stat fileStat;
+		if (fstat(fd, &fileStat) != 0 || !readAt(fd, &header, sizeof(header), 0) ||
+			std::memcmp(header.magic, Format::fileMagic, sizeof(header.magic)) != 0 ||
+			header.version != Format::version || header.recordSize != Format::recordSize)
+		{
+			::close(fd);
+			errorInfo = "StatsExportReader: wrong format of file '" + path + "'";
+			return false;
+		}
+
+		std::uint64_t size = static_cast<std::uint64_t>(fileStat.st_size);
+		std::uint64_t offset = firstBlockOffset(path, size, from);
+
+		while (offset + sizeof(Format::BlockHeader) <= size)
+		{
+			Format::BlockHeader block{};
+			if (!readAt(fd, &block, sizeof(block), offset) || block.magic != Format::blockMagic ||
+				offset + sizeof(block) + block.storedSize > size || block.rawSize % Format::recordSize)
+			{
+				TA_LOG(warning) << "StatsExportReader stopped at a damaged block of '" << path << "' at " << offset;
+				break;
+			}
+
+			if (block.firstTime > to)
+				break;
+
+			std::uint64_t next = offset + sizeof(block) + block.storedSize;
+			if (block.lastTime < from)
+			{
+				offset = next;
+				continue;
+			}
+
+			stored.resize(block.storedSize);
+			bool isValid = readAt(fd, stored.data(), stored.size(), offset + sizeof(block)) &&
+						   Format::checksum(stored.data(), stored.size()) == block.checksum;
+
+			if (isValid && block.codec == static_cast<std::uint8_t>(StatsExportCodec::zeroRuns))
+				isValid = Format::decodeZeroRuns(stored.data(), stored.size(), block.rawSize, shuffled, records);
+			else if (isValid && block.codec == static_cast<std::uint8_t>(StatsExportCodec::none) && block.storedSize == block.rawSize)
+				records.swap(stored);
+			else
+				isValid = false;
+
+			if (!isValid || !readRecords(block.rawSize / Format::recordSize, from, to, handler))
+			{
+				TA_LOG(warning) << "StatsExportReader stopped at a damaged block of '" << path << "' at " << offset;
+				break;
+			}
+
+			offset = next;
+		}
+
+		::close(fd);
+		return true;
+	}
+
+	/**
+	 * \brief Читает все файлы каталога по порядку, вызывая handler для каждого интервала,
+	 * закончившегося в [from, to] (время в мс с начала эпохи Unix)
+	 *
+	 * Файлы с чужим форматом пропускаются с предупреждением в логе
+	 * \param[out] errorInfo В случае ошибки, сюда будет записана причина
+	 * \return False - если в каталоге нет файлов выгрузки
+	 */
+	bool read(const std::string &directory, std::int64_t from, std::int64_t to, const IntervalHandler &handler, std::string &errorInfo)
+	{
+		std::vector<std::string> files = Format::listDataFiles(directory);
+		if (files.empty())
+		{
+			errorInfo = "StatsExportReader: no export files in '" + directory + "'";
+			return false;
+		}
+
+		for (std::size_t i = 0; i < files.size(); i++)
+		{
+			// Файл создан до начала следующего, поэтому файл, следующий за которым начат раньше from, можно пропустить
+			if (i + 1 < files.size())
+			{
+				std::string nextName = std::filesystem::path(files[i + 1]).filename().string();
+				if (std::stoll(nextName.substr(6, 14)) < from)
+					continue;
+			}
+
+			std::string fileError;
+			if (!readFile(files[i], from, to, handler, fileError))
+				TA_LOG(warning) << fileError;
+		}
+
+		return true;
+	}
+};
@@ -0,0 +1,449 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <memory>
+#include <vector>
+#include <tuple>
+#include <utility>
+#include <functional>
+#include <type_traits>
+
+#include <ITrafficStats.h>
+#include <JsonWriter.h>
+#include <AsyncLog.h>
+
+/**
+ * \brief Конвейер статистик, в который пакет передается один раз, а учитывается несколькими статистиками
+ *
+ * Пакет разбирается RawPacketParser до попадания в конвейер, поэтому все статистики получают
+ * одни и те же PacketView. Набор статистик задается при компиляции: вызовы методов статистик
+ * квалифицированы их типом и не проходят через таблицу виртуальных функций,
+ * так что на пачку пакетов приходится один виртуальный вызов - у самого конвейера.
+ *
+ * Каждая статистика строится из interfaceIpAddr и первого из аргументов конструктора конвейера,
+ * который она принимает (например, FlowTableConfig для HttpTrafficStats), либо только из interfaceIpAddr.
+ * Файл статистики хостов (attachStore) передается первой статистике
+ * \tparam Consumers Типы статистик, наследники ITrafficStats
+ */
+template <class... Consumers>
+class StatsPipeline : public ITrafficStats
+{
+	static_assert(sizeof...(Consumers) > 0, "StatsPipeline needs at least one consumer");
+	static_assert((std::is_base_of_v<ITrafficStats, Consumers> && ...), "StatsPipeline consumers must derive from ITrafficStats");
+
+private:
+	std::tuple<Consumers...> consumers;
+
+	template <class Consumer>
+	static Consumer makeConsumer(const std::string &interfaceIpAddr)
+	{
+		return Consumer(interfaceIpAddr);
+	}
+
+	template <class Consumer, class Arg, class... Args>
+	static Consumer makeConsumer(const std::string &interfaceIpAddr, const Arg &arg, const Args &...args)
+	{
+		if constexpr (std::is_constructible_v<Consumer, const std::string &, const Arg &>)
+			return Consumer(interfaceIpAddr, arg);
+		else
+			return makeConsumer<Consumer>(interfaceIpAddr, args...);
+	}
+
+	/// \brief Вызывает function для каждой статистики в порядке их перечисления
+	template <class Function>
+	void forEach(Function &&function)
+	{
+		std::apply([&function](auto &...consumer)
+				   { (function(consumer), ...); },
+				   consumers);
+	}
+
+	template <class Function>
+	void forEach(Function &&function) const
+	{
+		std::apply([&function](const auto &...consumer)
+				   { (function(consumer), ...); },
+				   consumers);
+	}
+
+	template <std::size_t... Indexes>
+	void mergeConsumers(const StatsPipeline &other, std::index_sequence<Indexes...>)
+	{
+		(std::get<Indexes>(consumers).merge(std::get<Indexes>(other.consumers)), ...);
+	}
+
+	template <std::size_t... Indexes>
+	bool updateConsumers(StatsPipeline &target, std::index_sequence<Indexes...>) const
+	{
+		return (std::get<Indexes>(consumers).updateCopy(std::get<Indexes>(target.consumers)) && ...);
+	}
+
+public:
+	/// \param[in] interfaceIpAddr IP-адрес интерфейса, относительно которого определяется направление пакетов
+	/// \param[in] args Параметры статистик, каждая статистика получает первый подходящий ей параметр
+	template <class... Args>
+	explicit StatsPipeline(const std::string &interfaceIpAddr, const Args &...args)
+		: ITrafficStats(interfaceIpAddr),
+		  consumers(makeConsumer<Consumers>(interfaceIpAddr, args...)...) {}
+
+	std::string_view name() const override { return "pipeline"; }
+
+	/// \brief Возвращает статистику типа Consumer
+	template <class Consumer>
+	Consumer &get() { return std::get<Consumer>(consumers); }
+
+	template <class Consumer>
+	const Consumer &get() const { return std::get<Consumer>(consumers); }
+
+	/// \brief Возвращает статистики, каждую под заголовком с её именем
+	std::string toString() const override
+	{
+		std::string out;
+		forEach([&out](const auto &consumer)
+				{
+					out += "[";
+					out += consumer.name();
+					out += "]\n";
+					out += consumer.toString(); });
+
+		return out;
+	}
+
+	/**
+	 * \brief Дописывает статистику в формате JSON в конец буфера out
+	 *
+	 * Документ имеет вид {"generation":N,"hosts":{...},"ports":{...}}, где под именем
+	 * каждой статистики лежит её собственный документ
+	 */
+	void writeJson(std::string &out, std::uint64_t sinceGeneration) const override
+	{
+		JsonWriter json(out);
+
+		json.beginObject();
+		json.field("generation", generation);
+
+		forEach([&](const auto &consumer)
+				{
+					json.key(consumer.name());
+					consumer.writeJson(out, sinceGeneration);
+
+					if (!out.empty() && out.back() == '\n')
+						out.pop_back();
+
+					json.valueWritten(); });
+
+		json.endObject();
+		out += '\n';
+	}
+
+	void setLocalAddresses(std::shared_ptr<const LocalAddressSet> addresses) override
+	{
+		forEach([&addresses](auto &consumer)
+				{ consumer.setLocalAddresses(addresses); });
+
+		localAddresses = std::move(addresses);
+	}
+
+	void setDnsCache(std::shared_ptr<DnsCache> cache) override
+	{
+		forEach([&cache](auto &consumer)
+				{ consumer.setDnsCache(cache); });
+
+		dnsCache = std::move(cache);
+	}
+
+	void setGeneration(std::uint64_t value) override
+	{
+		forEach([value](auto &consumer)
+				{ consumer.setGeneration(value); });
+
+		generation = value;
+	}
+
+	void setSamplingRate(std::uint32_t rate) override
+	{
+		forEach([rate](auto &consumer)
+				{ consumer.setSamplingRate(rate); });
+
+		ITrafficStats::setSamplingRate(rate);
+	}
+
+	using ITrafficStats::addPacket;
+
+	/// \brief Передает пакет всем статистикам без виртуальных вызовов
+	void addPacket(const PacketView &packet) override
+	{
+		forEach([&packet](auto &consumer)
+				{
+					using Consumer = std::remove_reference_t<decltype(consumer)>;
+					consumer.Consumer::addPacket(packet); });
+	}
+
+	/// \brief Передает пачку пакетов всем статистикам по очереди, каждая проходит пачку целиком
+	void addPackets(std::span<const PacketView> packets) override
+	{
+		forEach([packets](auto &consumer)
+				{
+					using Consumer = std::remove_reference_t<decltype(consumer)>;
+					consumer.Consumer::addPackets(packets); });
+	}
+
+	/// \brief Очищает все статистики
+	void clear() override
+	{
+		forEach([](auto &consumer)
+				{ consumer.clear(); });
+	}
+
+	/// \brief Передает файл статистики хостов первой статистике конвейера
+	bool attachStore(std::unique_ptr<HostStore> store, std::string &errorInfo) override
+	{
+		return std::get<0>(consumers).attachStore(std::move(store), errorInfo);
+	}
+
+	void closeStore() override
+	{
+		forEach([](auto &consumer)
+				{ consumer.closeStore(); });
+	}
+
+	void collectNames(NameTotals &totals) const override
+	{
+		forEach([&totals](const auto &consumer)
+				{ consumer.collectNames(totals); });
+	}
+
+	void visitHosts(IHostVisitor &visitor) const override
+	{
+		forEach([&visitor](const auto &consumer)
+				{ consumer.visitHosts(visitor); });
+	}
+
+	/// \brief Возвращает независимую копию конвейера, статистики копируются своими конструкторами копирования
+	std::unique_ptr<ITrafficStats> clone() const override
+	{
+		return std::make_unique<StatsPipeline>(*this);
+	}
+
+	/// \brief Обновляет копию каждой статистики, конвейер обновляется, только если обновились все статистики
+	bool updateCopy(ITrafficStats &copy) const override
+	{
+		auto *target = dynamic_cast<StatsPipeline *>(&copy);
+		if (!target || !updateConsumers(*target, std::index_sequence_for<Consumers...>()))
+			return false;
+
+		static_cast<ITrafficStats &>(*target) = *this;
+		return true;
+	}
+
+	/// \brief Добавляет к каждой статистике данные соответствующей статистики другого конвейера того же типа
+	void merge(const ITrafficStats &other) override
+	{
+		auto *otherPipeline = dynamic_cast<const StatsPipeline *>(&other);
+		if (!otherPipeline)
+		{
+			TA_LOG(warning) << "StatsPipeline merge failed, other stats have different type";
+			return;
+		}
+
+		mergeSampling(other);
+		mergeConsumers(*otherPipeline, std::index_sequence_for<Consumers...>());
+	}
+};
+
+/**
+ * \brief Конвейер статистик, набор которых задается при запуске программы
+ *
+ * В отличие от StatsPipeline, каждая статистика вызывается виртуально, но только один раз на пачку пакетов
+ */
+class DynamicStatsPipeline : public ITrafficStats
+{
+public:
+	/// \brief Создает статистику для IP-адреса интерфейса
+	using ConsumerFactory = std::function<std::unique_ptr<ITrafficStats>(const std::string &interfaceIpAddr)>;
+
+private:
+	std::vector<std::unique_ptr<ITrafficStats>> consumers;
+
+public:
+	/// \param[in] interfaceIpAddr IP-адрес интерфейса, относительно которого определяется направление пакетов
+	/// \param[in] factories Фабрики статистик в порядке, в котором статистики получают пакеты
+	DynamicStatsPipeline(const std::string &interfaceIpAddr, const std::vector<ConsumerFactory> &factories)
+		: ITrafficStats(interfaceIpAddr)
+	{
+		consumers.reserve(factories.size());
+		for (const auto &factory : factories)
+			consumers.push_back(factory(interfaceIpAddr));
+	}
+
+	/// \brief Копирует конвейер вместе с копиями всех статистик
+	DynamicStatsPipeline(const DynamicStatsPipeline &other)
+		: ITrafficStats(other)
+	{
+		consumers.reserve(other.consumers.size());
+		for (const auto &consumer : other.consumers)
+			consumers.push_back(consumer->clone());
+	}
+
+	std::string_view name() const override { return "pipeline"; }
+
+	/// \brief Возвращает количество статистик
+	std::size_t size() const { return consumers.size(); }
+
+	/// \brief Возвращает статистику с номером index
+	const ITrafficStats &at(std::size_t index) const { return *consumers[index]; }
+
+	/// \brief Возвращает статистики, каждую под заголовком с её именем
+	std::string toString() const override
+	{
+		std::string out;
+		for (const auto &consumer : consumers)
+		{
+			out += "[";
+			out += consumer->name();
+			out += "]\n";
+			out += consumer->toString();
+		}
+
+		return out;
+	}
+
+	/// \brief Дописывает статистику в формате JSON в конец буфера out, формат совпадает с StatsPipeline
+	void writeJson(std::string &out, std::uint64_t sinceGeneration) const override
+	{
+		JsonWriter json(out);
+
+		json.beginObject();
+		json.field("generation", generation);
+
+		for (const auto &consumer : consumers)
+		{
+			json.key(consumer->name());
+			consumer->writeJson(out, sinceGeneration);
+
+			if (!out.empty() && out.back() == '\n')
+				out.pop_back();
+
+			json.valueWritten();
+		}
+
+		json.endObject();
+		out += '\n';
+	}
+
+	void setLocalAddresses(std::shared_ptr<const LocalAddressSet> addresses) override
+	{
+		for (auto &consumer : consumers)
+			consumer->setLocalAddresses(addresses);
+
+		localAddresses = std::move(addresses);
+	}
+
+	void setDnsCache(std::shared_ptr<DnsCache> cache) override
+	{
+		for (auto &consumer : consumers)
+			consumer->setDnsCache(cache);
+
+		dnsCache = std::move(cache);
+	}
+
+	void setGeneration(std::uint64_t value) override
+	{
+		for (auto &consumer : consumers)
+			consumer->setGeneration(value);
+
+		generation = value;
+	}
+
+	void setSamplingRate(std::uint32_t rate) override
+	{
+		for (auto &consumer : consumers)
+			consumer->setSamplingRate(rate);
+
+		ITrafficStats::setSamplingRate(rate);
+	}
+
+	using ITrafficStats::addPacket;
+
+	void addPacket(const PacketView &packet) override
+	{
+		for (auto &consumer : consumers)
+			consumer->addPacket(packet);
+	}
+
+	void addPackets(std::span<const PacketView> packets) override
+	{
+		for (auto &consumer : consumers)
+			consumer->addPackets(packets);
+	}
+
+	/// \brief Очищает все статистики
+	void clear() override
+	{
+		for (auto &consumer : consumers)
+			consumer->clear();
+	}
+
+	/// \brief Передает файл статистики хостов первой статистике конвейера
+	bool attachStore(std::unique_ptr<HostStore> store, std::string &errorInfo) override
+	{
+		if (consumers.empty())
+			return ITrafficStats::attachStore(std::move(store), errorInfo);
+
+		return consumers.front()->attachStore(std::move(store), errorInfo);
+	}
+
+	void closeStore() override
+	{
+		for (auto &consumer : consumers)
+			consumer->closeStore();
+	}
+
+	void collectNames(NameTotals &totals) const override
+	{
+		for (const auto &consumer : consumers)
+			consumer->collectNames(totals);
+	}
+
+	void visitHosts(IHostVisitor &visitor) const override
+	{
+		for (const auto &consumer : consumers)
+			consumer->visitHosts(visitor);
+	}
+
+	/// \brief Возвращает независимую копию конвейера
+	std::unique_ptr<ITrafficStats> clone() const override
+	{
+		return std::make_unique<DynamicStatsPipeline>(*this);
+	}
+
+	/// \brief Обновляет копию каждой статистики, конвейер обновляется, только если обновились все статистики
+	bool updateCopy(ITrafficStats &copy) const override
+	{
+		auto *target = dynamic_cast<DynamicStatsPipeline *>(&copy);
+		if (!target || target->consumers.size() != consumers.size())
+			return false;
+
+		for (std::size_t i = 0; i < consumers.size(); i++)
+			if (!consumers[i]->updateCopy(*target->consumers[i]))
+				return false;
+
+		static_cast<ITrafficStats &>(*target) = *this;
+		return true;
+	}
+
+	/// \brief Добавляет к каждой статистике данные соответствующей статистики другого конвейера с тем же набором статистик
+	void merge(const ITrafficStats &other) override
+	{
+		auto *otherPipeline = dynamic_cast<const DynamicStatsPipeline *>(&other);
+		if (!otherPipeline || otherPipeline->consumers.size() != consumers.size())
+		{
+			TA_LOG(warning) << "DynamicStatsPipeline merge failed, other stats have different consumers";
+			return;
+		}
+
+		mergeSampling(other);
+		for (std::size_t i = 0; i < consumers.size(); i++)
+			consumers[i]->merge(*otherPipeline->consumers[i]);
+	}
+};
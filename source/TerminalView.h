@@ -0,0 +1,173 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+/**
+ * \brief Перерисовывает на терминале только изменившиеся строки текста
+ *
+ * Текст каждого обновления сравнивается по строкам с предыдущим: курсор возвращается к началу
+ * нарисованного текста, неизменившиеся строки пропускаются перемещением курсора, а изменившиеся
+ * стираются и выводятся заново. Строки обрезаются по ширине терминала, чтобы перенос строк
+ * не сбивал подсчет нарисованных строк, а текст - по высоте, чтобы курсор мог вернуться к его началу.
+ * Ширина считается в колонках экрана: строки в UTF-8 обрезаются по границе символа, а символы
+ * восточноазиатского письма занимают две колонки
+ */
+class TerminalView
+{
+private:
+	std::vector<std::string> lines; ///< Нарисованные строки
+	std::size_t width{0};			///< Ширина терминала, 0 - неизвестна
+	std::size_t height{0};			///< Высота терминала, 0 - неизвестна
+	std::size_t changedLines{0};
+
+	/// \brief Возвращает количество колонок экрана, занимаемых символом codePoint
+	static std::size_t columnsOf(std::uint32_t codePoint)
+	{
+		// Комбинируемые знаки и символы нулевой ширины дополняют предыдущий символ
+		if ((codePoint >= 0x0300 && codePoint <= 0x036F) || (codePoint >= 0x200B && codePoint <= 0x200F) ||
+			(codePoint >= 0xFE00 && codePoint <= 0xFE0F))
+			return 0;
+
+		bool isWide = (codePoint >= 0x1100 && codePoint <= 0x115F) || (codePoint >= 0x2E80 && codePoint <= 0xA4CF) ||
+					  (codePoint >= 0xAC00 && codePoint <= 0xD7A3) || (codePoint >= 0xF900 && codePoint <= 0xFAFF) ||
+					  (codePoint >= 0xFE30 && codePoint <= 0xFE4F) || (codePoint >= 0xFF00 && codePoint <= 0xFF60) ||
+					  (codePoint >= 0xFFE0 && codePoint <= 0xFFE6) || (codePoint >= 0x1F300 && codePoint <= 0x1F64F) ||
+					  (codePoint >= 0x1F900 && codePoint <= 0x1F9FF) || (codePoint >= 0x20000 && codePoint <= 0x3FFFD);
+		return isWide ? 2 : 1;
+	}
+
+	/**
+	 * \brief Возвращает длину в байтах самого длинного начала line, занимающего не больше columns колонок
+	 *
+	 * Начало не разрезает последовательность UTF-8, некорректный байт считается одной колонкой
+	 */
+	static std::size_t fitColumns(std::string_view line, std::size_t columns)
+	{
+		std::size_t used = 0;
+		std::size_t offset = 0;
+
+		while (offset < line.size())
+		{
+			auto lead = static_cast<std::uint8_t>(line[offset]);
+			std::size_t length = lead < 0x80 ? 1 : (lead & 0xE0) == 0xC0 ? 2 : (lead & 0xF0) == 0xE0 ? 3 : (lead & 0xF8) == 0xF0 ? 4 : 0;
+			std::uint32_t codePoint = length == 2 ? lead & 0x1F : length == 3 ? lead & 0x0F : length == 4 ? lead & 0x07 : lead;
+
+			for (std::size_t i = 1; i < length; i++)
+			{
+				if (offset + i >= line.size() || (static_cast<std::uint8_t>(line[offset + i]) & 0xC0) != 0x80)
+				{
+					length = 0;
+					break;
+				}
+
+				codePoint = (codePoint << 6) | (static_cast<std::uint8_t>(line[offset + i]) & 0x3F);
+			}
+
+			std::size_t symbolColumns = length ? columnsOf(codePoint) : 1;
+			if (used + symbolColumns > columns)
+				break;
+
+			used += symbolColumns;
+			offset += length ? length : 1;
+		}
+
+		return offset;
+	}
+
+	static void moveDown(std::size_t count, std::string &out)
+	{
+		if (count)
+			out += "\033[" + std::to_string(count) + "E";
+	}
+
+public:
+	/// \param[in] width Ширина терминала в колонках, 0 - строки не обрезаются
+	/// \param[in] height Высота терминала в строках, 0 - текст не обрезается
+	explicit TerminalView(std::size_t width = 0, std::size_t height = 0) : width(width), height(height) {}
+
+	/// \brief Возвращает ширину терминала fd, либо 0, если fd не является терминалом
+	static std::size_t terminalWidth(int fd)
+	{
+		winsize size{};
+		if (!isatty(fd) || ioctl(fd, TIOCGWINSZ, &size) != 0)
+			return 0;
+
+		return size.ws_col;
+	}
+
+	/// \brief Возвращает высоту терминала fd, либо 0, если fd не является терминалом
+	static std::size_t terminalHeight(int fd)
+	{
+		winsize size{};
+		if (!isatty(fd) || ioctl(fd, TIOCGWINSZ, &size) != 0)
+			return 0;
+
+		return size.ws_row;
+	}
+
+	/**
+	 * \brief Дописывает в out управляющие последовательности и строки, превращающие нарисованный текст в text
+	 *
+	 * После вывода курсор стоит в начале строки, следующей за текстом
+	 */
+	void render(std::string_view text, std::string &out)
+	{
+		// Последняя строка терминала остается для курсора, иначе экран прокрутится
+		std::size_t maxLines = height > 1 ? height - 1 : height ? 1 : SIZE_MAX;
+
+		std::vector<std::string> next;
+		for (std::size_t begin = 0; begin < text.size() && next.size() < maxLines;)
+		{
+			std::size_t end = text.find('\n', begin);
+			if (end == std::string_view::npos)
+				end = text.size();
+
+			std::string_view line = text.substr(begin, end - begin);
+			if (width && line.size() >= width)
+				line = line.substr(0, fitColumns(line, width - 1));
+
+			next.emplace_back(line);
+			begin = end + 1;
+		}
+
+		if (!lines.empty())
+			out += "\033[" + std::to_string(lines.size()) + "F";
+
+		changedLines = 0;
+		std::size_t unchanged = 0;
+
+		for (std::size_t i = 0; i < next.size(); i++)
+		{
+			if (i < lines.size() && lines[i] == next[i])
+			{
+				unchanged++;
+				continue;
+			}
+
+			moveDown(unchanged, out);
+			unchanged = 0;
+			changedLines++;
+
+			out += "\033[2K";
+			out += next[i];
+			out += '\n';
+		}
+
+		moveDown(unchanged, out);
+
+		// Строки прошлого текста ниже нового стираются
+		if (next.size() < lines.size())
+			out += "\033[J";
+
+		lines.swap(next);
+	}
+
+	/// \brief Возвращает количество строк, выведенных последним render
+	std::size_t getChangedLines() const { return changedLines; }
+};
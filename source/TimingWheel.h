@@ -0,0 +1,194 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * \brief Иерархическое колесо таймеров для объектов с целочисленными номерами
+ *
+ * Три уровня: 256 ячеек по одному тику, 64 ячейки по 256 тиков и 64 ячейки по 16384 тика,
+ * всего около миллиона тиков вперед. Постановка таймера и обработка каждого тика выполняются
+ * за O(1) на объект, без просмотра всех объектов: записи верхних уровней переносятся на нижний,
+ * когда колесо доходит до их ячейки. Списки ячеек интрузивные и хранятся в массивах по номеру объекта.
+ *
+ * У объекта может быть не более одного таймера, повторная постановка переносит его за O(1).
+ * Продлевать таймер при каждом событии не нужно: обработчик срабатывания сам решает,
+ * истек ли срок объекта, или ставит таймер заново (ленивая перепостановка)
+ */
+class TimingWheel
+{
+private:
+	static constexpr std::uint32_t level0Bits = 8;
+	static constexpr std::uint32_t upperBits = 6;
+	static constexpr std::uint32_t level0Size = 1u << level0Bits;
+	static constexpr std::uint32_t upperSize = 1u << upperBits;
+	static constexpr std::uint32_t level1Shift = level0Bits;
+	static constexpr std::uint32_t level2Shift = level0Bits + upperBits;
+	static constexpr std::uint64_t maxDelay = (1ull << (level2Shift + upperBits)) - 1; ///< Наибольшая задержка таймера в тиках
+
+	static constexpr std::uint32_t nil = UINT32_MAX;
+	static constexpr std::uint16_t noSlot = UINT16_MAX;
+
+	std::vector<std::uint32_t> heads;	  ///< Первый номер в списке каждой ячейки, ячейки всех уровней подряд
+	std::vector<std::uint32_t> next;	  ///< Следующий номер в списке ячейки для каждого объекта
+	std::vector<std::uint32_t> prev;	  ///< Предыдущий номер в списке ячейки для каждого объекта
+	std::vector<std::uint16_t> slotIds;	  ///< Ячейка, в которой находится таймер объекта, либо noSlot
+	std::vector<std::uint64_t> deadlines; ///< Тик срабатывания таймера каждого объекта
+
+	std::uint64_t currentTick{0};
+	std::size_t scheduled{0}; ///< Количество поставленных таймеров
+	bool isStarted{false};
+
+	std::uint32_t slotOf(std::uint64_t deadline) const
+	{
+		std::uint64_t delay = deadline - currentTick;
+
+		if (delay < level0Size)
+			return deadline & (level0Size - 1);
+
+		if (delay < (1ull << level2Shift))
+			return level0Size + ((deadline >> level1Shift) & (upperSize - 1));
+
+		return level0Size + upperSize + ((deadline >> level2Shift) & (upperSize - 1));
+	}
+
+	void link(std::uint32_t id, std::uint32_t slot)
+	{
+		prev[id] = nil;
+		next[id] = heads[slot];
+		if (heads[slot] != nil)
+			prev[heads[slot]] = id;
+
+		heads[slot] = id;
+		slotIds[id] = static_cast<std::uint16_t>(slot);
+	}
+
+	void unlink(std::uint32_t id)
+	{
+		if (prev[id] != nil)
+			next[prev[id]] = next[id];
+		else
+			heads[slotIds[id]] = next[id];
+
+		if (next[id] != nil)
+			prev[next[id]] = prev[id];
+
+		slotIds[id] = noSlot;
+	}
+
+	/// \brief Переносит записи ячейки slot верхнего уровня на уровни ниже
+	void cascade(std::uint32_t slot)
+	{
+		std::uint32_t id;
+		while ((id = heads[slot]) != nil)
+		{
+			unlink(id);
+			link(id, slotOf(deadlines[id]));
+		}
+	}
+
+public:
+	TimingWheel() : heads(level0Size + 2 * upperSize, nil) {}
+
+	/// \brief Задает количество объектов, для которых можно ставить таймеры
+	void resize(std::size_t count)
+	{
+		next.resize(count, nil);
+		prev.resize(count, nil);
+		slotIds.resize(count, noSlot);
+		deadlines.resize(count, 0);
+	}
+
+	/**
+	 * \brief Ставит таймер объекта id на тик deadline, заменяя поставленный ранее
+	 *
+	 * Таймер в прошлом сработает на следующем тике, слишком дальний - через максимальную задержку колеса
+	 */
+	void schedule(std::uint32_t id, std::uint64_t deadline)
+	{
+		cancel(id);
+
+		if (deadline <= currentTick)
+			deadline = currentTick + 1;
+		else if (deadline - currentTick > maxDelay)
+			deadline = currentTick + maxDelay;
+
+		deadlines[id] = deadline;
+		link(id, slotOf(deadline));
+		scheduled++;
+	}
+
+	/// \brief Снимает таймер объекта id, если он поставлен
+	void cancel(std::uint32_t id)
+	{
+		if (slotIds[id] == noSlot)
+			return;
+
+		unlink(id);
+		scheduled--;
+	}
+
+	/// \brief Проверяет, поставлен ли таймер объекта id
+	bool isScheduled(std::uint32_t id) const { return slotIds[id] != noSlot; }
+
+	/// \brief Возвращает тик срабатывания поставленного таймера объекта id
+	std::uint64_t deadlineOf(std::uint32_t id) const { return deadlines[id]; }
+
+	/**
+	 * \brief Продвигает колесо до тика tick и вызывает onExpired(id) для каждого сработавшего таймера
+	 *
+	 * Первый вызов только задает текущий тик. Обработчик может ставить и снимать любые таймеры
+	 */
+	template <class OnExpired>
+	void advance(std::uint64_t tick, OnExpired &&onExpired)
+	{
+		if (!isStarted)
+		{
+			currentTick = tick;
+			isStarted = true;
+			return;
+		}
+
+		while (currentTick < tick)
+		{
+			if (!scheduled)
+			{
+				currentTick = tick;
+				break;
+			}
+
+			currentTick++;
+
+			if ((currentTick & ((1ull << level2Shift) - 1)) == 0)
+				cascade(level0Size + upperSize + ((currentTick >> level2Shift) & (upperSize - 1)));
+
+			if ((currentTick & (level0Size - 1)) == 0)
+				cascade(level0Size + ((currentTick >> level1Shift) & (upperSize - 1)));
+
+			std::uint32_t slot = currentTick & (level0Size - 1);
+			std::uint32_t id;
+
+			while ((id = heads[slot]) != nil)
+			{
+				unlink(id);
+				scheduled--;
+				onExpired(id);
+			}
+		}
+	}
+
+	/// \brief Возвращает текущий тик колеса
+	std::uint64_t now() const { return currentTick; }
+
+	/// \brief Возвращает количество поставленных таймеров
+	std::size_t size() const { return scheduled; }
+
+	/// \brief Снимает все таймеры
+	void clear()
+	{
+		heads.assign(heads.size(), nil);
+		slotIds.assign(slotIds.size(), noSlot);
+		scheduled = 0;
+		isStarted = false;
+	}
+};
@@ -0,0 +1,540 @@
+#pragma once
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <ranges>
+#include <cstdint>
+#include <algorithm>
+
+#include <ITrafficStats.h>
+#include <HostInfo.h>
+#include <HostTable.h>
+#include <HostNameDetector.h>
+#include <CountMinSketch.h>
+#include <IpKey.h>
+#include <JsonWriter.h>
+#include <AsyncLog.h>
+
+/// \brief Параметры статистики наиболее активных хостов
+struct TopHostsConfig
+{
+	/// \brief Величина, по которой выбираются наиболее активные хосты
+	enum class Metric
+	{
+		bytes,
+		packets
+	};
+
+	std::size_t capacity{1024};	   ///< Максимальное количество отслеживаемых хостов (K)
+	std::size_t sketchWidth{4096}; ///< Количество счетчиков в строке Count-Min sketch
+	std::size_t sketchDepth{4};	   ///< Количество строк Count-Min sketch
+	Metric metric{Metric::bytes};
+};
+
+/**
+ * \brief Статистика K наиболее активных хостов в фиксированном объеме памяти
+ *
+ * Все хосты учитываются в Count-Min sketch, а точные счетчики ведутся только для K отслеживаемых хостов,
+ * упорядоченных в куче по весу. Неотслеживаемый хост заменяет самый легкий из отслеживаемых,
+ * если оценка его трафика по sketch больше веса этого хоста (по аналогии с Space-Saving).
+ *
+ * Для отслеживаемого хоста счетчики точны с момента начала отслеживания, а error - оценка сверху
+ * трафика, пропущенного до этого момента: истинный трафик хоста лежит в [total, total + error].
+ * Весом хоста считается total + error. Пусть N - весь трафик, ε = e / sketchWidth, δ = e^-sketchDepth.
+ * Тогда с вероятностью не менее 1 - δ:
+ *  - error превышает истинный пропущенный трафик не более чем на εN;
+ *  - вес самого легкого отслеживаемого хоста не превышает N / K + εN, поэтому любой хост
+ *    с трафиком больше N / K + εN отслеживается и не вытесняется
+ */
+class TopHostsTrafficStats : public ITrafficStats
+{
+private:
+	TopHostsConfig config;
+
+	/// \brief Точная статистика отслеживаемых хостов с момента начала отслеживания, не более config.capacity записей
+	///
+	/// Служебные данные хоста хранятся в отдельных массивах с тем же номером записи,
+	/// чтобы запись HostInfo занимала одну кэш-линию
+	HostTable<HostInfo> tracked;
+	std::vector<std::uint64_t> errors;		  ///< Оценка сверху величины, пропущенной до начала отслеживания хоста
+	std::vector<std::uint32_t> heapPositions; ///< Положение хоста в куче heap
+	std::vector<std::uint32_t> heap; ///< Номера записей tracked, упорядоченные по весу (минимальный в корне)
+	CountMinSketch sketch;			 ///< Приближенные счетчики всех хостов
+
+	std::uint64_t evictions{0}; ///< Сколько раз отслеживаемый хост был вытеснен другим
+
+	std::uint64_t valueOf(const PacketView &packet) const
+	{
+		return (config.metric == TopHostsConfig::Metric::bytes ? std::uint64_t(packet.length) : 1) * packet.weight;
+	}
+
+	std::uint64_t countedOf(const HostInfo &info) const
+	{
+		return config.metric == TopHostsConfig::Metric::bytes
+				   ? info.inTraffic + info.outTraffic
+				   : info.inPackets + info.outPackets;
+	}
+
+	std::uint64_t weightOf(std::uint32_t index) const
+	{
+		return countedOf(tracked.valueAt(index)) + errors[index];
+	}
+
+	void swapHeap(std::size_t a, std::size_t b)
+	{
+		std::swap(heap[a], heap[b]);
+		heapPositions[heap[a]] = static_cast<std::uint32_t>(a);
+		heapPositions[heap[b]] = static_cast<std::uint32_t>(b);
+	}
+
+	/// \brief Возвращает номер записи хоста, добавляя запись и её служебные данные при отсутствии
+	std::size_t findOrInsertTracked(const IpKey &host)
+	{
+		std::size_t index = tracked.findOrInsert(host);
+		if (index == errors.size())
+		{
+			errors.push_back(0);
+			heapPositions.push_back(0);
+		}
+
+		return index;
+	}
+
+	void siftUp(std::size_t pos)
+	{
+		while (pos > 0)
+		{
+			std::size_t parent = (pos - 1) / 2;
+			if (weightOf(heap[parent]) <= weightOf(heap[pos]))
+				break;
+
+			swapHeap(parent, pos);
+			pos = parent;
+		}
+	}
+
+	void siftDown(std::size_t pos)
+	{
+		while (true)
+		{
+			std::size_t smallest = pos;
+			std::size_t left = pos * 2 + 1;
+			std::size_t right = left + 1;
+
+			if (left < heap.size() && weightOf(heap[left]) < weightOf(heap[smallest]))
+				smallest = left;
+
+			if (right < heap.size() && weightOf(heap[right]) < weightOf(heap[smallest]))
+				smallest = right;
+
+			if (smallest == pos)
+				break;
+
+			swapHeap(smallest, pos);
+			pos = smallest;
+		}
+	}
+
+	/// \brief Добавляет отслеживаемый хост с пропущенной величиной error, таблица не должна быть заполнена
+	std::size_t insertTracked(const IpKey &host, std::uint64_t error)
+	{
+		std::size_t index = findOrInsertTracked(host);
+		errors[index] = error;
+		heapPositions[index] = static_cast<std::uint32_t>(heap.size());
+
+		heap.push_back(static_cast<std::uint32_t>(index));
+		siftUp(heap.size() - 1);
+		return index;
+	}
+
+	/**
+	 * \brief Начинает отслеживать хост, если для него есть место или он тяжелее самого легкого отслеживаемого
+	 * \param[in] value Величина текущего пакета, уже учтенная в sketch
+	 * \return Номер записи хоста, либо HostTable::npos
+	 */
+	std::size_t admit(const IpKey &host, std::uint64_t value)
+	{
+		std::uint64_t error = sketch.estimate(host) - value;
+
+		if (tracked.size() < config.capacity)
+			return insertTracked(host, error);
+
+		std::uint32_t lightest = heap[0];
+		if (error + value <= weightOf(lightest))
+			return HostTable<HostInfo>::npos;
+
+		TA_LOG_SAMPLED(debug, "Top hosts: {} replaces {}", host, tracked.keyAt(lightest));
+
+		evictions++;
+		tracked.replaceKey(lightest, host);
+
+		// Запись переходит к новому хосту на том же месте в куче (heapPositions не меняется),
+		// поэтому сбрасываются только счетчики и имя прежнего хоста
+		HostInfo &hostInfo = tracked.valueAt(lightest);
+		hostInfo.inPackets = 0;
+		hostInfo.outPackets = 0;
+		hostInfo.inTraffic = 0;
+		hostInfo.outTraffic = 0;
+		hostInfo.nameId = NameArena::noName;
+		hostInfo.activeFlows = 0;
+		hostInfo.completedFlows = 0;
+		hostInfo.nameLookups = 0;
+		hostInfo.sampledPackets = 0;
+		errors[lightest] = error;
+		return lightest;
+	}
+
+	/// \brief Оставляет только config.capacity самых тяжелых хостов, после чего кучу нужно перестроить
+	void shrinkToCapacity()
+	{
+		if (tracked.size() <= config.capacity)
+			return;
+
+		std::vector<std::uint32_t> order(tracked.size());
+		for (std::size_t i = 0; i < order.size(); i++)
+			order[i] = static_cast<std::uint32_t>(i);
+
+		std::nth_element(order.begin(), order.begin() + config.capacity, order.end(),
+						 [this](std::uint32_t a, std::uint32_t b)
+						 { return weightOf(a) > weightOf(b); });
+
+		HostTable<HostInfo> kept;
+		std::vector<std::uint64_t> keptErrors(config.capacity);
+		kept.reserve(config.capacity);
+
+		for (std::size_t i = 0; i < config.capacity; i++)
+		{
+			kept[tracked.keyAt(order[i])] = tracked.valueAt(order[i]);
+			keptErrors[i] = errors[order[i]];
+		}
+
+		tracked = std::move(kept);
+		errors = std::move(keptErrors);
+		heapPositions.resize(config.capacity);
+	}
+
+	void rebuildHeap()
+	{
+		heap.resize(tracked.size());
+		for (std::size_t i = 0; i < heap.size(); i++)
+		{
+			heap[i] = static_cast<std::uint32_t>(i);
+			heapPositions[i] = static_cast<std::uint32_t>(i);
+		}
+
+		for (std::size_t pos = heap.size() / 2; pos-- > 0;)
+			siftDown(pos);
+	}
+
+	static constexpr std::size_t prefetchDistance = 8; ///< За сколько пакетов пачки подгружается ячейка таблицы отслеживаемых хостов
+
+	/// \brief Записывает пакет в статистику, общая часть addPacket и addPackets
+	void record(const PacketView &packet)
+	{
+		if (packet.srcIp.empty())
+		{
+			TA_LOG_LIMITED(warning, 1, "IPLayer was nullptr");
+			return;
+		}
+
+		if (dnsCache)
+		{
+			if (DnsCache::isResponse(packet))
+				dnsCache->addResponse(packet);
+			else
+				dnsCache->advance(packet);
+		}
+
+		bool isInPacket = false;
+		const IpKey &host = localAddresses->remoteHostOf(packet, isInPacket);
+		std::uint64_t value = valueOf(packet);
+		std::size_t index = tracked.indexOf(host);
+
+		// Пакет с нулевым весом нужен только для поиска имени уже отслеживаемого хоста
+		if (!value && index == HostTable<HostInfo>::npos)
+			return;
+
+		sketch.add(host, value);
+
+		if (index == HostTable<HostInfo>::npos)
+		{
+			index = admit(host, value);
+			if (index == HostTable<HostInfo>::npos)
+				return;
+		}
+
+		auto &hostInfo = tracked.valueAt(index);
+		hostInfo.addPacket(packet.length, isInPacket, packet.weight);
+		hostInfo.generation = generation;
+		siftDown(heapPositions[index]);
+
+		HostNameDetector::update(packet, hostInfo);
+	}
+
+public:
+	/// \param[in] interfaceIpAddr IP-адрес интерфейса, относительно которого определяется направление пакетов
+	/// \param[in] config Количество отслеживаемых хостов и размеры sketch
+	TopHostsTrafficStats(const std::string &interfaceIpAddr, const TopHostsConfig &config = TopHostsConfig())
+		: ITrafficStats(interfaceIpAddr),
+		  config(config),
+		  sketch(config.sketchWidth, config.sketchDepth)
+	{
+		this->config.capacity = std::max<std::size_t>(this->config.capacity, 1);
+		tracked.reserve(this->config.capacity);
+		errors.reserve(this->config.capacity);
+		heapPositions.reserve(this->config.capacity);
+		heap.reserve(this->config.capacity);
+	}
+
+	/**
+	 * \brief Копирует отслеживаемые хосты, а sketch - только сводкой без счетчиков
+	 *
+	 * Копии публикуются для читателей, которым нужны хосты и total() sketch, поэтому при публикации
+	 * не копируется таблица счетчиков, занимающая половину памяти режима
+	 */
+	TopHostsTrafficStats(const TopHostsTrafficStats &other)
+		: ITrafficStats(other),
+		  config(other.config),
+		  tracked(other.tracked),
+		  errors(other.errors),
+		  heapPositions(other.heapPositions),
+		  heap(other.heap),
+		  sketch(other.sketch.summary()),
+		  evictions(other.evictions) {}
+
+	std::string_view name() const override { return "topHosts"; }
+
+	/// \brief Объем памяти, занимаемый одним отслеживаемым хостом (без учета длинных имен хостов)
+	static constexpr std::size_t trackedHostMemory()
+	{
+		// Запись, ошибка, положение в куче, ключ, номер в куче и до четырех ячеек индексной части HostTable
+		return sizeof(HostInfo) + sizeof(std::uint64_t) + 2 * sizeof(std::uint32_t) + sizeof(IpKey) + 4 * sizeof(std::uint64_t);
+	}
+
+	/**
+	 * \brief Подбирает параметры так, чтобы статистика занимала не более memoryLimit байт
+	 *
+	 * Половина памяти отводится под sketch глубины 4, остаток под отслеживаемые хосты
+	 */
+	static TopHostsConfig configForMemory(std::size_t memoryLimit, TopHostsConfig::Metric metric = TopHostsConfig::Metric::bytes)
+	{
+		TopHostsConfig config;
+		config.metric = metric;
+		config.sketchDepth = 4;
+
+		std::size_t rowMemory = config.sketchDepth * sizeof(std::uint64_t);
+		config.sketchWidth = 64;
+		while (config.sketchWidth * 2 * rowMemory <= memoryLimit / 2)
+			config.sketchWidth *= 2;
+
+		std::size_t sketchMemory = config.sketchWidth * rowMemory;
+		std::size_t hostsMemory = memoryLimit > sketchMemory ? memoryLimit - sketchMemory : 0;
+		config.capacity = std::max<std::size_t>(hostsMemory / trackedHostMemory(), 16);
+
+		return config;
+	}
+
+	/// \brief Возвращает статистику об обработанных пакетах в виде строки
+	std::string toString() const override
+	{
+		std::stringstream ss;
+
+		for (std::size_t i = 0; i < tracked.size(); i++)
+		{
+			const auto &hostInfo = tracked.valueAt(i);
+			std::uint32_t nameId = hostInfo.nameId;
+
+			ss << std::left << std::setw(37) << (nameId != NameArena::noName ? std::string(NameArena::instance().view(nameId)) : tracked.keyAt(i).toString()) << " "
+			   << std::right << std::setw(6) << (hostInfo.inPackets + hostInfo.outPackets) << " packets (OUT "
+			   << std::left << std::setw(6) << hostInfo.outPackets << " | "
+			   << std::right << std::setw(6) << hostInfo.inPackets << " IN) traffic: "
+			   << std::right << std::setw(8) << (hostInfo.inTraffic + hostInfo.outTraffic) << " [bytes] (OUT "
+			   << std::left << std::setw(8) << hostInfo.outTraffic << " | "
+			   << std::right << std::setw(6) << hostInfo.inTraffic << " IN) error: +"
+			   << errors[i] << std::endl;
+		}
+
+		ss << "Top hosts: tracked " << tracked.size() << " of " << config.capacity
+		   << ", sketch " << sketch.getWidth() << "x" << sketch.getDepth()
+		   << ", error bound " << sketch.errorBound()
+		   << (config.metric == TopHostsConfig::Metric::bytes ? " [bytes]" : " [packets]") << std::endl;
+
+		return ss.str();
+	}
+
+	/**
+	 * \brief Дописывает статистику в формате JSON в конец буфера out
+	 *
+	 * Помимо полей HttpTrafficStats, для каждого хоста выводится error, а для sketch -
+	 * общий учтенный объем total и граница ошибки errorBound
+	 */
+	void writeJson(std::string &out, std::uint64_t sinceGeneration) const override
+	{
+		JsonWriter json(out);
+		char ipBuffer[IpKey::maxStringLength];
+
+		json.beginObject();
+		json.field("generation", generation);
+
+		json.key("sketch").beginObject();
+		json.field("metric", config.metric == TopHostsConfig::Metric::bytes ? "bytes" : "packets");
+		json.field("width", std::uint64_t(sketch.getWidth()));
+		json.field("depth", std::uint64_t(sketch.getDepth()));
+		json.field("total", sketch.total());
+		json.field("errorBound", sketch.errorBound());
+		json.field("capacity", std::uint64_t(config.capacity));
+		json.field("evictions", evictions);
+		json.endObject();
+
+		if (maxSamplingRate > 1)
+		{
+			json.key("sampling").beginObject();
+			json.field("rate", std::uint64_t(samplingRate));
+			json.field("maxRate", std::uint64_t(maxSamplingRate));
+			json.endObject();
+		}
+
+		json.key("hosts").beginArray();
+
+		for (std::size_t i = 0; i < tracked.size(); i++)
+		{
+			const auto &hostInfo = tracked.valueAt(i);
+			if (sinceGeneration && hostInfo.generation <= sinceGeneration)
+				continue;
+
+			json.beginObject();
+			json.field("ip", std::string_view(ipBuffer, tracked.keyAt(i).format(ipBuffer)));
+			json.field("name", NameArena::instance().view(hostInfo.nameId));
+
+			json.key("packets").beginObject();
+			json.field("in", hostInfo.inPackets);
+			json.field("out", hostInfo.outPackets);
+			json.field("total", hostInfo.outPackets + hostInfo.inPackets);
+			json.endObject();
+
+			json.key("traffic").beginObject();
+			json.field("in", hostInfo.inTraffic);
+			json.field("out", hostInfo.outTraffic);
+			json.field("total", hostInfo.outTraffic + hostInfo.inTraffic);
+			json.endObject();
+
+			json.field("error", errors[i]);
+			json.endObject();
+		}
+
+		json.endArray();
+		json.endObject();
+		out += '\n';
+	}
+
+	using ITrafficStats::addPacket;
+
+	/// @brief Метод обрабатывающий пакет по его заголовкам
+	/// \param[in] packet Заголовки пакета, прочитанные RawPacketParser
+	void addPacket(const PacketView &packet) override { record(packet); }
+
+	/// \brief Обрабатывает пачку пакетов, заранее подгружая в кэш ячейки отслеживаемых хостов следующих пакетов
+	void addPackets(std::span<const PacketView> packets) override
+	{
+		std::size_t count = packets.size();
+		bool isInPacket = false;
+
+		for (std::size_t i = 0; i < count; i++)
+		{
+			if (i + prefetchDistance < count)
+				tracked.prefetchSlot(localAddresses->remoteHostOf(packets[i + prefetchDistance], isInPacket).hash());
+
+			record(packets[i]);
+		}
+	}
+
+	/// \brief Очищает статистику
+	void clear() override
+	{
+		tracked.clear();
+		tracked.reserve(config.capacity);
+		errors.clear();
+		heapPositions.clear();
+		heap.clear();
+		sketch.clear();
+		evictions = 0;
+	}
+
+	/// \brief Добавляет хосты в группировку по именам
+	void collectNames(NameTotals &totals) const override
+	{
+		for (std::size_t i = 0; i < tracked.size(); i++)
+			totals.add(tracked.valueAt(i), tracked.valueAt(i).nameId);
+	}
+
+	void visitHosts(IHostVisitor &visitor) const override
+	{
+		for (std::size_t i = 0; i < tracked.size(); i++)
+			visitor.onHost(tracked.keyAt(i), tracked.valueAt(i), tracked.valueAt(i).nameId);
+	}
+
+	/// \brief Возвращает независимую копию статистики с именами хостов из кэша DNS
+	std::unique_ptr<ITrafficStats> clone() const override
+	{
+		auto copy = std::make_unique<TopHostsTrafficStats>(*this);
+		copy->resolveNames(copy->tracked, std::views::iota(std::size_t(0), copy->tracked.size()));
+		return copy;
+	}
+
+	/**
+	 * \brief Добавляет к статистике данные другого объекта TopHostsTrafficStats
+	 *
+	 * Отслеживаемые хосты объединяются, после чего остаются config.capacity самых тяжелых
+	 */
+	void merge(const ITrafficStats &other) override
+	{
+		auto *otherStats = dynamic_cast<const TopHostsTrafficStats *>(&other);
+		if (!otherStats)
+		{
+			TA_LOG(warning) << "TopHostsTrafficStats merge failed, other stats have different type";
+			return;
+		}
+
+		if (!sketch.merge(otherStats->sketch))
+		{
+			TA_LOG(warning) << "TopHostsTrafficStats merge failed, sketches have different sizes";
+			return;
+		}
+
+		mergeSampling(other);
+
+		for (std::size_t i = 0; i < otherStats->tracked.size(); i++)
+		{
+			std::size_t index = findOrInsertTracked(otherStats->tracked.keyAt(i));
+			tracked.valueAt(index).merge(otherStats->tracked.valueAt(i));
+			errors[index] += otherStats->errors[i];
+		}
+
+		evictions += otherStats->evictions;
+		shrinkToCapacity();
+		rebuildHeap();
+	}
+
+	/// \brief Возвращает количество отслеживаемых хостов
+	std::size_t trackedCount() const { return tracked.size(); }
+
+	/// \brief Возвращает указатель на статистику отслеживаемого хоста, либо nullptr
+	const HostInfo *findHost(const IpKey &host) const
+	{
+		return tracked.find(host);
+	}
+
+	/// \brief Возвращает оценку сверху величины, пропущенной до начала отслеживания хоста
+	std::uint64_t errorOf(const IpKey &host) const
+	{
+		std::size_t index = tracked.indexOf(host);
+		return index == HostTable<HostInfo>::npos ? 0 : errors[index];
+	}
+
+	/// \brief Возвращает оценку трафика (или количества пакетов) любого хоста по sketch
+	std::uint64_t estimate(const IpKey &host) const { return sketch.estimate(host); }
+
+	/// \brief Возвращает параметры статистики
+	const TopHostsConfig &getConfig() const { return config; }
+};
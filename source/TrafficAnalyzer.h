@@ -2,183 +2,1776 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <span>
+#include <vector>
 #include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+#include <unistd.h>
 
 #include <boost/log/trivial.hpp>
 
 #include <PcapLiveDeviceList.h>
+#include <PcapFileDevice.h>
 #include <PacketUtils.h>
 #include <Packet.h>
 
 #include <ITrafficStats.h>
+#include <CaptureWorker.h>
+#include <RawPacketParser.h>
+#include <SnapshotPublisher.h>
+#include <RateHistory.h>
+#include <LocalAddressSet.h>
+#include <PacketRing.h>
+#include <HostTable.h>
+#include <JsonWriter.h>
+#include <MetricsExposition.h>
+#include <PerfCounters.h>
+#include <CpuAffinity.h>
+#include <HostQuery.h>
+#include <AsyncLog.h>
+
+/// \brief Итоги воспроизведения pcap/pcapng файла
+struct ReplayReport
+{
+	std::uint64_t packets{0}; ///< Количество обработанных пакетов
+	std::uint64_t bytes{0};	  ///< Суммарный размер обработанных пакетов
+	double wallTime{0};		  ///< Затраченное время (в сек)
+
+	/// \brief Возвращает скорость обработки в пакетах в секунду
+	double packetsPerSecond() const { return wallTime > 0 ? packets / wallTime : 0; }
+
+	/// \brief Возвращает скорость обработки в байтах в секунду
+	double bytesPerSecond() const { return wallTime > 0 ? bytes / wallTime : 0; }
+};
 
 /**
  * \brief Класс реализующий перехват пакетов из живого трафика и их анализ
- * Производит захват и обработку пакетов в отдельном потоке
+ * Производит захват и обработку пакетов в отдельном потоке,
+ * либо воспроизводит пакеты из pcap/pcapng файла
+ *
+ * Если задано количество обработчиков, поток захвата только распределяет пакеты
+ * между ними по хэшу пары адресов, а статистика собирается в шардах обработчиков
+ * без общей блокировки и объединяется только при запросе читателем
+ *
+ * Читатели никогда не обращаются к статистике, которую изменяет поток захвата:
+ * они получают последнюю опубликованную копию (см. SnapshotPublisher)
+ *
+ * На Linux вместо libpcap можно захватывать пакеты через кольца AF_PACKET (см. PacketRing):
+ * каждое кольцо обслуживает свой поток, который обрабатывает пакеты прямо в блоках кольца
+ *
+ * Можно захватывать сразу несколько интерфейсов (см. setInterfaces): у каждого свой поток libpcap,
+ * который пишет в шард своего обработчика. Статистика выводится как суммарной, так и по отдельному интерфейсу
  */
 class TrafficAnalyzer
 {
 private:
 	std::string interfaceIpAddr; ///< IP-адрес интерфейса, для которого собирается статистика
 
+	std::vector<std::string> localNetworks;				   ///< Дополнительные локальные сети в нотации CIDR
+	std::shared_ptr<const LocalAddressSet> localAddresses; ///< Адреса, относительно которых определяется направление пакетов
+
 	pcpp::OrFilter filter;
 	pcpp::PcapLiveDevice *dev;
+	pcpp::IFileReaderDevice *reader; ///< Источник пакетов в режиме воспроизведения файла
 
-	std::unique_ptr<std::mutex> collectorMutex;	 ///< Объект синхронизирущий работу со статистикой из рахных потоков
-	std::unique_ptr<ITrafficStats> trafficStats; ///< Объект отвечающий за обработку траффика и вывод статистики в формате строки
+	/// \brief Интерфейс, который захватывается собственным потоком libpcap при захвате нескольких интерфейсов
+	struct InterfaceCapture
+	{
+		TrafficAnalyzer *owner{nullptr};
+		std::size_t index{0};				///< Номер интерфейса, совпадает с номером его обработчика
+		pcpp::PcapLiveDevice *dev{nullptr};
+		std::string ipAddr;					///< IP-адрес, по которому найден интерфейс
+		int cpu{CpuAffinity::anyCpu};		///< Ядро потока захвата интерфейса
+		bool isPinned{false};				///< Поток захвата уже привязан к ядру, изменяется только этим потоком
+		std::mutex feedMutex;				///< Сериализует передачу пакетов обработчику и публикацию копии шарда idleTimer
+	};
+
+	std::vector<std::string> interfaceIpAddrs;				   ///< IP-адреса захватываемых интерфейсов, пусто - один интерфейс initializeAs
+	std::vector<std::unique_ptr<InterfaceCapture>> interfaces; ///< Устройства захвата, пусто при захвате одного интерфейса
+	std::vector<int> captureCpus;							   ///< Ядра потоков захвата (интерфейсов или колец) по порядку
+	bool isCapturePinned{false};							   ///< Поток libpcap единственного интерфейса уже привязан к ядру
 
-	static void onPacketArrives(pcpp::RawPacket *packet, pcpp::PcapLiveDevice *dev, void *cookie)
+	/// \brief Данные, через которые поток захвата и читатели обмениваются запросами
+	struct SyncState
 	{
-		TrafficAnalyzer *analyzer = static_cast<TrafficAnalyzer *>(cookie);
-		std::lock_guard<std::mutex> guard(*analyzer->collectorMutex);
-		analyzer->trafficStats->addPacket(pcpp::Packet(packet));
-	}
+		std::atomic<bool> capturing{false};		 ///< Поток захвата владеет trafficStats
+		std::atomic<bool> clearRequested{false}; ///< Читатель запросил очистку статистики во время захвата
+		std::atomic<bool> ringsRunning{false};	 ///< Потоки колец захвата должны продолжать работу
 
-public:
-	TrafficAnalyzer() : dev(nullptr), collectorMutex(std::make_unique<std::mutex>()) {}
-	~TrafficAnalyzer() { finalize(); }
+		std::mutex readersMutex;										///< Синхронизирует читателей между собой, поток захвата его не использует
+		std::vector<std::shared_ptr<const ITrafficStats>> mergedShards; ///< Копии шардов, из которых собран merged
+		std::shared_ptr<const ITrafficStats> merged;					///< Последний результат объединения копий шардов
 
-	TrafficAnalyzer(const TrafficAnalyzer &) = delete;
-	TrafficAnalyzer &operator=(const TrafficAnalyzer &) = delete;
+		std::mutex writerMutex;		 ///< Сериализует обработку пакетов потоком libpcap и публикацию копии idleTimer
+		IdlePublishTimer idleTimer; ///< Публикует копии статистики потока libpcap, пока пакетов нет
+	};
 
-	TrafficAnalyzer(TrafficAnalyzer &&other)
-		: dev(other.dev),
-		  interfaceIpAddr(std::move(other.interfaceIpAddr)),
-		  collectorMutex(std::move(other.collectorMutex)),
-		  filter(std::move(other.filter)),
-		  trafficStats(std::move(other.trafficStats))
+	std::unique_ptr<SyncState> syncState;
+	std::unique_ptr<ITrafficStats> trafficStats; ///< Объект отвечающий за обработку траффика и вывод статистики в формате строки
+	std::unique_ptr<SnapshotPublisher> publisher; ///< Публикует копии trafficStats, если пакеты обрабатываются в потоке захвата
+	SnapshotPolicy snapshotPolicy;				  ///< Правила публикации копий статистики
+
+	std::vector<std::unique_ptr<CaptureWorker>> workers; ///< Обработчики пакетов, пусто если пакеты обрабатываются в потоке захвата
+
+	HostStoreConfig storeConfig; ///< Параметры файлов, в которых сохраняется статистика хостов
+
+	DnsCacheConfig dnsCacheConfig;		 ///< Параметры кэша ответов DNS
+	std::shared_ptr<DnsCache> dnsCache; ///< Кэш ответов DNS, общий для всех писателей, nullptr если не ведется
+
+	RateHistoryConfig historyConfig;	  ///< Параметры истории скорости трафика
+	std::unique_ptr<RateHistory> history; ///< История скорости трафика, если пакеты обрабатываются в потоке захвата
+
+	PacketRingConfig ringConfig;					 ///< Параметры колец AF_PACKET, кольца не используются, если ringsCount == 0
+	std::vector<std::unique_ptr<PacketRing>> rings; ///< Кольца захвата, пусто при захвате через libpcap
+	std::vector<std::thread> ringThreads;			 ///< Поток каждого кольца
+
+	/// \brief Кэши строк вывода в формате Prometheus: суммарного и каждого интерфейса
+	std::vector<std::unique_ptr<MetricsExposition>> metrics;
+
+	SamplingConfig samplingConfig;			 ///< Параметры выборочного учета пакетов при перегрузке живого захвата
+	AdaptiveSampler sampler;				 ///< Выборочный учет пакетов, обрабатываемых в потоке захвата
+	CaptureWorker::LoadSource captureLoad; ///< Счетчики потерь устройства захвата для sampler
+
+	static constexpr int ringPollTimeoutMs = 10; ///< Сколько ждать заполненного блока, прежде чем проверить остановку
+	static constexpr std::size_t replayBatchSize = 256; ///< Сколько пакетов файла читается и обрабатывается за раз
+
+	static void onPacketArrives(pcpp::RawPacket *packet, pcpp::PcapLiveDevice *, void *cookie)
 	{
-		other.dev = nullptr;
+		static_cast<TrafficAnalyzer *>(cookie)->processPacket(packet);
 	}
 
-	TrafficAnalyzer &operator=(TrafficAnalyzer &&other)
+	static void onInterfacePacketArrives(pcpp::RawPacket *packet, pcpp::PcapLiveDevice *, void *cookie)
 	{
-		dev = other.dev;
-
-		filter = std::move(other.filter);
-		trafficStats = std::move(other.trafficStats);
-		collectorMutex = std::move(other.collectorMutex);
-		interfaceIpAddr = std::move(other.interfaceIpAddr);
+		auto *capture = static_cast<InterfaceCapture *>(cookie);
+		capture->owner->processInterfacePacket(*capture, packet);
+	}
 
-		other.dev = nullptr;
+	/// \brief Возвращает ядро потока захвата с номером index, либо CpuAffinity::anyCpu
+	int cpuOfCaptureThread(std::size_t index) const
+	{
+		return index < captureCpus.size() ? captureCpus[index] : CpuAffinity::anyCpu;
+	}
 
-		return *this;
+	/// \brief Привязывает вызывающий поток захвата к ядру, ошибка пишется в лог
+	static void pinCaptureThread(int cpu)
+	{
+		std::string errorInfo;
+		if (!CpuAffinity::pinCurrentThread(cpu, errorInfo))
+			TA_LOG(warning) << errorInfo;
 	}
 
-	/// \brief Инициализирующий метод
-	/// \tparam T Тип который будет иметь trafficStats
-	/// \param[in] interfaceIpAddr IP-адрес устройства, для которого будет собираться статистика
-	/// \param[in] portFilterVec Вектор портов, по которым будет происходить анализ пакетов
-	/// \param[out] errorInfo В случае ошибки инициализации, сюда будет записана причина
-	/// \return True - если инициализация прошла усешно, иначе False
-	template <class T>
-	bool initializeAs(const std::string &interfaceIpAddr,
-					  std::vector<pcpp::GeneralFilter *> &portFilterVec,
-					  std::string &errorInfo)
+	/// \brief Настраивает фильтр портов на устройстве захвата
+	bool applyFilter(pcpp::IPcapDevice *device,
+					 std::vector<pcpp::GeneralFilter *> &portFilterVec,
+					 std::string &errorInfo)
 	{
-		this->interfaceIpAddr = interfaceIpAddr;
+		filter = pcpp::OrFilter(portFilterVec);
+		std::string filterAsString;
+		filter.parseToString(filterAsString);
 
-		dev = pcpp::PcapLiveDeviceList::getInstance().getPcapLiveDeviceByIp(interfaceIpAddr);
-		if (!dev)
+		if (!device->setFilter(filter))
 		{
-			errorInfo = "TrafficAnalyzer: cannot find interface with IPv4 address of '" + interfaceIpAddr + "'";
+			errorInfo = "TrafficAnalyzer: cannot set filter '" + filterAsString + "'";
+			device->close();
 			return false;
 		}
 
-		if (!dev->open())
-		{
-			errorInfo = "TrafficAnalyzer: cannot open device";
-			return false;
-		}
+		TA_LOG(info) << "TrafficAnalyzer filter: '" << filterAsString << "'";
+		return true;
+	}
 
+	/// \brief Открывает кольца AF_PACKET на интерфейсе и объединяет их в группу fanout
+	bool openRings(const std::string &interfaceName,
+				   std::vector<pcpp::GeneralFilter *> &portFilterVec,
+				   std::string &errorInfo)
+	{
 		filter = pcpp::OrFilter(portFilterVec);
 		std::string filterAsString;
 		filter.parseToString(filterAsString);
 
-		if (!dev->setFilter(filter))
+		PacketRingConfig config = ringConfig;
+		if (config.ringsCount > 1 && !config.fanoutGroup)
+			config.fanoutGroup = static_cast<std::uint16_t>(::getpid() & 0xFFFF);
+
+		rings.clear();
+		for (std::size_t i = 0; i < config.ringsCount; i++)
 		{
-			errorInfo = "TrafficAnalyzer: cannot set filter '" + filterAsString + "'";
-			dev->close();
-			return false;
+			rings.push_back(std::make_unique<PacketRing>());
+			if (!rings.back()->open(interfaceName, config, filterAsString, errorInfo))
+			{
+				rings.clear();
+				return false;
+			}
 		}
 
-		BOOST_LOG_TRIVIAL(info) << "TrafficAnalyzer filter: '" << filterAsString << "'";
+		TA_LOG(info) << "TrafficAnalyzer captures from " << rings.size() << " AF_PACKET rings on '" << interfaceName
+					 << "', fanout group " << config.fanoutGroup << ", filter: '" << filterAsString << "'";
+		return true;
+	}
+
+	/**
+	 * \brief Собирает локальные адреса: адрес интерфейса, все адреса интерфейсов interfaceNames и сети localNetworks
+	 * \param[in] interfaceNames Имена захватываемых интерфейсов, пусто при воспроизведении файла
+	 */
+	bool loadLocalAddresses(const std::vector<std::string> &interfaceNames, std::string &errorInfo)
+	{
+		auto addresses = LocalAddressSet::ofAddress(interfaceIpAddr);
+
+		for (const auto &interfaceName : interfaceNames)
+			if (!addresses->addInterfaceAddresses(interfaceName, errorInfo))
+				return false;
 
-		trafficStats = std::make_unique<T>(interfaceIpAddr);
+		for (const auto &network : localNetworks)
+			if (!addresses->addNetwork(network, errorInfo))
+				return false;
 
+		TA_LOG(info) << "TrafficAnalyzer local addresses: " << addresses->toString();
+
+		localAddresses = std::move(addresses);
 		return true;
 	}
 
-	/// \brief Освобождения ресурсы, занимаемымы объектом
-	void finalize()
+	/// \brief Создает объект статистики и шарды обработчиков
+	/// \param[in] statsArgs Аргументы конструктора T, передаваемые после IP-адреса интерфейса
+	template <class T, class... Args>
+	void createStats(std::size_t workersCount, const Args &...statsArgs)
 	{
-		if (dev)
+		dnsCache.reset();
+		if (dnsCacheConfig.isEnabled())
+			dnsCache = std::make_shared<DnsCache>(dnsCacheConfig);
+
+		trafficStats = std::make_unique<T>(interfaceIpAddr, statsArgs...);
+		trafficStats->setLocalAddresses(localAddresses);
+		trafficStats->setDnsCache(dnsCache);
+		publisher = std::make_unique<SnapshotPublisher>(*trafficStats, snapshotPolicy);
+
+		history.reset();
+		if (historyConfig.retention.count() > 0 && !workersCount)
+			history = std::make_unique<RateHistory>(historyConfig, localAddresses);
+
+		// Шард кольца или интерфейса заполняет поток захвата, поэтому создается на его ядре (и узле NUMA)
+		bool isShardOfCaptureThread = rings.size() > 1 || !interfaces.empty();
+
+		workers.clear();
+		for (std::size_t i = 0; i < workersCount; i++)
 		{
-			if (dev->captureActive())
-				dev->stopCapture();
+			CpuAffinity::runOn(isShardOfCaptureThread ? cpuOfCaptureThread(i) : CpuAffinity::anyCpu, [&]
+							   {
+								   auto shard = std::make_unique<T>(interfaceIpAddr, statsArgs...);
+								   shard->setLocalAddresses(localAddresses);
+								   shard->setDnsCache(dnsCache);
+								   workers.push_back(std::make_unique<CaptureWorker>(std::move(shard), snapshotPolicy));
 
-			if (dev->isOpened())
-				dev->close();
+								   if (historyConfig.retention.count() > 0)
+									   workers.back()->attachHistory(std::make_unique<RateHistory>(historyConfig, localAddresses)); });
 		}
 
-		if (trafficStats.get())
+		metrics.clear();
+		for (std::size_t i = 0; i <= interfaces.size(); i++)
+			metrics.push_back(std::make_unique<MetricsExposition>());
+
+		if (workersCount)
+			TA_LOG(info) << "TrafficAnalyzer uses " << workersCount << " workers";
+	}
+
+	/**
+	 * \brief Открывает файлы статистики хостов и загружает из них статистику писателей
+	 *
+	 * Каждый обработчик сохраняет свой шард в отдельный файл: к пути добавляется точка и номер обработчика
+	 */
+	bool openStores(std::string &errorInfo)
+	{
+		if (!storeConfig.isEnabled())
+			return true;
+
+		for (std::size_t i = 0; i < std::max<std::size_t>(workers.size(), 1); i++)
+		{
+			HostStoreConfig config = storeConfig;
+			if (!workers.empty())
+				config.path += "." + std::to_string(i);
+
+			auto store = std::make_unique<HostStore>();
+			if (!store->open(config, errorInfo))
+				return false;
+
+			if (workers.empty())
+			{
+				if (!trafficStats->attachStore(std::move(store), errorInfo))
+					return false;
+
+				publisher->publish(*trafficStats);
+			}
+			else if (!workers[i]->attachStore(std::move(store), errorInfo))
+				return false;
+		}
+
+		return true;
+	}
+
+	/// \brief Передает пакет обработчику, выбранному по хэшу пары адресов
+	bool dispatchPacket(const pcpp::RawPacket &packet, bool waitIfFull)
+	{
+		TA_PERF_SAMPLED_SCOPE(dispatch);
+		auto &worker = workers[RawPacketParser::flowHash(packet) % workers.size()];
+		return worker->enqueue(packet, waitIfFull);
+	}
+
+	void startWorkers()
+	{
+		for (auto &worker : workers)
+			worker->start();
+	}
+
+	void stopWorkers()
+	{
+		for (auto &worker : workers)
+			worker->stop();
+	}
+
+	/// \brief Выполняет запрос читателя на очистку статистики, вызывается только потоком захвата
+	void serveClearRequest()
+	{
+		if (syncState->clearRequested.load(std::memory_order_relaxed) &&
+			syncState->clearRequested.exchange(false, std::memory_order_acquire))
+		{
+			if (history)
+				history->clear();
+
 			trafficStats->clear();
+			publisher->publish(*trafficStats);
+		}
 	}
 
-	/// \brief Начинает захват пакетов из живого трафика
-	void startCapture()
+	/// \brief Публикует копию статистики потока libpcap, если поток в этот момент не обрабатывает пакет
+	void publishIdle()
 	{
-		if (dev && dev->isOpened())
-			dev->startCapture(onPacketArrives, this);
-		else
-			BOOST_LOG_TRIVIAL(warning) << "TrafficAnalyzer startCapture failed, device was not opened or nullptr";
+		std::unique_lock<std::mutex> writer(syncState->writerMutex, std::try_to_lock);
+		if (!writer.owns_lock())
+			return;
+
+		serveClearRequest();
+		publisher->onIdle(*trafficStats);
 	}
 
-	/// \brief Останавливает захват пакетов
-	void stopCapture()
+	/// \brief Публикует копии шардов интерфейсов, потоки захвата которых в этот момент не обрабатывают пакет
+	void publishInterfacesIdle()
 	{
-		if (dev && dev->isOpened())
-			dev->stopCapture();
+		for (auto &capture : interfaces)
+		{
+			std::unique_lock<std::mutex> feed(capture->feedMutex, std::try_to_lock);
+			if (feed.owns_lock())
+				workers[capture->index]->feedIdle();
+		}
+	}
+
+	/// \brief Поток захвата завершил работу: публикует итоговую копию статистики
+	void finishCapture()
+	{
+		syncState->capturing.store(false, std::memory_order_release);
+		serveClearRequest();
+		publisher->publish(*trafficStats);
+	}
+
+	/// \brief Возвращает источник счетчиков потерь кольца захвата, либо устройства libpcap, если ring == nullptr
+	static CaptureWorker::LoadSource loadSourceOf(PacketRing *ring, pcpp::IPcapDevice *device)
+	{
+		if (ring)
+			return [ring](std::uint64_t &received, std::uint64_t &dropped)
+			{
+				PacketRingStats stats = ring->getStats();
+				received = stats.packets;
+				dropped = stats.drops;
+			};
+
+		return [device](std::uint64_t &received, std::uint64_t &dropped)
+		{
+			pcpp::IPcapDevice::PcapStats stats{};
+			device->getStatistics(stats);
+			received = stats.packetsRecv;
+			dropped = stats.packetsDrop + stats.packetsDropByInterface;
+		};
+	}
+
+	/// \brief Включает выборочный учет при перегрузке у каждого писателя живого захвата
+	///
+	/// Писатели, которые заполняет сам поток захвата, следят за потерями своего устройства,
+	/// а обработчики с очередями - за заполнением очереди. Воспроизведение файла всегда учитывается точно
+	void configureSampling()
+	{
+		if (!samplingConfig.isEnabled())
+			return;
+
+		if (!interfaces.empty())
+		{
+			for (auto &capture : interfaces)
+				workers[capture->index]->setSampling(samplingConfig, loadSourceOf(nullptr, capture->dev));
+		}
+		else if (rings.size() > 1)
+		{
+			for (std::size_t i = 0; i < rings.size(); i++)
+				workers[i]->setSampling(samplingConfig, loadSourceOf(rings[i].get(), nullptr));
+		}
+		else if (!workers.empty())
+		{
+			for (auto &worker : workers)
+				worker->setSampling(samplingConfig);
+		}
 		else
-			BOOST_LOG_TRIVIAL(warning) << "TrafficAnalyzer stopCapture failed, device was not opened or nullptr";
+		{
+			sampler = AdaptiveSampler(samplingConfig);
+			captureLoad = loadSourceOf(rings.empty() ? nullptr : rings.front().get(), dev);
+		}
 	}
 
-	/// \brief Возвращает собранную статистику в виде строки
-	std::string getPlaneTextStat()
+	/// \brief Пересчитывает коэффициент выборки по потерям устройства захвата и отбирает учитываемые пакеты пачки
+	std::span<const PacketView> sampleViews(std::span<const PacketView> views)
 	{
-		if (!trafficStats.get())
+		if (!sampler.isEnabled())
+			return views;
+
+		if (sampler.isCheckDue(views.size()))
 		{
-			BOOST_LOG_TRIVIAL(warning) << "TrafficAnalyzer trying get plain text stat, but trafficStats was nullptr";
-			return "";
+			std::uint64_t received = 0, dropped = 0;
+			captureLoad(received, dropped);
+
+			if (sampler.observe(received, dropped, 0))
+			{
+				trafficStats->setSamplingRate(sampler.getRate());
+
+				if (sampler.getRate() > 1)
+					TA_LOG_ASYNC(warning, "Overload: capture thread counts 1 of {} flows", sampler.getRate());
+				else
+					TA_LOG_ASYNC(info, "Load dropped: capture thread counts all packets again");
+			}
 		}
 
-		std::lock_guard<std::mutex> guard(*collectorMutex);
-		return trafficStats->toString();
+		return sampler.sample(views);
 	}
 
-	/// \brief Возвращает собранную статистику в формате JSON строки
-	std::string getJsonStat()
+	/// \brief Записывает пачку пакетов в статистику, вызывается только потоком захвата
+	///
+	/// Запрос на очистку и необходимость публикации копии проверяются один раз на пачку
+	void processViews(std::span<const PacketView> views)
 	{
-		if (!trafficStats.get())
+		serveClearRequest();
+		views = sampleViews(views);
+
 		{
-			BOOST_LOG_TRIVIAL(warning) << "TrafficAnalyzer trying get json stat, but trafficStats was nullptr";
-			return "";
+			TA_PERF_SCOPE(stats, views.size());
+			trafficStats->addPackets(views);
+		}
+
+		{
+			TA_PERF_SCOPE(publish, views.size());
+			publisher->onPackets(*trafficStats, views.size());
 		}
 
-		std::lock_guard<std::mutex> guard(*collectorMutex);
-		return trafficStats->toJsonString();
+		if (history)
+			history->addPackets(views);
 	}
 
-	/// \brief Очищает собранную статистику
-	void clearStats()
+	/// \brief Записывает пакет в статистику, вызывается только потоком захвата
+	void processView(const PacketView &view) { processViews(std::span<const PacketView>(&view, 1)); }
+
+	/**
+	 * \brief Цикл потока кольца захвата
+	 *
+	 * При нескольких кольцах каждое заполняет шард своего обработчика, а при одном -
+	 * статистику потока захвата, либо копирует пакеты в очереди обработчиков.
+	 * Кадры блока записываются в статистику одной пачкой, до возврата блока ядру
+	 */
+	void runRing(std::size_t index)
 	{
-		if (!trafficStats.get())
+		PacketRing &ring = *rings[index];
+		CaptureWorker *owner = rings.size() > 1 ? workers[index].get() : nullptr;
+		pcpp::LinkLayerType linkType = ring.getLinkType();
+		bool isDispatching = !owner && !workers.empty();
+		std::vector<PacketView> batch;
+
+		TA_PERF_THREAD("ring");
+
+		if (cpuOfCaptureThread(index) != CpuAffinity::anyCpu)
+			pinCaptureThread(cpuOfCaptureThread(index));
+
+		if (owner)
+			owner->beginFeed();
+
+		while (syncState->ringsRunning.load(std::memory_order_acquire))
 		{
-			BOOST_LOG_TRIVIAL(warning) << "TrafficAnalyzer trying clear stat, but trafficStats was nullptr";
-			return;
+			std::size_t processed = ring.poll(
+				ringPollTimeoutMs,
+				[&](const PacketRingFrame &frame)
+				{
+					if (isDispatching)
+					{
+						pcpp::RawPacket rawPacket(frame.data, static_cast<int>(frame.length), frame.timestamp, false, linkType);
+						dispatchPacket(rawPacket, false);
+						return;
+					}
+
+					batch.emplace_back();
+					TA_PERF_SAMPLED_SCOPE(parse);
+					RawPacketParser::parse(frame.data, frame.length, linkType, frame.timestamp, batch.back());
+				},
+				[&]
+				{
+					if (batch.empty())
+						return;
+
+					if (owner)
+						owner->feed(batch);
+					else
+						processViews(batch);
+
+					batch.clear();
+				});
+
+			if (processed)
+				continue;
+
+			if (owner)
+				owner->feedIdle();
+			else if (workers.empty())
+			{
+				serveClearRequest();
+				publisher->onIdle(*trafficStats);
+			}
+		}
+
+		if (owner)
+			owner->endFeed();
+	}
+
+	void stopRings()
+	{
+		syncState->ringsRunning.store(false, std::memory_order_release);
+
+		for (auto &thread : ringThreads)
+			thread.join();
+
+		ringThreads.clear();
+	}
+
+	void stopIdleTimer()
+	{
+		if (syncState)
+			syncState->idleTimer.stop();
+	}
+
+	/**
+	 * \brief Возвращает последнюю опубликованную копию статистики
+	 *
+	 * При наличии обработчиков объединяет опубликованные копии их шардов.
+	 * Если ни один шард не опубликовал новую копию, возвращается прошлый результат объединения.
+	 * Поколением объединенной копии считается наименьшее из поколений шардов: клиент, получивший
+	 * его, при следующем запросе может повторно получить часть записей, но не пропустит изменений
+	 * \param[in] interfaceIndex Номер интерфейса, статистику которого нужно вернуть, allInterfaces - суммарную
+	 */
+	std::shared_ptr<const ITrafficStats> getSnapshot(std::size_t interfaceIndex = allInterfaces)
+	{
+		if (workers.empty())
+			return publisher->get();
+
+		if (interfaceIndex != allInterfaces && !interfaces.empty())
+			return workers[interfaceIndex]->getSnapshot();
+
+		std::lock_guard<std::mutex> guard(syncState->readersMutex);
+
+		std::vector<std::shared_ptr<const ITrafficStats>> shards;
+		for (auto &worker : workers)
+			shards.push_back(worker->getSnapshot());
+
+		if (syncState->merged && shards == syncState->mergedShards)
+			return syncState->merged;
+
+		auto merged = trafficStats->clone();
+		std::uint64_t generation = UINT64_MAX;
+
+		for (const auto &shard : shards)
+		{
+			merged->merge(*shard);
+			generation = std::min(generation, shard->getGeneration());
+		}
+
+		merged->setGeneration(generation);
+
+		syncState->mergedShards = std::move(shards);
+		syncState->merged = std::move(merged);
+		return syncState->merged;
+	}
+
+	/// \brief Возвращает истории скорости трафика всех писателей, либо только писателя интерфейса interfaceIndex
+	std::vector<const RateHistory *> getHistories(std::size_t interfaceIndex = allInterfaces) const
+	{
+		std::vector<const RateHistory *> histories;
+
+		if (interfaceIndex != allInterfaces && !interfaces.empty())
+		{
+			if (workers[interfaceIndex]->getHistory())
+				histories.push_back(workers[interfaceIndex]->getHistory());
+
+			return histories;
+		}
+
+		if (history)
+			histories.push_back(history.get());
+
+		for (const auto &worker : workers)
+			if (worker->getHistory())
+				histories.push_back(worker->getHistory());
+
+		return histories;
+	}
+
+	/**
+	 * \brief Определяет окно из последних завершенных интервалов истории
+	 * \param[out] endTick Последний завершенный интервал
+	 * \param[out] count Количество интервалов в окне
+	 * \return False - если завершенных интервалов ещё нет
+	 */
+	static bool getWindow(const std::vector<const RateHistory *> &histories, std::chrono::seconds window,
+						  std::uint64_t &endTick, std::size_t &count)
+	{
+		std::uint64_t latestTick = 0;
+		for (const auto *source : histories)
+			if (source->hasPackets())
+				latestTick = std::max(latestTick, source->getLatestTick() + 1);
+
+		// Интервал последнего пакета ещё не завершен, поэтому в окно не входит
+		if (latestTick < 2)
+			return false;
+
+		const RateHistory *first = histories.front();
+		endTick = latestTick - 2;
+		count = static_cast<std::size_t>(std::max<std::int64_t>(window.count() / first->getResolution(), 1));
+		count = std::min(count, first->getSlotsCount() - 1);
+		return true;
+	}
+
+	static void writeRateFields(JsonWriter &json, const RateSummary &summary, std::int64_t seconds, std::int64_t resolution)
+	{
+		json.field("bytes", summary.bytes);
+		json.field("packets", summary.packets);
+		json.field("bytesPerSecond", summary.bytes / seconds);
+		json.field("packetsPerSecond", summary.packets / seconds);
+		json.field("peakBytesPerSecond", summary.peakBytes / resolution);
+		json.field("peakPacketsPerSecond", summary.peakPackets / resolution);
+	}
+
+	/// \brief Суммарные счетчики хостов копии статистики
+	struct TrafficTotals : public IHostVisitor
+	{
+		std::uint64_t hosts{0};
+		std::uint64_t inPackets{0};
+		std::uint64_t outPackets{0};
+		std::uint64_t inTraffic{0};
+		std::uint64_t outTraffic{0};
+
+		void onHost(const IpKey &, const HostInfo &hostInfo, std::uint32_t) override
+		{
+			hosts++;
+			inPackets += hostInfo.inPackets;
+			outPackets += hostInfo.outPackets;
+			inTraffic += hostInfo.inTraffic;
+			outTraffic += hostInfo.outTraffic;
+		}
+	};
+
+	/// \brief Открывает интерфейсы interfaceIpAddrs, каждый со своим фильтром портов
+	bool openInterfaces(std::vector<pcpp::GeneralFilter *> &portFilterVec, std::string &errorInfo)
+	{
+		interfaces.clear();
+		for (std::size_t i = 0; i < interfaceIpAddrs.size(); i++)
+		{
+			auto capture = std::make_unique<InterfaceCapture>();
+			capture->owner = this;
+			capture->index = i;
+			capture->ipAddr = interfaceIpAddrs[i];
+			capture->cpu = cpuOfCaptureThread(i);
+			capture->dev = pcpp::PcapLiveDeviceList::getInstance().getPcapLiveDeviceByIp(capture->ipAddr);
+
+			if (!capture->dev)
+			{
+				errorInfo = "TrafficAnalyzer: cannot find interface with IPv4 address of '" + capture->ipAddr + "'";
+				return false;
+			}
+
+			// Устройство закрывается в finalize, даже если его не удалось настроить
+			interfaces.push_back(std::move(capture));
+			InterfaceCapture &opened = *interfaces.back();
+
+			if (!opened.dev->open())
+			{
+				errorInfo = "TrafficAnalyzer: cannot open device '" + opened.dev->getName() + "'";
+				return false;
+			}
+
+			if (!applyFilter(opened.dev, portFilterVec, errorInfo))
+				return false;
+
+			TA_LOG(info) << "TrafficAnalyzer captures '" << opened.dev->getName() << "' (" << opened.ipAddr << ")"
+						 << (opened.cpu == CpuAffinity::anyCpu ? std::string() : " on cpu " + std::to_string(opened.cpu) + ", NUMA node " + std::to_string(CpuAffinity::numaNodeOf(opened.cpu)));
+		}
+
+		return true;
+	}
+
+	/// \brief Записывает пакет интерфейса в шард его обработчика, вызывается только потоком захвата интерфейса
+	void processInterfacePacket(InterfaceCapture &capture, pcpp::RawPacket *packet)
+	{
+		if (!capture.isPinned)
+		{
+			capture.isPinned = true;
+			if (capture.cpu != CpuAffinity::anyCpu)
+				pinCaptureThread(capture.cpu);
+		}
+
+		TA_PERF_THREAD("capture");
+
+		PacketView view;
+		{
+			TA_PERF_SAMPLED_SCOPE(parse);
+			RawPacketParser::parse(*packet, view);
+		}
+
+		std::lock_guard<std::mutex> feed(capture.feedMutex);
+		workers[capture.index]->feed(view);
+	}
+
+	/// \brief Дописывает в json описание и суммарные счетчики интерфейса
+	void writeInterfaceJson(JsonWriter &json, const std::string &name, const std::string &ipAddr, int cpu,
+							const ITrafficStats &snapshot, pcpp::IPcapDevice *device) const
+	{
+		TrafficTotals totals;
+		snapshot.visitHosts(totals);
+
+		json.beginObject();
+		json.field("name", std::string_view(name));
+		json.field("ip", std::string_view(ipAddr));
+
+		if (cpu != CpuAffinity::anyCpu)
+		{
+			json.field("cpu", std::uint64_t(cpu));
+			int node = CpuAffinity::numaNodeOf(cpu);
+			if (node >= 0)
+				json.field("numaNode", std::uint64_t(node));
+		}
+
+		json.field("hosts", totals.hosts);
+
+		json.key("packets").beginObject();
+		json.field("in", totals.inPackets);
+		json.field("out", totals.outPackets);
+		json.endObject();
+
+		json.key("traffic").beginObject();
+		json.field("in", totals.inTraffic);
+		json.field("out", totals.outTraffic);
+		json.endObject();
+
+		if (device && device->isOpened())
+		{
+			pcpp::IPcapDevice::PcapStats stats;
+			device->getStatistics(stats);
+
+			json.key("pcap").beginObject();
+			json.field("received", std::uint64_t(stats.packetsRecv));
+			json.field("dropped", std::uint64_t(stats.packetsDrop));
+			json.field("droppedByInterface", std::uint64_t(stats.packetsDropByInterface));
+			json.endObject();
 		}
 
-		std::lock_guard<std::mutex> guard(*collectorMutex);
-		trafficStats->clear();
+		json.endObject();
+	}
+
+public:
+	/// \brief Номер интерфейса, означающий суммарную статистику всех интерфейсов
+	static constexpr std::size_t allInterfaces = SIZE_MAX;
+
+	TrafficAnalyzer()
+		: dev(nullptr),
+		  reader(nullptr),
+		  syncState(std::make_unique<SyncState>())
+	{
+		metrics.push_back(std::make_unique<MetricsExposition>());
+	}
+	~TrafficAnalyzer() { finalize(); }
+
+	TrafficAnalyzer(const TrafficAnalyzer &) = delete;
+	TrafficAnalyzer &operator=(const TrafficAnalyzer &) = delete;
+
+	TrafficAnalyzer(TrafficAnalyzer &&other)
+		: interfaceIpAddr(std::move(other.interfaceIpAddr)),
+		  localNetworks(std::move(other.localNetworks)),
+		  localAddresses(std::move(other.localAddresses)),
+		  filter(std::move(other.filter)),
+		  dev(other.dev),
+		  reader(other.reader),
+		  interfaceIpAddrs(std::move(other.interfaceIpAddrs)),
+		  interfaces(std::move(other.interfaces)),
+		  captureCpus(std::move(other.captureCpus)),
+		  isCapturePinned(other.isCapturePinned),
+		  syncState(std::move(other.syncState)),
+		  trafficStats(std::move(other.trafficStats)),
+		  publisher(std::move(other.publisher)),
+		  snapshotPolicy(other.snapshotPolicy),
+		  workers(std::move(other.workers)),
+		  storeConfig(other.storeConfig),
+		  dnsCacheConfig(other.dnsCacheConfig),
+		  dnsCache(std::move(other.dnsCache)),
+		  historyConfig(other.historyConfig),
+		  history(std::move(other.history)),
+		  ringConfig(other.ringConfig),
+		  rings(std::move(other.rings)),
+		  ringThreads(std::move(other.ringThreads)),
+		  metrics(std::move(other.metrics)),
+		  samplingConfig(other.samplingConfig),
+		  sampler(std::move(other.sampler)),
+		  captureLoad(std::move(other.captureLoad))
+	{
+		other.dev = nullptr;
+		other.reader = nullptr;
+
+		for (auto &capture : interfaces)
+			capture->owner = this;
+	}
+
+	TrafficAnalyzer &operator=(TrafficAnalyzer &&other)
+	{
+		dev = other.dev;
+		reader = other.reader;
+
+		interfaceIpAddrs = std::move(other.interfaceIpAddrs);
+		interfaces = std::move(other.interfaces);
+		captureCpus = std::move(other.captureCpus);
+		isCapturePinned = other.isCapturePinned;
+
+		for (auto &capture : interfaces)
+			capture->owner = this;
+
+		filter = std::move(other.filter);
+		trafficStats = std::move(other.trafficStats);
+		syncState = std::move(other.syncState);
+		publisher = std::move(other.publisher);
+		snapshotPolicy = other.snapshotPolicy;
+		workers = std::move(other.workers);
+		storeConfig = other.storeConfig;
+		dnsCacheConfig = other.dnsCacheConfig;
+		dnsCache = std::move(other.dnsCache);
+		historyConfig = other.historyConfig;
+		history = std::move(other.history);
+		ringConfig = other.ringConfig;
+		rings = std::move(other.rings);
+		ringThreads = std::move(other.ringThreads);
+		metrics = std::move(other.metrics);
+		samplingConfig = other.samplingConfig;
+		sampler = std::move(other.sampler);
+		captureLoad = std::move(other.captureLoad);
+		interfaceIpAddr = std::move(other.interfaceIpAddr);
+		localNetworks = std::move(other.localNetworks);
+		localAddresses = std::move(other.localAddresses);
+
+		other.dev = nullptr;
+		other.reader = nullptr;
+
+		return *this;
+	}
+
+	/// \brief Задает правила публикации копий статистики, вызывается до инициализации
+	void setSnapshotPolicy(const SnapshotPolicy &policy) { snapshotPolicy = policy; }
+
+	/// \brief Задает файл, в котором сохраняется статистика хостов между запусками, вызывается до инициализации
+	void setHostStoreConfig(const HostStoreConfig &config) { storeConfig = config; }
+
+	/// \brief Задает параметры кэша ответов DNS, вызывается до инициализации
+	void setDnsCacheConfig(const DnsCacheConfig &config) { dnsCacheConfig = config; }
+
+	/// \brief Задает параметры истории скорости трафика, вызывается до инициализации
+	void setHistoryConfig(const RateHistoryConfig &config) { historyConfig = config; }
+
+	/// \brief Задает дополнительные локальные сети в нотации CIDR, вызывается до инициализации
+	///
+	/// Пакеты, адресованные этим сетям или любому адресу интерфейса, считаются входящими
+	void setLocalNetworks(const std::vector<std::string> &networks) { localNetworks = networks; }
+
+	/**
+	 * \brief Задает IP-адреса интерфейсов, которые захватываются одновременно, вызывается до initializeAs
+	 *
+	 * При нескольких интерфейсах каждый захватывается своим потоком libpcap в шард своего обработчика,
+	 * а IP-адрес, переданный в initializeAs, остается основным адресом статистики.
+	 * Локальными считаются адреса всех интерфейсов
+	 */
+	void setInterfaces(const std::vector<std::string> &ipAddrs) { interfaceIpAddrs = ipAddrs; }
+
+	/// \brief Задает ядра, к которым привязываются потоки захвата интерфейсов (или колец) по порядку, вызывается до initializeAs
+	///
+	/// Шард, который заполняет поток захвата, создается на том же ядре, чтобы его память была на узле NUMA этого ядра
+	void setCaptureCpus(const std::vector<int> &cpus) { captureCpus = cpus; }
+
+	/// \brief Задает выборочный учет пакетов при перегрузке живого захвата, вызывается до startCapture
+	void setSamplingConfig(const SamplingConfig &config) { samplingConfig = config; }
+
+	/// \brief Задает захват через кольца AF_PACKET вместо libpcap, вызывается до initializeAs
+	///
+	/// При нескольких кольцах количество обработчиков равно количеству колец
+	void setPacketRingConfig(const PacketRingConfig &config) { ringConfig = config; }
+
+	/// \brief Инициализирующий метод
+	/// \tparam T Тип который будет иметь trafficStats
+	/// \param[in] interfaceIpAddr IP-адрес устройства, для которого будет собираться статистика
+	/// \param[in] portFilterVec Вектор портов, по которым будет происходить анализ пакетов
+	/// \param[out] errorInfo В случае ошибки инициализации, сюда будет записана причина
+	/// \param[in] workersCount Количество обработчиков пакетов, 0 - обрабатывать пакеты в потоке захвата
+	/// \param[in] statsArgs Дополнительные аргументы конструктора T (например, TopHostsConfig)
+	/// \return True - если инициализация прошла усешно, иначе False
+	template <class T, class... Args>
+	bool initializeAs(const std::string &interfaceIpAddr,
+					  std::vector<pcpp::GeneralFilter *> &portFilterVec,
+					  std::string &errorInfo,
+					  std::size_t workersCount = 0,
+					  const Args &...statsArgs)
+	{
+		this->interfaceIpAddr = interfaceIpAddr;
+
+		if (interfaceIpAddrs.size() > 1)
+		{
+			if (ringConfig.isEnabled() || workersCount)
+			{
+				errorInfo = "TrafficAnalyzer: several interfaces are captured only by libpcap without workers";
+				return false;
+			}
+
+			if (!openInterfaces(portFilterVec, errorInfo))
+				return false;
+
+			std::vector<std::string> interfaceNames;
+			for (const auto &capture : interfaces)
+				interfaceNames.push_back(capture->dev->getName());
+
+			if (!loadLocalAddresses(interfaceNames, errorInfo))
+				return false;
+
+			createStats<T>(interfaces.size(), statsArgs...);
+			return openStores(errorInfo);
+		}
+
+		dev = pcpp::PcapLiveDeviceList::getInstance().getPcapLiveDeviceByIp(interfaceIpAddr);
+		if (!dev)
+		{
+			errorInfo = "TrafficAnalyzer: cannot find interface with IPv4 address of '" + interfaceIpAddr + "'";
+			return false;
+		}
+
+		if (!loadLocalAddresses({dev->getName()}, errorInfo))
+			return false;
+
+		if (ringConfig.isEnabled())
+		{
+			if (!openRings(dev->getName(), portFilterVec, errorInfo))
+				return false;
+
+			createStats<T>(ringConfig.ringsCount > 1 ? ringConfig.ringsCount : workersCount, statsArgs...);
+			return openStores(errorInfo);
+		}
+
+		if (!dev->open())
+		{
+			errorInfo = "TrafficAnalyzer: cannot open device";
+			return false;
+		}
+
+		if (!applyFilter(dev, portFilterVec, errorInfo))
+			return false;
+
+		createStats<T>(workersCount, statsArgs...);
+
+		return openStores(errorInfo);
+	}
+
+	/// \brief Инициализирующий метод для воспроизведения пакетов из файла
+	/// \tparam T Тип который будет иметь trafficStats
+	/// \param[in] filePath Путь к pcap/pcapng файлу
+	/// \param[in] interfaceIpAddr IP-адрес, относительно которого определяется направление пакетов
+	/// \param[in] portFilterVec Вектор портов, по которым будет происходить анализ пакетов
+	/// \param[out] errorInfo В случае ошибки инициализации, сюда будет записана причина
+	/// \param[in] workersCount Количество обработчиков пакетов, 0 - обрабатывать пакеты в вызывающем потоке
+	/// \param[in] statsArgs Дополнительные аргументы конструктора T (например, TopHostsConfig)
+	/// \return True - если инициализация прошла усешно, иначе False
+	template <class T, class... Args>
+	bool initializeFromFileAs(const std::string &filePath,
+							  const std::string &interfaceIpAddr,
+							  std::vector<pcpp::GeneralFilter *> &portFilterVec,
+							  std::string &errorInfo,
+							  std::size_t workersCount = 0,
+							  const Args &...statsArgs)
+	{
+		this->interfaceIpAddr = interfaceIpAddr;
+
+		if (!loadLocalAddresses({}, errorInfo))
+			return false;
+
+		reader = pcpp::IFileReaderDevice::getReader(filePath);
+		if (!reader)
+		{
+			errorInfo = "TrafficAnalyzer: cannot determine reader for file '" + filePath + "'";
+			return false;
+		}
+
+		if (!reader->open())
+		{
+			errorInfo = "TrafficAnalyzer: cannot open file '" + filePath + "'";
+			return false;
+		}
+
+		if (!applyFilter(reader, portFilterVec, errorInfo))
+			return false;
+
+		createStats<T>(workersCount, statsArgs...);
+
+		return openStores(errorInfo);
+	}
+
+	/// \brief Освобождения ресурсы, занимаемымы объектом
+	void finalize()
+	{
+		stopIdleTimer();
+		stopRings();
+		stopWorkers();
+		rings.clear();
+
+		if (dev)
+		{
+			if (dev->captureActive())
+				dev->stopCapture();
+
+			if (dev->isOpened())
+				dev->close();
+		}
+
+		for (auto &capture : interfaces)
+		{
+			if (capture->dev->captureActive())
+				capture->dev->stopCapture();
+
+			if (capture->dev->isOpened())
+				capture->dev->close();
+		}
+
+		if (reader)
+		{
+			if (reader->isOpened())
+				reader->close();
+
+			delete reader;
+			reader = nullptr;
+		}
+
+		if (trafficStats.get())
+		{
+			// Сохраненная статистика не очищается вместе со статистикой в памяти
+			syncState->capturing.store(false, std::memory_order_release);
+			trafficStats->closeStore();
+			trafficStats->clear();
+			publisher->publish(*trafficStats);
+		}
+
+		for (auto &worker : workers)
+		{
+			worker->closeStore();
+			worker->clear();
+		}
+	}
+
+	/// \brief Начинает захват пакетов из живого трафика
+	void startCapture()
+	{
+		configureSampling();
+
+		if (!rings.empty())
+		{
+			// Обработчики нескольких колец работают в потоках колец
+			if (rings.size() == 1)
+				startWorkers();
+
+			syncState->capturing.store(true, std::memory_order_release);
+			syncState->ringsRunning.store(true, std::memory_order_release);
+
+			for (std::size_t i = 0; i < rings.size(); i++)
+				ringThreads.emplace_back(&TrafficAnalyzer::runRing, this, i);
+		}
+		else if (!interfaces.empty())
+		{
+			// Обработчики интерфейсов работают в потоках захвата libpcap
+			syncState->capturing.store(true, std::memory_order_release);
+
+			for (auto &capture : interfaces)
+			{
+				capture->isPinned = false;
+				workers[capture->index]->beginFeed();
+				capture->dev->startCapture(onInterfacePacketArrives, capture.get());
+			}
+
+			// Тихий интерфейс не вызывает обработчик, и без таймера его шард не публиковался бы
+			syncState->idleTimer.start(snapshotPolicy.period, [this]
+									   { publishInterfacesIdle(); });
+		}
+		else if (dev && dev->isOpened())
+		{
+			startWorkers();
+			isCapturePinned = false;
+			syncState->capturing.store(true, std::memory_order_release);
+			dev->startCapture(onPacketArrives, this);
+
+			// Обработчики публикуют копии сами, а статистике потока libpcap нужен таймер
+			if (workers.empty())
+				syncState->idleTimer.start(snapshotPolicy.period, [this]
+										   { publishIdle(); });
+		}
+		else
+			TA_LOG(warning) << "TrafficAnalyzer startCapture failed, device was not opened or nullptr";
+	}
+
+	/// \brief Обрабатывает пакет и записывает данные о нём в статистику
+	///
+	/// При наличии обработчиков пакет копируется в очередь одного из них,
+	/// а при её переполнении отбрасывается
+	void processPacket(pcpp::RawPacket *packet)
+	{
+		if (!isCapturePinned)
+		{
+			isCapturePinned = true;
+			if (cpuOfCaptureThread(0) != CpuAffinity::anyCpu)
+				pinCaptureThread(cpuOfCaptureThread(0));
+		}
+
+		TA_PERF_THREAD("capture");
+
+		if (!workers.empty())
+		{
+			dispatchPacket(*packet, false);
+			return;
+		}
+
+		PacketView view;
+		{
+			TA_PERF_SAMPLED_SCOPE(parse);
+			RawPacketParser::parse(*packet, view);
+		}
+
+		std::lock_guard<std::mutex> writer(syncState->writerMutex);
+		processView(view);
+	}
+
+	/**
+	 * \brief Воспроизводит все пакеты из открытого файла с максимальной скоростью
+	 *
+	 * Пакеты обрабатываются в вызывающем потоке (или обработчиками) без каких-либо задержек,
+	 * пачками по replayBatchSize пакетов. При переполнении очереди обработчика пакет
+	 * не отбрасывается, а ожидает места
+	 * \return Количество обработанных пакетов, байт и затраченное время
+	 */
+	ReplayReport replayFile()
+	{
+		ReplayReport report;
+
+		if (!reader || !reader->isOpened() || !trafficStats.get())
+		{
+			TA_LOG(warning) << "TrafficAnalyzer replayFile failed, file was not opened or nullptr";
+			return report;
+		}
+
+		// Буферы пакетов переиспользуются между пачками
+		std::vector<pcpp::RawPacket> rawPackets(replayBatchSize);
+		std::vector<PacketView> views(replayBatchSize);
+		auto start = std::chrono::steady_clock::now();
+
+		TA_PERF_THREAD("replay");
+		startWorkers();
+		syncState->capturing.store(true, std::memory_order_release);
+
+		while (true)
+		{
+			std::size_t count = 0;
+			while (count < replayBatchSize && reader->getNextPacket(rawPackets[count]))
+				count++;
+
+			if (!count)
+				break;
+
+			for (std::size_t i = 0; i < count; i++)
+			{
+				if (workers.empty())
+				{
+					TA_PERF_SAMPLED_SCOPE(parse);
+					RawPacketParser::parse(rawPackets[i], views[i]);
+				}
+				else
+					dispatchPacket(rawPackets[i], true);
+
+				report.bytes += rawPackets[i].getRawDataLen();
+			}
+
+			if (workers.empty())
+				processViews(std::span<const PacketView>(views.data(), count));
+
+			report.packets += count;
+		}
+
+		stopWorkers();
+		finishCapture();
+
+		report.wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		TA_LOG(info) << "TrafficAnalyzer replayed " << report.packets << " packets in " << report.wallTime << " sec";
+
+		return report;
+	}
+
+	/// \brief Останавливает захват пакетов
+	void stopCapture()
+	{
+		if (!rings.empty())
+		{
+			stopRings();
+			stopWorkers();
+			finishCapture();
+		}
+		else if (!interfaces.empty())
+		{
+			for (auto &capture : interfaces)
+				capture->dev->stopCapture();
+
+			stopIdleTimer();
+
+			for (auto &capture : interfaces)
+				workers[capture->index]->endFeed();
+
+			finishCapture();
+		}
+		else if (dev && dev->isOpened())
+		{
+			dev->stopCapture();
+			stopIdleTimer();
+			stopWorkers();
+			finishCapture();
+		}
+		else
+			TA_LOG(warning) << "TrafficAnalyzer stopCapture failed, device was not opened or nullptr";
+	}
+
+	/// \brief Возвращает собранную статистику в виде строки
+	/// \param[in] interfaceIndex Номер интерфейса, allInterfaces - суммарная статистика
+	std::string getPlaneTextStat(std::size_t interfaceIndex = allInterfaces)
+	{
+		if (!trafficStats.get())
+		{
+			TA_LOG(warning) << "TrafficAnalyzer trying get plain text stat, but trafficStats was nullptr";
+			return "";
+		}
+
+		return getSnapshot(interfaceIndex)->toString();
+	}
+
+	/// \brief Возвращает собранную статистику в формате JSON строки
+	/// \param[in] sinceGeneration Выводить только хосты, изменённые после этого поколения, 0 - выводить все
+	std::string getJsonStat(std::uint64_t sinceGeneration = 0)
+	{
+		std::string out;
+		writeJsonStat(out, sinceGeneration);
+		return out;
+	}
+
+	/// \brief Дописывает собранную статистику в формате JSON в конец буфера out
+	/// \param[out] out Буфер, может переиспользоваться между вызовами
+	/// \param[in] sinceGeneration Выводить только хосты, изменённые после этого поколения, 0 - выводить все
+	/// \param[in] interfaceIndex Номер интерфейса, allInterfaces - суммарная статистика
+	void writeJsonStat(std::string &out, std::uint64_t sinceGeneration = 0, std::size_t interfaceIndex = allInterfaces)
+	{
+		if (!trafficStats.get())
+		{
+			TA_LOG(warning) << "TrafficAnalyzer trying get json stat, but trafficStats was nullptr";
+			return;
+		}
+
+		getSnapshot(interfaceIndex)->writeJson(out, sinceGeneration);
+	}
+
+	/// \brief Дописывает в out статистику, сгруппированную по именам хостов, в формате JSON
+	/// \param[in] interfaceIndex Номер интерфейса, allInterfaces - суммарная статистика
+	void writeNamesJson(std::string &out, std::size_t interfaceIndex = allInterfaces)
+	{
+		if (!trafficStats.get())
+		{
+			TA_LOG(warning) << "TrafficAnalyzer trying get names stat, but trafficStats was nullptr";
+			return;
+		}
+
+		auto snapshot = getSnapshot(interfaceIndex);
+		NameTotals totals;
+		snapshot->collectNames(totals);
+		totals.writeJson(out, snapshot->getGeneration());
+	}
+
+	/**
+	 * \brief Передает visitor хосты последней опубликованной копии статистики
+	 *
+	 * Может вызываться из любого потока, например потоком выгрузки StatsExporter
+	 * \param[in] interfaceIndex Номер интерфейса, allInterfaces - суммарная статистика
+	 */
+	void visitHosts(IHostVisitor &visitor, std::size_t interfaceIndex = allInterfaces)
+	{
+		if (!trafficStats.get())
+		{
+			TA_LOG(warning) << "TrafficAnalyzer trying visit hosts, but trafficStats was nullptr";
+			return;
+		}
+
+		getSnapshot(interfaceIndex)->visitHosts(visitor);
+	}
+
+	/**
+	 * \brief Выбирает из последней опубликованной копии статистики хосты по запросу query
+	 * \param[out] result Результат, может переиспользоваться между вызовами
+	 * \param[in] interfaceIndex Номер интерфейса, allInterfaces - суммарная статистика
+	 */
+	void queryHosts(const HostQuery &query, HostQueryResult &result, std::size_t interfaceIndex = allInterfaces)
+	{
+		if (!trafficStats.get())
+		{
+			TA_LOG(warning) << "TrafficAnalyzer trying query hosts, but trafficStats was nullptr";
+			return;
+		}
+
+		result.run(*getSnapshot(interfaceIndex), query);
+	}
+
+	/**
+	 * \brief Дописывает в out счетчики кэша ответов DNS в формате JSON
+	 * \return False - если кэш не ведется
+	 */
+	bool writeDnsCacheJson(std::string &out) const
+	{
+		if (!dnsCache)
+			return false;
+
+		dnsCache->writeJson(out);
+		return true;
+	}
+
+	/**
+	 * \brief Дописывает в out статистику хостов и показатели работы анализатора в текстовом формате Prometheus
+	 *
+	 * Серии хостов, не изменившихся с прошлого запроса, берутся готовыми из кэша (см. MetricsExposition).
+	 * У каждого интерфейса свой кэш, счетчики libpcap берутся только с выбранного интерфейса
+	 * \param[in] interfaceIndex Номер интерфейса, allInterfaces - суммарная статистика
+	 */
+	void writeMetrics(std::string &out, std::size_t interfaceIndex = allInterfaces)
+	{
+		if (!trafficStats.get())
+		{
+			TA_LOG(warning) << "TrafficAnalyzer trying get metrics, but trafficStats was nullptr";
+			return;
+		}
+
+		AnalyzerHealth health;
+		health.queueDrops = getDroppedPackets();
+
+		PacketRingStats ringStats;
+		health.hasRings = getRingStats(ringStats);
+		health.ringPackets = ringStats.packets;
+		health.ringDrops = ringStats.drops;
+
+		pcpp::IPcapDevice::PcapStats pcapStats;
+		health.hasPcap = getPcapStats(pcapStats, interfaceIndex);
+		health.pcapPackets = pcapStats.packetsRecv;
+		health.pcapDrops = pcapStats.packetsDrop;
+		health.interfaceDrops = pcapStats.packetsDropByInterface;
+
+		if (dnsCache)
+		{
+			health.hasDnsCache = true;
+			health.dnsEntries = dnsCache->size();
+			health.dnsHits = dnsCache->getHits();
+			health.dnsMisses = dnsCache->getMisses();
+		}
+
+		health.names = NameArena::instance().size();
+		health.samplingRate = getSnapshot(interfaceIndex)->getSamplingRate();
+
+		std::size_t metricsIndex = interfaceIndex == allInterfaces ? 0 : interfaceIndex + 1;
+		metrics[metricsIndex]->write(getSnapshot(interfaceIndex), health, out);
+	}
+
+	/// \brief Очищает собранную статистику
+	void clearStats()
+	{
+		if (!trafficStats.get())
+		{
+			TA_LOG(warning) << "TrafficAnalyzer trying clear stat, but trafficStats was nullptr";
+			return;
+		}
+
+		for (auto &worker : workers)
+			worker->clear();
+
+		if (syncState->capturing.load(std::memory_order_acquire))
+			syncState->clearRequested.store(true, std::memory_order_release);
+		else
+		{
+			if (history)
+				history->clear();
+
+			trafficStats->clear();
+			publisher->publish(*trafficStats);
+		}
+	}
+
+	/**
+	 * \brief Возвращает суммарный трафик за последние завершенные интервалы истории
+	 * \param[in] window Длина окна, ограничивается глубиной истории
+	 * \param[out] seconds Фактическая длина окна (в сек)
+	 * \param[in] interfaceIndex Номер интерфейса, allInterfaces - весь трафик
+	 * \return False - если история не хранится или завершенных интервалов ещё нет
+	 */
+	bool getTotalRate(std::chrono::seconds window, RateSummary &summary, std::int64_t &seconds,
+					  std::size_t interfaceIndex = allInterfaces) const
+	{
+		auto histories = getHistories(interfaceIndex);
+		std::uint64_t endTick = 0;
+		std::size_t count = 0;
+
+		if (histories.empty() || !getWindow(histories, window, endTick, count))
+			return false;
+
+		std::vector<RateHistory::Row> rows;
+		for (const auto *source : histories)
+			rows.push_back(source->totalRow());
+
+		RateHistory::sumRows(rows, endTick, count, summary);
+		seconds = count * histories.front()->getResolution();
+		return true;
+	}
+
+	/**
+	 * \brief Дописывает в out средние и пиковые скорости всего трафика и каждого хоста за окно window
+	 *
+	 * Окно состоит из последних завершенных интервалов истории
+	 * \param[in] interfaceIndex Номер интерфейса, allInterfaces - весь трафик
+	 * \return False - если история скорости трафика не хранится
+	 */
+	bool writeRateJson(std::string &out, std::chrono::seconds window, std::size_t interfaceIndex = allInterfaces) const
+	{
+		auto histories = getHistories(interfaceIndex);
+		if (histories.empty())
+			return false;
+
+		std::uint64_t endTick = 0;
+		std::size_t count = 0;
+		bool hasWindow = getWindow(histories, window, endTick, count);
+
+		std::int64_t resolution = histories.front()->getResolution();
+		std::int64_t seconds = std::max<std::int64_t>(count * resolution, 1);
+
+		// Пакеты хоста распределяются по сумме хэшей адресов пары, поэтому его трафик может быть
+		// в историях нескольких писателей: строки хоста суммируются по интервалам до поиска пиков
+		RateSummary total;
+		HostTable<RateSummary> hosts;
+
+		if (hasWindow)
+		{
+			std::vector<RateHistory::Row> rows;
+			HostTable<std::vector<RateHistory::Row>> hostRows;
+
+			for (const auto *source : histories)
+			{
+				rows.push_back(source->totalRow());
+				for (const auto &row : source->getHostRows())
+					hostRows[row.host].push_back(row);
+			}
+
+			RateHistory::sumRows(rows, endTick, count, total);
+			for (std::size_t i = 0; i < hostRows.size(); i++)
+				RateHistory::sumRows(hostRows.valueAt(i), endTick, count, hosts[hostRows.keyAt(i)]);
+		}
+
+		JsonWriter json(out);
+		char ipBuffer[IpKey::maxStringLength];
+
+		json.beginObject();
+		json.field("resolution", std::uint64_t(resolution));
+		json.field("window", std::uint64_t(hasWindow ? seconds : 0));
+		json.field("end", hasWindow ? (endTick + 1) * resolution : 0);
+
+		json.key("total").beginObject();
+		writeRateFields(json, total, seconds, resolution);
+		json.endObject();
+
+		json.key("hosts").beginArray();
+		for (std::size_t i = 0; i < hosts.size(); i++)
+		{
+			json.beginObject();
+			json.field("ip", std::string_view(ipBuffer, hosts.keyAt(i).format(ipBuffer)));
+			writeRateFields(json, hosts.valueAt(i), seconds, resolution);
+			json.endObject();
+		}
+		json.endArray();
+
+		json.endObject();
+		out += '\n';
+		return true;
+	}
+
+	/**
+	 * \brief Дописывает в out количество байт и пакетов хоста за каждый интервал окна window
+	 *
+	 * Значения идут от старого интервала к новому, end - время окончания последнего интервала
+	 * \param[in] host Хост, либо пустой ключ для всего трафика
+	 * \param[in] interfaceIndex Номер интерфейса, allInterfaces - весь трафик
+	 * \return False - если история не хранится или для хоста нет истории
+	 */
+	bool writeHistoryJson(std::string &out, const IpKey &host, std::chrono::seconds window,
+						  std::size_t interfaceIndex = allInterfaces) const
+	{
+		auto histories = getHistories(interfaceIndex);
+		if (histories.empty())
+			return false;
+
+		std::uint64_t endTick = 0;
+		std::size_t count = 0;
+		bool hasWindow = getWindow(histories, window, endTick, count);
+		if (!hasWindow)
+			count = 0;
+
+		std::vector<std::uint64_t> bytes(count, 0), packets(count, 0);
+		bool isFound = host.empty();
+
+		for (const auto *source : histories)
+		{
+			RateHistory::Row row = host.empty() ? source->totalRow() : source->findHost(host);
+			if (!host.empty() && row.index == RateHistory::npos)
+				continue;
+
+			isFound |= source->collect(row, endTick, count, bytes.data(), packets.data());
+		}
+
+		if (!isFound)
+			return false;
+
+		std::int64_t resolution = histories.front()->getResolution();
+		JsonWriter json(out);
+
+		json.beginObject();
+		json.field("host", host.empty() ? std::string("total") : host.toString());
+		json.field("resolution", std::uint64_t(resolution));
+		json.field("end", hasWindow ? (endTick + 1) * resolution : 0);
+
+		json.key("bytes").beginArray();
+		for (std::uint64_t value : bytes)
+			json.value(value);
+		json.endArray();
+
+		json.key("packets").beginArray();
+		for (std::uint64_t value : packets)
+			json.value(value);
+		json.endArray();
+
+		json.endObject();
+		out += '\n';
+		return true;
+	}
+
+	/**
+	 * \brief Возвращает счетчики ядра всех колец захвата, может вызываться из любого потока
+	 * \return False - если пакеты захватываются не через кольца AF_PACKET
+	 */
+	bool getRingStats(PacketRingStats &stats)
+	{
+		if (rings.empty())
+			return false;
+
+		stats = PacketRingStats();
+		for (auto &ring : rings)
+			stats.merge(ring->getStats());
+
+		return true;
+	}
+
+	/**
+	 * \brief Возвращает счетчики libpcap устройства захвата: принятые, отброшенные libpcap и интерфейсом пакеты
+	 *
+	 * При захвате нескольких интерфейсов счетчики суммируются, либо берутся с интерфейса interfaceIndex
+	 * \return False - если пакеты захватываются не через libpcap с живого интерфейса
+	 */
+	bool getPcapStats(pcpp::IPcapDevice::PcapStats &stats, std::size_t interfaceIndex = allInterfaces) const
+	{
+		stats = pcpp::IPcapDevice::PcapStats();
+
+		if (!interfaces.empty())
+		{
+			for (const auto &capture : interfaces)
+			{
+				if ((interfaceIndex != allInterfaces && capture->index != interfaceIndex) || !capture->dev->isOpened())
+					continue;
+
+				pcpp::IPcapDevice::PcapStats deviceStats;
+				capture->dev->getStatistics(deviceStats);
+				stats.packetsRecv += deviceStats.packetsRecv;
+				stats.packetsDrop += deviceStats.packetsDrop;
+				stats.packetsDropByInterface += deviceStats.packetsDropByInterface;
+			}
+
+			return true;
+		}
+
+		if (!dev || !dev->isOpened() || !rings.empty())
+			return false;
+
+		dev->getStatistics(stats);
+		return true;
+	}
+
+	/**
+	 * \brief Ищет захватываемый интерфейс по имени устройства или IP-адресу
+	 * \param[out] index Номер найденного интерфейса, при захвате одного интерфейса - allInterfaces
+	 * \return False - если интерфейс не захватывается
+	 */
+	bool findInterface(const std::string &nameOrIp, std::size_t &index) const
+	{
+		if (interfaces.empty() && dev && (dev->getName() == nameOrIp || interfaceIpAddr == nameOrIp))
+		{
+			index = allInterfaces;
+			return true;
+		}
+
+		for (const auto &capture : interfaces)
+			if (capture->dev->getName() == nameOrIp || capture->ipAddr == nameOrIp)
+			{
+				index = capture->index;
+				return true;
+			}
+
+		return false;
+	}
+
+	/**
+	 * \brief Дописывает в out захватываемые интерфейсы и суммарные счетчики каждого в формате JSON
+	 *
+	 * При захвате одного интерфейса массив состоит из одного элемента со всей статистикой
+	 */
+	void writeInterfacesJson(std::string &out)
+	{
+		if (!trafficStats.get())
+		{
+			TA_LOG(warning) << "TrafficAnalyzer trying get interfaces, but trafficStats was nullptr";
+			return;
+		}
+
+		JsonWriter json(out);
+		json.beginArray();
+
+		if (interfaces.empty())
+			writeInterfaceJson(json, dev ? dev->getName() : std::string(), interfaceIpAddr, cpuOfCaptureThread(0),
+							   *getSnapshot(), rings.empty() ? dev : nullptr);
+
+		for (const auto &capture : interfaces)
+			writeInterfaceJson(json, capture->dev->getName(), capture->ipAddr, capture->cpu,
+							   *getSnapshot(capture->index), capture->dev);
+
+		json.endArray();
+		out += '\n';
+	}
+
+	/// \brief Возвращает по строке на каждый захватываемый интерфейс: хосты, трафик и потери libpcap
+	std::string getInterfacesSummary()
+	{
+		std::string summary;
+
+		for (const auto &capture : interfaces)
+		{
+			TrafficTotals totals;
+			getSnapshot(capture->index)->visitHosts(totals);
+
+			pcpp::IPcapDevice::PcapStats stats;
+			getPcapStats(stats, capture->index);
+
+			summary += capture->dev->getName() + " (" + capture->ipAddr + ")";
+			if (capture->cpu != CpuAffinity::anyCpu)
+				summary += " cpu " + std::to_string(capture->cpu);
+
+			summary += ": hosts " + std::to_string(totals.hosts) +
+					   ", in " + std::to_string(totals.inTraffic) + " bytes" +
+					   ", out " + std::to_string(totals.outTraffic) + " bytes" +
+					   ", received " + std::to_string(stats.packetsRecv) +
+					   ", dropped " + std::to_string(stats.packetsDrop) +
+					   " (interface " + std::to_string(stats.packetsDropByInterface) + ")\n";
+		}
+
+		return summary;
+	}
+
+	/// \brief Возвращает количество одновременно захватываемых интерфейсов, 0 - захватывается один интерфейс
+	std::size_t getInterfacesCount() const { return interfaces.size(); }
+
+	/**
+	 * \brief Дописывает в out счетчики отброшенных пакетов и гистограммы задержек этапов обработки в формате JSON
+	 *
+	 * Гистограммы есть только в сборке с TRAFFIC_ANALYZER_PERF, иначе поле threads пустое, а enabled равно false
+	 */
+	void writePerfJson(std::string &out)
+	{
+		JsonWriter json(out);
+
+		json.beginObject();
+		json.key("enabled");
+		out += TRAFFIC_ANALYZER_PERF ? "true" : "false";
+		json.valueWritten();
+
+		json.key("drops").beginObject();
+		json.field("queue", getDroppedPackets());
+
+		PacketRingStats ringStats;
+		if (getRingStats(ringStats))
+		{
+			json.field("ringPackets", ringStats.packets);
+			json.field("ring", ringStats.drops);
+		}
+
+		pcpp::IPcapDevice::PcapStats pcapStats;
+		if (getPcapStats(pcapStats))
+		{
+			json.field("pcapPackets", std::uint64_t(pcapStats.packetsRecv));
+			json.field("pcap", std::uint64_t(pcapStats.packetsDrop));
+			json.field("interface", std::uint64_t(pcapStats.packetsDropByInterface));
+		}
+
+		json.endObject();
+		json.key("threads");
+		PerfRegistry::instance().writeJson(json);
+		json.endObject();
+		out += '\n';
+	}
+
+	/// \brief Возвращает наибольший текущий коэффициент выборочного учета писателей, 1 - все пакеты учитываются точно
+	std::uint32_t getSamplingRate()
+	{
+		if (!trafficStats.get())
+			return 1;
+
+		return getSnapshot()->getSamplingRate();
+	}
+
+	/// \brief Возвращает количество пакетов, отброшенных из-за переполнения очередей обработчиков
+	std::uint64_t getDroppedPackets() const
+	{
+		std::uint64_t dropped = 0;
+		for (const auto &worker : workers)
+			dropped += worker->getDroppedPackets();
+
+		return dropped;
 	}
 };
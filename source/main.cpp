@@ -1,6 +1,10 @@
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstdarg>
 
 #include <boost/log/trivial.hpp>
 #include <served/served.hpp>
@@ -10,6 +14,11 @@
 #include <App.h>
 #include <TrafficAnalyzer.h>
 #include <HttpTrafficStats.h>
+#include <TopHostsTrafficStats.h>
+#include <PortTrafficStats.h>
+#include <StatsPipeline.h>
+#include <StatsExport.h>
+#include <TerminalView.h>
 
 int main(int argc, char **argv)
 {
@@ -23,70 +32,530 @@ int main(int argc, char **argv)
 	}
 	catch (std::exception &e)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "parseComandLine exception: " << e.what();
+		TA_LOG(fatal) << "parseComandLine exception: " << e.what();
 		return -1;
 	}
 
 	if (options.shouldClose)
 		return 0;
 
-	BOOST_LOG_TRIVIAL(debug) << "App initial state: "
-							 << "{ interfaceIpAddr: " << options.interfaceIpAddr << ", "
-							 << "executionTime: " << options.executionTime << ", "
-							 << "updatePeriod: " << options.updatePeriod << " }";
+	AsyncLog::setLevel(options.logLevel);
+	AsyncLog::setSampleEvery(static_cast<std::uint32_t>(options.logSampleEvery));
+	AsyncLog::start();
+
+	TA_LOG(debug) << "App initial state: "
+				  << "{ interfaceIpAddr: " << options.interfaceIpAddr << ", "
+				  << "pcapFilePath: " << options.pcapFilePath << ", "
+				  << "workersCount: " << options.workersCount << ", "
+				  << "executionTime: " << options.executionTime << ", "
+				  << "updatePeriod: " << options.updatePeriod << " }";
 
 	pcpp::ApplicationEventHandler::getInstance().onApplicationInterrupted(app::onApplicationInterrupted, &options.shouldClose);
 
 	TrafficAnalyzer httpAnalyzer;
+	httpAnalyzer.setSnapshotPolicy({std::chrono::milliseconds(options.snapshotPeriod),
+									static_cast<std::uint64_t>(options.snapshotPackets)});
+	httpAnalyzer.setHistoryConfig({std::chrono::seconds(options.historyResolution),
+								   std::chrono::seconds(options.historyRetention),
+								   static_cast<std::size_t>(options.historyHosts)});
+
+	httpAnalyzer.setLocalNetworks(options.localNetworks);
+	httpAnalyzer.setInterfaces(options.interfaceIpAddrs);
+	httpAnalyzer.setCaptureCpus(options.captureCpus);
+
+	if (options.overloadSampling > 0)
+	{
+		SamplingConfig samplingConfig;
+		samplingConfig.maxRate = static_cast<std::uint32_t>(options.overloadSampling);
+		httpAnalyzer.setSamplingConfig(samplingConfig);
+	}
+	httpAnalyzer.setHostStoreConfig({options.storePath,
+									 static_cast<std::size_t>(options.storeHosts),
+									 std::chrono::seconds(options.storeSync)});
+
+	if (options.dnsCacheMemory > 0)
+	{
+		DnsCacheConfig dnsCacheConfig;
+		dnsCacheConfig.capacity = static_cast<std::size_t>(options.dnsCacheMemory) * 1024 / DnsCache::entryMemory();
+		httpAnalyzer.setDnsCacheConfig(dnsCacheConfig);
+	}
+
+	if (options.captureBackend == "ring")
+	{
+		PacketRingConfig ringConfig;
+		ringConfig.blockSize = static_cast<std::size_t>(options.ringBlockSize) * 1024;
+		ringConfig.blocksCount = static_cast<std::size_t>(options.ringBlocks);
+		ringConfig.ringsCount = static_cast<std::size_t>(options.ringThreads);
+		ringConfig.fanoutGroup = static_cast<std::uint16_t>(options.ringFanout);
+		httpAnalyzer.setPacketRingConfig(ringConfig);
+	}
 
 	std::vector<pcpp::GeneralFilter *> portFilterVec = {
 		new pcpp::PortFilter(80, pcpp::SRC_OR_DST),
 		new pcpp::PortFilter(443, pcpp::SRC_OR_DST)};
 
+	// Ответы DNS нужны кэшу имен, поэтому порт 53 захватывается вместе с HTTP и HTTPS
+	if (options.dnsCacheMemory > 0)
+		portFilterVec.push_back(new pcpp::PortFilter(53, pcpp::SRC_OR_DST));
+
+	bool isReplayMode = !options.pcapFilePath.empty();
+
 	std::string httpAnalyzerInitInfo;
-	if (!httpAnalyzer.initializeAs<HttpTrafficStats>(options.interfaceIpAddr, portFilterVec, httpAnalyzerInitInfo))
+	bool isInitialized = false;
+
+	FlowTableConfig flowConfig;
+	flowConfig.capacity = static_cast<std::size_t>(options.flowCapacity);
+	flowConfig.idleTimeout = std::chrono::seconds(options.flowTimeout);
+
+	TopHostsConfig topHostsConfig;
+	if (options.topHostsMemory > 0)
+	{
+		auto metric = options.topHostsMetric == "packets" ? TopHostsConfig::Metric::packets : TopHostsConfig::Metric::bytes;
+		topHostsConfig = TopHostsTrafficStats::configForMemory(static_cast<std::size_t>(options.topHostsMemory) * 1024, metric);
+
+		TA_LOG(info) << "Top hosts mode: capacity " << topHostsConfig.capacity
+								<< ", sketch " << topHostsConfig.sketchWidth << "x" << topHostsConfig.sketchDepth;
+	}
+
+	bool isHostsOnly = options.statsConsumers == std::vector<std::string>{"hosts"};
+	bool isHostsAndPorts = options.statsConsumers == std::vector<std::string>{"hosts", "ports"};
+
+	if (isHostsOnly && options.topHostsMemory > 0)
+	{
+		isInitialized = isReplayMode
+							? httpAnalyzer.initializeFromFileAs<TopHostsTrafficStats>(options.pcapFilePath, options.interfaceIpAddr, portFilterVec, httpAnalyzerInitInfo, options.workersCount, topHostsConfig)
+							: httpAnalyzer.initializeAs<TopHostsTrafficStats>(options.interfaceIpAddr, portFilterVec, httpAnalyzerInitInfo, options.workersCount, topHostsConfig);
+	}
+	else if (isHostsOnly)
+	{
+		isInitialized = isReplayMode
+							? httpAnalyzer.initializeFromFileAs<HttpTrafficStats>(options.pcapFilePath, options.interfaceIpAddr, portFilterVec, httpAnalyzerInitInfo, options.workersCount, flowConfig)
+							: httpAnalyzer.initializeAs<HttpTrafficStats>(options.interfaceIpAddr, portFilterVec, httpAnalyzerInitInfo, options.workersCount, flowConfig);
+	}
+	else if (isHostsAndPorts && options.topHostsMemory == 0)
+	{
+		// Самый частый набор статистик собирается конвейером без виртуальных вызовов
+		using HostsAndPorts = StatsPipeline<HttpTrafficStats, PortTrafficStats>;
+
+		isInitialized = isReplayMode
+							? httpAnalyzer.initializeFromFileAs<HostsAndPorts>(options.pcapFilePath, options.interfaceIpAddr, portFilterVec, httpAnalyzerInitInfo, options.workersCount, flowConfig)
+							: httpAnalyzer.initializeAs<HostsAndPorts>(options.interfaceIpAddr, portFilterVec, httpAnalyzerInitInfo, options.workersCount, flowConfig);
+	}
+	else
+	{
+		std::vector<DynamicStatsPipeline::ConsumerFactory> factories;
+		for (const auto &consumer : options.statsConsumers)
+		{
+			if (consumer == "ports")
+				factories.push_back([](const std::string &ip)
+									{ return std::make_unique<PortTrafficStats>(ip); });
+			else if (options.topHostsMemory > 0)
+				factories.push_back([topHostsConfig](const std::string &ip)
+									{ return std::make_unique<TopHostsTrafficStats>(ip, topHostsConfig); });
+			else
+				factories.push_back([flowConfig](const std::string &ip)
+									{ return std::make_unique<HttpTrafficStats>(ip, flowConfig); });
+		}
+
+		isInitialized = isReplayMode
+							? httpAnalyzer.initializeFromFileAs<DynamicStatsPipeline>(options.pcapFilePath, options.interfaceIpAddr, portFilterVec, httpAnalyzerInitInfo, options.workersCount, factories)
+							: httpAnalyzer.initializeAs<DynamicStatsPipeline>(options.interfaceIpAddr, portFilterVec, httpAnalyzerInitInfo, options.workersCount, factories);
+	}
+
+	if (!isInitialized)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "TrafficAnalyzer initialization error: " << httpAnalyzerInitInfo << std::endl;
+		TA_LOG(fatal) << "TrafficAnalyzer initialization error: " << httpAnalyzerInitInfo << std::endl;
 		for (auto it : portFilterVec)
 			delete it;
 
 		httpAnalyzer.finalize();
+		AsyncLog::stop();
 		return -1;
 	}
 
+	StatsExporter exporter;
+	if (!options.exportPath.empty())
+	{
+		StatsExportConfig exportConfig;
+		exportConfig.directory = options.exportPath;
+		exportConfig.period = std::chrono::seconds(options.updatePeriod);
+		exportConfig.maxFileSize = static_cast<std::uint64_t>(options.exportFileSize) << 20;
+		exportConfig.maxFiles = static_cast<std::size_t>(options.exportFiles);
+		exportConfig.codec = options.exportCodec == "none" ? StatsExportCodec::none : StatsExportCodec::zeroRuns;
+
+		std::string exportErrorInfo;
+		if (!exporter.start(exportConfig, [&httpAnalyzer](IHostVisitor &visitor)
+							{ httpAnalyzer.visitHosts(visitor); },
+							exportErrorInfo))
+			TA_LOG(error) << "Statistics export is disabled: " << exportErrorInfo;
+	}
+
+	// Номер интерфейса из параметра interface запроса (имя или IP-адрес), без параметра - все интерфейсы
+	auto interfaceOf = [&httpAnalyzer](const served::request &req, std::size_t &index)
+	{
+		std::string interface = req.query["interface"];
+		index = TrafficAnalyzer::allInterfaces;
+		return interface.empty() || httpAnalyzer.findInterface(interface, index);
+	};
+
 	served::multiplexer mux;
 	mux.handle("/stat").get(
-		[&httpAnalyzer](served::response &res, const served::request &req)
+		[&httpAnalyzer, &interfaceOf](served::response &res, const served::request &req)
 		{
+			TA_LOG(debug) << "Server received a request GET /stat" << std::endl;
+
+			std::size_t interfaceIndex;
+			if (!interfaceOf(req, interfaceIndex))
+			{
+				served::response::stock_reply(404, res);
+				return;
+			}
+
+			std::uint64_t sinceGeneration = 0;
+			std::string since = req.query["since"];
+
+			if (!since.empty())
+			{
+				auto result = std::from_chars(since.data(), since.data() + since.size(), sinceGeneration);
+				if (result.ec != std::errc() || result.ptr != since.data() + since.size())
+				{
+					served::response::stock_reply(400, res);
+					return;
+				}
+			}
+
+			thread_local std::string buffer;
+			buffer.clear();
+
+			std::string sort = req.query["sort"], limit = req.query["limit"], filter = req.query["filter"];
+			if (sort.empty() && limit.empty() && filter.empty())
+				httpAnalyzer.writeJsonStat(buffer, sinceGeneration, interfaceIndex);
+			else
+			{
+				HostQuery query;
+				query.sinceGeneration = sinceGeneration;
+				std::string errorInfo;
+
+				if (!limit.empty())
+				{
+					auto result = std::from_chars(limit.data(), limit.data() + limit.size(), query.limit);
+					if (result.ec != std::errc() || result.ptr != limit.data() + limit.size())
+					{
+						served::response::stock_reply(400, res);
+						return;
+					}
+				}
+
+				if ((!sort.empty() && !HostQuery::parseSortKey(sort, query.sortKey)) || !query.setFilter(filter, errorInfo))
+				{
+					TA_LOG(debug) << "Wrong /stat query: " << (errorInfo.empty() ? "unknown sort '" + sort + "'" : errorInfo);
+					served::response::stock_reply(400, res);
+					return;
+				}
+
+				thread_local HostQueryResult result;
+				httpAnalyzer.queryHosts(query, result, interfaceIndex);
+				result.writeJson(buffer);
+			}
+
 			res.set_header("content-type", "application/json");
-			BOOST_LOG_TRIVIAL(debug) << "Server received a request GET /stat" << std::endl;
-			res << httpAnalyzer.getJsonStat();
+			res << buffer;
 		});
 
-	auto server = served::net::server("127.0.0.1", "8080", mux, false);
-	server.run(2, false);
+	mux.handle("/names").get(
+		[&httpAnalyzer, &interfaceOf](served::response &res, const served::request &req)
+		{
+			TA_LOG(debug) << "Server received a request GET /names" << std::endl;
 
-	printf("Use this to get statistics in JSON format: curl \"http://localhost:8080/stat\"\n");
+			std::size_t interfaceIndex;
+			if (!interfaceOf(req, interfaceIndex))
+			{
+				served::response::stock_reply(404, res);
+				return;
+			}
 
-	httpAnalyzer.startCapture();
+			thread_local std::string buffer;
+			buffer.clear();
+			httpAnalyzer.writeNamesJson(buffer, interfaceIndex);
+
+			res.set_header("content-type", "application/json");
+			res << buffer;
+		});
+
+	mux.handle("/metrics").get(
+		[&httpAnalyzer, &interfaceOf](served::response &res, const served::request &req)
+		{
+			TA_LOG(debug) << "Server received a request GET /metrics" << std::endl;
+
+			std::size_t interfaceIndex;
+			if (!interfaceOf(req, interfaceIndex))
+			{
+				served::response::stock_reply(404, res);
+				return;
+			}
+
+			thread_local std::string buffer;
+			buffer.clear();
+			httpAnalyzer.writeMetrics(buffer, interfaceIndex);
+
+			res.set_header("content-type", "text/plain; version=0.0.4");
+			res << buffer;
+		});
+
+	mux.handle("/interfaces").get(
+		[&httpAnalyzer](served::response &res, const served::request &)
+		{
+			TA_LOG(debug) << "Server received a request GET /interfaces" << std::endl;
+
+			thread_local std::string buffer;
+			buffer.clear();
+			httpAnalyzer.writeInterfacesJson(buffer);
+
+			res.set_header("content-type", "application/json");
+			res << buffer;
+		});
 
-	while (!options.shouldClose && options.executionTime > 0)
+	mux.handle("/debug/perf").get(
+		[&httpAnalyzer](served::response &res, const served::request &)
+		{
+			TA_LOG(debug) << "Server received a request GET /debug/perf" << std::endl;
+
+			thread_local std::string buffer;
+			buffer.clear();
+			httpAnalyzer.writePerfJson(buffer);
+
+			res.set_header("content-type", "application/json");
+			res << buffer;
+		});
+
+	mux.handle("/dns").get(
+		[&httpAnalyzer](served::response &res, const served::request &)
+		{
+			TA_LOG(debug) << "Server received a request GET /dns" << std::endl;
+
+			thread_local std::string buffer;
+			buffer.clear();
+
+			if (!httpAnalyzer.writeDnsCacheJson(buffer))
+			{
+				served::response::stock_reply(404, res);
+				return;
+			}
+
+			res.set_header("content-type", "application/json");
+			res << buffer;
+		});
+
+	mux.handle("/rate").get(
+		[&httpAnalyzer, &interfaceOf](served::response &res, const served::request &req)
+		{
+			TA_LOG(debug) << "Server received a request GET /rate" << std::endl;
+
+			std::chrono::seconds window(60);
+			std::string windowParam = req.query["window"];
+
+			if (!windowParam.empty() && !app::parseDuration(windowParam, window))
+			{
+				served::response::stock_reply(400, res);
+				return;
+			}
+
+			std::size_t interfaceIndex;
+			thread_local std::string buffer;
+			buffer.clear();
+
+			if (!interfaceOf(req, interfaceIndex) || !httpAnalyzer.writeRateJson(buffer, window, interfaceIndex))
+			{
+				served::response::stock_reply(404, res);
+				return;
+			}
+
+			res.set_header("content-type", "application/json");
+			res << buffer;
+		});
+
+	mux.handle("/history").get(
+		[&httpAnalyzer, &options, &interfaceOf](served::response &res, const served::request &req)
+		{
+			TA_LOG(debug) << "Server received a request GET /history" << std::endl;
+
+			std::chrono::seconds window(options.historyRetention);
+			std::string windowParam = req.query["window"];
+			std::string hostParam = req.query["host"];
+			IpKey host = IpKey::fromString(hostParam);
+
+			if ((!windowParam.empty() && !app::parseDuration(windowParam, window)) ||
+				(!hostParam.empty() && host.empty()))
+			{
+				served::response::stock_reply(400, res);
+				return;
+			}
+
+			std::size_t interfaceIndex;
+			thread_local std::string buffer;
+			buffer.clear();
+
+			if (!interfaceOf(req, interfaceIndex) || !httpAnalyzer.writeHistoryJson(buffer, host, window, interfaceIndex))
+			{
+				served::response::stock_reply(404, res);
+				return;
+			}
+
+			res.set_header("content-type", "application/json");
+			res << buffer;
+		});
+
+	// Файл воспроизводится с максимальной скоростью, а статистика выводится по его окончании,
+	// поэтому HTTP сервер запускается только при захвате живого трафика
+	std::unique_ptr<served::net::server> server;
+	if (!isReplayMode)
 	{
-		pcpp::multiPlatformSleep(std::min(options.updatePeriod, options.executionTime));
-		printf("%s", httpAnalyzer.getPlaneTextStat().c_str());
-		printf("----------------------------------------------------------------------------------------------------------------------------------\n");
-		options.executionTime -= options.updatePeriod;
+		server = std::make_unique<served::net::server>("127.0.0.1", "8080", mux, false);
+		server->run(2, false);
+
+		printf("Use this to get statistics in JSON format: curl \"http://localhost:8080/stat\"\n");
+		printf("Use this to get statistics grouped by host name: curl \"http://localhost:8080/names\"\n");
+		printf("Use this to get metrics for Prometheus: curl \"http://localhost:8080/metrics\"\n");
+		printf("Use this to get traffic rates: curl \"http://localhost:8080/rate?window=60s\"\n");
+
+		if (httpAnalyzer.getInterfacesCount())
+			printf("Use this to get statistics of one interface: curl \"http://localhost:8080/stat?interface=%s\"\n", options.interfaceIpAddr.c_str());
 	}
 
-	server.stop();
-	httpAnalyzer.stopCapture();
+	ReplayReport replayReport;
+
+	if (isReplayMode)
+		replayReport = httpAnalyzer.replayFile();
+	else
+	{
+		httpAnalyzer.startCapture();
+
+		bool isQueryScreen = options.topRows > 0 || !options.hostFilter.empty();
+
+		// На терминале экран перерисовывается на месте, в файл или канал выводится целиком
+		std::size_t terminalWidth = TerminalView::terminalWidth(STDOUT_FILENO);
+		TerminalView terminal(terminalWidth, TerminalView::terminalHeight(STDOUT_FILENO));
+		HostQueryResult screenHosts;
+		std::string screen, output;
+
+		auto appendf = [&screen](const char *format, ...)
+		{
+			char line[512];
+			va_list args;
+			va_start(args, format);
+			int length = vsnprintf(line, sizeof(line), format, args);
+			va_end(args);
+			screen.append(line, std::min<std::size_t>(std::max(length, 0), sizeof(line) - 1));
+		};
+
+		while (!options.shouldClose && options.executionTime > 0)
+		{
+			pcpp::multiPlatformSleep(std::min(options.updatePeriod, options.executionTime));
+
+			screen.clear();
+			if (isQueryScreen)
+			{
+				httpAnalyzer.queryHosts(options.screenQuery, screenHosts);
+				screen += screenHosts.toString();
+			}
+			else
+				screen += httpAnalyzer.getPlaneTextStat();
+
+			RateSummary rate;
+			std::int64_t rateSeconds = 0;
+			if (httpAnalyzer.getTotalRate(std::chrono::seconds(options.updatePeriod), rate, rateSeconds))
+				appendf("Last %lld sec: %llu bytes/sec, %llu packets/sec (peak %llu bytes/sec)\n",
+						static_cast<long long>(rateSeconds),
+						static_cast<unsigned long long>(rate.bytes / rateSeconds),
+						static_cast<unsigned long long>(rate.packets / rateSeconds),
+						static_cast<unsigned long long>(rate.peakBytes / options.historyResolution));
+
+			PacketRingStats ringStats;
+			if (httpAnalyzer.getRingStats(ringStats))
+				appendf("Kernel: %llu packets, %llu dropped\n",
+						static_cast<unsigned long long>(ringStats.packets),
+						static_cast<unsigned long long>(ringStats.drops));
+
+			pcpp::IPcapDevice::PcapStats pcapStats;
+			if (httpAnalyzer.getPcapStats(pcapStats))
+				appendf("libpcap: %llu packets, %llu dropped, %llu dropped by the interface\n",
+						static_cast<unsigned long long>(pcapStats.packetsRecv),
+						static_cast<unsigned long long>(pcapStats.packetsDrop),
+						static_cast<unsigned long long>(pcapStats.packetsDropByInterface));
+
+			screen += httpAnalyzer.getInterfacesSummary();
+
+			std::uint32_t samplingRate = httpAnalyzer.getSamplingRate();
+			if (samplingRate > 1)
+				appendf("Overload: counting 1 of %u flows, counters are estimates\n", samplingRate);
+			if (!terminalWidth)
+				screen += "----------------------------------------------------------------------------------------------------------------------------------\n";
+
+			output.clear();
+			if (terminalWidth)
+				terminal.render(screen, output);
+			else
+				output.swap(screen);
+
+			fwrite(output.data(), 1, output.size(), stdout);
+			fflush(stdout);
+			options.executionTime -= options.updatePeriod;
+		}
+
+		httpAnalyzer.stopCapture();
+	}
+
+	if (server)
+		server->stop();
+
+	exporter.stop();
 
 	printf("--------------------------------------------------------------RESULTS-------------------------------------------------------------\n");
 	printf("%s", httpAnalyzer.getPlaneTextStat().c_str());
 	printf("-----------------------------------------------------------JSON-RESULTS-----------------------------------------------------------\n");
 	printf("%s", httpAnalyzer.getJsonStat().c_str());
 
+	if (options.workersCount > 0)
+		printf("Packets dropped by full worker queues: %llu\n", static_cast<unsigned long long>(httpAnalyzer.getDroppedPackets()));
+
+	PacketRingStats ringStats;
+	if (httpAnalyzer.getRingStats(ringStats))
+		printf("Packets dropped by the kernel (full capture ring): %llu of %llu, ring freezes: %llu\n",
+			   static_cast<unsigned long long>(ringStats.drops),
+			   static_cast<unsigned long long>(ringStats.packets),
+			   static_cast<unsigned long long>(ringStats.queueFreezes));
+
+	pcpp::IPcapDevice::PcapStats pcapStats;
+	if (httpAnalyzer.getPcapStats(pcapStats))
+		printf("Packets dropped by libpcap: %llu, by the interface: %llu, of %llu received\n",
+			   static_cast<unsigned long long>(pcapStats.packetsDrop),
+			   static_cast<unsigned long long>(pcapStats.packetsDropByInterface),
+			   static_cast<unsigned long long>(pcapStats.packetsRecv));
+
+	if (httpAnalyzer.getInterfacesCount())
+		printf("Interfaces:\n%s", httpAnalyzer.getInterfacesSummary().c_str());
+
+	std::string dnsCacheJson;
+	if (httpAnalyzer.writeDnsCacheJson(dnsCacheJson))
+		printf("DNS cache: %s", dnsCacheJson.c_str());
+
+	if (isReplayMode)
+	{
+		printf("----------------------------------------------------------REPLAY-THROUGHPUT---------------------------------------------------------\n");
+		printf("packets: %llu, bytes: %llu, wall time: %.3f [sec]\n",
+			   static_cast<unsigned long long>(replayReport.packets),
+			   static_cast<unsigned long long>(replayReport.bytes),
+			   replayReport.wallTime);
+		printf("%.0f packets/sec, %.0f bytes/sec\n", replayReport.packetsPerSecond(), replayReport.bytesPerSecond());
+	}
+
+#if TRAFFIC_ANALYZER_PERF
+	printf("----------------------------------------------------------STAGE-LATENCIES----------------------------------------------------------\n");
+	printf("%s", PerfRegistry::instance().toString().c_str());
+#endif
+
 	httpAnalyzer.finalize();
+	AsyncLog::stop();
 
 	for (auto it : portFilterVec)
 		delete it;
@@ -0,0 +1,145 @@
+#pragma once
+#include <gtest/gtest.h>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "../source/AdaptiveSampler.h"
+#include "../source/HttpTrafficStats.h"
+#include "TestPacket.h"
+
+TEST(AdaptiveSamplerTest, RaisesRateUnderLoadAndReturnsToExact)
+{
+	SamplingConfig config;
+	config.maxRate = 4;
+	config.calmChecks = 2;
+
+	AdaptiveSampler sampler(config);
+	EXPECT_EQ(1, sampler.getRate());
+
+	// Потери пакетов удваивают коэффициент до maxRate
+	EXPECT_TRUE(sampler.observe(1000, 10, 0));
+	EXPECT_EQ(2, sampler.getRate());
+	EXPECT_TRUE(sampler.observe(2000, 20, 0));
+	EXPECT_FALSE(sampler.observe(3000, 30, 0));
+	EXPECT_EQ(4, sampler.getRate());
+
+	// Заполненная очередь тоже считается перегрузкой, а частично заполненная не дает уменьшить коэффициент
+	EXPECT_FALSE(sampler.observe(4000, 30, 0.9));
+	EXPECT_FALSE(sampler.observe(5000, 30, 0.3));
+	EXPECT_FALSE(sampler.observe(6000, 30, 0.3));
+	EXPECT_EQ(4, sampler.getRate());
+
+	// После calmChecks спокойных проверок коэффициент уменьшается вдвое
+	EXPECT_FALSE(sampler.observe(7000, 30, 0));
+	EXPECT_TRUE(sampler.observe(8000, 30, 0));
+	EXPECT_EQ(2, sampler.getRate());
+	EXPECT_FALSE(sampler.observe(9000, 30, 0));
+	EXPECT_TRUE(sampler.observe(10000, 30, 0));
+	EXPECT_EQ(1, sampler.getRate());
+	EXPECT_EQ(4, sampler.getSwitches());
+}
+
+TEST(AdaptiveSamplerTest, SamplesWholeFlows)
+{
+	SamplingConfig config;
+	config.maxRate = 4;
+
+	AdaptiveSampler sampler(config);
+	sampler.observe(100, 100, 0);
+	sampler.observe(200, 200, 0);
+	ASSERT_EQ(4, sampler.getRate());
+
+	std::size_t keptFlows = 0;
+	for (std::uint16_t port = 1000; port < 1400; port++)
+	{
+		// Оба направления потока получают одно решение
+		PacketView request = TestPacket("10.0.0.1", "127.0.0.1", 100).tcp(port, 80);
+		PacketView response = TestPacket("127.0.0.1", "10.0.0.1", 1500).tcp(80, port);
+
+		bool isKept = sampler.admit(request);
+		ASSERT_EQ(isKept, sampler.admit(response));
+
+		if (isKept)
+		{
+			keptFlows++;
+			EXPECT_EQ(4, request.weight);
+			EXPECT_EQ(4, response.weight);
+		}
+	}
+
+	EXPECT_GT(keptFlows, 50);
+	EXPECT_LT(keptFlows, 150);
+	EXPECT_EQ(800 - 2 * keptFlows, sampler.getSkippedPackets());
+
+	// Пропущенный пакет с возможным именем хоста передается с нулевым весом
+	const std::uint8_t clientHello[] = {0x16, 0x03, 0x01, 0x00, 0x40, 0x01};
+	for (std::uint16_t port = 2000;; port++)
+	{
+		PacketView hello = TestPacket("10.0.0.2", "127.0.0.1", 100).tcp(port, 443);
+		hello.payload = clientHello;
+		hello.payloadLength = sizeof(clientHello);
+
+		PacketView plain = hello;
+		plain.payloadLength = 0;
+
+		if (!sampler.admit(plain))
+		{
+			ASSERT_TRUE(sampler.admit(hello));
+			EXPECT_EQ(0, hello.weight);
+			break;
+		}
+	}
+}
+
+TEST(AdaptiveSamplerTest, ScalesCountersAndReportsError)
+{
+	HttpTrafficStats stats("127.0.0.1");
+	stats.setSamplingRate(4);
+
+	PacketView packet = TestPacket("10.0.0.1", "127.0.0.1", 100).tcp(1000, 80);
+	packet.weight = 4;
+	for (int i = 0; i < 25; i++)
+		stats.addPacket(packet);
+
+	PacketView exact = TestPacket("10.0.0.2", "127.0.0.1", 100).tcp(1000, 80);
+	stats.addPacket(exact);
+
+	auto document = nlohmann::json::parse(stats.toJsonString());
+	EXPECT_EQ(4, document["sampling"]["rate"]);
+	EXPECT_EQ(4, document["sampling"]["maxRate"]);
+
+	for (const auto &host : document["hosts"])
+	{
+		if (host["ip"] == "10.0.0.1")
+		{
+			EXPECT_EQ(100, host["packets"]["in"]);
+			EXPECT_EQ(10000, host["traffic"]["in"]);
+			EXPECT_EQ(25, host["estimate"]["sampledPackets"]);
+			EXPECT_EQ(AdaptiveSampler::packetsErrorBound(25, 4), host["estimate"]["packetsError"]);
+			EXPECT_EQ(AdaptiveSampler::packetsErrorBound(25, 4) * 100, host["estimate"]["trafficError"]);
+		}
+		else
+		{
+			EXPECT_EQ(1, host["packets"]["in"]);
+			EXPECT_FALSE(host.contains("estimate"));
+		}
+	}
+
+	// Пакет с нулевым весом не меняет счетчиков и не создает хост без учтенных пакетов
+	std::string before = stats.toJsonString();
+	PacketView nameOnly = TestPacket("10.0.0.3", "127.0.0.1", 100).tcp(1000, 80);
+	nameOnly.weight = 0;
+	stats.addPacket(nameOnly);
+	EXPECT_EQ(std::string::npos, stats.toJsonString().find("10.0.0.3"));
+
+	nameOnly.srcIp = IpKey::fromString("10.0.0.2");
+	stats.addPacket(nameOnly);
+	EXPECT_EQ(before, stats.toJsonString());
+
+	// Копия статистики без выборки не выводит поле sampling
+	EXPECT_FALSE(nlohmann::json::parse(HttpTrafficStats("127.0.0.1").toJsonString()).contains("sampling"));
+
+	EXPECT_EQ(0, AdaptiveSampler::packetsErrorBound(25, 1));
+	EXPECT_EQ(68, AdaptiveSampler::packetsErrorBound(100, 4));
+}
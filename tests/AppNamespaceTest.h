@@ -33,3 +33,254 @@ TEST(ComandLineParsingTest, TestComandLineWithRightParams)
 	EXPECT_EQ(expectation.executionTime, result.executionTime);
 	EXPECT_EQ(expectation.interfaceIpAddr, result.interfaceIpAddr);
 }
+
+TEST(ComandLineParsingTest, TestReplayFileOption)
+{
+	char *options[] = {"./path", "-r", "capture.pcapng"};
+	app::ProgramOptions result = app::parseComandLine(3, options);
+
+	EXPECT_EQ("capture.pcapng", result.pcapFilePath);
+}
+
+TEST(ComandLineParsingTest, TestNegativeWorkersCount)
+{
+	char *options[] = {"./path", "-w", "-2"};
+	EXPECT_ANY_THROW(app::parseComandLine(3, options));
+}
+
+TEST(ComandLineParsingTest, TestZeroSnapshotPeriod)
+{
+	char *options[] = {"./path", "--snapshot-period", "0"};
+	EXPECT_ANY_THROW(app::parseComandLine(3, options));
+}
+
+TEST(ComandLineParsingTest, TestTopHostsOptions)
+{
+	char *options[] = {"./path", "-m", "512", "--top-hosts-by", "packets"};
+	app::ProgramOptions result = app::parseComandLine(5, options);
+
+	EXPECT_EQ(512, result.topHostsMemory);
+	EXPECT_EQ("packets", result.topHostsMetric);
+}
+
+TEST(ComandLineParsingTest, TestWrongTopHostsMetric)
+{
+	char *options[] = {"./path", "--top-hosts-by", "flows"};
+	EXPECT_ANY_THROW(app::parseComandLine(3, options));
+}
+
+TEST(ComandLineParsingTest, TestZeroFlowTimeout)
+{
+	char *options[] = {"./path", "--flow-timeout", "0"};
+	EXPECT_ANY_THROW(app::parseComandLine(3, options));
+}
+
+TEST(ComandLineParsingTest, TestLogOptions)
+{
+	char *options[] = {"./path", "--log-level", "warning", "--log-sample", "100"};
+	auto parsed = app::parseComandLine(5, options);
+	EXPECT_EQ(boost::log::trivial::warning, parsed.logLevel);
+	EXPECT_EQ(100, parsed.logSampleEvery);
+
+	char *wrongLevel[] = {"./path", "--log-level", "verbose"};
+	EXPECT_ANY_THROW(app::parseComandLine(3, wrongLevel));
+}
+
+TEST(ComandLineParsingTest, TestCaptureOptions)
+{
+	char *options[] = {"./path", "--capture", "ring", "--ring-block-size", "2048", "--ring-blocks", "32", "--ring-threads", "4"};
+	auto parsed = app::parseComandLine(9, options);
+	EXPECT_EQ("ring", parsed.captureBackend);
+	EXPECT_EQ(2048, parsed.ringBlockSize);
+	EXPECT_EQ(32, parsed.ringBlocks);
+	EXPECT_EQ(4, parsed.ringThreads);
+
+	char *wrongBackend[] = {"./path", "--capture", "dpdk"};
+	EXPECT_ANY_THROW(app::parseComandLine(3, wrongBackend));
+
+	char *wrongBlockSize[] = {"./path", "--capture", "ring", "--ring-block-size", "1000"};
+	EXPECT_ANY_THROW(app::parseComandLine(5, wrongBlockSize));
+}
+
+TEST(ComandLineParsingTest, TestLocalNetworkOptions)
+{
+	char *options[] = {"./path", "--local-net", "10.0.0.0/8", "--local-net", "fd00::/8"};
+	auto parsed = app::parseComandLine(5, options);
+	ASSERT_EQ(2u, parsed.localNetworks.size());
+	EXPECT_EQ("fd00::/8", parsed.localNetworks[1]);
+
+	char *wrongNetwork[] = {"./path", "--local-net", "10.0.0.0/40"};
+	EXPECT_ANY_THROW(app::parseComandLine(3, wrongNetwork));
+}
+
+TEST(ComandLineParsingTest, TestStoreOptions)
+{
+	char *options[] = {"./path", "--store", "hosts.bin", "--store-hosts", "1000", "--store-sync", "0"};
+	auto parsed = app::parseComandLine(7, options);
+	EXPECT_EQ("hosts.bin", parsed.storePath);
+	EXPECT_EQ(1000, parsed.storeHosts);
+	EXPECT_EQ(0, parsed.storeSync);
+
+	char *withTopHosts[] = {"./path", "--store", "hosts.bin", "-m", "1024"};
+	EXPECT_ANY_THROW(app::parseComandLine(5, withTopHosts));
+}
+
+TEST(ComandLineParsingTest, TestStatsOption)
+{
+	char *defaults[] = {"./path"};
+	EXPECT_EQ(std::vector<std::string>{"hosts"}, app::parseComandLine(1, defaults).statsConsumers);
+
+	char *options[] = {"./path", "--stats", "ports,hosts"};
+	EXPECT_EQ((std::vector<std::string>{"ports", "hosts"}), app::parseComandLine(3, options).statsConsumers);
+
+	char *unknown[] = {"./path", "--stats", "hosts,flows"};
+	EXPECT_ANY_THROW(app::parseComandLine(3, unknown));
+
+	char *twice[] = {"./path", "--stats", "hosts,hosts"};
+	EXPECT_ANY_THROW(app::parseComandLine(3, twice));
+
+	char *storeWithoutHosts[] = {"./path", "--stats", "ports", "--store", "hosts.bin"};
+	EXPECT_ANY_THROW(app::parseComandLine(5, storeWithoutHosts));
+}
+
+TEST(ComandLineParsingTest, TestDnsCacheOption)
+{
+	char *defaults[] = {"./path"};
+	EXPECT_EQ(0, app::parseComandLine(1, defaults).dnsCacheMemory);
+
+	char *options[] = {"./path", "--dns-cache-memory", "2048"};
+	EXPECT_EQ(2048, app::parseComandLine(3, options).dnsCacheMemory);
+
+	char *negative[] = {"./path", "--dns-cache-memory", "-1"};
+	EXPECT_ANY_THROW(app::parseComandLine(3, negative));
+}
+
+TEST(ComandLineParsingTest, TestParseDuration)
+{
+	std::chrono::seconds duration;
+
+	ASSERT_TRUE(app::parseDuration("90", duration));
+	EXPECT_EQ(90, duration.count());
+	ASSERT_TRUE(app::parseDuration("15m", duration));
+	EXPECT_EQ(900, duration.count());
+	ASSERT_TRUE(app::parseDuration("1h", duration));
+	EXPECT_EQ(3600, duration.count());
+
+	EXPECT_FALSE(app::parseDuration("", duration));
+	EXPECT_FALSE(app::parseDuration("h", duration));
+	EXPECT_FALSE(app::parseDuration("10x", duration));
+	EXPECT_FALSE(app::parseDuration("10mm", duration));
+}
+
+TEST(ComandLineParsingTest, TestHistoryRetentionOption)
+{
+	char *options[] = {"./path", "--history-retention", "30m"};
+	app::ProgramOptions result = app::parseComandLine(3, options);
+
+	EXPECT_EQ(1800, result.historyRetention);
+}
+
+TEST(ComandLineParsingTest, TestTooLongHistoryRetention)
+{
+	char *options[] = {"./path", "--history-retention", "999999999d"};
+	EXPECT_ANY_THROW(app::parseComandLine(3, options));
+}
+
+TEST(ComandLineParsingTest, TestInterfacesOption)
+{
+	char *options[] = {"./path", "-i", "10.0.0.1", "-i", "10.0.1.1", "--capture-cpus", "2,10"};
+	app::ProgramOptions result = app::parseComandLine(7, options);
+
+	EXPECT_EQ("10.0.0.1", result.interfaceIpAddr);
+	EXPECT_EQ((std::vector<std::string>{"10.0.0.1", "10.0.1.1"}), result.interfaceIpAddrs);
+	EXPECT_EQ((std::vector<int>{2, 10}), result.captureCpus);
+
+	char *duplicate[] = {"./path", "-i", "10.0.0.1", "-i", "10.0.0.1"};
+	EXPECT_ANY_THROW(app::parseComandLine(5, duplicate));
+
+	char *withWorkers[] = {"./path", "-i", "10.0.0.1", "-i", "10.0.1.1", "-w", "2"};
+	EXPECT_ANY_THROW(app::parseComandLine(7, withWorkers));
+
+	char *withRing[] = {"./path", "-i", "10.0.0.1", "-i", "10.0.1.1", "--capture", "ring"};
+	EXPECT_ANY_THROW(app::parseComandLine(7, withRing));
+
+	char *tooManyCpus[] = {"./path", "-i", "10.0.0.1", "--capture-cpus", "1,2"};
+	EXPECT_ANY_THROW(app::parseComandLine(5, tooManyCpus));
+
+	char *negativeCpu[] = {"./path", "--capture-cpus", "-1"};
+	EXPECT_ANY_THROW(app::parseComandLine(3, negativeCpu));
+
+	char *ringCpus[] = {"./path", "--capture", "ring", "--ring-threads", "2", "--capture-cpus", "3,4"};
+	EXPECT_EQ((std::vector<int>{3, 4}), app::parseComandLine(7, ringCpus).captureCpus);
+}
+
+TEST(ComandLineParsingTest, TestOverloadSamplingOption)
+{
+	char *defaults[] = {"./path"};
+	EXPECT_EQ(0, app::parseComandLine(1, defaults).overloadSampling);
+
+	char *options[] = {"./path", "--overload-sampling", "64"};
+	EXPECT_EQ(64, app::parseComandLine(3, options).overloadSampling);
+
+	char *notPowerOfTwo[] = {"./path", "--overload-sampling", "48"};
+	EXPECT_ANY_THROW(app::parseComandLine(3, notPowerOfTwo));
+
+	char *one[] = {"./path", "--overload-sampling", "1"};
+	EXPECT_ANY_THROW(app::parseComandLine(3, one));
+}
+
+TEST(ComandLineParsingTest, TestExportOptions)
+{
+	char *defaults[] = {"./path"};
+	app::ProgramOptions options = app::parseComandLine(1, defaults);
+	EXPECT_TRUE(options.exportPath.empty());
+	EXPECT_EQ(64, options.exportFileSize);
+	EXPECT_EQ(168, options.exportFiles);
+	EXPECT_EQ("zeros", options.exportCodec);
+
+	char *exportOptions[] = {"./path", "--export", "/var/lib/traffic", "--export-file-size", "16", "--export-files", "24", "--export-codec", "none"};
+	options = app::parseComandLine(9, exportOptions);
+	EXPECT_EQ("/var/lib/traffic", options.exportPath);
+	EXPECT_EQ(16, options.exportFileSize);
+	EXPECT_EQ(24, options.exportFiles);
+	EXPECT_EQ("none", options.exportCodec);
+
+	char *wrongCodec[] = {"./path", "--export-codec", "zstd"};
+	EXPECT_ANY_THROW(app::parseComandLine(3, wrongCodec));
+
+	char *noFiles[] = {"./path", "--export-files", "0"};
+	EXPECT_ANY_THROW(app::parseComandLine(3, noFiles));
+
+	char *noPeriod[] = {"./path", "--export", "/tmp/traffic", "-u", "0"};
+	EXPECT_ANY_THROW(app::parseComandLine(5, noPeriod));
+}
+
+TEST(ComandLineParsingTest, TestTopHostsViewOptions)
+{
+	char *defaults[] = {"./path"};
+	app::ProgramOptions options = app::parseComandLine(1, defaults);
+	EXPECT_EQ(0, options.topRows);
+	EXPECT_EQ("bytes", options.sortBy);
+	EXPECT_TRUE(options.hostFilter.empty());
+
+	char *viewOptions[] = {"./path", "--top", "20", "--sort", "in", "--filter", "*.example.com"};
+	options = app::parseComandLine(7, viewOptions);
+	EXPECT_EQ(20, options.topRows);
+	EXPECT_EQ("in", options.sortBy);
+	EXPECT_EQ("*.example.com", options.hostFilter);
+	EXPECT_EQ(20u, options.screenQuery.limit);
+	EXPECT_EQ(HostQuery::SortKey::in, options.screenQuery.sortKey);
+	EXPECT_EQ("*.example.com", options.screenQuery.namePattern);
+
+	char *network[] = {"./path", "--filter", "10.0.0.0/8"};
+	EXPECT_EQ("10.0.0.0/8", app::parseComandLine(3, network).hostFilter);
+
+	char *wrongSort[] = {"./path", "--sort", "name"};
+	EXPECT_ANY_THROW(app::parseComandLine(3, wrongSort));
+
+	char *wrongPrefix[] = {"./path", "--filter", "10.0.0.0/40"};
+	EXPECT_ANY_THROW(app::parseComandLine(3, wrongPrefix));
+
+	char *negativeTop[] = {"./path", "--top", "-1"};
+	EXPECT_ANY_THROW(app::parseComandLine(3, negativeTop));
+}
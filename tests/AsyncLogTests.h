@@ -0,0 +1,93 @@
+#pragma once
+#include <gtest/gtest.h>
+#include <sstream>
+#include <thread>
+
+#include <boost/make_shared.hpp>
+#include <boost/core/null_deleter.hpp>
+#include <boost/log/sinks/sync_frontend.hpp>
+#include <boost/log/sinks/text_ostream_backend.hpp>
+
+#include "../source/AsyncLog.h"
+
+TEST(AsyncLogTest, FormatSubstitutesArguments)
+{
+	EXPECT_EQ("host 10.0.0.1 sent 42 bytes", AsyncLog::format("host {} sent {} bytes", IpKey::fromString("10.0.0.1"), 42));
+	EXPECT_EQ("name example.com", AsyncLog::format("name {}", std::string("example.com")));
+	EXPECT_EQ("no arguments {}", AsyncLog::format("no arguments {}"));
+}
+
+TEST(AsyncLogTest, LongStringIsTruncated)
+{
+	std::string name(100, 'a');
+	EXPECT_EQ(std::string(LogString::capacity, 'a'), AsyncLog::format("{}", name));
+}
+
+TEST(AsyncLogTest, SampleEveryNthEvent)
+{
+	AsyncLog::setSampleEvery(3);
+
+	std::uint32_t counter = 0;
+	int sampled = 0;
+	for (int i = 0; i < 9; i++)
+		sampled += AsyncLog::shouldSample(counter);
+
+	AsyncLog::setSampleEvery(1);
+	EXPECT_EQ(3, sampled);
+}
+
+TEST(AsyncLogTest, RateLimitPerSecond)
+{
+	AsyncLog::RateLimit limit;
+
+	int allowed = 0;
+	for (int i = 0; i < 100; i++)
+		allowed += limit.allow(10);
+
+	// Вызовы могут прийтись на границу секунды
+	EXPECT_GE(allowed, 10);
+	EXPECT_LE(allowed, 20);
+}
+
+TEST(AsyncLogTest, ElseAfterLogBelongsToOuterIf)
+{
+	bool isLogged = false;
+	bool isElseTaken = false;
+
+	if (isLogged)
+		TA_LOG(warning) << "not written";
+	else
+		isElseTaken = true;
+
+	EXPECT_TRUE(isElseTaken);
+}
+
+TEST(AsyncLogTest, BackgroundThreadWritesRecords)
+{
+	auto stream = boost::make_shared<std::ostringstream>();
+	auto backend = boost::make_shared<boost::log::sinks::text_ostream_backend>();
+	backend->add_stream(boost::shared_ptr<std::ostream>(stream.get(), boost::null_deleter()));
+
+	auto sink = boost::make_shared<boost::log::sinks::synchronous_sink<boost::log::sinks::text_ostream_backend>>(backend);
+	boost::log::core::get()->add_sink(sink);
+
+	AsyncLog::start();
+
+	std::thread writer([]
+					   {
+						   for (int i = 0; i < 3; i++)
+							   TA_LOG_ASYNC(warning, "async record {}", i); });
+	writer.join();
+
+	for (const char *ip : {"10.0.0.2", "10.0.0.3"})
+		TA_LOG_LIMITED(error, 1, "limited record {}", IpKey::fromString(ip));
+
+	AsyncLog::stop();
+	boost::log::core::get()->remove_sink(sink);
+
+	std::string output = stream->str();
+	EXPECT_NE(std::string::npos, output.find("async record 0"));
+	EXPECT_NE(std::string::npos, output.find("async record 2"));
+	EXPECT_NE(std::string::npos, output.find("limited record 10.0.0.2"));
+	EXPECT_EQ(std::string::npos, output.find("limited record 10.0.0.3"));
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <gtest/gtest.h>
+#include <thread>
+#include <stdexcept>
+
+#include "../source/CpuAffinity.h"
+
+TEST(CpuAffinityTest, RunsInlineWithoutCpu)
+{
+	std::thread::id runner;
+	CpuAffinity::runOn(CpuAffinity::anyCpu, [&runner]
+					   { runner = std::this_thread::get_id(); });
+
+	EXPECT_EQ(std::this_thread::get_id(), runner);
+}
+
+TEST(CpuAffinityTest, RunsOnPinnedThread)
+{
+	std::thread::id runner;
+	int cpu = -1;
+	CpuAffinity::runOn(0, [&runner, &cpu]
+					   {
+						   runner = std::this_thread::get_id();
+#if defined(__linux__)
+						   cpu = sched_getcpu();
+#endif
+					   });
+
+	EXPECT_NE(std::this_thread::get_id(), runner);
+#if defined(__linux__)
+	EXPECT_EQ(0, cpu);
+#endif
+}
+
+TEST(CpuAffinityTest, RethrowsOnCallingThread)
+{
+	std::thread::id runner;
+	EXPECT_THROW(CpuAffinity::runOn(0, [&runner]
+									{
+										runner = std::this_thread::get_id();
+										throw std::runtime_error("shard allocation failed"); }),
+				 std::runtime_error);
+
+	EXPECT_NE(std::this_thread::get_id(), runner);
+}
+
+TEST(CpuAffinityTest, RejectsWrongCpu)
+{
+	std::string errorInfo;
+	std::thread thread([&errorInfo]
+					   { EXPECT_FALSE(CpuAffinity::pinCurrentThread(-2, errorInfo)); });
+	thread.join();
+
+	EXPECT_FALSE(errorInfo.empty());
+}
@@ -0,0 +1,178 @@
+#pragma once
+#include <gtest/gtest.h>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "../source/DnsCache.h"
+#include "../source/HttpTrafficStats.h"
+#include "../source/SnapshotPublisher.h"
+#include "TestPacket.h"
+
+namespace
+{
+	/// \brief Ответ на запрос A записи name: CNAME на cdn.example.net и адреса addresses
+	std::vector<std::uint8_t> dnsResponse(const std::string &name, const std::vector<std::array<std::uint8_t, 4>> &addresses, std::uint32_t ttl)
+	{
+		std::vector<std::uint8_t> data = {0x12, 0x34, 0x81, 0x80, 0, 1, 0, static_cast<std::uint8_t>(addresses.size() + 1), 0, 0, 0, 0};
+
+		std::size_t begin = 0;
+		while (begin <= name.size())
+		{
+			std::size_t end = std::min(name.find('.', begin), name.size());
+			data.push_back(static_cast<std::uint8_t>(end - begin));
+			data.insert(data.end(), name.begin() + begin, name.begin() + end);
+			begin = end + 1;
+		}
+		data.insert(data.end(), {0, 0, 1, 0, 1});
+
+		auto appendRecord = [&](std::uint16_t type, const std::vector<std::uint8_t> &rdata)
+		{
+			data.insert(data.end(), {0xC0, 0x0C, 0, static_cast<std::uint8_t>(type), 0, 1,
+									 static_cast<std::uint8_t>(ttl >> 24), static_cast<std::uint8_t>(ttl >> 16),
+									 static_cast<std::uint8_t>(ttl >> 8), static_cast<std::uint8_t>(ttl),
+									 0, static_cast<std::uint8_t>(rdata.size())});
+			data.insert(data.end(), rdata.begin(), rdata.end());
+		};
+
+		appendRecord(5, {3, 'c', 'd', 'n', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'n', 'e', 't', 0});
+		for (const auto &address : addresses)
+			appendRecord(1, {address.begin(), address.end()});
+
+		return data;
+	}
+
+	DnsCacheConfig dnsConfig(std::size_t capacity)
+	{
+		DnsCacheConfig config;
+		config.capacity = capacity;
+		config.minTtl = 1;
+		return config;
+	}
+}
+
+TEST(DnsResponseParserTest, ReadsQuestionNameAndAddresses)
+{
+	auto payload = dnsResponse("www.example.com", {{93, 184, 216, 34}, {93, 184, 216, 35}}, 300);
+
+	std::string name;
+	std::vector<std::string> addresses;
+	ASSERT_TRUE(DnsResponseParser::parse(payload.data(), payload.size(), name, [&](const IpKey &address, std::uint32_t ttl)
+										 {
+											 EXPECT_EQ(300, ttl);
+											 addresses.push_back(address.toString()); }));
+
+	EXPECT_EQ("www.example.com", name);
+	EXPECT_EQ((std::vector<std::string>{"93.184.216.34", "93.184.216.35"}), addresses);
+
+	// Обрезанный ответ не разбирается
+	EXPECT_FALSE(DnsResponseParser::parse(payload.data(), payload.size() - 2, name, [](const IpKey &, std::uint32_t) {}));
+
+	// Запрос (бит QR сброшен) не является ответом
+	payload[2] = 0x01;
+	EXPECT_FALSE(DnsResponseParser::parse(payload.data(), payload.size(), name, [](const IpKey &, std::uint32_t) {}));
+}
+
+TEST(DnsCacheTest, EntriesExpireByPacketTime)
+{
+	DnsCache cache(dnsConfig(16));
+	IpKey address = IpKey::fromString("93.184.216.34");
+
+	auto payload = dnsResponse("www.example.com", {{93, 184, 216, 34}}, 300);
+	ASSERT_TRUE(cache.addResponse(TestPacket("8.8.8.8", "127.0.0.1", 28).udp(53, 40000).carrying(payload).at(1000)));
+
+	EXPECT_EQ("www.example.com", NameArena::instance().view(cache.lookup(address)));
+	EXPECT_EQ(NameArena::noName, cache.lookup(IpKey::fromString("93.184.216.35")));
+	EXPECT_EQ(1, cache.getHits());
+	EXPECT_EQ(1, cache.getMisses());
+
+	// Время кэша идет по временным меткам пакетов
+	auto later = dnsResponse("other.example.com", {{10, 0, 0, 1}}, 300);
+	ASSERT_TRUE(cache.addResponse(TestPacket("8.8.8.8", "127.0.0.1", 28).udp(53, 40000).carrying(later).at(1301)));
+	EXPECT_EQ(NameArena::noName, cache.lookup(address));
+
+	std::string out;
+	cache.writeJson(out);
+	auto json = nlohmann::json::parse(out);
+	EXPECT_EQ(2, json["responses"]);
+	EXPECT_EQ(2, json["entries"]);
+	EXPECT_EQ(2, json["misses"]);
+}
+
+TEST(DnsCacheTest, ClockKeepsReferencedEntries)
+{
+	DnsCache cache(dnsConfig(2));
+
+	auto first = dnsResponse("first.example.com", {{10, 0, 0, 1}}, 300);
+	auto second = dnsResponse("second.example.com", {{10, 0, 0, 2}}, 300);
+	auto third = dnsResponse("third.example.com", {{10, 0, 0, 3}}, 300);
+
+	cache.addResponse(TestPacket("8.8.8.8", "127.0.0.1", 28).udp(53, 40000).carrying(first).at(1000));
+	cache.addResponse(TestPacket("8.8.8.8", "127.0.0.1", 28).udp(53, 40000).carrying(second).at(1000));
+	EXPECT_NE(NameArena::noName, cache.lookup(IpKey::fromString("10.0.0.1")));
+
+	cache.addResponse(TestPacket("8.8.8.8", "127.0.0.1", 28).udp(53, 40000).carrying(third).at(1000));
+
+	EXPECT_EQ(2, cache.size());
+	EXPECT_NE(NameArena::noName, cache.lookup(IpKey::fromString("10.0.0.1")));
+	EXPECT_EQ(NameArena::noName, cache.lookup(IpKey::fromString("10.0.0.2")));
+	EXPECT_NE(NameArena::noName, cache.lookup(IpKey::fromString("10.0.0.3")));
+}
+
+TEST(DnsCacheTest, UnnamedHostsAreLabeledInPublishedCopies)
+{
+	auto cache = std::make_shared<DnsCache>(dnsConfig(16));
+	HttpTrafficStats stats("127.0.0.1");
+	stats.setDnsCache(cache);
+
+	auto payload = dnsResponse("www.example.com", {{93, 184, 216, 34}}, 300);
+	stats.addPacket(TestPacket("8.8.8.8", "127.0.0.1", 28).udp(53, 40000).carrying(payload).at(1000));
+	stats.addPacket(TestPacket("93.184.216.34", "127.0.0.1", 1500).at(1000));
+	stats.addPacket(TestPacket("93.184.216.35", "127.0.0.1", 100).at(1000));
+
+	SnapshotPolicy policy;
+	policy.period = std::chrono::hours(1);
+	SnapshotPublisher publisher(stats, policy);
+
+	auto json = nlohmann::json::parse(publisher.get()->toJsonString());
+	ASSERT_EQ(3, json["hosts"].size());
+	EXPECT_EQ("", json["hosts"][0]["name"]);
+	EXPECT_EQ("www.example.com", json["hosts"][1]["name"]);
+	EXPECT_EQ("", json["hosts"][2]["name"]);
+
+	// Вывод копии к кэшу не обращается
+	std::uint64_t lookups = cache->getHits() + cache->getMisses();
+	publisher.get()->toString();
+	EXPECT_EQ(lookups, cache->getHits() + cache->getMisses());
+
+	// Третья публикация обновляет первую копию: имя получает хост, изменившийся после ответа DNS
+	publisher.publish(stats);
+	auto later = dnsResponse("api.example.com", {{93, 184, 216, 35}}, 300);
+	stats.addPacket(TestPacket("8.8.8.8", "127.0.0.1", 28).udp(53, 40000).carrying(later).at(1001));
+	stats.addPacket(TestPacket("93.184.216.35", "127.0.0.1", 100).at(1001));
+	publisher.publish(stats);
+
+	json = nlohmann::json::parse(publisher.get()->toJsonString());
+	EXPECT_EQ("www.example.com", json["hosts"][1]["name"]);
+	EXPECT_EQ("api.example.com", json["hosts"][2]["name"]);
+}
+
+TEST(DnsCacheTest, EntriesExpireWithoutLaterDnsTraffic)
+{
+	auto cache = std::make_shared<DnsCache>(dnsConfig(16));
+	HttpTrafficStats stats("127.0.0.1");
+	stats.setDnsCache(cache);
+	IpKey address = IpKey::fromString("93.184.216.34");
+
+	auto payload = dnsResponse("www.example.com", {{93, 184, 216, 34}}, 300);
+	stats.addPacket(TestPacket("8.8.8.8", "127.0.0.1", 28).udp(53, 40000).carrying(payload).at(1000));
+
+	auto packet = TestPacket(address, "127.0.0.1", 1500).at(1300);
+	stats.addPacket(packet);
+	EXPECT_EQ("www.example.com", NameArena::instance().view(cache->lookup(address)));
+
+	// Время кэша продвигают и пакеты, не являющиеся ответами DNS
+	stats.addPacket(packet.at(1301));
+	EXPECT_EQ(NameArena::noName, cache->lookup(address));
+	EXPECT_EQ(1, cache->getHits());
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <vector>
+
+#include "../source/TimingWheel.h"
+#include "../source/FlowTable.h"
+#include "TestPacket.h"
+
+TEST(TimingWheelTest, FiresAtDeadlineOnAllLevels)
+{
+	TimingWheel wheel;
+	wheel.resize(4);
+	wheel.advance(1000, [](std::uint32_t) {});
+
+	std::uint64_t deadlines[] = {1005, 1000 + 300, 1000 + 20000, 1000 + 500000};
+	for (std::uint32_t id = 0; id < 4; id++)
+		wheel.schedule(id, deadlines[id]);
+
+	std::vector<std::uint64_t> fired(4, 0);
+	for (std::uint64_t tick = 1001; tick <= 1000 + 500000; tick += 7)
+		wheel.advance(tick, [&](std::uint32_t id)
+					  { fired[id] = wheel.now(); });
+	wheel.advance(1000 + 500000, [&](std::uint32_t id)
+				  { fired[id] = wheel.now(); });
+
+	for (std::uint32_t id = 0; id < 4; id++)
+		EXPECT_EQ(deadlines[id], fired[id]);
+
+	EXPECT_EQ(0, wheel.size());
+}
+
+TEST(TimingWheelTest, RescheduleFromHandler)
+{
+	TimingWheel wheel;
+	wheel.resize(1);
+	wheel.advance(0, [](std::uint32_t) {});
+	wheel.schedule(0, 10);
+
+	int firedCount = 0;
+	wheel.advance(100, [&](std::uint32_t id)
+				  {
+					  if (++firedCount < 3)
+						  wheel.schedule(id, wheel.now() + 10); });
+
+	EXPECT_EQ(3, firedCount);
+	EXPECT_EQ(0, wheel.size());
+}
+
+TEST(FlowTableTest, BothDirectionsShareFlow)
+{
+	FlowTable table;
+	bool isNew = false;
+
+	auto request = TestPacket("10.0.0.1", "93.184.216.34", 100).tcp(40000, 80, 0x02).at(1);
+	auto response = TestPacket("93.184.216.34", "10.0.0.1", 100).tcp(80, 40000, 0x12).at(1);
+	auto ack = TestPacket("10.0.0.1", "93.184.216.34", 100).tcp(40000, 80, 0x10).at(1);
+
+	table.update(request, 7, isNew);
+	EXPECT_TRUE(isNew);
+	table.update(response, 7, isNew);
+	EXPECT_FALSE(isNew);
+	const Flow *flow = table.update(ack, 7, isNew);
+
+	ASSERT_NE(nullptr, flow);
+	EXPECT_EQ(1, table.size());
+	EXPECT_EQ(3, flow->packets);
+	EXPECT_EQ(300, flow->bytes);
+	EXPECT_EQ(7, flow->owner);
+	EXPECT_EQ(TcpState::established, flow->state);
+}
+
+TEST(FlowTableTest, IdleFlowsAreEvicted)
+{
+	FlowTableConfig config;
+	config.idleTimeout = std::chrono::seconds(60);
+	config.closedTimeout = std::chrono::seconds(5);
+	FlowTable table(config);
+
+	std::vector<std::uint16_t> expired;
+	auto onExpired = [&](const Flow &flow)
+	{ expired.push_back(flow.key.lowPort); };
+
+	bool isNew = false;
+	table.advance({100, 0}, onExpired);
+	table.update(TestPacket("10.0.0.1", "10.0.0.2", 100).tcp(1, 80).at(100), 0, isNew);
+	table.update(TestPacket("10.0.0.1", "10.0.0.2", 100).tcp(2, 80).at(100), 0, isNew);
+	table.update(TestPacket("10.0.0.1", "10.0.0.2", 100).tcp(3, 80, 0x04).at(100), 0, isNew);
+
+	// Поток 1 остается активным, поэтому его таймер переставляется
+	table.advance({150, 0}, onExpired);
+	table.update(TestPacket("10.0.0.1", "10.0.0.2", 100).tcp(1, 80).at(150), 0, isNew);
+	EXPECT_EQ(std::vector<std::uint16_t>{3}, expired);
+
+	table.advance({170, 0}, onExpired);
+	EXPECT_EQ((std::vector<std::uint16_t>{3, 2}), expired);
+	EXPECT_EQ(1, table.size());
+
+	table.advance({300, 0}, onExpired);
+	EXPECT_EQ((std::vector<std::uint16_t>{3, 2, 1}), expired);
+	EXPECT_EQ(0, table.size());
+}
+
+TEST(FlowTableTest, CapacityAndReuse)
+{
+	FlowTableConfig config;
+	config.capacity = 1000;
+	config.idleTimeout = std::chrono::seconds(10);
+	FlowTable table(config);
+
+	bool isNew = false;
+	std::size_t expiredCount = 0;
+	auto onExpired = [&](const Flow &)
+	{ expiredCount++; };
+
+	table.advance({0, 0}, onExpired);
+	for (std::uint16_t port = 0; port < 1500; port++)
+		table.update(TestPacket("10.0.0.1", "10.0.0.2", 100).tcp(port, 80).at(0), 0, isNew);
+
+	EXPECT_EQ(1000, table.size());
+	EXPECT_EQ(500, table.getDroppedFlows());
+
+	table.advance({20, 0}, onExpired);
+	EXPECT_EQ(1000, expiredCount);
+	EXPECT_EQ(0, table.size());
+
+	for (std::uint16_t port = 0; port < 1000; port++)
+		EXPECT_NE(nullptr, table.update(TestPacket("10.0.0.3", "10.0.0.2", 100).tcp(port, 80).at(20), 0, isNew));
+
+	bool isFromLow = false;
+	EXPECT_NE(nullptr, table.find(FlowKey::fromPacket(TestPacket("10.0.0.3", "10.0.0.2", 100).tcp(999, 80).at(20), isFromLow)));
+	EXPECT_EQ(nullptr, table.find(FlowKey::fromPacket(TestPacket("10.0.0.1", "10.0.0.2", 100).tcp(999, 80).at(20), isFromLow)));
+}
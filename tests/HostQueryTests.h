@@ -0,0 +1,242 @@
+#pragma once
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "../source/HostQuery.h"
+#include "../source/TerminalView.h"
+
+namespace
+{
+	/// \brief Статистика с заданными хостами, по которой выполняются выборки
+	class QueriedHostsStats : public ITrafficStats
+	{
+	public:
+		std::vector<std::pair<IpKey, HostInfo>> hosts;
+
+		QueriedHostsStats() : ITrafficStats("10.0.0.254") {}
+
+		HostInfo &add(const char *ip, std::uint64_t inTraffic, std::uint64_t outTraffic, const char *name = nullptr)
+		{
+			hosts.push_back({IpKey::fromString(ip), HostInfo()});
+			HostInfo &hostInfo = hosts.back().second;
+			hostInfo.inTraffic = inTraffic;
+			hostInfo.outTraffic = outTraffic;
+			hostInfo.inPackets = inTraffic / 100;
+			hostInfo.outPackets = outTraffic / 100;
+			if (name)
+				hostInfo.nameId = NameArena::instance().intern(name);
+
+			return hostInfo;
+		}
+
+		std::string toString() const override { return ""; }
+		void writeJson(std::string &, std::uint64_t) const override {}
+		std::string_view name() const override { return "queried"; }
+		void addPacket(const PacketView &) override {}
+		void clear() override { hosts.clear(); }
+		std::unique_ptr<ITrafficStats> clone() const override { return std::make_unique<QueriedHostsStats>(*this); }
+		void merge(const ITrafficStats &) override {}
+
+		void visitHosts(IHostVisitor &visitor) const override
+		{
+			for (const auto &[host, hostInfo] : hosts)
+				visitor.onHost(host, hostInfo, hostInfo.nameId);
+		}
+	};
+
+	std::vector<std::string> queriedAddresses(const HostQueryResult &result)
+	{
+		std::vector<std::string> addresses;
+		for (const auto &row : result.getRows())
+			addresses.push_back(row.host.toString());
+
+		return addresses;
+	}
+}
+
+TEST(HostQueryTest, SortsBySelectedKey)
+{
+	QueriedHostsStats stats;
+	stats.add("10.0.0.1", 100, 900);
+	stats.add("10.0.0.2", 800, 100);
+	stats.add("10.0.0.3", 500, 600);
+
+	HostQuery query;
+	HostQueryResult result;
+
+	result.run(stats, query);
+	EXPECT_EQ((std::vector<std::string>{"10.0.0.3", "10.0.0.1", "10.0.0.2"}), queriedAddresses(result));
+
+	ASSERT_TRUE(HostQuery::parseSortKey("in", query.sortKey));
+	result.run(stats, query);
+	EXPECT_EQ((std::vector<std::string>{"10.0.0.2", "10.0.0.3", "10.0.0.1"}), queriedAddresses(result));
+
+	ASSERT_TRUE(HostQuery::parseSortKey("out", query.sortKey));
+	result.run(stats, query);
+	EXPECT_EQ((std::vector<std::string>{"10.0.0.1", "10.0.0.3", "10.0.0.2"}), queriedAddresses(result));
+
+	EXPECT_FALSE(HostQuery::parseSortKey("name", query.sortKey));
+	EXPECT_EQ(HostQuery::SortKey::out, query.sortKey);
+}
+
+TEST(HostQueryTest, LimitKeepsHeaviestHosts)
+{
+	QueriedHostsStats stats;
+	for (int i = 0; i < 250; i++)
+	{
+		std::string ip = "10.0." + std::to_string(i / 100) + "." + std::to_string(i % 100);
+		// Значения перемешаны, чтобы лучшие хосты встречались в разных частях обхода
+		stats.add(ip.c_str(), static_cast<std::uint64_t>((i * 37) % 250) * 10, 0);
+	}
+
+	// Хосты с равным трафиком упорядочиваются по адресу
+	stats.add("10.0.9.2", 2490, 0);
+
+	HostQuery query;
+	query.limit = 5;
+	HostQueryResult result;
+	result.run(stats, query);
+
+	ASSERT_EQ(5, result.getRows().size());
+	EXPECT_EQ(251, result.getMatched());
+
+	std::vector<std::string> addresses = queriedAddresses(result);
+	EXPECT_EQ("10.0.9.2", addresses[1]);
+	std::vector<std::uint64_t> traffic;
+	for (const auto &row : result.getRows())
+		traffic.push_back(row.inTraffic);
+	EXPECT_EQ((std::vector<std::uint64_t>{2490, 2490, 2480, 2470, 2460}), traffic);
+
+	query.limit = 1000;
+	result.run(stats, query);
+	EXPECT_EQ(251, result.getRows().size());
+}
+
+TEST(HostQueryTest, FiltersByNetworkPatternAndGeneration)
+{
+	QueriedHostsStats stats;
+	stats.add("10.1.0.1", 100, 0, "api.example.com").generation = 3;
+	stats.add("10.1.0.2", 200, 0).generation = 5;
+	stats.add("192.168.0.1", 300, 0, "example.org").generation = 7;
+	stats.add("fd00::1", 400, 0, "db.example.com").generation = 9;
+
+	HostQuery query;
+	HostQueryResult result;
+	std::string errorInfo;
+
+	ASSERT_TRUE(query.setFilter("10.1.0.0/16", errorInfo)) << errorInfo;
+	result.run(stats, query);
+	EXPECT_EQ((std::vector<std::string>{"10.1.0.2", "10.1.0.1"}), queriedAddresses(result));
+
+	ASSERT_TRUE(query.setFilter("192.168.0.1", errorInfo)) << errorInfo;
+	result.run(stats, query);
+	EXPECT_EQ((std::vector<std::string>{"192.168.0.1"}), queriedAddresses(result));
+
+	ASSERT_TRUE(query.setFilter("*.example.com", errorInfo)) << errorInfo;
+	result.run(stats, query);
+	EXPECT_EQ((std::vector<std::string>{"fd00::1", "10.1.0.1"}), queriedAddresses(result));
+
+	// Шаблон проверяется и по адресу хоста
+	ASSERT_TRUE(query.setFilter("10.1.*", errorInfo)) << errorInfo;
+	result.run(stats, query);
+	EXPECT_EQ(2, result.getMatched());
+
+	query.sinceGeneration = 4;
+	result.run(stats, query);
+	EXPECT_EQ((std::vector<std::string>{"10.1.0.2"}), queriedAddresses(result));
+
+	ASSERT_TRUE(query.setFilter("", errorInfo)) << errorInfo;
+	result.run(stats, query);
+	EXPECT_EQ(3, result.getMatched());
+
+	EXPECT_FALSE(query.setFilter("10.0.0.0/40", errorInfo));
+	EXPECT_FALSE(query.setFilter("hosts/example", errorInfo));
+}
+
+TEST(HostQueryTest, WritesJsonAndText)
+{
+	QueriedHostsStats stats;
+	stats.setGeneration(12);
+	stats.add("10.0.0.1", 100, 200, "example.com").activeFlows = 2;
+	stats.add("10.0.0.2", 10, 20);
+
+	HostQuery query;
+	query.limit = 1;
+	HostQuery::parseSortKey("packets", query.sortKey);
+	HostQueryResult result;
+	result.run(stats, query);
+
+	std::string json;
+	result.writeJson(json);
+	EXPECT_EQ("{\"generation\":12,\"sort\":\"packets\",\"matched\":2,\"hosts\":[{\"ip\":\"10.0.0.1\",\"name\":\"example.com\","
+			  "\"packets\":{\"in\":1,\"out\":2,\"total\":3},\"traffic\":{\"in\":100,\"out\":200,\"total\":300},"
+			  "\"flows\":{\"active\":2,\"completed\":0}}]}\n",
+			  json);
+
+	std::string text = result.toString();
+	EXPECT_EQ(0, text.find("Top 1 of 2 hosts by packets\n"));
+	EXPECT_NE(std::string::npos, text.find("example.com"));
+	EXPECT_EQ(std::string::npos, text.find("10.0.0.2"));
+}
+
+TEST(TerminalViewTest, RewritesOnlyChangedLines)
+{
+	TerminalView view;
+	std::string out;
+
+	view.render("first\nsecond\nthird\n", out);
+	EXPECT_EQ("\033[2Kfirst\n\033[2Ksecond\n\033[2Kthird\n", out);
+	EXPECT_EQ(3, view.getChangedLines());
+
+	out.clear();
+	view.render("first\nchanged\nthird\n", out);
+	EXPECT_EQ("\033[3F\033[1E\033[2Kchanged\n\033[1E", out);
+	EXPECT_EQ(1, view.getChangedLines());
+
+	// Лишние строки прошлого текста стираются
+	out.clear();
+	view.render("first\n", out);
+	EXPECT_EQ("\033[3F\033[1E\033[J", out);
+	EXPECT_EQ(0, view.getChangedLines());
+
+	TerminalView narrow(6);
+	out.clear();
+	narrow.render("long line\n", out);
+	EXPECT_EQ("\033[2Klong \n", out);
+}
+
+TEST(TerminalViewTest, TruncatesByDisplayColumns)
+{
+	std::string out;
+
+	// Кириллица занимает два байта и одну колонку на символ
+	TerminalView cyrillic(6);
+	cyrillic.render("привет мир\n", out);
+	EXPECT_EQ("\033[2Kприве\n", out);
+
+	// Иероглиф занимает две колонки и не разрезается пополам
+	TerminalView wide(6);
+	out.clear();
+	wide.render("ab漢字かな\n", out);
+	EXPECT_EQ("\033[2Kab漢\n", out);
+
+	// Некорректный байт считается одной колонкой
+	TerminalView invalid(4);
+	out.clear();
+	invalid.render("a\xFF\xD0xyz\n", out);
+	EXPECT_EQ("\033[2Ka\xFF\xD0\n", out);
+}
+
+TEST(TerminalViewTest, ClampsTextToTerminalHeight)
+{
+	TerminalView view(0, 3);
+	std::string out;
+
+	view.render("first\nsecond\nthird\nfourth\n", out);
+	EXPECT_EQ("\033[2Kfirst\n\033[2Ksecond\n", out);
+
+	out.clear();
+	view.render("first\nchanged\nthird\n", out);
+	EXPECT_EQ("\033[2F\033[1E\033[2Kchanged\n", out);
+}
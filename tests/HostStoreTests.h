@@ -0,0 +1,175 @@
+#pragma once
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+
+#include <nlohmann/json.hpp>
+
+#include "../source/HostStore.h"
+#include "../source/HttpTrafficStats.h"
+#include "TestPacket.h"
+
+struct HostStoreClassTest : public testing::Test
+{
+	HostStoreConfig config;
+
+	void SetUp()
+	{
+		config.path = testing::TempDir() + "host-store-test.bin";
+		config.capacity = 4;
+		config.syncPeriod = std::chrono::seconds(0);
+		std::remove(config.path.c_str());
+	}
+
+	void TearDown() { std::remove(config.path.c_str()); }
+};
+
+TEST_F(HostStoreClassTest, RecordsSurviveReopen)
+{
+	std::string errorInfo;
+	{
+		HostStore store;
+		ASSERT_TRUE(store.open(config, errorInfo)) << errorInfo;
+
+		std::size_t index = store.findOrInsert(IpKey::fromString("10.0.0.1"));
+		store.at(index).addPacket(100, true);
+		store.at(index).addPacket(40, false);
+		store.at(index).setName("example.com");
+
+		EXPECT_EQ(index, store.findOrInsert(IpKey::fromString("10.0.0.1")));
+		store.findOrInsert(IpKey::fromString("fd00::1"));
+	}
+
+	HostStore store;
+	ASSERT_TRUE(store.open(config, errorInfo)) << errorInfo;
+	ASSERT_EQ(2u, store.size());
+
+	const StoredHost &stored = store.at(0);
+	EXPECT_EQ(IpKey::fromString("10.0.0.1"), stored.key());
+	EXPECT_EQ(1u, stored.inPackets);
+	EXPECT_EQ(1u, stored.outPackets);
+	EXPECT_EQ(100u, stored.inTraffic);
+	EXPECT_EQ(40u, stored.outTraffic);
+	EXPECT_EQ("example.com", std::string(stored.name, stored.nameLength));
+	EXPECT_EQ(1u, store.findOrInsert(IpKey::fromString("fd00::1")));
+}
+
+TEST_F(HostStoreClassTest, FullStoreRejectsNewHosts)
+{
+	std::string errorInfo;
+	HostStore store;
+	ASSERT_TRUE(store.open(config, errorInfo)) << errorInfo;
+
+	for (int i = 0; i < 4; i++)
+		EXPECT_NE(HostStore::npos, store.findOrInsert(IpKey::fromString("10.0.0." + std::to_string(i))));
+
+	EXPECT_EQ(HostStore::npos, store.findOrInsert(IpKey::fromString("10.0.0.100")));
+	EXPECT_NE(HostStore::npos, store.findOrInsert(IpKey::fromString("10.0.0.2")));
+
+	store.clear();
+	EXPECT_EQ(0u, store.size());
+	EXPECT_NE(HostStore::npos, store.findOrInsert(IpKey::fromString("10.0.0.100")));
+}
+
+TEST_F(HostStoreClassTest, ForeignFileIsNotOpened)
+{
+	{
+		std::ofstream file(config.path);
+		file << "not a host store";
+	}
+
+	std::string errorInfo;
+	HostStore store;
+	EXPECT_FALSE(store.open(config, errorInfo));
+	EXPECT_FALSE(errorInfo.empty());
+
+	std::ifstream file(config.path);
+	std::string content;
+	std::getline(file, content);
+	EXPECT_EQ("not a host store", content);
+}
+
+TEST_F(HostStoreClassTest, DamagedIndexIsNotOpened)
+{
+	std::string errorInfo;
+	{
+		HostStore store;
+		ASSERT_TRUE(store.open(config, errorInfo)) << errorInfo;
+		store.findOrInsert(IpKey::fromString("10.0.0.1"));
+	}
+
+	// Индекс из 8 ячеек начинается после заголовка размером в страницу, ячейки указывают за последнюю запись
+	{
+		std::fstream file(config.path, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(4096);
+		std::string damaged(8 * sizeof(std::uint32_t), '\xFF');
+		file.write(damaged.data(), damaged.size());
+	}
+
+	HostStore store;
+	EXPECT_FALSE(store.open(config, errorInfo));
+	EXPECT_NE(std::string::npos, errorInfo.find("damaged index"));
+	EXPECT_EQ(0u, store.size());
+}
+
+TEST_F(HostStoreClassTest, StatsAreRestoredAfterRestart)
+{
+	std::string errorInfo;
+	std::string before;
+	{
+		HttpTrafficStats stats("127.0.0.1");
+		auto store = std::make_unique<HostStore>();
+		ASSERT_TRUE(store->open(config, errorInfo)) << errorInfo;
+		ASSERT_TRUE(stats.attachStore(std::move(store), errorInfo));
+
+		stats.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 100));
+		stats.addPacket(TestPacket("10.0.0.2", "127.0.0.1", 200));
+		stats.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 300));
+		before = stats.toString();
+
+		// Закрытие файла не очищает сохраненную статистику
+		stats.closeStore();
+		stats.clear();
+	}
+
+	HttpTrafficStats restarted("127.0.0.1");
+	auto store = std::make_unique<HostStore>();
+	ASSERT_TRUE(store->open(config, errorInfo)) << errorInfo;
+	ASSERT_TRUE(restarted.attachStore(std::move(store), errorInfo));
+	EXPECT_EQ(before, restarted.toString());
+
+	restarted.addPacket(TestPacket("10.0.0.2", "127.0.0.1", 50));
+	auto json = nlohmann::json::parse(restarted.toJsonString());
+	EXPECT_EQ(250, json["hosts"][1]["traffic"]["in"]);
+}
+
+TEST_F(HostStoreClassTest, RecordsAreUpdatedOnPublish)
+{
+	std::string errorInfo;
+	HttpTrafficStats stats("127.0.0.1");
+	auto store = std::make_unique<HostStore>();
+	ASSERT_TRUE(store->open(config, errorInfo)) << errorInfo;
+	ASSERT_TRUE(stats.attachStore(std::move(store), errorInfo));
+
+	// Второе отображение того же файла видит записи, как их увидит следующий запуск
+	HostStore mapped;
+	ASSERT_TRUE(mapped.open(config, errorInfo)) << errorInfo;
+
+	// Счетчики больше 4 ГиБ сохраняются без усечения
+	PacketView packet = TestPacket("10.0.0.1", "127.0.0.1", 1500);
+	packet.weight = 4000000;
+	stats.addPacket(packet);
+	ASSERT_EQ(1u, mapped.size());
+	EXPECT_EQ(0u, mapped.at(0).inTraffic);
+
+	stats.setGeneration(1);
+	EXPECT_EQ(6000000000u, mapped.at(0).inTraffic);
+	EXPECT_EQ(4000000u, mapped.at(0).inPackets);
+
+	stats.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 100));
+	stats.addPacket(TestPacket("10.0.0.2", "127.0.0.1", 200));
+	stats.setGeneration(2);
+	EXPECT_EQ(6000000100u, mapped.at(0).inTraffic);
+	ASSERT_EQ(2u, mapped.size());
+	EXPECT_EQ(200u, mapped.at(1).inTraffic);
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <gtest/gtest.h>
+
+#include "../source/HostTable.h"
+#include "../source/IpKey.h"
+
+TEST(IpKeyTest, StringRoundTrip)
+{
+	EXPECT_EQ("192.168.1.10", IpKey::fromString("192.168.1.10").toString());
+	EXPECT_EQ("2001:db8::1", IpKey::fromString("2001:db8::1").toString());
+	EXPECT_TRUE(IpKey::fromString("not an address").empty());
+}
+
+TEST(IpKeyTest, FamiliesAreDistinct)
+{
+	EXPECT_TRUE(IpKey::fromString("10.0.0.1").isIPv4());
+	EXPECT_TRUE(IpKey::fromString("::a00:1").isIPv6());
+	EXPECT_NE(IpKey::fromString("10.0.0.1"), IpKey::fromString("::a00:1"));
+}
+
+TEST(HostTableTest, InsertAndFind)
+{
+	HostTable<int> table;
+	table[IpKey::fromString("10.0.0.1")] = 1;
+	table[IpKey::fromString("fe80::1")] = 2;
+
+	ASSERT_NE(nullptr, table.find(IpKey::fromString("10.0.0.1")));
+	EXPECT_EQ(1, *table.find(IpKey::fromString("10.0.0.1")));
+	EXPECT_EQ(2, *table.find(IpKey::fromString("fe80::1")));
+	EXPECT_EQ(nullptr, table.find(IpKey::fromString("10.0.0.2")));
+	EXPECT_EQ(2, table.size());
+}
+
+TEST(HostTableTest, GrowthKeepsInsertionOrder)
+{
+	HostTable<std::uint32_t> table;
+
+	for (std::uint32_t i = 0; i < 100000; i++)
+	{
+		std::uint32_t address = htonl(0x0A000000 + i);
+		table[IpKey::fromIPv4(reinterpret_cast<const std::uint8_t *>(&address))] += i;
+	}
+
+	ASSERT_EQ(100000, table.size());
+	for (std::uint32_t i = 0; i < table.size(); i += 997)
+	{
+		std::uint32_t address = htonl(0x0A000000 + i);
+		auto key = IpKey::fromIPv4(reinterpret_cast<const std::uint8_t *>(&address));
+		EXPECT_EQ(key, table.keyAt(i));
+		EXPECT_EQ(i, table.valueAt(i));
+		EXPECT_EQ(i, *table.find(key));
+	}
+}
+
+TEST(HostTableTest, Clear)
+{
+	HostTable<int> table;
+	table[IpKey::fromString("10.0.0.1")] = 1;
+	table.clear();
+
+	EXPECT_TRUE(table.empty());
+	EXPECT_EQ(nullptr, table.find(IpKey::fromString("10.0.0.1")));
+}
+
+TEST(HostTableTest, ReplaceKeyKeepsIndex)
+{
+	HostTable<int> table;
+	table.reserve(16);
+
+	for (std::uint32_t i = 0; i < 16; i++)
+	{
+		std::uint32_t address = htonl(0x0A000000 + i);
+		table[IpKey::fromIPv4(reinterpret_cast<const std::uint8_t *>(&address))] = i;
+	}
+
+	auto oldKey = table.keyAt(5);
+	auto newKey = IpKey::fromString("192.168.0.1");
+	table.replaceKey(5, newKey);
+
+	EXPECT_EQ(HostTable<int>::npos, table.indexOf(oldKey));
+	EXPECT_EQ(5, table.indexOf(newKey));
+	EXPECT_EQ(5, *table.find(newKey));
+	EXPECT_EQ(16, table.size());
+
+	for (std::size_t i = 0; i < table.size(); i++)
+		EXPECT_EQ(i, table.indexOf(table.keyAt(i)));
+}
@@ -8,6 +8,9 @@
 #include "TcpLayer.h"
 #include "UdpLayer.h"
 #include "IPv4Layer.h"
+#include "PayloadLayer.h"
+
+#include <nlohmann/json.hpp>
 
 #include "../source/TrafficAnalyzer.h"
 #include "../source/HttpTrafficStats.h"
@@ -53,3 +56,139 @@ TEST_F(HttpTrafficStatsClassTest, ClearStatsTest)
 	trafficStats->clear();
 	EXPECT_EQ("", trafficStats->toString());
 }
+
+TEST_F(HttpTrafficStatsClassTest, HostNameFromRawPacketTest)
+{
+	const std::string request = "GET / HTTP/1.1\r\nHost: example.com\r\n\r\n";
+
+	pcpp::EthLayer newEthernetLayer(pcpp::MacAddress("00:50:43:11:22:33"), pcpp::MacAddress("aa:bb:cc:dd:ee"));
+	pcpp::IPv4Layer newIPLayer(pcpp::IPv4Address("127.0.0.1"), pcpp::IPv4Address("93.184.216.34"));
+	pcpp::TcpLayer newTcpLayer(50000, 80);
+	pcpp::PayloadLayer newPayloadLayer(reinterpret_cast<const uint8_t *>(request.data()), request.size(), false);
+
+	pcpp::Packet newPacket;
+	newPacket.addLayer(&newEthernetLayer);
+	newPacket.addLayer(&newIPLayer);
+	newPacket.addLayer(&newTcpLayer);
+	newPacket.addLayer(&newPayloadLayer);
+	newPacket.computeCalculateFields();
+
+	PacketView view;
+	ASSERT_TRUE(RawPacketParser::parse(*newPacket.getRawPacket(), view));
+	trafficStats->addPacket(view);
+
+	EXPECT_EQ(0, trafficStats->toString().rfind("example.com", 0));
+}
+
+TEST_F(HttpTrafficStatsClassTest, JsonSinceGenerationTest)
+{
+	PacketView view;
+	view.srcIp = IpKey::fromString("10.0.0.1");
+	view.dstIp = IpKey::fromString("127.0.0.1");
+	view.length = 100;
+	trafficStats->addPacket(view);
+
+	trafficStats->setGeneration(5);
+	view.srcIp = IpKey::fromString("10.0.0.2");
+	trafficStats->addPacket(view);
+
+	auto full = nlohmann::json::parse(trafficStats->toJsonString());
+	EXPECT_EQ(5, full["generation"]);
+	EXPECT_EQ(2, full["hosts"].size());
+
+	std::string out;
+	trafficStats->writeJson(out, 4);
+	auto delta = nlohmann::json::parse(out);
+	ASSERT_EQ(1, delta["hosts"].size());
+	EXPECT_EQ("10.0.0.2", delta["hosts"][0]["ip"]);
+	EXPECT_EQ(100, delta["hosts"][0]["traffic"]["in"]);
+	EXPECT_EQ(1, delta["hosts"][0]["packets"]["total"]);
+
+	out.clear();
+	trafficStats->writeJson(out, 5);
+	EXPECT_TRUE(nlohmann::json::parse(out)["hosts"].empty());
+}
+
+TEST_F(HttpTrafficStatsClassTest, CompletedFlowsRollUpIntoHostTest)
+{
+	PacketView view;
+	view.srcIp = IpKey::fromString("10.0.0.1");
+	view.dstIp = IpKey::fromString("127.0.0.1");
+	view.transportProtocol = PacketView::udpProtocol;
+	view.srcPort = 5000;
+	view.dstPort = 443;
+	view.length = 100;
+	view.timestamp.tv_sec = 1000;
+
+	trafficStats->addPacket(view);
+	view.srcPort = 5001;
+	trafficStats->addPacket(view);
+
+	auto json = nlohmann::json::parse(trafficStats->toJsonString());
+	EXPECT_EQ(2, json["hosts"][0]["flows"]["active"]);
+	EXPECT_EQ(0, json["hosts"][0]["flows"]["completed"]);
+
+	// Пакет другого хоста спустя время неактивности завершает оба потока
+	view.srcIp = IpKey::fromString("10.0.0.2");
+	view.timestamp.tv_sec = 2000;
+	trafficStats->addPacket(view);
+
+	json = nlohmann::json::parse(trafficStats->toJsonString());
+	EXPECT_EQ(0, json["hosts"][0]["flows"]["active"]);
+	EXPECT_EQ(2, json["hosts"][0]["flows"]["completed"]);
+	EXPECT_EQ(1, json["hosts"][1]["flows"]["active"]);
+	EXPECT_EQ(1, trafficStats->getFlows()->size());
+
+	auto copy = trafficStats->clone();
+	EXPECT_EQ(trafficStats->toJsonString(), copy->toJsonString());
+}
+
+TEST_F(HttpTrafficStatsClassTest, AddPacketsMatchesAddPacketTest)
+{
+	HttpTrafficStats batched("127.0.0.1");
+	std::vector<PacketView> views;
+
+	for (std::uint8_t i = 0; i < 100; i++)
+	{
+		std::uint8_t remote[4] = {10, 0, 0, static_cast<std::uint8_t>(i % 30)};
+		PacketView view;
+		view.srcIp = i % 3 ? IpKey::fromIPv4(remote) : IpKey::fromString("127.0.0.1");
+		view.dstIp = i % 3 ? IpKey::fromString("127.0.0.1") : IpKey::fromIPv4(remote);
+		view.length = 60 + i;
+		views.push_back(view);
+	}
+
+	// Пакет без IP заголовка пропускается
+	views.push_back(PacketView());
+
+	for (const auto &view : views)
+		trafficStats->addPacket(view);
+
+	batched.addPackets(views);
+
+	EXPECT_EQ(trafficStats->toString(), batched.toString());
+}
+
+TEST_F(HttpTrafficStatsClassTest, CountersDoNotWrapAt4GiBTest)
+{
+	PacketView view;
+	view.srcIp = IpKey::fromString("10.0.0.1");
+	view.dstIp = IpKey::fromString("127.0.0.1");
+	view.length = 1 << 20;
+	view.timestamp.tv_sec = 1700000000;
+
+	// Больше 4 ГиБ входящего трафика
+	for (int i = 0; i < 5000; i++)
+		trafficStats->addPacket(view);
+
+	view.timestamp.tv_sec = 1700000100;
+	HttpTrafficStats other("127.0.0.1");
+	other.addPacket(view);
+	trafficStats->merge(other);
+
+	auto json = nlohmann::json::parse(trafficStats->toJsonString());
+	ASSERT_EQ(1, json["hosts"].size());
+	EXPECT_EQ(5001, json["hosts"][0]["packets"]["in"]);
+	EXPECT_EQ(std::uint64_t(1 << 20) * 5001, json["hosts"][0]["traffic"]["in"].get<std::uint64_t>());
+	EXPECT_EQ(1700000000, json["hosts"][0]["firstSeen"]);
+}
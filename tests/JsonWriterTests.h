@@ -0,0 +1,51 @@
+#pragma once
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+
+#include "../source/JsonWriter.h"
+
+TEST(JsonWriterTest, NestedDocument)
+{
+	std::string out;
+	JsonWriter json(out);
+
+	json.beginObject();
+	json.field("count", std::uint64_t(2));
+	json.key("items").beginArray();
+	json.beginObject().field("name", "a").endObject();
+	json.beginObject().field("name", "b").endObject();
+	json.endArray();
+	json.key("empty").beginObject().endObject();
+	json.endObject();
+
+	EXPECT_EQ(R"({"count":2,"items":[{"name":"a"},{"name":"b"}],"empty":{}})", out);
+}
+
+TEST(JsonWriterTest, EscapesStrings)
+{
+	std::string out;
+	JsonWriter(out).value("quote\" slash\\ line\n\x01");
+
+	EXPECT_EQ(R"("quote\" slash\\ line\n\u0001")", out);
+	EXPECT_EQ("quote\" slash\\ line\n\x01", nlohmann::json::parse(out).get<std::string>());
+}
+
+TEST(JsonWriterTest, ReplacesInvalidUtf8)
+{
+	std::string out;
+	JsonWriter(out).value("пр\xD0 \xFFok \xE2\x82\xAC \xC0\xAF \xED\xA0\x80 \xF0\x9F\x98\x80");
+
+	EXPECT_EQ("\"пр\xEF\xBF\xBD \xEF\xBF\xBDok \xE2\x82\xAC \xEF\xBF\xBD\xEF\xBF\xBD "
+			  "\xEF\xBF\xBD\xEF\xBF\xBD\xEF\xBF\xBD \xF0\x9F\x98\x80\"",
+			  out);
+	EXPECT_NO_THROW(nlohmann::json::parse(out));
+}
+
+TEST(JsonWriterTest, AppendsToReusedBuffer)
+{
+	std::string out = "prefix ";
+	JsonWriter(out).beginArray().value(std::uint64_t(18446744073709551615ull)).endArray();
+
+	EXPECT_EQ("prefix [18446744073709551615]", out);
+}
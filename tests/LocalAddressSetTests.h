@@ -0,0 +1,100 @@
+#pragma once
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+
+#include "../source/LocalAddressSet.h"
+#include "../source/HttpTrafficStats.h"
+
+TEST(LocalAddressSetTest, SingleAddress)
+{
+	auto addresses = LocalAddressSet::ofAddress("192.168.1.10");
+
+	EXPECT_TRUE(addresses->contains(IpKey::fromString("192.168.1.10")));
+	EXPECT_FALSE(addresses->contains(IpKey::fromString("192.168.1.11")));
+	EXPECT_FALSE(addresses->contains(IpKey::fromString("::ffff:192.168.1.10")));
+	EXPECT_FALSE(addresses->contains(IpKey()));
+}
+
+TEST(LocalAddressSetTest, NetworksOfBothFamilies)
+{
+	LocalAddressSet addresses;
+	std::string errorInfo;
+
+	ASSERT_TRUE(addresses.addNetwork("10.1.0.0/16", errorInfo));
+	ASSERT_TRUE(addresses.addNetwork("fd00::/8", errorInfo));
+	ASSERT_TRUE(addresses.addNetwork("2001:db8::1", errorInfo));
+
+	EXPECT_TRUE(addresses.contains(IpKey::fromString("10.1.0.0")));
+	EXPECT_TRUE(addresses.contains(IpKey::fromString("10.1.255.255")));
+	EXPECT_FALSE(addresses.contains(IpKey::fromString("10.2.0.0")));
+	EXPECT_FALSE(addresses.contains(IpKey::fromString("10.0.255.255")));
+
+	EXPECT_TRUE(addresses.contains(IpKey::fromString("fd12:3456::1")));
+	EXPECT_FALSE(addresses.contains(IpKey::fromString("fe80::1")));
+	EXPECT_TRUE(addresses.contains(IpKey::fromString("2001:db8::1")));
+	EXPECT_FALSE(addresses.contains(IpKey::fromString("2001:db8::2")));
+}
+
+TEST(LocalAddressSetTest, OverlappingNetworksAreMerged)
+{
+	LocalAddressSet addresses;
+	std::string errorInfo;
+
+	ASSERT_TRUE(addresses.addNetwork("10.0.0.0/24", errorInfo));
+	ASSERT_TRUE(addresses.addNetwork("10.0.1.0/24", errorInfo));
+	ASSERT_TRUE(addresses.addNetwork("10.0.0.128/25", errorInfo));
+	ASSERT_TRUE(addresses.addNetwork("0.0.0.0/0", errorInfo));
+	ASSERT_TRUE(addresses.addNetwork("::/0", errorInfo));
+
+	EXPECT_EQ(2u, addresses.size());
+	EXPECT_TRUE(addresses.contains(IpKey::fromString("255.255.255.255")));
+	EXPECT_TRUE(addresses.contains(IpKey::fromString("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff")));
+}
+
+TEST(LocalAddressSetTest, WrongNetworks)
+{
+	LocalAddressSet addresses;
+	std::string errorInfo;
+
+	EXPECT_FALSE(addresses.addNetwork("10.0.0.0/33", errorInfo));
+	EXPECT_FALSE(addresses.addNetwork("10.0.0.0/", errorInfo));
+	EXPECT_FALSE(addresses.addNetwork("fd00::/129", errorInfo));
+	EXPECT_FALSE(addresses.addNetwork("example.com/8", errorInfo));
+	EXPECT_FALSE(errorInfo.empty());
+	EXPECT_TRUE(addresses.empty());
+}
+
+TEST(LocalAddressSetTest, LoopbackInterfaceAddresses)
+{
+	LocalAddressSet addresses;
+	std::string errorInfo;
+
+	ASSERT_TRUE(addresses.addInterfaceAddresses("lo", errorInfo));
+	EXPECT_TRUE(addresses.contains(IpKey::fromString("127.0.0.1")));
+}
+
+TEST(LocalAddressSetTest, DirectionFromSecondaryAddress)
+{
+	auto addresses = LocalAddressSet::ofAddress("127.0.0.1");
+	std::string errorInfo;
+	ASSERT_TRUE(addresses->addNetwork("fd00::/8", errorInfo));
+
+	HttpTrafficStats stats("127.0.0.1");
+	stats.setLocalAddresses(addresses);
+
+	PacketView view;
+	view.srcIp = IpKey::fromString("2001:db8::5");
+	view.dstIp = IpKey::fromString("fd00::10");
+	view.length = 100;
+	stats.addPacket(view);
+
+	std::swap(view.srcIp, view.dstIp);
+	stats.addPacket(view);
+
+	auto json = nlohmann::json::parse(stats.toJsonString());
+	ASSERT_EQ(1u, json["hosts"].size());
+	EXPECT_EQ("2001:db8::5", json["hosts"][0]["ip"]);
+	EXPECT_EQ(1, json["hosts"][0]["packets"]["in"]);
+	EXPECT_EQ(1, json["hosts"][0]["packets"]["out"]);
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include <gtest/gtest.h>
+#include <memory>
+
+#include "../source/HttpTrafficStats.h"
+#include "../source/MetricsExposition.h"
+#include "../source/SnapshotPublisher.h"
+#include "TestPacket.h"
+
+namespace
+{
+	std::size_t countOf(const std::string &text, const std::string &pattern)
+	{
+		std::size_t count = 0;
+		for (std::size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1))
+			count++;
+
+		return count;
+	}
+}
+
+TEST(MetricsExpositionTest, WritesHostSeriesAndHealth)
+{
+	HttpTrafficStats stats("127.0.0.1");
+	stats.setGeneration(1);
+	stats.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 1500));
+	stats.addPacket(TestPacket("127.0.0.1", "10.0.0.1", 100));
+	stats.addPacket(TestPacket("10.0.0.2", "127.0.0.1", 60));
+
+	AnalyzerHealth health;
+	health.queueDrops = 7;
+	health.hasPcap = true;
+	health.pcapDrops = 3;
+
+	MetricsExposition exposition;
+	std::string out;
+	exposition.write(stats.clone(), health, out);
+
+	EXPECT_EQ(1, countOf(out, "# TYPE traffic_analyzer_host_bytes_total counter\n"));
+	EXPECT_EQ(1, countOf(out, "# TYPE traffic_analyzer_host_packets_total counter\n"));
+	EXPECT_NE(std::string::npos, out.find("traffic_analyzer_host_bytes_total{host=\"10.0.0.1\",name=\"\",direction=\"in\"} 1500\n"));
+	EXPECT_NE(std::string::npos, out.find("traffic_analyzer_host_bytes_total{host=\"10.0.0.1\",name=\"\",direction=\"out\"} 100\n"));
+	EXPECT_NE(std::string::npos, out.find("traffic_analyzer_host_packets_total{host=\"10.0.0.2\",name=\"\",direction=\"in\"} 1\n"));
+	EXPECT_NE(std::string::npos, out.find("traffic_analyzer_hosts 2\n"));
+	EXPECT_NE(std::string::npos, out.find("traffic_analyzer_queue_dropped_packets_total 7\n"));
+	EXPECT_NE(std::string::npos, out.find("traffic_analyzer_pcap_dropped_packets_total 3\n"));
+
+	// Кольца и кэш DNS не используются, их показатели не выводятся
+	EXPECT_EQ(std::string::npos, out.find("traffic_analyzer_ring_"));
+	EXPECT_EQ(std::string::npos, out.find("traffic_analyzer_dns_cache_"));
+
+	// Все серии одного семейства идут подряд после его заголовка
+	EXPECT_LT(out.rfind("traffic_analyzer_host_bytes_total{"), out.find("# HELP traffic_analyzer_host_packets_total"));
+}
+
+TEST(MetricsExpositionTest, RendersOnlyChangedHosts)
+{
+	HttpTrafficStats stats("127.0.0.1");
+	stats.setGeneration(1);
+	stats.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 1500));
+	stats.addPacket(TestPacket("10.0.0.2", "127.0.0.1", 60));
+
+	MetricsExposition exposition;
+	std::string out;
+
+	std::shared_ptr<const ITrafficStats> snapshot = stats.clone();
+	exposition.write(snapshot, AnalyzerHealth(), out);
+	EXPECT_EQ(2, exposition.getRenderedHosts());
+
+	// Та же копия статистики: ответ собирается без обхода хостов и совпадает с прошлым
+	std::string repeated;
+	exposition.write(snapshot, AnalyzerHealth(), repeated);
+	EXPECT_EQ(out, repeated);
+
+	stats.setGeneration(2);
+	stats.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 500));
+
+	out.clear();
+	exposition.write(stats.clone(), AnalyzerHealth(), out);
+	EXPECT_EQ(1, exposition.getRenderedHosts());
+	EXPECT_NE(std::string::npos, out.find("{host=\"10.0.0.1\",name=\"\",direction=\"in\"} 2000\n"));
+	EXPECT_NE(std::string::npos, out.find("{host=\"10.0.0.2\",name=\"\",direction=\"in\"} 60\n"));
+
+	// Хосты, исчезнувшие из статистики, удаляются и из вывода
+	stats.clear();
+	stats.setGeneration(3);
+	stats.addPacket(TestPacket("10.0.0.2", "127.0.0.1", 60));
+
+	out.clear();
+	exposition.write(stats.clone(), AnalyzerHealth(), out);
+	EXPECT_EQ(1, exposition.size());
+	EXPECT_EQ(std::string::npos, out.find("10.0.0.1"));
+}
+
+TEST(MetricsExpositionTest, RendersCopiesReusedByPublisher)
+{
+	HttpTrafficStats stats("127.0.0.1");
+	stats.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 100));
+
+	SnapshotPolicy policy;
+	policy.period = std::chrono::hours(1);
+	SnapshotPublisher publisher(stats, policy);
+
+	MetricsExposition exposition;
+	std::string out;
+	exposition.write(publisher.get(), AnalyzerHealth(), out);
+	EXPECT_NE(std::string::npos, out.find("{host=\"10.0.0.1\",name=\"\",direction=\"in\"} 100\n"));
+
+	// Вторая публикация без запросов между ними обновляет первую копию, отпущенную читателями
+	stats.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 900));
+	publisher.publish(stats);
+	stats.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 1000));
+	publisher.publish(stats);
+
+	out.clear();
+	exposition.write(publisher.get(), AnalyzerHealth(), out);
+	EXPECT_NE(std::string::npos, out.find("{host=\"10.0.0.1\",name=\"\",direction=\"in\"} 2000\n"));
+	EXPECT_EQ(1, exposition.getRenderedHosts());
+
+	stats.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 3000));
+	publisher.publish(stats);
+	publisher.publish(stats);
+
+	out.clear();
+	exposition.write(publisher.get(), AnalyzerHealth(), out);
+	EXPECT_NE(std::string::npos, out.find("{host=\"10.0.0.1\",name=\"\",direction=\"in\"} 5000\n"));
+}
+
+TEST(MetricsExpositionTest, EscapesLabelValues)
+{
+	// Имя с кавычкой и обратной косой чертой, полученное, например, из SNI
+	HostInfo hostInfo;
+	hostInfo.generation = 1;
+	hostInfo.nameId = NameArena::instance().intern("bad\"name\\");
+	hostInfo.addPacket(100, true);
+
+	// Статистика из одного хоста с заданной записью
+	class SingleHost : public HttpTrafficStats
+	{
+	public:
+		HostInfo host;
+		using HttpTrafficStats::HttpTrafficStats;
+
+		void visitHosts(IHostVisitor &visitor) const override { visitor.onHost(IpKey::fromString("10.0.0.3"), host, host.nameId); }
+	};
+
+	auto named = std::make_shared<SingleHost>("127.0.0.1");
+	named->host = hostInfo;
+
+	MetricsExposition exposition;
+	std::string out;
+	exposition.write(named, AnalyzerHealth(), out);
+	EXPECT_NE(std::string::npos, out.find("{host=\"10.0.0.3\",name=\"bad\\\"name\\\\\",direction=\"in\"} 100\n"));
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+
+#include "../source/NameArena.h"
+#include "../source/NameTotals.h"
+
+TEST(NameArenaTest, InternsEachNameOnce)
+{
+	NameArena arena;
+
+	std::uint32_t example = arena.intern("example.com");
+	std::uint32_t cdn = arena.intern("cdn.example.com");
+
+	EXPECT_NE(NameArena::noName, example);
+	EXPECT_NE(example, cdn);
+	EXPECT_EQ(example, arena.intern(std::string("example.com")));
+	EXPECT_EQ(2, arena.size());
+
+	EXPECT_EQ("example.com", arena.view(example));
+	EXPECT_EQ("cdn.example.com", arena.view(cdn));
+	EXPECT_EQ(cdn, arena.find("cdn.example.com"));
+	EXPECT_EQ(NameArena::noName, arena.find("other.example.com"));
+
+	EXPECT_EQ(NameArena::noName, arena.intern(""));
+	EXPECT_TRUE(arena.view(NameArena::noName).empty());
+}
+
+TEST(NameArenaTest, ViewsStayValidAcrossBlocks)
+{
+	NameArena arena;
+	std::vector<std::uint32_t> ids;
+
+	// Больше, чем помещается в один блок символов и один блок индекса номеров
+	for (int i = 0; i < 10000; i++)
+		ids.push_back(arena.intern("host-" + std::to_string(i) + ".example.com"));
+
+	std::string_view first = arena.view(ids.front());
+	for (int i = 0; i < 10000; i++)
+		EXPECT_EQ("host-" + std::to_string(i) + ".example.com", arena.view(ids[i]));
+
+	EXPECT_EQ("host-0.example.com", first);
+	EXPECT_GT(arena.memoryUsage(), NameArena::blockSize);
+}
+
+TEST(NameArenaTest, LongNamesAreTruncated)
+{
+	NameArena arena;
+	std::string name(1000, 'a');
+
+	std::uint32_t id = arena.intern(name);
+	EXPECT_EQ(NameArena::maxNameLength, arena.view(id).size());
+	EXPECT_EQ(id, arena.intern(name));
+}
+
+TEST(NameTotalsTest, GroupsHostsByName)
+{
+	std::uint32_t cdn = NameArena::instance().intern("cdn.example.com");
+	std::uint32_t mail = NameArena::instance().intern("mail.example.com");
+
+	NameTotals totals;
+	HostInfo host;
+
+	host.nameId = cdn;
+	host.addPacket(1000, true);
+	totals.add(host);
+	totals.add(host);
+
+	host.nameId = mail;
+	host.activeFlows = 2;
+	totals.add(host);
+
+	totals.add(HostInfo());
+
+	EXPECT_EQ(2, totals.size());
+	EXPECT_EQ(1, totals.getUnnamedHosts());
+
+	std::string out;
+	totals.writeJson(out, 5);
+	auto json = nlohmann::json::parse(out);
+
+	EXPECT_EQ(5, json["generation"]);
+	EXPECT_EQ(1, json["unnamedHosts"]);
+	ASSERT_EQ(2, json["names"].size());
+	EXPECT_EQ("cdn.example.com", json["names"][0]["name"]);
+	EXPECT_EQ(2, json["names"][0]["hosts"]);
+	EXPECT_EQ(2000, json["names"][0]["traffic"]["in"]);
+	EXPECT_EQ("mail.example.com", json["names"][1]["name"]);
+	EXPECT_EQ(2, json["names"][1]["flows"]["active"]);
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <gtest/gtest.h>
+#include <chrono>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "../source/PacketRing.h"
+
+namespace
+{
+	/// \brief Отправляет count UDP датаграмм на 127.0.0.1:port
+	void sendUdp(std::uint16_t port, int count)
+	{
+		int fd = socket(AF_INET, SOCK_DGRAM, 0);
+		ASSERT_GE(fd, 0);
+
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		const char payload[] = "packet ring test";
+		for (int i = 0; i < count; i++)
+			sendto(fd, payload, sizeof(payload), 0, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+
+		close(fd);
+	}
+}
+
+TEST(PacketRingTest, ReceivesLoopbackPacketsOnce)
+{
+	PacketRingConfig config;
+	config.blockSize = 1 << 16;
+	config.blocksCount = 4;
+	config.ringsCount = 1;
+
+	const std::uint16_t port = 47811;
+	PacketRing ring;
+	std::string errorInfo;
+
+	// Для AF_PACKET нужны права CAP_NET_RAW
+	if (!ring.open("lo", config, "udp port " + std::to_string(port), errorInfo))
+		GTEST_SKIP() << errorInfo;
+
+	sendUdp(port, 100);
+
+	int received = 0;
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+	while (received < 100 && std::chrono::steady_clock::now() < deadline)
+		ring.poll(10, [&received](const PacketRingFrame &frame)
+				  {
+					  EXPECT_GT(frame.length, 0u);
+					  EXPECT_GT(frame.timestamp.tv_sec, 0);
+					  received++; });
+
+	EXPECT_EQ(100, received);
+
+	// Последние счетчики ядра поток кольца забирает при закрытии
+	ring.close();
+	EXPECT_GE(ring.getStats().packets, 100u);
+	EXPECT_EQ(0u, ring.getStats().drops);
+}
+
+TEST(PacketRingTest, UnknownInterfaceFails)
+{
+	PacketRingConfig config;
+	config.ringsCount = 1;
+
+	PacketRing ring;
+	std::string errorInfo;
+	EXPECT_FALSE(ring.open("no-such-interface0", config, "", errorInfo));
+	EXPECT_FALSE(errorInfo.empty());
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <gtest/gtest.h>
+#include <thread>
+
+#include <nlohmann/json.hpp>
+
+#include "../source/PerfCounters.h"
+
+TEST(LatencyHistogramTest, BucketsKeepRelativeError)
+{
+	for (std::uint64_t value : std::initializer_list<std::uint64_t>{0, 1, 15, 16, 17, 100, 1000, 123456789, 1ull << 40, UINT64_MAX})
+	{
+		std::size_t bucket = LatencyHistogram::bucketOf(value);
+		ASSERT_LT(bucket, LatencyHistogram::bucketsCount);
+
+		std::uint64_t upper = LatencyHistogram::upperBoundOf(bucket);
+		EXPECT_GE(upper, value);
+		EXPECT_LE(upper - value, value / LatencyHistogram::subBuckets);
+	}
+
+	// Корзины идут подряд без пропусков
+	for (std::uint64_t value = 1; value < 100000; value++)
+		ASSERT_LE(LatencyHistogram::bucketOf(value) - LatencyHistogram::bucketOf(value - 1), 1u);
+}
+
+TEST(LatencyHistogramTest, ReportsQuantiles)
+{
+	LatencyHistogram histogram;
+
+	for (std::uint64_t i = 1; i <= 1000; i++)
+		histogram.record(i, 2);
+
+	EXPECT_EQ(1000, histogram.getCalls());
+	EXPECT_EQ(2000, histogram.getItems());
+	EXPECT_EQ(1000, histogram.getMaxTicks());
+	EXPECT_EQ(500500, histogram.getTotalTicks());
+
+	std::uint64_t median = histogram.valueAt(0.5);
+	EXPECT_GE(median, 500);
+	EXPECT_LE(median, 500 + 500 / LatencyHistogram::subBuckets);
+	EXPECT_EQ(1000, histogram.valueAt(1.0));
+	EXPECT_EQ(0, LatencyHistogram().valueAt(0.99));
+}
+
+TEST(PerfRegistryTest, KeepsStagesPerThread)
+{
+	std::thread worker([]
+					   {
+						   PerfRegistry::instance().nameThread("perf-test");
+						   PerfThread &thread = PerfRegistry::instance().local();
+						   thread.at(PerfStage::stats).record(100, 64);
+
+						   // Из каждых sampleEvery вызовов замеряется один
+						   std::uint32_t sampled = 0;
+						   for (std::uint32_t i = 0; i < PerfRegistry::sampleEvery * 4; i++)
+							   sampled += PerfRegistry::shouldSample(thread);
+						   EXPECT_EQ(4, sampled); });
+	worker.join();
+
+	std::string out;
+	JsonWriter json(out);
+	PerfRegistry::instance().writeJson(json);
+
+	auto threads = nlohmann::json::parse(out);
+	bool isFound = false;
+	for (const auto &thread : threads)
+		if (thread["thread"] == "perf-test")
+		{
+			isFound = true;
+			ASSERT_EQ(1, thread["stages"].size());
+			EXPECT_EQ("stats", thread["stages"][0]["stage"]);
+			EXPECT_EQ(64, thread["stages"][0]["packets"]);
+		}
+
+	EXPECT_TRUE(isFound);
+	EXPECT_NE(std::string::npos, PerfRegistry::instance().toString().find("perf-test"));
+}
@@ -0,0 +1,153 @@
+#pragma once
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "../source/RateHistory.h"
+#include "TestPacket.h"
+
+namespace
+{
+	RateHistoryConfig rateConfig(std::int64_t resolution, std::int64_t retention, std::size_t hosts)
+	{
+		return {std::chrono::seconds(resolution), std::chrono::seconds(retention), hosts};
+	}
+}
+
+TEST(RateHistoryTest, CountsPerInterval)
+{
+	RateHistory history(rateConfig(1, 60, 4), "127.0.0.1");
+
+	history.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 100).at(1000));
+	history.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 100).at(1000));
+	history.addPacket(TestPacket("10.0.0.2", "127.0.0.1", 50).at(1001));
+	history.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 300).at(1003));
+
+	EXPECT_EQ(1003, history.getLatestTick());
+	ASSERT_EQ(2, history.getHostsCount());
+
+	std::vector<std::uint64_t> bytes(4, 0), packets(4, 0);
+	EXPECT_TRUE(history.collect(history.findHost(IpKey::fromString("10.0.0.1")), 1003, 4, bytes.data(), packets.data()));
+	EXPECT_EQ((std::vector<std::uint64_t>{200, 0, 0, 300}), bytes);
+	EXPECT_EQ((std::vector<std::uint64_t>{2, 0, 0, 1}), packets);
+
+	RateSummary total;
+	history.sumTotal(1002, 3, total);
+	EXPECT_EQ(250, total.bytes);
+	EXPECT_EQ(3, total.packets);
+	EXPECT_EQ(200, total.peakBytes);
+	EXPECT_EQ(2, total.peakPackets);
+}
+
+TEST(RateHistoryTest, OldIntervalsAreOverwritten)
+{
+	RateHistory history(rateConfig(10, 100, 4), "127.0.0.1");
+	ASSERT_EQ(10, history.getSlotsCount());
+
+	history.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 100).at(0));
+	history.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 100).at(95));
+	history.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 100).at(1000));
+
+	RateSummary summary;
+	std::vector<RateHistory::Row> rows{history.findHost(IpKey::fromString("10.0.0.1"))};
+	RateHistory::sumRows(rows, 100, 100, summary);
+	EXPECT_EQ(100, summary.bytes);
+
+	// Интервал 9 (время 90-99) вышел за глубину истории после перехода к интервалу 100
+	std::vector<std::uint64_t> bytes(2, 0), packets(2, 0);
+	history.collect(rows[0], 9, 2, bytes.data(), packets.data());
+	EXPECT_EQ((std::vector<std::uint64_t>{0, 0}), bytes);
+}
+
+TEST(RateHistoryTest, HostsOverCapacityCountOnlyInTotal)
+{
+	RateHistory history(rateConfig(1, 60, 1), "127.0.0.1");
+
+	history.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 100).at(10));
+	history.addPacket(TestPacket("10.0.0.2", "127.0.0.1", 100).at(10));
+
+	EXPECT_EQ(1, history.getHostsCount());
+	EXPECT_EQ(RateHistory::npos, history.findHost(IpKey::fromString("10.0.0.2")).index);
+
+	RateSummary total;
+	history.sumTotal(10, 1, total);
+	EXPECT_EQ(200, total.bytes);
+}
+
+TEST(RateHistoryTest, IdleAndClearedRowsAreReused)
+{
+	RateHistory history(rateConfig(1, 10, 1), "127.0.0.1");
+	const IpKey first = IpKey::fromString("10.0.0.1");
+	const IpKey second = IpKey::fromString("10.0.0.2");
+
+	history.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 100).at(100));
+	RateHistory::Row firstRow = history.findHost(first);
+
+	// Пока у первого хоста есть трафик в истории, его строка не выдается
+	history.addPacket(TestPacket("10.0.0.2", "127.0.0.1", 100).at(109));
+	EXPECT_EQ(RateHistory::npos, history.findHost(second).index);
+
+	history.addPacket(TestPacket("10.0.0.2", "127.0.0.1", 100).at(110));
+	EXPECT_EQ(RateHistory::npos, history.findHost(first).index);
+	ASSERT_EQ(0, history.findHost(second).index);
+	EXPECT_EQ(1, history.getHostsCount());
+
+	// Строку, прочитанную до передачи другому хосту, читатель не учитывает
+	std::vector<std::uint64_t> bytes(1, 0), packets(1, 0);
+	EXPECT_FALSE(history.collect(firstRow, 110, 1, bytes.data(), packets.data()));
+	EXPECT_TRUE(history.collect(history.findHost(second), 110, 1, bytes.data(), packets.data()));
+	EXPECT_EQ(100, bytes[0]);
+
+	history.clear();
+	RateSummary cleared;
+	history.sumTotal(110, 1, cleared);
+	EXPECT_EQ(0, cleared.bytes);
+	EXPECT_EQ(0, history.getHostsCount());
+
+	history.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 100).at(111));
+	EXPECT_EQ(0, history.findHost(first).index);
+}
+
+TEST(RateHistoryTest, PeaksOfSeveralHistoriesSumIntervalsFirst)
+{
+	RateHistory first(rateConfig(1, 60, 4), "127.0.0.1");
+	RateHistory second(rateConfig(1, 60, 4), "127.0.0.1");
+
+	// Пакеты хоста пришли к двум писателям в одних и тех же интервалах
+	first.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 100).at(10));
+	first.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 20).at(11));
+	second.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 100).at(10));
+	second.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 150).at(11));
+	first.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 1).at(12));
+	second.addPacket(TestPacket("10.0.0.1", "127.0.0.1", 1).at(12));
+
+	const IpKey hostKey = IpKey::fromString("10.0.0.1");
+	std::vector<RateHistory::Row> rows{first.findHost(hostKey), second.findHost(hostKey)};
+	RateSummary host;
+	RateHistory::sumRows(rows, 11, 2, host);
+	EXPECT_EQ(370, host.bytes);
+	EXPECT_EQ(4, host.packets);
+	EXPECT_EQ(200, host.peakBytes);
+	EXPECT_EQ(2, host.peakPackets);
+
+	rows = {first.totalRow(), second.totalRow()};
+	RateSummary total;
+	RateHistory::sumRows(rows, 11, 2, total);
+	EXPECT_EQ(200, total.peakBytes);
+}
+
+TEST(RateHistoryTest, IntervalsHoldMoreThan4GiB)
+{
+	RateHistory history(rateConfig(60, 3600, 4), "127.0.0.1");
+
+	// Минута канала 10 Гбит/с: 75 ГБ, при выборочном учете пакет представляет weight пакетов
+	PacketView packet = TestPacket("10.0.0.1", "127.0.0.1", 1500).at(600);
+	packet.weight = 50000;
+	for (int i = 0; i < 1000; i++)
+		history.addPacket(packet);
+
+	RateSummary summary;
+	std::vector<RateHistory::Row> rows{history.findHost(IpKey::fromString("10.0.0.1"))};
+	RateHistory::sumRows(rows, 10, 1, summary);
+	EXPECT_EQ(75000000000ULL, summary.bytes);
+	EXPECT_EQ(50000000ULL, summary.packets);
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include <gtest/gtest.h>
+
+#include <vector>
+#include <cstdint>
+
+#include "../source/RawPacketParser.h"
+
+/// \brief Собирает байты Ethernet кадра с IPv4/TCP заголовками и данными payload
+static std::vector<std::uint8_t> makeIPv4TcpFrame(const std::string &payload, bool withVlan)
+{
+	std::vector<std::uint8_t> frame(12, 0xAA);
+
+	if (withVlan)
+		frame.insert(frame.end(), {0x81, 0x00, 0x00, 0x0A});
+
+	frame.insert(frame.end(), {0x08, 0x00});
+
+	std::uint16_t totalLength = 20 + 20 + payload.size();
+	frame.insert(frame.end(), {0x45, 0x00, static_cast<std::uint8_t>(totalLength >> 8), static_cast<std::uint8_t>(totalLength),
+							   0x00, 0x00, 0x40, 0x00, 0x40, 0x06, 0x00, 0x00,
+							   192, 168, 1, 10,
+							   93, 184, 216, 34});
+
+	frame.insert(frame.end(), {0xC3, 0x50, 0x00, 0x50,
+							   0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+							   0x50, 0x18, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00});
+
+	frame.insert(frame.end(), payload.begin(), payload.end());
+	return frame;
+}
+
+TEST(RawPacketParserTest, ParseIPv4Tcp)
+{
+	auto frame = makeIPv4TcpFrame("GET / HTTP/1.1\r\n", false);
+
+	PacketView view;
+	ASSERT_TRUE(RawPacketParser::parse(frame.data(), frame.size(), pcpp::LINKTYPE_ETHERNET, {}, view));
+
+	EXPECT_EQ("192.168.1.10", view.srcIp.toString());
+	EXPECT_EQ("93.184.216.34", view.dstIp.toString());
+	EXPECT_TRUE(view.isTcp());
+	EXPECT_EQ(50000, view.srcPort);
+	EXPECT_EQ(80, view.dstPort);
+	EXPECT_EQ(0x18, view.tcpFlags);
+	EXPECT_EQ(frame.size(), view.length);
+	ASSERT_EQ(16, view.payloadLength);
+	EXPECT_EQ(0, std::memcmp(view.payload, "GET ", 4));
+}
+
+TEST(RawPacketParserTest, ParseVlanTagged)
+{
+	auto frame = makeIPv4TcpFrame("", true);
+
+	PacketView view;
+	ASSERT_TRUE(RawPacketParser::parse(frame.data(), frame.size(), pcpp::LINKTYPE_ETHERNET, {}, view));
+
+	EXPECT_EQ("192.168.1.10", view.srcIp.toString());
+	EXPECT_EQ(80, view.dstPort);
+	EXPECT_EQ(0, view.payloadLength);
+	EXPECT_EQ(nullptr, view.payload);
+}
+
+TEST(RawPacketParserTest, ParseRawIPv6Udp)
+{
+	std::vector<std::uint8_t> packet = {0x60, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x11, 0x40};
+	auto src = IpKey::fromString("2001:db8::1");
+	auto dst = IpKey::fromString("2001:db8::2");
+	packet.insert(packet.end(), src.bytes.begin(), src.bytes.end());
+	packet.insert(packet.end(), dst.bytes.begin(), dst.bytes.end());
+	packet.insert(packet.end(), {0x00, 0x35, 0xD4, 0x31, 0x00, 0x0C, 0x00, 0x00, 'a', 'b', 'c', 'd'});
+
+	PacketView view;
+	ASSERT_TRUE(RawPacketParser::parse(packet.data(), packet.size(), pcpp::LINKTYPE_RAW, {}, view));
+
+	EXPECT_EQ(src, view.srcIp);
+	EXPECT_EQ(dst, view.dstIp);
+	EXPECT_TRUE(view.isUdp());
+	EXPECT_EQ(53, view.srcPort);
+	EXPECT_EQ(4, view.payloadLength);
+}
+
+TEST(RawPacketParserTest, ParseIPv6TcpAfterAuthenticationHeader)
+{
+	// Hop-by-Hop (8 байт), затем AH с ICV 12 байт: длина (4 + 2) * 4 = 24 байта
+	std::vector<std::uint8_t> extensions = {51, 0, 0x01, 0x04, 0x00, 0x00, 0x00, 0x00,
+											6, 4, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x01};
+	extensions.insert(extensions.end(), 12, 0xEE);
+
+	std::vector<std::uint8_t> tcp = {0xC3, 0x50, 0x01, 0xBB,
+									 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+									 0x50, 0x02, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00};
+
+	std::uint16_t payloadLength = static_cast<std::uint16_t>(extensions.size() + tcp.size());
+	std::vector<std::uint8_t> packet = {0x60, 0x00, 0x00, 0x00, static_cast<std::uint8_t>(payloadLength >> 8),
+										static_cast<std::uint8_t>(payloadLength), 0x00, 0x40};
+	auto src = IpKey::fromString("2001:db8::1");
+	auto dst = IpKey::fromString("2001:db8::2");
+	packet.insert(packet.end(), src.bytes.begin(), src.bytes.end());
+	packet.insert(packet.end(), dst.bytes.begin(), dst.bytes.end());
+	packet.insert(packet.end(), extensions.begin(), extensions.end());
+	packet.insert(packet.end(), tcp.begin(), tcp.end());
+
+	PacketView view;
+	ASSERT_TRUE(RawPacketParser::parse(packet.data(), packet.size(), pcpp::LINKTYPE_RAW, {}, view));
+
+	EXPECT_TRUE(view.isTcp());
+	EXPECT_EQ(50000, view.srcPort);
+	EXPECT_EQ(443, view.dstPort);
+	EXPECT_EQ(0x02, view.tcpFlags);
+	EXPECT_EQ(0, view.payloadLength);
+}
+
+TEST(RawPacketParserTest, NonIpPacket)
+{
+	std::vector<std::uint8_t> arpFrame(42, 0);
+	arpFrame[12] = 0x08;
+	arpFrame[13] = 0x06;
+
+	PacketView view;
+	EXPECT_FALSE(RawPacketParser::parse(arpFrame.data(), arpFrame.size(), pcpp::LINKTYPE_ETHERNET, {}, view));
+	EXPECT_TRUE(view.srcIp.empty());
+	EXPECT_EQ(42, view.length);
+}
+
+TEST(RawPacketParserTest, FlowHashIsSymmetric)
+{
+	auto frame = makeIPv4TcpFrame("", false);
+	auto reversed = frame;
+	std::swap_ranges(reversed.begin() + 26, reversed.begin() + 30, reversed.begin() + 30);
+
+	pcpp::RawPacket packet(frame.data(), frame.size(), timespec{}, false);
+	pcpp::RawPacket reversedPacket(reversed.data(), reversed.size(), timespec{}, false);
+
+	EXPECT_EQ(RawPacketParser::flowHash(packet), RawPacketParser::flowHash(reversedPacket));
+}
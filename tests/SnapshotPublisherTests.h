@@ -0,0 +1,184 @@
+#pragma once
+#include <gtest/gtest.h>
+
+#include "../source/SnapshotPublisher.h"
+#include "../source/HttpTrafficStats.h"
+#include "../source/CaptureWorker.h"
+
+struct SnapshotPublisherClassTest : public testing::Test
+{
+	HttpTrafficStats stats{"127.0.0.1"};
+
+	void addPacket(SnapshotPublisher &publisher)
+	{
+		PacketView view;
+		view.srcIp = IpKey::fromString("10.1.1.1");
+		view.dstIp = IpKey::fromString("127.0.0.1");
+		view.length = 100;
+
+		stats.addPacket(view);
+		publisher.onPacket(stats);
+	}
+};
+
+TEST_F(SnapshotPublisherClassTest, PublishByPacketsCount)
+{
+	SnapshotPublisher publisher(stats, {std::chrono::hours(1), 3});
+	EXPECT_EQ("", publisher.get()->toString());
+
+	addPacket(publisher);
+	addPacket(publisher);
+	EXPECT_EQ("", publisher.get()->toString());
+
+	addPacket(publisher);
+	EXPECT_EQ(stats.toString(), publisher.get()->toString());
+}
+
+TEST_F(SnapshotPublisherClassTest, PublishByPacketsCountInBatches)
+{
+	SnapshotPublisher publisher(stats, {std::chrono::hours(1), 100});
+
+	publisher.onPackets(stats, 64);
+	EXPECT_EQ("", publisher.get()->toString());
+
+	addPacket(publisher);
+	publisher.onPackets(stats, 35);
+	EXPECT_EQ(stats.toString(), publisher.get()->toString());
+}
+
+TEST_F(SnapshotPublisherClassTest, SnapshotIsImmutable)
+{
+	SnapshotPublisher publisher(stats, {std::chrono::hours(1), 1});
+
+	addPacket(publisher);
+	auto snapshot = publisher.get();
+	std::string published = snapshot->toString();
+
+	addPacket(publisher);
+	EXPECT_EQ(published, snapshot->toString());
+	EXPECT_NE(published, publisher.get()->toString());
+}
+
+TEST_F(SnapshotPublisherClassTest, IdlePublishAfterPeriod)
+{
+	SnapshotPublisher publisher(stats, {std::chrono::milliseconds(1), 0});
+
+	addPacket(publisher);
+	std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	publisher.onIdle(stats);
+
+	EXPECT_EQ(stats.toString(), publisher.get()->toString());
+}
+
+TEST_F(SnapshotPublisherClassTest, IdleTimerPublishesAfterTrafficStops)
+{
+	SnapshotPublisher publisher(stats, {std::chrono::milliseconds(10), 0});
+	std::mutex writerMutex;
+
+	{
+		std::lock_guard<std::mutex> writer(writerMutex);
+		addPacket(publisher);
+		addPacket(publisher);
+	}
+
+	// Пакетов больше нет, и писатель сам не проверяет возраст копии
+	EXPECT_EQ("", publisher.get()->toString());
+
+	IdlePublishTimer timer;
+	timer.start(std::chrono::milliseconds(10), [&]
+				{
+					std::unique_lock<std::mutex> writer(writerMutex, std::try_to_lock);
+					if (writer.owns_lock())
+						publisher.onIdle(stats); });
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (publisher.get()->toString().empty() && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+	timer.stop();
+
+	std::lock_guard<std::mutex> writer(writerMutex);
+	EXPECT_EQ(stats.toString(), publisher.get()->toString());
+}
+
+TEST_F(SnapshotPublisherClassTest, IdleTimerPublishesFedWorkerShard)
+{
+	CaptureWorker worker(std::make_unique<HttpTrafficStats>("127.0.0.1"), {std::chrono::milliseconds(10), 0});
+	std::mutex feedMutex;
+	worker.beginFeed();
+
+	PacketView view;
+	view.srcIp = IpKey::fromString("10.1.1.1");
+	view.dstIp = IpKey::fromString("127.0.0.1");
+	view.length = 100;
+
+	{
+		std::lock_guard<std::mutex> feed(feedMutex);
+		worker.feed(view);
+	}
+
+	EXPECT_EQ("", worker.getSnapshot()->toString());
+
+	// Как поток захвата тихого интерфейса: пакетов нет, копию публикует только таймер
+	IdlePublishTimer timer;
+	timer.start(std::chrono::milliseconds(10), [&]
+				{
+					std::unique_lock<std::mutex> feed(feedMutex, std::try_to_lock);
+					if (feed.owns_lock())
+						worker.feedIdle(); });
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (worker.getSnapshot()->toString().empty() && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+	EXPECT_NE(std::string::npos, worker.getSnapshot()->toString().find("10.1.1.1"));
+
+	timer.stop();
+	worker.endFeed();
+}
+
+TEST_F(SnapshotPublisherClassTest, PublishReusesReleasedCopy)
+{
+	SnapshotPublisher publisher(stats, {std::chrono::hours(1), 0});
+
+	auto addHostPacket = [this](const std::string &ip, std::uint32_t length)
+	{
+		PacketView view;
+		view.srcIp = IpKey::fromString(ip);
+		view.dstIp = IpKey::fromString("127.0.0.1");
+		view.length = length;
+		stats.addPacket(view);
+	};
+
+	std::shared_ptr<const ITrafficStats> held;
+	std::string heldJson;
+	const ITrafficStats *published[8] = {};
+
+	for (int round = 0; round < 8; round++)
+	{
+		addHostPacket("10.2.0." + std::to_string(round), 100);
+		addHostPacket("10.1.1.1", 50 + round);
+
+		// Очистка обнуляет журналы изменений: следующие копии делаются целиком
+		if (round == 4)
+			stats.clear();
+
+		auto expected = stats.clone();
+		publisher.publish(stats);
+
+		auto snapshot = publisher.get();
+		published[round] = snapshot.get();
+		EXPECT_EQ(expected->toJsonString(), snapshot->toJsonString()) << "round " << round;
+
+		// Читатель держит копию второго раунда, поэтому она не переиспользуется
+		if (round == 1)
+		{
+			held = snapshot;
+			heldJson = held->toJsonString();
+		}
+	}
+
+	EXPECT_EQ(published[0], published[2]);
+	EXPECT_NE(published[1], published[3]);
+	EXPECT_EQ(heldJson, held->toJsonString());
+}
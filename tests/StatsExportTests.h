@@ -0,0 +1,209 @@
+#pragma once
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+
+#include "../source/StatsExport.h"
+
+namespace
+{
+	/// \brief Статистика хостов, которую StatsExporter получает вместо копии статистики анализатора
+	struct ExportedHostsSource
+	{
+		std::vector<std::pair<IpKey, HostInfo>> hosts;
+
+		HostInfo &add(const char *ip, const char *name = nullptr)
+		{
+			hosts.push_back({IpKey::fromString(ip), HostInfo()});
+			if (name)
+				hosts.back().second.nameId = NameArena::instance().intern(name);
+
+			return hosts.back().second;
+		}
+
+		StatsExporter::HostsSource source()
+		{
+			return [this](IHostVisitor &visitor)
+			{
+				for (const auto &[host, hostInfo] : hosts)
+					visitor.onHost(host, hostInfo, hostInfo.nameId);
+			};
+		}
+	};
+
+	std::vector<ExportedInterval> readExported(const std::string &directory, std::int64_t from = 0, std::int64_t to = INT64_MAX)
+	{
+		std::vector<ExportedInterval> intervals;
+		std::string errorInfo;
+		StatsExportReader reader;
+
+		EXPECT_TRUE(reader.read(directory, from, to, [&intervals](const ExportedInterval &interval)
+								{ intervals.push_back(interval); },
+								errorInfo))
+			<< errorInfo;
+		return intervals;
+	}
+
+	const ExportedHost *findExported(const ExportedInterval &interval, const char *ip)
+	{
+		for (const auto &host : interval.hosts)
+			if (host.host == IpKey::fromString(ip))
+				return &host;
+
+		return nullptr;
+	}
+}
+
+TEST(StatsExportTest, ZeroRunsRoundTrip)
+{
+	std::vector<std::uint8_t> records(StatsExportFormat::recordSize * 300, 0);
+	for (std::size_t i = 0; i < records.size(); i += 7)
+		records[i] = static_cast<std::uint8_t>(i * 31 + 1);
+
+	// Серия ненулевых байтов длиннее одного литерала и одиночный ноль в конце
+	for (std::size_t i = 1000; i < 1300; i++)
+		records[i] = 0xAB;
+	records.back() = 0;
+
+	std::vector<std::uint8_t> shuffled, encoded, decoded;
+	StatsExportFormat::encodeZeroRuns(records.data(), records.size(), shuffled, encoded);
+	ASSERT_TRUE(StatsExportFormat::decodeZeroRuns(encoded.data(), encoded.size(), records.size(), shuffled, decoded));
+	EXPECT_EQ(records, decoded);
+
+	// Типичные записи хостов: малые приросты и пустые старшие байты
+	std::vector<std::uint8_t> hosts(StatsExportFormat::recordSize * 1000, 0);
+	for (std::size_t i = 0; i < 1000; i++)
+	{
+		StatsExportFormat::HostRecord record{};
+		record.kind = StatsExportFormat::host;
+		record.addressLength = 4;
+		record.address[0] = 10;
+		record.address[3] = static_cast<std::uint8_t>(i);
+		record.inPackets = i % 50;
+		record.inTraffic = (i % 50) * 1400;
+		std::memcpy(hosts.data() + i * StatsExportFormat::recordSize, &record, sizeof(record));
+	}
+
+	StatsExportFormat::encodeZeroRuns(hosts.data(), hosts.size(), shuffled, encoded);
+	EXPECT_LT(encoded.size() * 4, hosts.size());
+	ASSERT_TRUE(StatsExportFormat::decodeZeroRuns(encoded.data(), encoded.size(), hosts.size(), shuffled, decoded));
+	EXPECT_EQ(hosts, decoded);
+
+	// Поврежденные данные не читаются за пределами буфера
+	encoded.resize(encoded.size() / 2);
+	EXPECT_FALSE(StatsExportFormat::decodeZeroRuns(encoded.data(), encoded.size(), hosts.size(), shuffled, decoded));
+}
+
+TEST(StatsExportTest, WritesDeltasAndReadsTimeRange)
+{
+	const std::string directory = "/tmp/stats-export-test";
+	std::filesystem::remove_all(directory);
+
+	StatsExportConfig config;
+	config.directory = directory;
+	config.period = std::chrono::hours(1);
+	config.maxFiles = 2;
+
+	ExportedHostsSource hosts;
+	hosts.add("10.0.0.1").inPackets = 10;
+
+	// Счетчики на момент запуска не выгружаются, выгружается только прирост после запуска
+	StatsExporter exporter;
+	std::string errorInfo;
+	ASSERT_TRUE(exporter.start(config, hosts.source(), errorInfo)) << errorInfo;
+
+	hosts.hosts[0].second.inPackets = 15;
+	hosts.hosts[0].second.inTraffic = 1500;
+	HostInfo &named = hosts.add("10.0.0.2", "example.com");
+	named.outPackets = 3;
+	named.activeFlows = 1;
+	hosts.add("10.0.0.3");
+	exporter.stop();
+
+	// Второй запуск пишет второй файл, интервалы запусков заканчиваются в разные миллисекунды
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	std::string longName(100, 'a');
+	ASSERT_TRUE(exporter.start(config, hosts.source(), errorInfo)) << errorInfo;
+	hosts.hosts[1].second.outPackets = 5;
+	hosts.add("fd00::1", longName.c_str()).inPackets = 1;
+	exporter.stop();
+
+	std::vector<ExportedInterval> intervals = readExported(directory);
+	ASSERT_EQ(2, intervals.size());
+
+	ASSERT_EQ(2, intervals[0].hosts.size());
+	EXPECT_EQ(3, intervals[0].hostsTotal);
+	EXPECT_EQ(5, findExported(intervals[0], "10.0.0.1")->inPackets);
+	EXPECT_EQ(1500, findExported(intervals[0], "10.0.0.1")->inTraffic);
+	EXPECT_EQ(3, findExported(intervals[0], "10.0.0.2")->outPackets);
+	EXPECT_EQ(1, findExported(intervals[0], "10.0.0.2")->activeFlows);
+	EXPECT_EQ("example.com", findExported(intervals[0], "10.0.0.2")->name);
+	EXPECT_EQ(nullptr, findExported(intervals[0], "10.0.0.3"));
+
+	ASSERT_EQ(2, intervals[1].hosts.size());
+	EXPECT_EQ(2, findExported(intervals[1], "10.0.0.2")->outPackets);
+	EXPECT_EQ("example.com", findExported(intervals[1], "10.0.0.2")->name);
+	EXPECT_EQ(longName, findExported(intervals[1], "fd00::1")->name);
+	EXPECT_GE(intervals[1].time, intervals[0].time);
+
+	// Диапазон времени отбирает интервалы по их концу
+	EXPECT_EQ(1, readExported(directory, intervals[1].time).size());
+	EXPECT_EQ(0, readExported(directory, 0, intervals[0].time - 1).size());
+
+	// Без индекса и с недописанным блоком в конце файла читается всё записанное
+	std::vector<std::string> files = StatsExportFormat::listDataFiles(directory);
+	ASSERT_EQ(2, files.size());
+	std::filesystem::remove(StatsExportFormat::indexPathOf(files[1]));
+	{
+		std::ofstream tail(files[1], std::ios::binary | std::ios::app);
+		tail << "TBLK partial block";
+	}
+	EXPECT_EQ(2, readExported(directory).size());
+
+	// Посторонние файлы с похожим именем не считаются выгрузкой
+	std::ofstream(directory + "/stats-abcdefghijklmn.bin") << "stray";
+	EXPECT_EQ(2, StatsExportFormat::listDataFiles(directory).size());
+	EXPECT_EQ(1, readExported(directory, intervals[1].time).size());
+
+	// Старые файлы сверх maxFiles удаляются
+	ASSERT_TRUE(exporter.start(config, hosts.source(), errorInfo)) << errorInfo;
+	hosts.hosts[0].second.inPackets = 20;
+	exporter.stop();
+
+	files = StatsExportFormat::listDataFiles(directory);
+	EXPECT_EQ(2, files.size());
+	EXPECT_EQ(2, readExported(directory).size());
+
+	std::filesystem::remove_all(directory);
+}
+
+TEST(StatsExportTest, WritesIntervalsInBackground)
+{
+	const std::string directory = "/tmp/stats-export-periodic-test";
+	std::filesystem::remove_all(directory);
+
+	StatsExportConfig config;
+	config.directory = directory;
+	config.period = std::chrono::milliseconds(10);
+	config.codec = StatsExportCodec::none;
+
+	ExportedHostsSource hosts;
+	hosts.add("10.0.0.1");
+
+	StatsExporter exporter;
+	std::string errorInfo;
+	ASSERT_TRUE(exporter.start(config, hosts.source(), errorInfo)) << errorInfo;
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	exporter.stop();
+
+	std::vector<ExportedInterval> intervals = readExported(directory);
+	EXPECT_GE(intervals.size(), 2);
+	EXPECT_EQ(exporter.getIntervals(), intervals.size());
+
+	for (std::size_t i = 1; i < intervals.size(); i++)
+		EXPECT_LE(intervals[i - 1].time, intervals[i].time);
+
+	std::filesystem::remove_all(directory);
+}
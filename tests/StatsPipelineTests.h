@@ -0,0 +1,121 @@
+#pragma once
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+
+#include "../source/HttpTrafficStats.h"
+#include "../source/PortTrafficStats.h"
+#include "../source/StatsPipeline.h"
+#include "TestPacket.h"
+
+namespace
+{
+	std::vector<PacketView> pipelinePackets()
+	{
+		return {TestPacket("127.0.0.1", "10.0.0.1", 100).tcp(40000, 443),
+				TestPacket("10.0.0.1", "127.0.0.1", 1500).tcp(443, 40000),
+				TestPacket("127.0.0.1", "10.0.0.2", 60).udp(50000, 53),
+				TestPacket("10.0.0.3", "127.0.0.1", 200).tcp(50001, 80),
+				TestPacket("10.0.0.3", "127.0.0.1", 40)};
+	}
+}
+
+TEST(PortTrafficStatsTest, CountsByServicePort)
+{
+	PortTrafficStats stats("127.0.0.1");
+	for (const auto &packet : pipelinePackets())
+		stats.addPacket(packet);
+
+	// Пакет без транспортного заголовка не относится ни к одному порту
+	EXPECT_EQ(3, stats.size());
+
+	const PortInfo *https = stats.findPort(443, false);
+	ASSERT_NE(nullptr, https);
+	EXPECT_EQ(1, https->inPackets);
+	EXPECT_EQ(1, https->outPackets);
+	EXPECT_EQ(1500, https->inTraffic);
+	EXPECT_EQ(100, https->outTraffic);
+
+	const PortInfo *dns = stats.findPort(53, true);
+	ASSERT_NE(nullptr, dns);
+	EXPECT_EQ(1, dns->outPackets);
+	EXPECT_EQ(nullptr, stats.findPort(53, false));
+
+	auto json = nlohmann::json::parse(stats.toJsonString());
+	ASSERT_EQ(3, json["ports"].size());
+	EXPECT_EQ("tcp", json["ports"][0]["protocol"]);
+	EXPECT_EQ(443, json["ports"][0]["port"]);
+	EXPECT_EQ(1600, json["ports"][0]["traffic"]["total"]);
+
+	stats.clear();
+	EXPECT_EQ(0, stats.size());
+	EXPECT_EQ(nullptr, stats.findPort(443, false));
+}
+
+TEST(PortTrafficStatsTest, MergeAddsCounters)
+{
+	PortTrafficStats first("127.0.0.1");
+	PortTrafficStats second("127.0.0.1");
+	auto packets = pipelinePackets();
+
+	first.addPackets(std::span<const PacketView>(packets.data(), 2));
+	second.addPackets(packets);
+	first.merge(second);
+
+	EXPECT_EQ(3, first.size());
+	EXPECT_EQ(4, first.findPort(443, false)->inPackets + first.findPort(443, false)->outPackets);
+	EXPECT_EQ(1, first.findPort(80, false)->inPackets);
+}
+
+TEST(StatsPipelineTest, ConsumersSeeSamePackets)
+{
+	using Pipeline = StatsPipeline<HttpTrafficStats, PortTrafficStats>;
+	Pipeline pipeline("127.0.0.1", FlowTableConfig());
+	HttpTrafficStats hosts("127.0.0.1");
+	PortTrafficStats ports("127.0.0.1");
+
+	auto packets = pipelinePackets();
+	pipeline.addPackets(packets);
+	hosts.addPackets(packets);
+	ports.addPackets(packets);
+
+	EXPECT_EQ(hosts.toString(), pipeline.get<HttpTrafficStats>().toString());
+	EXPECT_EQ(ports.toString(), pipeline.get<PortTrafficStats>().toString());
+
+	auto json = nlohmann::json::parse(pipeline.toJsonString());
+	EXPECT_EQ(nlohmann::json::parse(hosts.toJsonString()), json["hosts"]);
+	EXPECT_EQ(nlohmann::json::parse(ports.toJsonString()), json["ports"]);
+
+	// Поколение и локальные адреса конвейера передаются статистикам
+	pipeline.setGeneration(7);
+	EXPECT_EQ(7, pipeline.get<PortTrafficStats>().getGeneration());
+
+	auto copy = pipeline.clone();
+	copy->merge(pipeline);
+	EXPECT_EQ(2, dynamic_cast<const Pipeline &>(*copy).get<PortTrafficStats>().findPort(53, true)->outPackets);
+
+	pipeline.clear();
+	EXPECT_EQ(0, pipeline.get<PortTrafficStats>().size());
+}
+
+TEST(StatsPipelineTest, DynamicPipelineMatchesStatic)
+{
+	StatsPipeline<HttpTrafficStats, PortTrafficStats> pipeline("127.0.0.1");
+	DynamicStatsPipeline dynamicPipeline("127.0.0.1", {[](const std::string &ip)
+													   { return std::make_unique<HttpTrafficStats>(ip); },
+													   [](const std::string &ip)
+													   { return std::make_unique<PortTrafficStats>(ip); }});
+
+	auto packets = pipelinePackets();
+	pipeline.addPackets(packets);
+	dynamicPipeline.addPackets(packets);
+
+	ASSERT_EQ(2, dynamicPipeline.size());
+	EXPECT_EQ("ports", dynamicPipeline.at(1).name());
+	EXPECT_EQ(pipeline.toString(), dynamicPipeline.toString());
+	EXPECT_EQ(pipeline.toJsonString(), dynamicPipeline.toJsonString());
+
+	auto copy = dynamicPipeline.clone();
+	copy->merge(dynamicPipeline);
+	EXPECT_EQ(2, dynamic_cast<const PortTrafficStats &>(dynamic_cast<const DynamicStatsPipeline &>(*copy).at(1)).findPort(80, false)->inPackets);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <ctime>
+#include <vector>
+#include <cstdint>
+
+#include "../source/PacketView.h"
+
+/**
+ * \brief Заголовки пакета для тестов статистики
+ *
+ * Создается пакет без транспортного уровня с нулевой временной меткой, остальные поля
+ * задаются цепочкой вызовов, например TestPacket("10.0.0.1", "127.0.0.1", 100).tcp(40000, 443).at(10)
+ */
+struct TestPacket : public PacketView
+{
+	TestPacket(const IpKey &src, const IpKey &dst, std::uint32_t size)
+	{
+		srcIp = src;
+		dstIp = dst;
+		length = size;
+	}
+
+	TestPacket(const IpKey &src, const char *dst, std::uint32_t size)
+		: TestPacket(src, IpKey::fromString(dst), size) {}
+
+	TestPacket(const char *src, const char *dst, std::uint32_t size)
+		: TestPacket(IpKey::fromString(src), IpKey::fromString(dst), size) {}
+
+	/// \brief Делает пакет TCP сегментом с флагами flags (по умолчанию ACK)
+	TestPacket &tcp(std::uint16_t fromPort, std::uint16_t toPort, std::uint8_t flags = 0x10)
+	{
+		transportProtocol = tcpProtocol;
+		srcPort = fromPort;
+		dstPort = toPort;
+		tcpFlags = flags;
+		return *this;
+	}
+
+	/// \brief Делает пакет UDP датаграммой
+	TestPacket &udp(std::uint16_t fromPort, std::uint16_t toPort)
+	{
+		transportProtocol = udpProtocol;
+		srcPort = fromPort;
+		dstPort = toPort;
+		return *this;
+	}
+
+	/// \brief Задает время захвата пакета (в сек)
+	TestPacket &at(std::time_t second)
+	{
+		timestamp.tv_sec = second;
+		return *this;
+	}
+
+	/// \brief Задает данные транспортного уровня, длина пакета увеличивается на их размер
+	/// \param[in] bytes Данные, которые должны жить дольше пакета
+	TestPacket &carrying(const std::vector<std::uint8_t> &bytes)
+	{
+		payload = bytes.data();
+		payloadLength = static_cast<std::uint32_t>(bytes.size());
+		length += payloadLength;
+		return *this;
+	}
+};
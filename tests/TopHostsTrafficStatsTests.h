@@ -0,0 +1,185 @@
+#pragma once
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+
+#include <nlohmann/json.hpp>
+
+#include "../source/CountMinSketch.h"
+#include "../source/TopHostsTrafficStats.h"
+#include "TestPacket.h"
+
+namespace
+{
+	IpKey hostKey(std::uint32_t number)
+	{
+		std::uint32_t address = htonl(0x0A000000 + number);
+		return IpKey::fromIPv4(reinterpret_cast<const std::uint8_t *>(&address));
+	}
+}
+
+TEST(CountMinSketchTest, NeverUnderestimates)
+{
+	CountMinSketch sketch(256, 4);
+
+	for (std::uint32_t i = 0; i < 10000; i++)
+		sketch.add(hostKey(i % 1000), i % 7 + 1);
+
+	for (std::uint32_t host = 0; host < 1000; host++)
+	{
+		std::uint64_t exact = 0;
+		for (std::uint32_t i = host; i < 10000; i += 1000)
+			exact += i % 7 + 1;
+
+		EXPECT_GE(sketch.estimate(hostKey(host)), exact);
+	}
+
+	EXPECT_EQ(256, sketch.getWidth());
+	EXPECT_GT(sketch.errorBound(), 0);
+}
+
+TEST(TopHostsTrafficStatsTest, HeavyHostsAreTrackedExactly)
+{
+	TopHostsConfig config;
+	config.capacity = 8;
+	config.sketchWidth = 1024;
+	TopHostsTrafficStats stats("127.0.0.1", config);
+
+	// Три тяжелых хоста на фоне большого количества легких
+	for (std::uint32_t round = 0; round < 200; round++)
+	{
+		for (std::uint32_t heavy = 0; heavy < 3; heavy++)
+			stats.addPacket(TestPacket(hostKey(heavy), "127.0.0.1", 1000));
+
+		for (std::uint32_t light = 0; light < 50; light++)
+			stats.addPacket(TestPacket(hostKey(1000 + round * 50 + light), "127.0.0.1", 60));
+	}
+
+	EXPECT_EQ(8, stats.trackedCount());
+
+	for (std::uint32_t heavy = 0; heavy < 3; heavy++)
+	{
+		const HostInfo *info = stats.findHost(hostKey(heavy));
+		ASSERT_NE(nullptr, info);
+		EXPECT_EQ(200, info->inPackets);
+		EXPECT_EQ(200000, info->inTraffic);
+		EXPECT_EQ(0, stats.errorOf(hostKey(heavy)));
+	}
+}
+
+TEST(TopHostsTrafficStatsTest, LateHeavyHostReplacesLightest)
+{
+	TopHostsConfig config;
+	config.capacity = 4;
+	TopHostsTrafficStats stats("127.0.0.1", config);
+
+	for (std::uint32_t host = 0; host < 4; host++)
+		stats.addPacket(TestPacket(hostKey(host), "127.0.0.1", 100 * (host + 1)));
+
+	for (int i = 0; i < 3; i++)
+		stats.addPacket(TestPacket(hostKey(99), "127.0.0.1", 500));
+
+	ASSERT_NE(nullptr, stats.findHost(hostKey(99)));
+	EXPECT_EQ(nullptr, stats.findHost(hostKey(0)));
+	EXPECT_EQ(4, stats.trackedCount());
+
+	std::uint64_t tracked = stats.findHost(hostKey(99))->inTraffic;
+	EXPECT_LE(1500, tracked + stats.errorOf(hostKey(99)));
+}
+
+TEST(TopHostsTrafficStatsTest, MergeKeepsHeaviest)
+{
+	TopHostsConfig config;
+	config.capacity = 2;
+	TopHostsTrafficStats first("127.0.0.1", config), second("127.0.0.1", config);
+
+	first.addPacket(TestPacket(hostKey(1), "127.0.0.1", 100));
+	first.addPacket(TestPacket(hostKey(2), "127.0.0.1", 300));
+	second.addPacket(TestPacket(hostKey(3), "127.0.0.1", 200));
+	second.addPacket(TestPacket(hostKey(4), "127.0.0.1", 50));
+
+	first.merge(second);
+
+	EXPECT_EQ(2, first.trackedCount());
+	EXPECT_NE(nullptr, first.findHost(hostKey(2)));
+	EXPECT_NE(nullptr, first.findHost(hostKey(3)));
+
+	auto json = nlohmann::json::parse(first.toJsonString());
+	EXPECT_EQ(650, json["sketch"]["total"]);
+	EXPECT_EQ(2, json["hosts"].size());
+}
+
+TEST(TopHostsTrafficStatsTest, CopiesKeepSketchSummaryOnly)
+{
+	TopHostsConfig config;
+	config.capacity = 2;
+	TopHostsTrafficStats first("127.0.0.1", config), second("127.0.0.1", config);
+
+	first.addPacket(TestPacket(hostKey(1), "127.0.0.1", 100));
+	first.addPacket(TestPacket(hostKey(2), "127.0.0.1", 300));
+	second.addPacket(TestPacket(hostKey(3), "127.0.0.1", 200));
+
+	auto firstCopy = first.clone();
+	auto secondCopy = second.clone();
+	auto &copy = static_cast<TopHostsTrafficStats &>(*firstCopy);
+
+	// Без счетчиков оценкой хоста служит весь учтенный объем
+	EXPECT_EQ(100, first.estimate(hostKey(1)));
+	EXPECT_EQ(400, copy.estimate(hostKey(1)));
+	EXPECT_EQ(2, copy.trackedCount());
+
+	copy.merge(*secondCopy);
+	first.merge(second);
+	EXPECT_EQ(nlohmann::json::parse(first.toJsonString()), nlohmann::json::parse(copy.toJsonString()));
+}
+
+TEST(TopHostsTrafficStatsTest, EvictedEntryKeepsHeapOrder)
+{
+	TopHostsConfig config;
+	config.capacity = 3;
+	TopHostsTrafficStats stats("127.0.0.1", config);
+
+	// Хосты по очереди вытесняют самый легкий, после чего он снова становится тяжелее остальных
+	for (std::uint32_t round = 1; round <= 20; round++)
+		stats.addPacket(TestPacket(hostKey(round), "127.0.0.1", 100 * round));
+
+	EXPECT_EQ(3, stats.trackedCount());
+	for (std::uint32_t host = 18; host <= 20; host++)
+	{
+		const HostInfo *info = stats.findHost(hostKey(host));
+		ASSERT_NE(nullptr, info);
+		EXPECT_EQ(1, info->inPackets);
+		EXPECT_EQ(100 * host, info->inTraffic);
+	}
+}
+
+TEST(TopHostsTrafficStatsTest, ConfigForMemoryFitsLimit)
+{
+	std::size_t limit = 1024 * 1024;
+	auto config = TopHostsTrafficStats::configForMemory(limit);
+
+	std::size_t memory = config.sketchWidth * config.sketchDepth * sizeof(std::uint64_t) +
+						 config.capacity * TopHostsTrafficStats::trackedHostMemory();
+
+	EXPECT_LE(memory, limit);
+	EXPECT_GT(config.capacity, 1000);
+}
+
+TEST(TopHostsTrafficStatsTest, AddPacketsMatchesAddPacket)
+{
+	TopHostsConfig config;
+	config.capacity = 16;
+	TopHostsTrafficStats single("127.0.0.1", config);
+	TopHostsTrafficStats batched("127.0.0.1", config);
+
+	std::vector<PacketView> views;
+	for (std::uint32_t i = 0; i < 1000; i++)
+		views.push_back(TestPacket(hostKey(i % 7 == 0 ? i % 3 : i), "127.0.0.1", 100 + i % 50));
+
+	for (const auto &view : views)
+		single.addPacket(view);
+
+	for (std::size_t offset = 0; offset < views.size(); offset += 64)
+		batched.addPackets(std::span<const PacketView>(views).subspan(offset, std::min<std::size_t>(64, views.size() - offset)));
+
+	EXPECT_EQ(single.toString(), batched.toString());
+}
@@ -2,6 +2,10 @@
 #include <gtest/gtest.h>
 
 #include "PcapFilter.h"
+#include "PcapFileDevice.h"
+#include "EthLayer.h"
+#include "TcpLayer.h"
+#include "IPv4Layer.h"
 
 #include "../source/TrafficAnalyzer.h"
 #include "../source/HttpTrafficStats.h"
@@ -21,6 +25,47 @@ struct TrafficAnalyzerClassTest : public testing::Test
 	{
 		analyzer.finalize();
 	}
+
+	/// \brief Записывает в файл packetsCount TCP пакетов от hostsCount разных хостов
+	/// \return Размер одного пакета
+	static int writeTestCapture(const std::string &filePath, int packetsCount, int hostsCount)
+	{
+		pcpp::PcapFileWriterDevice writer(filePath);
+		EXPECT_TRUE(writer.open());
+
+		int packetSize = 0;
+		for (int i = 0; i < packetsCount; i++)
+		{
+			std::string srcIp = "192.192.1." + std::to_string(1 + i % hostsCount);
+
+			pcpp::EthLayer ethLayer(pcpp::MacAddress("00:50:43:11:22:33"), pcpp::MacAddress("aa:bb:cc:dd:ee"));
+			pcpp::IPv4Layer ipLayer(pcpp::IPv4Address(srcIp), pcpp::IPv4Address("127.0.0.1"));
+			pcpp::TcpLayer tcpLayer(80, 80);
+
+			pcpp::Packet packet;
+			packet.addLayer(&ethLayer);
+			packet.addLayer(&ipLayer);
+			packet.addLayer(&tcpLayer);
+			packet.computeCalculateFields();
+
+			writer.writePacket(*packet.getRawPacket());
+			packetSize = packet.getRawPacket()->getRawDataLen();
+		}
+
+		writer.close();
+		return packetSize;
+	}
+
+	static std::vector<std::string> sortedLines(const std::string &text)
+	{
+		std::vector<std::string> lines;
+		std::stringstream ss(text);
+		for (std::string line; std::getline(ss, line);)
+			lines.push_back(line);
+
+		std::sort(lines.begin(), lines.end());
+		return lines;
+	}
 };
 
 TEST_F(TrafficAnalyzerClassTest, TestStartCaptureBeforeInit)
@@ -33,3 +78,59 @@ TEST_F(TrafficAnalyzerClassTest, TestGetStatBeforeInit)
 {
 	EXPECT_EQ("", analyzer.getPlaneTextStat());
 }
+
+TEST_F(TrafficAnalyzerClassTest, TestRateBeforeInit)
+{
+	std::string out;
+	EXPECT_FALSE(analyzer.writeRateJson(out, std::chrono::seconds(60)));
+	EXPECT_FALSE(analyzer.writeHistoryJson(out, IpKey(), std::chrono::seconds(60)));
+}
+
+TEST_F(TrafficAnalyzerClassTest, TestReplayMissingFile)
+{
+	std::string errorInfo;
+	EXPECT_FALSE(analyzer.initializeFromFileAs<HttpTrafficStats>("missing-capture.pcap", "127.0.0.1", vec, errorInfo));
+	EXPECT_FALSE(errorInfo.empty());
+}
+
+TEST_F(TrafficAnalyzerClassTest, TestReplayFile)
+{
+	const std::string filePath = "replay-test.pcap";
+	const int packetsCount = 10;
+	const int packetSize = writeTestCapture(filePath, packetsCount, 1);
+
+	std::string errorInfo;
+	ASSERT_TRUE(analyzer.initializeFromFileAs<HttpTrafficStats>(filePath, "127.0.0.1", vec, errorInfo)) << errorInfo;
+
+	ReplayReport report = analyzer.replayFile();
+
+	EXPECT_EQ(packetsCount, report.packets);
+	EXPECT_EQ(packetsCount * packetSize, report.bytes);
+	EXPECT_NE("", analyzer.getPlaneTextStat());
+
+	std::remove(filePath.c_str());
+}
+
+TEST_F(TrafficAnalyzerClassTest, TestReplayFileWithWorkers)
+{
+	const std::string filePath = "replay-workers-test.pcap";
+	writeTestCapture(filePath, 1000, 50);
+
+	std::string errorInfo;
+	ASSERT_TRUE(analyzer.initializeFromFileAs<HttpTrafficStats>(filePath, "127.0.0.1", vec, errorInfo)) << errorInfo;
+	analyzer.replayFile();
+	auto expectation = sortedLines(analyzer.getPlaneTextStat());
+	analyzer.finalize();
+
+	TrafficAnalyzer shardedAnalyzer;
+	ASSERT_TRUE(shardedAnalyzer.initializeFromFileAs<HttpTrafficStats>(filePath, "127.0.0.1", vec, errorInfo, 4)) << errorInfo;
+
+	ReplayReport report = shardedAnalyzer.replayFile();
+
+	EXPECT_EQ(1000, report.packets);
+	EXPECT_EQ(0, shardedAnalyzer.getDroppedPackets());
+	EXPECT_EQ(expectation, sortedLines(shardedAnalyzer.getPlaneTextStat()));
+
+	shardedAnalyzer.finalize();
+	std::remove(filePath.c_str());
+}
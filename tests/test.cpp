@@ -1,6 +1,26 @@
 #include <gtest/gtest.h>
 #include "AppNamespaceTest.h"
 #include "HttpTrafficStatsTests.h"
+#include "HostTableTests.h"
+#include "RawPacketParserTests.h"
+#include "SnapshotPublisherTests.h"
+#include "JsonWriterTests.h"
+#include "TopHostsTrafficStatsTests.h"
+#include "FlowTableTests.h"
+#include "RateHistoryTests.h"
+#include "AsyncLogTests.h"
+#include "PacketRingTests.h"
+#include "LocalAddressSetTests.h"
+#include "HostStoreTests.h"
+#include "NameArenaTests.h"
+#include "DnsCacheTests.h"
+#include "MetricsTests.h"
+#include "PerfCountersTests.h"
+#include "CpuAffinityTests.h"
+#include "AdaptiveSamplerTests.h"
+#include "StatsExportTests.h"
+#include "HostQueryTests.h"
+#include "StatsPipelineTests.h"
 #include "TrafficAnalyzerTests.h"
 
 int main(int argc, char **argv)
@@ -0,0 +1,137 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <AsyncLog.h>
+#include <JsonWriter.h>
+#include <StatsExport.h>
+
+/// \brief Выводит интервал строкой JSON: время и прирост счетчиков изменившихся хостов
+static void writeJsonInterval(const ExportedInterval &interval, std::string &out)
+{
+	char ipBuffer[IpKey::maxStringLength];
+	JsonWriter json(out);
+
+	json.beginObject();
+	json.field("time", std::uint64_t(interval.time));
+	json.field("duration", std::uint64_t(interval.duration));
+	json.field("hostsTotal", interval.hostsTotal);
+	json.key("hosts").beginArray();
+
+	for (const auto &host : interval.hosts)
+	{
+		json.beginObject();
+		json.field("ip", std::string_view(ipBuffer, host.host.format(ipBuffer)));
+		json.field("name", std::string_view(host.name));
+
+		json.key("packets").beginObject();
+		json.field("in", host.inPackets);
+		json.field("out", host.outPackets);
+		json.endObject();
+
+		json.key("traffic").beginObject();
+		json.field("in", host.inTraffic);
+		json.field("out", host.outTraffic);
+		json.endObject();
+
+		json.key("flows").beginObject();
+		json.field("active", std::uint64_t(host.activeFlows));
+		json.field("completed", std::uint64_t(host.completedFlows));
+		json.endObject();
+
+		if (host.sampledPackets)
+			json.field("sampledPackets", std::uint64_t(host.sampledPackets));
+
+		json.endObject();
+	}
+
+	json.endArray();
+	json.endObject();
+	out += '\n';
+}
+
+/// \brief Выводит хосты интервала строками CSV, имя берется в кавычки, если содержит запятую или кавычку
+static void writeCsvInterval(const ExportedInterval &interval, std::string &out)
+{
+	char ipBuffer[IpKey::maxStringLength];
+
+	for (const auto &host : interval.hosts)
+	{
+		out += std::to_string(interval.time) + ',' + std::to_string(interval.duration) + ',';
+		out.append(ipBuffer, host.host.format(ipBuffer));
+		out += ',';
+
+		if (host.name.find_first_of(",\"") == std::string::npos)
+			out += host.name;
+		else
+		{
+			out += '"';
+			for (char c : host.name)
+			{
+				if (c == '"')
+					out += '"';
+				out += c;
+			}
+			out += '"';
+		}
+
+		for (std::uint64_t value : {host.inPackets, host.outPackets, host.inTraffic, host.outTraffic,
+									std::uint64_t(host.activeFlows), std::uint64_t(host.completedFlows), std::uint64_t(host.sampledPackets)})
+			out += ',' + std::to_string(value);
+
+		out += '\n';
+	}
+}
+
+/// Usage: traffic-analyzer-export-reader <directory> [json|csv] [from] [to]
+/// from и to - время начала и конца выводимого диапазона в секундах с начала эпохи Unix
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s <directory> [json|csv] [from] [to]\n", argv[0]);
+		return 1;
+	}
+
+	std::string directory = argv[1];
+	std::string format = argc > 2 ? argv[2] : "json";
+	std::int64_t from = argc > 3 ? std::atoll(argv[3]) * 1000 : 0;
+	std::int64_t to = argc > 4 ? std::atoll(argv[4]) * 1000 + 999 : INT64_MAX;
+
+	if (format != "json" && format != "csv")
+	{
+		fprintf(stderr, "format must be 'json' or 'csv'\n");
+		return 1;
+	}
+
+	AsyncLog::setLevel(boost::log::trivial::warning);
+
+	bool isCsv = format == "csv";
+	if (isCsv)
+		printf("time,duration,ip,name,in_packets,out_packets,in_bytes,out_bytes,active_flows,completed_flows,sampled_packets\n");
+
+	std::string out;
+	StatsExportReader reader;
+	std::string errorInfo;
+
+	bool isRead = reader.read(directory, from, to, [&out, isCsv](const ExportedInterval &interval)
+							  {
+								  out.clear();
+								  if (isCsv)
+									  writeCsvInterval(interval, out);
+								  else
+									  writeJsonInterval(interval, out);
+
+								  fwrite(out.data(), 1, out.size(), stdout); },
+							  errorInfo);
+
+	if (!isRead)
+	{
+		fprintf(stderr, "%s\n", errorInfo.c_str());
+		return 1;
+	}
+
+	return 0;
+}